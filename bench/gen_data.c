@@ -0,0 +1,402 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Writes out a synthetic data directory (players, maps and leagues) of
+ * any size, so the pipeline can be run over more games than the real
+ * data has.  Every player has a hidden skill that decides how likely
+ * they are to win, and each league is a random group of players
+ * playing over a stretch of time that can overlap other leagues'. */
+
+#define _XOPEN_SOURCE 500
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* How many maps each league is played on. */
+#ifndef GEN_LEAGUE_MAPS
+#define GEN_LEAGUE_MAPS 5
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct options
+{
+    const char *out;
+    long players;
+    long maps;
+    long leagues;
+    long games;
+    long league_players;
+    double overlap;
+    long start;
+    long span;
+    uint64_t seed;
+};
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+static const char *races[] = { "Terran", "Zerg", "Protoss" };
+
+static uint64_t rng_state;
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static void print_usage(const char *argv0);
+static int parse_long(const char *str, long min, long *out);
+
+/* A small xorshift generator, so the same seed always gives the same
+ * data everywhere. */
+static uint64_t rng_next(void);
+static double rng_uniform(void);
+static long rng_below(long n);
+
+static int make_dir(const char *path);
+static int write_players(const struct options *o, const double *skill);
+static int write_maps(const struct options *o);
+static int write_league(const struct options *o, const double *skill,
+                        long league, long games, long *pick);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int main(int argc, char **argv)
+{
+    struct options o;
+    double *skill;
+    long *pick;
+    long l;
+    int i;
+
+    o.out = NULL;
+    o.players = 1000;
+    o.maps = 20;
+    o.leagues = 50;
+    o.games = 100000;
+    o.league_players = 32;
+    o.overlap = 0.5;
+    o.start = 1330000000;
+    o.span = 60 * 60 * 24 * 60;
+    o.seed = 1;
+
+    for (i = 1; i < argc; i++)
+    {
+        long seed;
+        int ok;
+
+        ok = (i + 1 < argc);
+        if (ok && strcmp(argv[i], "--out") == 0)
+            o.out = argv[++i];
+        else if (ok && strcmp(argv[i], "--players") == 0)
+            ok = parse_long(argv[++i], 2, &o.players) == 0;
+        else if (ok && strcmp(argv[i], "--maps") == 0)
+            ok = parse_long(argv[++i], 1, &o.maps) == 0;
+        else if (ok && strcmp(argv[i], "--leagues") == 0)
+            ok = parse_long(argv[++i], 1, &o.leagues) == 0;
+        else if (ok && strcmp(argv[i], "--games") == 0)
+            ok = parse_long(argv[++i], 0, &o.games) == 0;
+        else if (ok && strcmp(argv[i], "--league-players") == 0)
+            ok = parse_long(argv[++i], 2, &o.league_players) == 0;
+        else if (ok && strcmp(argv[i], "--start") == 0)
+            ok = parse_long(argv[++i], 0, &o.start) == 0;
+        else if (ok && strcmp(argv[i], "--span") == 0)
+            ok = parse_long(argv[++i], 1, &o.span) == 0;
+        else if (ok && strcmp(argv[i], "--seed") == 0)
+        {
+            ok = parse_long(argv[++i], 0, &seed) == 0;
+            o.seed = seed;
+        }
+        else if (ok && strcmp(argv[i], "--overlap") == 0)
+        {
+            char *end;
+
+            o.overlap = strtod(argv[++i], &end);
+            ok = (*end == '\0' && o.overlap >= 0 && o.overlap <= 1);
+        }
+        else
+            ok = 0;
+
+        if (!ok)
+        {
+            fprintf(stderr, "Bad argument: '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (o.out == NULL)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (o.league_players > o.players)
+        o.league_players = o.players;
+
+    /* The generator is never seeded with 0, xorshift would get stuck
+     * there. */
+    rng_state = o.seed * 2654435761u + 0x9E3779B97F4A7C15ull;
+
+    skill = malloc(o.players * sizeof(*skill));
+    pick = malloc(o.players * sizeof(*pick));
+    if (skill == NULL || pick == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+
+    /* Skills are roughly normal, from the sum of a few uniforms. */
+    for (l = 0; l < o.players; l++)
+    {
+        skill[l] = 2000 + 200 * (rng_uniform() + rng_uniform()
+                                 + rng_uniform() + rng_uniform() - 2);
+        pick[l] = l;
+    }
+
+    if (make_dir(o.out) != 0)
+        return 1;
+    if (chdir(o.out) != 0)
+    {
+        perror(o.out);
+        return 1;
+    }
+
+    if (make_dir("data") != 0 || make_dir("data/players") != 0
+        || make_dir("data/maps") != 0 || make_dir("data/leagues") != 0
+        || write_players(&o, skill) != 0 || write_maps(&o) != 0)
+        return 1;
+
+    /* The games are spread evenly over the leagues. */
+    for (l = 0; l < o.leagues; l++)
+    {
+        long games;
+
+        games = o.games / o.leagues + (l < o.games % o.leagues);
+        if (write_league(&o, skill, l, games, pick) != 0)
+            return 1;
+    }
+
+    free(skill);
+    free(pick);
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void print_usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s --out <dir> [options]\n", argv0);
+    fprintf(stderr, "  --players <n>         "
+            "Players in total (1000)\n");
+    fprintf(stderr, "  --maps <n>            "
+            "Maps in total (20)\n");
+    fprintf(stderr, "  --leagues <n>         "
+            "League files (50)\n");
+    fprintf(stderr, "  --games <n>           "
+            "Games in total, split evenly over the leagues (100000)\n");
+    fprintf(stderr, "  --league-players <n>  "
+            "Players in each league (32)\n");
+    fprintf(stderr, "  --overlap <0-1>       "
+            "How much each league's games overlap the next's (0.5)\n");
+    fprintf(stderr, "  --start <time>        "
+            "When the first league starts (1330000000)\n");
+    fprintf(stderr, "  --span <seconds>      "
+            "How long each league runs for (60 days)\n");
+    fprintf(stderr, "  --seed <n>            "
+            "Seeds the random numbers (1)\n");
+}
+
+int parse_long(const char *str, long min, long *out)
+{
+    char *end;
+
+    *out = strtol(str, &end, 10);
+    if (*end != '\0' || *out < min)
+        return -1;
+
+    return 0;
+}
+
+uint64_t rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+double rng_uniform(void)
+{
+    return (rng_next() >> 11) / 9007199254740992.0;
+}
+
+long rng_below(long n)
+{
+    return (long)(rng_next() % (uint64_t)n);
+}
+
+int make_dir(const char *path)
+{
+    if (mkdir(path, 0777) != 0 && errno != EEXIST)
+    {
+        perror(path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int write_players(const struct options *o, const double *skill)
+{
+    char filename[64];
+    FILE *file;
+    long p;
+
+    for (p = 0; p < o->players; p++)
+    {
+        snprintf(filename, sizeof(filename), "data/players/p%07ld", p);
+        file = fopen(filename, "w");
+        if (file == NULL)
+        {
+            perror(filename);
+            return -1;
+        }
+
+        fprintf(file, "ID Player%ld\nRACE %s\n", p,
+                races[(long)skill[p] % 3]);
+        fclose(file);
+    }
+
+    return 0;
+}
+
+int write_maps(const struct options *o)
+{
+    char filename[64];
+    FILE *file;
+    long m;
+
+    for (m = 0; m < o->maps; m++)
+    {
+        snprintf(filename, sizeof(filename), "data/maps/m%05ld", m);
+        file = fopen(filename, "w");
+        if (file == NULL)
+        {
+            perror(filename);
+            return -1;
+        }
+
+        fprintf(file, "NAME Map %ld\n", m);
+        fclose(file);
+    }
+
+    return 0;
+}
+
+int write_league(const struct options *o, const double *skill, long league,
+                 long games, long *pick)
+{
+    char filename[64];
+    long maps[GEN_LEAGUE_MAPS];
+    long map_count;
+    long start, gap;
+    FILE *file;
+    long i;
+
+    snprintf(filename, sizeof(filename), "data/leagues/l%05ld", league);
+    file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    /* The first league_players entries of "pick" end up as a random
+     * choice of players, shuffled in place. */
+    for (i = 0; i < o->league_players; i++)
+    {
+        long j, t;
+
+        j = i + rng_below(o->players - i);
+        t = pick[i];
+        pick[i] = pick[j];
+        pick[j] = t;
+    }
+
+    /* Maps are picked the same way, without any repeats. */
+    map_count = (o->maps < GEN_LEAGUE_MAPS) ? o->maps : GEN_LEAGUE_MAPS;
+    for (i = 0; i < map_count; i++)
+    {
+        long j;
+
+        do
+        {
+            maps[i] = rng_below(o->maps);
+            for (j = 0; j < i && maps[j] != maps[i]; j++)
+                ;
+        }
+        while (j < i);
+    }
+
+    fprintf(file, "NAME Synthetic League %ld\n\n", league);
+    for (i = 0; i < o->league_players; i++)
+        fprintf(file, "PLAYER p%07ld\n", pick[i]);
+    fprintf(file, "\n");
+    for (i = 0; i < map_count; i++)
+        fprintf(file, "MAP m%05ld\n", maps[i]);
+    fprintf(file, "\n");
+
+    /* Each league starts a fraction of a span after the last one.
+     * Every game time in a league is the league's number modulo the
+     * number of leagues, so no two games anywhere share a time. */
+    start = o->start + (long)(league * o->span * (1 - o->overlap));
+    start += (league - start % o->leagues + o->leagues) % o->leagues;
+    gap = (games > 0) ? o->span / games : 1;
+    gap = (gap / o->leagues + 1) * o->leagues;
+
+    for (i = 0; i < games; i++)
+    {
+        long a, b;
+        double expected;
+
+        a = pick[rng_below(o->league_players)];
+        do
+            b = pick[rng_below(o->league_players)];
+        while (b == a);
+
+        expected = 1 / (1 + pow(10, (skill[b] - skill[a]) / 400));
+        fprintf(file, "GAME %ld m%05ld p%07ld %c p%07ld\n", start + i * gap,
+                maps[rng_below(map_count)], a,
+                (rng_uniform() < expected) ? '>' : '<', b);
+    }
+
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,490 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmarks for the functions every run spends its time in.
+ * Each benchmark is warmed up, then timed over a number of samples of
+ * many calls each, and the median and 99th percentile time per call
+ * are written out as CSV so builds can be compared line by line:
+ *
+ *   benchmark,unit,ops,samples,median_ns,p99_ns,min_ns,max_ns
+ *
+ * The data comes from a data directory ("data" by default, or the
+ * output of bin/gen_data), and nothing is written anywhere. */
+
+#include "arena.h"
+#include "game_list.h"
+#include "global.h"
+#include "html.h"
+#include "league_list.h"
+#include "map_list.h"
+#include "player_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <time.h>
+
+/* How many calls each sample times, for benchmarks that can pick. */
+#ifndef MICROBENCH_OPS
+#define MICROBENCH_OPS 10000
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Everything the benchmarks work on, read in once up front. */
+struct bench_state
+{
+    void *ctx;
+
+    struct player **players;
+    size_t player_count;
+    const char **map_keys;
+    size_t map_count;
+
+    /* Every game in chronological order, along with the text of its
+     * GAME line. */
+    struct league_list *leagues;
+    struct game **games;
+    char **game_lines;
+    size_t game_count;
+    size_t game_alloc;
+
+    /* Games hold a reference to their league's name, so it has to be
+     * allocated. */
+    const char *league_name;
+
+    FILE *devnull;
+
+    /* Results are added up in here so nothing gets optimized away. */
+    volatile unsigned long sink;
+};
+
+/* A single benchmark, which makes up to "ops" calls and returns how
+ * many it made. */
+struct bench
+{
+    const char *name;
+    const char *unit;
+    long (*run) (struct bench_state * s, long ops);
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int collect_player(struct player *player, void *s_uncast);
+static int collect_map(struct map *map, void *s_uncast);
+static int collect_game(struct game *game, void *s_uncast);
+static int count_game(struct game *game, void *s_uncast);
+
+static long bench_game_parse(struct bench_state *s, long ops);
+static long bench_game_parse_arena(struct bench_state *s, long ops);
+static long bench_player_list_get(struct bench_state *s, long ops);
+static long bench_map_list_get(struct bench_state *s, long ops);
+static long bench_game_list_add(struct bench_state *s, long ops);
+static long bench_player_win(struct bench_state *s, long ops);
+static long bench_league_list_each_game(struct bench_state *s, long ops);
+static long bench_html_table_row(struct bench_state *s, long ops);
+static long bench_html_player_row(struct bench_state *s, long ops);
+static long bench_html_table(struct bench_state *s, long ops);
+
+/* Runs one benchmark and writes out its line. */
+static int run_bench(struct bench_state *s, const struct bench *b,
+                     int warmup, int samples);
+static double now_ns(void);
+static int compare_doubles(const void *a, const void *b);
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+static const struct bench benches[] = {
+    {"game_parse", "game", &bench_game_parse},
+    {"game_parse_arena", "game", &bench_game_parse_arena},
+    {"player_list_get", "lookup", &bench_player_list_get},
+    {"map_list_get", "lookup", &bench_map_list_get},
+    {"game_list_add", "game", &bench_game_list_add},
+    {"player_win", "game", &bench_player_win},
+    {"league_list_each_game", "game", &bench_league_list_each_game},
+    {"html_table_row", "row", &bench_html_table_row},
+    {"html_player_row", "row", &bench_html_player_row},
+    {"html_table", "table", &bench_html_table},
+    {NULL, NULL, NULL}
+};
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int main(int argc, char **argv)
+{
+    struct bench_state s;
+    const char *data;
+    const char *filter;
+    char *dir;
+    int samples, warmup;
+    int i;
+
+    data = INDIR;
+    filter = NULL;
+    samples = 30;
+    warmup = 3;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--data") == 0 && i + 1 < argc)
+            data = argv[++i];
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else
+            samples = 0;
+
+        if (samples <= 0 || warmup < 0)
+        {
+            fprintf(stderr, "Usage: %s [--data <dir>] [--filter <name>] "
+                    "[--samples <n>] [--warmup <n>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.ctx = talloc_new(NULL);
+    s.league_name = talloc_strdup(s.ctx, "Benchmark League");
+    s.devnull = fopen("/dev/null", "w");
+    if (s.ctx == NULL || s.league_name == NULL || s.devnull == NULL)
+        return 1;
+
+    /* Reads everything in just like generate_html does. */
+    dir = talloc_asprintf(s.ctx, "%s/players", data);
+    global_player_list = player_list_new(s.ctx, dir);
+    dir = talloc_asprintf(s.ctx, "%s/maps", data);
+    global_map_list = map_list_new(s.ctx, dir);
+    dir = talloc_asprintf(s.ctx, "%s/leagues", data);
+    s.leagues = league_list_new(s.ctx, dir);
+    if (global_player_list == NULL || global_map_list == NULL
+        || s.leagues == NULL)
+    {
+        fprintf(stderr, "Unable to read '%s'\n", data);
+        return 1;
+    }
+
+    player_list_each(global_player_list, &collect_player, &s);
+    map_list_each(global_map_list, &collect_map, &s);
+    league_list_each_game(s.leagues, &collect_game, &s);
+    if (s.player_count < 2 || s.map_count == 0 || s.game_count == 0)
+    {
+        fprintf(stderr, "Not enough data in '%s'\n", data);
+        return 1;
+    }
+
+    printf("benchmark,unit,ops,samples,median_ns,p99_ns,min_ns,max_ns\n");
+    for (i = 0; benches[i].name != NULL; i++)
+    {
+        if (filter != NULL && strstr(benches[i].name, filter) == NULL)
+            continue;
+
+        if (run_bench(&s, benches + i, warmup, samples) != 0)
+            return 1;
+    }
+
+    fclose(s.devnull);
+    TALLOC_FREE(s.ctx);
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int collect_player(struct player *player, void *s_uncast)
+{
+    struct bench_state *s;
+    struct player **players;
+
+    s = s_uncast;
+    players = talloc_realloc(s->ctx, s->players, struct player *,
+                             s->player_count + 1);
+    if (players == NULL)
+        return -1;
+
+    s->players = players;
+    s->players[s->player_count++] = player;
+    return 0;
+}
+
+int collect_map(struct map *map, void *s_uncast)
+{
+    struct bench_state *s;
+    const char **keys;
+
+    s = s_uncast;
+    keys = talloc_realloc(s->ctx, s->map_keys, const char *,
+                          s->map_count + 1);
+    if (keys == NULL)
+        return -1;
+
+    s->map_keys = keys;
+    s->map_keys[s->map_count++] = map_key(map);
+    return 0;
+}
+
+int collect_game(struct game *game, void *s_uncast)
+{
+    struct bench_state *s;
+
+    s = s_uncast;
+    if (s->game_count == s->game_alloc)
+    {
+        s->game_alloc = (s->game_alloc == 0) ? 1024 : s->game_alloc * 2;
+        s->games = talloc_realloc(s->ctx, s->games, struct game *,
+                                  s->game_alloc);
+        s->game_lines = talloc_realloc(s->ctx, s->game_lines, char *,
+                                       s->game_alloc);
+        if (s->games == NULL || s->game_lines == NULL)
+            return -1;
+    }
+
+    s->games[s->game_count] = game;
+    s->game_lines[s->game_count] =
+        talloc_asprintf(s->game_lines, "%ld %s %s > %s",
+                        (long)game_time(game), game_map_key(game),
+                        game_winner_key(game), game_loser_key(game));
+    s->game_count++;
+    return 0;
+}
+
+int count_game(struct game *game, void *s_uncast)
+{
+    struct bench_state *s;
+
+    s = s_uncast;
+    s->sink += (unsigned long)game_time(game);
+    return 0;
+}
+
+long bench_game_parse(struct bench_state *s, long ops)
+{
+    void *ctx;
+    long i;
+
+    /* Freeing the parsed games is counted too, it's a single free. */
+    ctx = talloc_new(s->ctx);
+    for (i = 0; i < ops; i++)
+    {
+        struct game *game;
+
+        game = game_parse(ctx, s->game_lines[i % s->game_count],
+                          s->league_name, NULL, NULL);
+        s->sink += (unsigned long)game;
+    }
+    TALLOC_FREE(ctx);
+
+    return ops;
+}
+
+long bench_game_parse_arena(struct bench_state *s, long ops)
+{
+    struct arena *arena;
+    long i;
+
+    /* This is how league files are read, the unmapping is counted
+     * too. */
+    arena = arena_new(s->ctx, STATS_MEMORY_GAMES);
+    for (i = 0; i < ops; i++)
+    {
+        struct game *game;
+
+        game = game_parse_arena(arena, s->game_lines[i % s->game_count],
+                                s->league_name, NULL, NULL);
+        s->sink += (unsigned long)game;
+    }
+    TALLOC_FREE(arena);
+
+    return ops;
+}
+
+long bench_player_list_get(struct bench_state *s, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++)
+        s->sink += (unsigned long)
+            player_list_get(global_player_list,
+                            player_key(s->players[i % s->player_count]));
+
+    return ops;
+}
+
+long bench_map_list_get(struct bench_state *s, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++)
+        s->sink += (unsigned long)
+            map_list_get(global_map_list, s->map_keys[i % s->map_count]);
+
+    return ops;
+}
+
+long bench_game_list_add(struct bench_state *s, long ops)
+{
+    void *ctx;
+    struct game_list *gl;
+    long i;
+
+    /* Games only go on the end in order, so each sample starts a new
+     * list. */
+    if ((size_t)ops > s->game_count)
+        ops = s->game_count;
+
+    ctx = talloc_new(s->ctx);
+    gl = game_list_new(ctx);
+    for (i = 0; i < ops; i++)
+        s->sink += game_list_add(gl, s->games[i]);
+    TALLOC_FREE(ctx);
+
+    return ops;
+}
+
+long bench_player_win(struct bench_state *s, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++)
+    {
+        struct game *game;
+
+        game = s->games[i % s->game_count];
+        player_win(player_list_get(global_player_list,
+                                   game_winner_key(game)),
+                   player_list_get(global_player_list,
+                                   game_loser_key(game)));
+    }
+
+    return ops;
+}
+
+long bench_league_list_each_game(struct bench_state *s,
+                                 long ops __attribute__ ((unused)))
+{
+    league_list_each_game(s->leagues, &count_game, s);
+    return s->game_count;
+}
+
+long bench_html_table_row(struct bench_state *s, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++)
+        html_table_row(s->ctx, s->devnull, "1",
+                       "<a href=\"player_a.html\">a</a>",
+                       "Terran", "2000", "2000", NULL);
+
+    return ops;
+}
+
+long bench_html_player_row(struct bench_state *s, long ops)
+{
+    long i;
+
+    for (i = 0; i < ops; i++)
+        html_player_row(s->ctx, s->devnull,
+                        s->players[i % s->player_count]);
+
+    return ops;
+}
+
+long bench_html_table(struct bench_state *s, long ops)
+{
+    long i;
+
+    /* A whole player list, one table at a time. */
+    ops /= s->player_count;
+    if (ops == 0)
+        ops = 1;
+
+    for (i = 0; i < ops; i++)
+    {
+        size_t j;
+
+        html_start_table(s->ctx, s->devnull, "player_list", 0, false,
+                         "Rank", "Name", "Race", "Rating", "Peak", NULL);
+        for (j = 0; j < s->player_count; j++)
+            html_player_row(s->ctx, s->devnull, s->players[j]);
+        html_end_table(s->ctx, s->devnull);
+    }
+
+    return ops;
+}
+
+int run_bench(struct bench_state *s, const struct bench *b, int warmup,
+              int samples)
+{
+    double *ns;
+    long ops;
+    int i;
+
+    ns = talloc_array(s->ctx, double, samples);
+    if (ns == NULL)
+        return -1;
+
+    for (i = 0; i < warmup; i++)
+        b->run(s, MICROBENCH_OPS);
+
+    ops = 0;
+    for (i = 0; i < samples; i++)
+    {
+        double start;
+
+        start = now_ns();
+        ops = b->run(s, MICROBENCH_OPS);
+        ns[i] = (now_ns() - start) / ops;
+    }
+
+    qsort(ns, samples, sizeof(*ns), &compare_doubles);
+    printf("%s,%s,%ld,%d,%.1f,%.1f,%.1f,%.1f\n", b->name, b->unit, ops,
+           samples, ns[samples / 2], ns[(samples * 99 + 99) / 100 - 1],
+           ns[0], ns[samples - 1]);
+    fflush(stdout);
+
+    TALLOC_FREE(ns);
+    return 0;
+}
+
+double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int compare_doubles(const void *a_uncast, const void *b_uncast)
+{
+    const double *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+    return (*a > *b) - (*a < *b);
+}
@@ -0,0 +1,344 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _BSD_SOURCE
+#define _DEFAULT_SOURCE
+
+#include "arena.h"
+#include "stats.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <talloc.h>
+#include <unistd.h>
+
+/* Everything handed out is aligned to this, which is enough for any
+ * type we store. */
+#ifndef ARENA_ALIGN
+#define ARENA_ALIGN 16
+#endif
+
+/* Chunks start small, so an arena that's barely used stays small, and
+ * double up to this size. */
+#ifndef ARENA_CHUNK_MIN
+#define ARENA_CHUNK_MIN (64 * 1024)
+#endif
+
+#ifndef ARENA_CHUNK_MAX
+#define ARENA_CHUNK_MAX (16 * 1024 * 1024)
+#endif
+
+#define ALIGN_UP(n, to) (((n) + (to) - 1) & ~((size_t)(to) - 1))
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Sits at the start of every mapped chunk. */
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;
+};
+
+/* A single interned string, empty slots have a NULL string. */
+struct arena_string
+{
+    const char *str;
+    uint32_t hash;
+};
+
+struct arena
+{
+    /* Newest first, allocations come out of the first one. */
+    struct arena_chunk *chunks;
+    char *next;
+    char *end;
+    size_t mapped;
+
+    /* Where everything above and below is counted. */
+    enum stats_memory group;
+
+    /* How many things have been handed out since the last reset. */
+    size_t allocations;
+
+    /* An open addressing hash table with linear probing, just like a
+     * key_index.  It's only allocated once something is interned. */
+    struct arena_string *strings;
+    size_t mask;
+    size_t count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Maps a new chunk with room for at least size bytes. */
+static int add_chunk(struct arena *a, size_t size);
+
+/* Unmaps every chunk. */
+static int unmap_chunks(struct arena *a);
+
+/* Also stops counting the string table, as talloc's destructor. */
+static int destroy_arena(struct arena *a);
+
+static uint32_t hash_string(const char *str);
+static struct arena_string *find_string(struct arena *a, const char *str,
+                                        uint32_t hash);
+static int grow_strings(struct arena *a);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct arena *arena_new(void *ctx, enum stats_memory group)
+{
+    struct arena *a;
+
+    a = talloc(ctx, struct arena);
+    if (a == NULL)
+        return NULL;
+
+    a->chunks = NULL;
+    a->next = NULL;
+    a->end = NULL;
+    a->mapped = 0;
+    a->group = group;
+    a->allocations = 0;
+    a->strings = NULL;
+    a->mask = 0;
+    a->count = 0;
+
+    talloc_set_destructor(a, &destroy_arena);
+    return a;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    char *p;
+
+    size = ALIGN_UP(size, ARENA_ALIGN);
+    if ((size_t)(a->end - a->next) < size)
+        if (add_chunk(a, size) != 0)
+            return NULL;
+
+    p = a->next;
+    a->next += size;
+    a->allocations++;
+    stats_memory_add(a->group, 0, 1);
+    return p;
+}
+
+char *arena_strdup(struct arena *a, const char *str)
+{
+    char *copy;
+    size_t length;
+
+    length = strlen(str) + 1;
+    copy = arena_alloc(a, length);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, str, length);
+    return copy;
+}
+
+const char *arena_intern(struct arena *a, const char *str)
+{
+    struct arena_string *slot;
+    uint32_t hash;
+
+    if ((a->count + 1) * 2 > a->mask + 1)
+        if (grow_strings(a) != 0)
+            return NULL;
+
+    hash = hash_string(str);
+    slot = find_string(a, str, hash);
+    if (slot->str == NULL)
+    {
+        slot->str = arena_strdup(a, str);
+        if (slot->str == NULL)
+            return NULL;
+
+        slot->hash = hash;
+        a->count++;
+    }
+
+    return slot->str;
+}
+
+void arena_reset(struct arena *a)
+{
+    struct arena_chunk *keep;
+
+    if (a->chunks == NULL)
+        return;
+
+    keep = a->chunks;
+    a->chunks = keep->next;
+    unmap_chunks(a);
+
+    keep->next = NULL;
+    a->chunks = keep;
+    a->mapped = keep->size;
+    a->next = (char *)keep + ALIGN_UP(sizeof(*keep), ARENA_ALIGN);
+    a->end = (char *)keep + keep->size;
+
+    if (a->strings != NULL)
+        memset(a->strings, 0, (a->mask + 1) * sizeof(*a->strings));
+    a->count = 0;
+}
+
+size_t arena_size(const struct arena *a)
+{
+    return a->mapped;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int add_chunk(struct arena *a, size_t size)
+{
+    struct arena_chunk *chunk;
+    size_t header, chunk_size;
+    long page;
+
+    header = ALIGN_UP(sizeof(*chunk), ARENA_ALIGN);
+    page = sysconf(_SC_PAGESIZE);
+    if (page <= 0)
+        page = 4096;
+
+    /* Each chunk is twice the size of the last, as arenas that have
+     * filled one are likely to fill many. */
+    chunk_size = ARENA_CHUNK_MIN;
+    if (a->chunks != NULL)
+        chunk_size = a->chunks->size * 2;
+    if (chunk_size > ARENA_CHUNK_MAX)
+        chunk_size = ARENA_CHUNK_MAX;
+    if (chunk_size < header + size)
+        chunk_size = ALIGN_UP(header + size, page);
+
+    chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED)
+        return -1;
+
+    /* Whatever was left of the last chunk is given up on. */
+    chunk->next = a->chunks;
+    chunk->size = chunk_size;
+    a->chunks = chunk;
+    a->next = (char *)chunk + header;
+    a->end = (char *)chunk + chunk_size;
+    a->mapped += chunk_size;
+    stats_memory_add(a->group, chunk_size, 0);
+    return 0;
+}
+
+int unmap_chunks(struct arena *a)
+{
+    while (a->chunks != NULL)
+    {
+        struct arena_chunk *chunk;
+
+        chunk = a->chunks;
+        a->chunks = chunk->next;
+        a->mapped -= chunk->size;
+        stats_memory_remove(a->group, chunk->size, 0);
+        munmap(chunk, chunk->size);
+    }
+
+    stats_memory_remove(a->group, 0, a->allocations);
+    a->allocations = 0;
+    a->next = NULL;
+    a->end = NULL;
+    return 0;
+}
+
+int destroy_arena(struct arena *a)
+{
+    if (a->strings != NULL)
+        stats_memory_remove(a->group,
+                            (a->mask + 1) * sizeof(*a->strings), 0);
+
+    return unmap_chunks(a);
+}
+
+uint32_t hash_string(const char *str)
+{
+    uint32_t hash;
+
+    /* FNV-1a, the same as a key_index. */
+    hash = 2166136261U;
+    while (*str != '\0')
+    {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+struct arena_string *find_string(struct arena *a, const char *str,
+                                 uint32_t hash)
+{
+    size_t i;
+
+    i = hash & a->mask;
+    while (a->strings[i].str != NULL)
+    {
+        if (a->strings[i].hash == hash && strcmp(a->strings[i].str, str) == 0)
+            break;
+
+        i = (i + 1) & a->mask;
+    }
+
+    return a->strings + i;
+}
+
+int grow_strings(struct arena *a)
+{
+    struct arena_string *old;
+    size_t old_size, size;
+    size_t i;
+
+    old = a->strings;
+    old_size = (old == NULL) ? 0 : a->mask + 1;
+    size = (old == NULL) ? 64 : old_size * 2;
+
+    a->strings = talloc_zero_array(a, struct arena_string, size);
+    if (a->strings == NULL)
+    {
+        a->strings = old;
+        return -1;
+    }
+    a->mask = size - 1;
+    stats_memory_add(a->group, size * sizeof(*a->strings), 0);
+    stats_memory_remove(a->group, old_size * sizeof(*old), 0);
+
+    /* The strings themselves stay where they are in the arena, only
+     * the slots need moving. */
+    for (i = 0; i < old_size; i++)
+        if (old[i].str != NULL)
+            *find_string(a, old[i].str, old[i].hash) = old[i];
+
+    TALLOC_FREE(old);
+    return 0;
+}
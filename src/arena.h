@@ -0,0 +1,60 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+/* Hands out memory by bumping a pointer through large mmap()ed chunks,
+ * for the many small things that all live exactly as long as something
+ * else does (like a league's games).  Nothing is ever freed on its own:
+ * an arena is a talloc object, and freeing it unmaps every chunk at
+ * once.  Arenas aren't thread safe. */
+struct arena;
+
+#include "stats.h"
+
+#include <stddef.h>
+
+/* Creates an empty arena, which maps nothing until it's used.  What it
+ * maps and hands out is counted in the given memory group, which has
+ * to be one that's counted as it's allocated. */
+struct arena *arena_new(void *ctx, enum stats_memory group);
+
+/* Returns size bytes, aligned for anything, or NULL when out of
+ * memory. */
+void *arena_alloc(struct arena *a, size_t size);
+
+/* Copies a string into the arena. */
+char *arena_strdup(struct arena *a, const char *str);
+
+/* Returns the arena's copy of a string, which is only made the first
+ * time that string is seen.  Interned strings must never be
+ * changed. */
+const char *arena_intern(struct arena *a, const char *str);
+
+/* Forgets everything handed out so far (including interned strings),
+ * keeping only the newest chunk to be used again. */
+void arena_reset(struct arena *a);
+
+/* Returns the number of bytes the arena has mapped. */
+size_t arena_size(const struct arena *a);
+
+#endif
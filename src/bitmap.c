@@ -0,0 +1,774 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitmap.h"
+
+#include <string.h>
+#include <talloc.h>
+
+/* A bitmap container holds every value that shares its top 16 bits. */
+#define BITMAP_WORDS (65536 / 64)
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct container
+{
+    uint16_t key;
+    uint32_t cardinality;
+
+    /* A sorted array of the bottom 16 bits of every value, unless
+     * this is a bitmap container, in which case "words" is set
+     * instead. */
+    uint16_t *array;
+    uint32_t alloc;
+    uint64_t *words;
+};
+
+struct bitmap
+{
+    /* Sorted by key. */
+    struct container *containers;
+    size_t count;
+    size_t alloc;
+};
+
+/* Which operation is being applied to a pair of containers. */
+enum bitmap_op
+{
+    OP_AND,
+    OP_OR,
+    OP_ANDNOT
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Returns the position of the container with the given key, or
+ * -(position + 1) of where it would go if there isn't one. */
+static long find_container(const struct bitmap *b, uint16_t key);
+static struct container *insert_container(struct bitmap *b, size_t pos,
+                                          uint16_t key);
+
+static int container_add(struct bitmap *b, struct container *c,
+                         uint16_t low);
+
+/* Turns an array container into a bitmap container. */
+static int make_words(struct bitmap *b, struct container *c);
+
+/* Fills a scratch bitmap with every value in a container. */
+static void load_words(const struct container *c, uint64_t *words);
+
+/* Adds a container to the end of a result, from either a scratch
+ * bitmap or a sorted array, picking whichever representation fits. */
+static int append_words(struct bitmap *out, uint16_t key,
+                        const uint64_t *words);
+static int append_array(struct bitmap *out, uint16_t key,
+                        const uint16_t *values, uint32_t count);
+static int append_copy(struct bitmap *out, const struct container *c);
+
+/* Applies an operation to two containers with the same key, adding
+ * the result to "out". */
+static int combine(struct bitmap *out, enum bitmap_op op,
+                   const struct container *a, const struct container *b,
+                   uint64_t *scratch, uint16_t *values);
+static struct bitmap *apply(void *ctx, enum bitmap_op op,
+                            const struct bitmap *a, const struct bitmap *b);
+
+static int words_test(const uint64_t *words, uint16_t low);
+static uint32_t words_count(const uint64_t *words);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct bitmap *bitmap_new(void *ctx)
+{
+    struct bitmap *b;
+
+    b = talloc(ctx, struct bitmap);
+    if (b == NULL)
+        return NULL;
+
+    b->containers = NULL;
+    b->count = 0;
+    b->alloc = 0;
+    return b;
+}
+
+int bitmap_add(struct bitmap *b, uint32_t value)
+{
+    struct container *c;
+    uint16_t key;
+    long pos;
+
+    key = value >> 16;
+
+    /* Values usually come in order, so the last container is tried
+     * before searching. */
+    if (b->count > 0 && b->containers[b->count - 1].key == key)
+        c = b->containers + b->count - 1;
+    else if ((pos = find_container(b, key)) >= 0)
+        c = b->containers + pos;
+    else if ((c = insert_container(b, -(pos + 1), key)) == NULL)
+        return -1;
+
+    return container_add(b, c, value & 0xFFFF);
+}
+
+int bitmap_add_range(struct bitmap *b, uint32_t lo, uint32_t hi)
+{
+    while (lo < hi)
+    {
+        struct container *c;
+        uint32_t end, low, high;
+        uint16_t key;
+        long pos;
+
+        /* The part of the range that's in this container. */
+        key = lo >> 16;
+        end = ((uint32_t)key << 16) + 0xFFFF;
+        if (end > hi - 1)
+            end = hi - 1;
+        low = lo & 0xFFFF;
+        high = end & 0xFFFF;
+
+        if ((pos = find_container(b, key)) >= 0)
+            c = b->containers + pos;
+        else if ((c = insert_container(b, -(pos + 1), key)) == NULL)
+            return -1;
+
+        if (c->words == NULL && high - low + 1 + c->cardinality
+            <= BITMAP_ARRAY_MAX)
+        {
+            uint32_t v;
+
+            for (v = low; v <= high; v++)
+                if (container_add(b, c, v) != 0)
+                    return -1;
+        }
+        else
+        {
+            uint32_t first, last, w;
+
+            if (c->words == NULL && make_words(b, c) != 0)
+                return -1;
+
+            /* Whole words in the middle, masks at either end. */
+            first = low / 64;
+            last = high / 64;
+            for (w = first; w <= last; w++)
+            {
+                uint64_t mask;
+
+                mask = ~(uint64_t)0;
+                if (w == first)
+                    mask &= ~(uint64_t)0 << (low % 64);
+                if (w == last && high % 64 != 63)
+                    mask &= ((uint64_t)1 << (high % 64 + 1)) - 1;
+                c->words[w] |= mask;
+            }
+            c->cardinality = words_count(c->words);
+        }
+
+        if (end == 0xFFFFFFFF)
+            break;
+        lo = end + 1;
+    }
+
+    return 0;
+}
+
+int bitmap_contains(const struct bitmap *b, uint32_t value)
+{
+    const struct container *c;
+    uint16_t low;
+    long pos;
+    size_t lo, hi;
+
+    pos = find_container(b, value >> 16);
+    if (pos < 0)
+        return 0;
+
+    c = b->containers + pos;
+    low = value & 0xFFFF;
+    if (c->words != NULL)
+        return words_test(c->words, low);
+
+    lo = 0;
+    hi = c->cardinality;
+    while (lo < hi)
+    {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if (c->array[mid] < low)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < c->cardinality && c->array[lo] == low;
+}
+
+uint64_t bitmap_cardinality(const struct bitmap *b)
+{
+    uint64_t total;
+    size_t i;
+
+    total = 0;
+    for (i = 0; i < b->count; i++)
+        total += b->containers[i].cardinality;
+
+    return total;
+}
+
+struct bitmap *bitmap_and(void *ctx, const struct bitmap *a,
+                          const struct bitmap *b)
+{
+    return apply(ctx, OP_AND, a, b);
+}
+
+struct bitmap *bitmap_or(void *ctx, const struct bitmap *a,
+                         const struct bitmap *b)
+{
+    return apply(ctx, OP_OR, a, b);
+}
+
+struct bitmap *bitmap_andnot(void *ctx, const struct bitmap *a,
+                             const struct bitmap *b)
+{
+    return apply(ctx, OP_ANDNOT, a, b);
+}
+
+uint64_t bitmap_and_cardinality(const struct bitmap *a,
+                                const struct bitmap *b)
+{
+    uint64_t total;
+    size_t i, j;
+
+    total = 0;
+    i = j = 0;
+    while (i < a->count && j < b->count)
+    {
+        const struct container *x, *y;
+
+        x = a->containers + i;
+        y = b->containers + j;
+        if (x->key < y->key)
+        {
+            i++;
+            continue;
+        }
+        if (x->key > y->key)
+        {
+            j++;
+            continue;
+        }
+
+        /* Arrays go on the left, so there are only three cases. */
+        if (x->words != NULL && y->words == NULL)
+        {
+            const struct container *t;
+
+            t = x;
+            x = y;
+            y = t;
+        }
+
+        if (x->words != NULL)
+        {
+            uint32_t w;
+
+            for (w = 0; w < BITMAP_WORDS; w++)
+                total += __builtin_popcountll(x->words[w] & y->words[w]);
+        }
+        else if (y->words != NULL)
+        {
+            uint32_t k;
+
+            for (k = 0; k < x->cardinality; k++)
+                total += words_test(y->words, x->array[k]);
+        }
+        else
+        {
+            uint32_t k, l;
+
+            k = l = 0;
+            while (k < x->cardinality && l < y->cardinality)
+            {
+                if (x->array[k] < y->array[l])
+                    k++;
+                else if (x->array[k] > y->array[l])
+                    l++;
+                else
+                {
+                    total++;
+                    k++;
+                    l++;
+                }
+            }
+        }
+
+        i++;
+        j++;
+    }
+
+    return total;
+}
+
+int bitmap_each(const struct bitmap *b, int (*func) (uint32_t, void *),
+                void *arg)
+{
+    size_t i;
+
+    for (i = 0; i < b->count; i++)
+    {
+        const struct container *c;
+        uint32_t high;
+        int ret;
+
+        c = b->containers + i;
+        high = (uint32_t)c->key << 16;
+        if (c->words != NULL)
+        {
+            uint32_t w;
+
+            for (w = 0; w < BITMAP_WORDS; w++)
+            {
+                uint64_t word;
+
+                for (word = c->words[w]; word != 0; word &= word - 1)
+                    if ((ret = func(high | (w * 64
+                                            + __builtin_ctzll(word)),
+                                    arg)) != 0)
+                        return ret;
+            }
+        }
+        else
+        {
+            uint32_t k;
+
+            for (k = 0; k < c->cardinality; k++)
+                if ((ret = func(high | c->array[k], arg)) != 0)
+                    return ret;
+        }
+    }
+
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+long find_container(const struct bitmap *b, uint16_t key)
+{
+    size_t lo, hi;
+
+    lo = 0;
+    hi = b->count;
+    while (lo < hi)
+    {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if (b->containers[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < b->count && b->containers[lo].key == key)
+        return lo;
+
+    return -(long)lo - 1;
+}
+
+struct container *insert_container(struct bitmap *b, size_t pos,
+                                   uint16_t key)
+{
+    struct container *c;
+
+    if (b->count == b->alloc)
+    {
+        struct container *grown;
+        size_t alloc;
+
+        alloc = (b->alloc == 0) ? 4 : b->alloc * 2;
+        grown = talloc_realloc(b, b->containers, struct container, alloc);
+        if (grown == NULL)
+            return NULL;
+
+        b->containers = grown;
+        b->alloc = alloc;
+    }
+
+    memmove(b->containers + pos + 1, b->containers + pos,
+            (b->count - pos) * sizeof(*b->containers));
+    b->count++;
+
+    c = b->containers + pos;
+    c->key = key;
+    c->cardinality = 0;
+    c->array = NULL;
+    c->alloc = 0;
+    c->words = NULL;
+    return c;
+}
+
+int container_add(struct bitmap *b, struct container *c, uint16_t low)
+{
+    uint32_t lo, hi;
+
+    if (c->words != NULL)
+    {
+        if (!words_test(c->words, low))
+        {
+            c->words[low / 64] |= (uint64_t)1 << (low % 64);
+            c->cardinality++;
+        }
+        return 0;
+    }
+
+    /* Finds where the value goes, which is usually on the end. */
+    if (c->cardinality == 0 || c->array[c->cardinality - 1] < low)
+        lo = c->cardinality;
+    else
+    {
+        lo = 0;
+        hi = c->cardinality;
+        while (lo < hi)
+        {
+            uint32_t mid;
+
+            mid = lo + (hi - lo) / 2;
+            if (c->array[mid] < low)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (c->array[lo] == low)
+            return 0;
+    }
+
+    if (c->cardinality == BITMAP_ARRAY_MAX)
+    {
+        if (make_words(b, c) != 0)
+            return -1;
+        return container_add(b, c, low);
+    }
+
+    if (c->cardinality == c->alloc)
+    {
+        uint16_t *grown;
+        uint32_t alloc;
+
+        alloc = (c->alloc == 0) ? 4 : c->alloc * 2;
+        if (alloc > BITMAP_ARRAY_MAX)
+            alloc = BITMAP_ARRAY_MAX;
+        grown = talloc_realloc(b, c->array, uint16_t, alloc);
+        if (grown == NULL)
+            return -1;
+
+        c->array = grown;
+        c->alloc = alloc;
+    }
+
+    memmove(c->array + lo + 1, c->array + lo,
+            (c->cardinality - lo) * sizeof(*c->array));
+    c->array[lo] = low;
+    c->cardinality++;
+    return 0;
+}
+
+int make_words(struct bitmap *b, struct container *c)
+{
+    uint64_t *words;
+
+    words = talloc_array(b, uint64_t, BITMAP_WORDS);
+    if (words == NULL)
+        return -1;
+
+    load_words(c, words);
+    TALLOC_FREE(c->array);
+    c->alloc = 0;
+    c->words = words;
+    return 0;
+}
+
+void load_words(const struct container *c, uint64_t *words)
+{
+    uint32_t k;
+
+    if (c->words != NULL)
+    {
+        memcpy(words, c->words, BITMAP_WORDS * sizeof(*words));
+        return;
+    }
+
+    memset(words, 0, BITMAP_WORDS * sizeof(*words));
+    for (k = 0; k < c->cardinality; k++)
+        words[c->array[k] / 64] |= (uint64_t)1 << (c->array[k] % 64);
+}
+
+int append_words(struct bitmap *out, uint16_t key, const uint64_t *words)
+{
+    struct container *c;
+    uint32_t count;
+
+    count = words_count(words);
+    if (count == 0)
+        return 0;
+
+    c = insert_container(out, out->count, key);
+    if (c == NULL)
+        return -1;
+
+    c->cardinality = count;
+    if (count > BITMAP_ARRAY_MAX)
+    {
+        c->words = talloc_memdup(out, words, BITMAP_WORDS * sizeof(*words));
+        return (c->words == NULL) ? -1 : 0;
+    }
+
+    /* Sparse results go back to being an array. */
+    c->array = talloc_array(out, uint16_t, count);
+    if (c->array == NULL)
+        return -1;
+    c->alloc = count;
+
+    count = 0;
+    {
+        uint32_t w;
+
+        for (w = 0; w < BITMAP_WORDS; w++)
+        {
+            uint64_t word;
+
+            for (word = words[w]; word != 0; word &= word - 1)
+                c->array[count++] = w * 64 + __builtin_ctzll(word);
+        }
+    }
+
+    return 0;
+}
+
+int append_array(struct bitmap *out, uint16_t key, const uint16_t *values,
+                 uint32_t count)
+{
+    struct container *c;
+
+    if (count == 0)
+        return 0;
+
+    c = insert_container(out, out->count, key);
+    if (c == NULL)
+        return -1;
+
+    c->array = talloc_memdup(out, values, count * sizeof(*values));
+    if (c->array == NULL)
+        return -1;
+
+    c->cardinality = count;
+    c->alloc = count;
+    return 0;
+}
+
+int append_copy(struct bitmap *out, const struct container *c)
+{
+    if (c->words != NULL)
+        return append_words(out, c->key, c->words);
+
+    return append_array(out, c->key, c->array, c->cardinality);
+}
+
+int combine(struct bitmap *out, enum bitmap_op op, const struct container *a,
+            const struct container *b, uint64_t *scratch, uint16_t *values)
+{
+    uint32_t i, j, n;
+    uint32_t w;
+
+    /* Two arrays are merged, unless a union could get too big. */
+    if (a->words == NULL && b->words == NULL
+        && (op != OP_OR
+            || a->cardinality + b->cardinality <= BITMAP_ARRAY_MAX))
+    {
+        i = j = n = 0;
+        while (i < a->cardinality && j < b->cardinality)
+        {
+            if (a->array[i] < b->array[j])
+            {
+                if (op != OP_AND)
+                    values[n++] = a->array[i];
+                i++;
+            }
+            else if (a->array[i] > b->array[j])
+            {
+                if (op == OP_OR)
+                    values[n++] = b->array[j];
+                j++;
+            }
+            else
+            {
+                if (op != OP_ANDNOT)
+                    values[n++] = a->array[i];
+                i++;
+                j++;
+            }
+        }
+
+        if (op != OP_AND)
+            while (i < a->cardinality)
+                values[n++] = a->array[i++];
+        if (op == OP_OR)
+            while (j < b->cardinality)
+                values[n++] = b->array[j++];
+
+        return append_array(out, a->key, values, n);
+    }
+
+    /* An array on the left of an intersection or difference only
+     * needs each of its values looked up in the other bitmap. */
+    if (a->words == NULL && op != OP_OR)
+    {
+        n = 0;
+        for (i = 0; i < a->cardinality; i++)
+        {
+            if (words_test(b->words, a->array[i]) == (op == OP_AND))
+                values[n++] = a->array[i];
+        }
+
+        return append_array(out, a->key, values, n);
+    }
+
+    if (op == OP_AND && b->words == NULL)
+        return combine(out, op, b, a, scratch, values);
+
+    /* Everything else is done a word at a time. */
+    load_words(a, scratch);
+    if (b->words != NULL)
+    {
+        switch (op)
+        {
+        case OP_AND:
+            for (w = 0; w < BITMAP_WORDS; w++)
+                scratch[w] &= b->words[w];
+            break;
+        case OP_OR:
+            for (w = 0; w < BITMAP_WORDS; w++)
+                scratch[w] |= b->words[w];
+            break;
+        case OP_ANDNOT:
+            for (w = 0; w < BITMAP_WORDS; w++)
+                scratch[w] &= ~b->words[w];
+            break;
+        }
+    }
+    else
+    {
+        for (j = 0; j < b->cardinality; j++)
+        {
+            uint64_t bit;
+
+            bit = (uint64_t)1 << (b->array[j] % 64);
+            if (op == OP_OR)
+                scratch[b->array[j] / 64] |= bit;
+            else
+                scratch[b->array[j] / 64] &= ~bit;
+        }
+    }
+
+    return append_words(out, a->key, scratch);
+}
+
+struct bitmap *apply(void *ctx, enum bitmap_op op, const struct bitmap *a,
+                     const struct bitmap *b)
+{
+    struct bitmap *out;
+    uint64_t *scratch;
+    uint16_t *values;
+    size_t i, j;
+
+    out = bitmap_new(ctx);
+    scratch = talloc_array(out, uint64_t, BITMAP_WORDS);
+    values = talloc_array(out, uint16_t, 2 * BITMAP_ARRAY_MAX);
+    if (out == NULL || scratch == NULL || values == NULL)
+    {
+        TALLOC_FREE(out);
+        return NULL;
+    }
+
+    i = j = 0;
+    while (i < a->count || j < b->count)
+    {
+        const struct container *x, *y;
+        int ret;
+
+        x = (i < a->count) ? a->containers + i : NULL;
+        y = (j < b->count) ? b->containers + j : NULL;
+
+        /* Containers only on one side are either copied or dropped. */
+        if (y == NULL || (x != NULL && x->key < y->key))
+        {
+            ret = (op == OP_AND) ? 0 : append_copy(out, x);
+            i++;
+        }
+        else if (x == NULL || y->key < x->key)
+        {
+            ret = (op == OP_OR) ? append_copy(out, y) : 0;
+            j++;
+        }
+        else
+        {
+            ret = combine(out, op, x, y, scratch, values);
+            i++;
+            j++;
+        }
+
+        if (ret != 0)
+        {
+            TALLOC_FREE(out);
+            return NULL;
+        }
+    }
+
+    TALLOC_FREE(scratch);
+    TALLOC_FREE(values);
+    return out;
+}
+
+int words_test(const uint64_t *words, uint16_t low)
+{
+    return (words[low / 64] >> (low % 64)) & 1;
+}
+
+uint32_t words_count(const uint64_t *words)
+{
+    uint32_t count;
+    uint32_t w;
+
+    count = 0;
+    for (w = 0; w < BITMAP_WORDS; w++)
+        count += __builtin_popcountll(words[w]);
+
+    return count;
+}
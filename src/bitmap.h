@@ -0,0 +1,76 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+/* A compressed set of 32-bit integers, in the style of Roaring
+ * bitmaps.  Values are split by their top 16 bits into containers of
+ * up to 65536 values each.  Sparse containers are a sorted array of the
+ * bottom 16 bits, and dense ones (more than BITMAP_ARRAY_MAX values)
+ * are a plain 8KB bitmap, so sets stay small whether they're sparse or
+ * dense.  Set operations work a container at a time, and between two
+ * dense containers it's 64 bits at a time with popcount, in loops the
+ * compiler can vectorize. */
+struct bitmap;
+
+#include <stdint.h>
+
+/* The most values in an array container, past which it's a bitmap. */
+#ifndef BITMAP_ARRAY_MAX
+#define BITMAP_ARRAY_MAX 4096
+#endif
+
+/* Creates an empty set. */
+struct bitmap *bitmap_new(void *ctx);
+
+/* Adds a single value, or every value from "lo" up to (but not
+ * including) "hi".  Adding values in increasing order is fastest.
+ * Returns 0 on success. */
+int bitmap_add(struct bitmap *b, uint32_t value);
+int bitmap_add_range(struct bitmap *b, uint32_t lo, uint32_t hi);
+
+/* Returns TRUE if the value is in the set. */
+int bitmap_contains(const struct bitmap *b, uint32_t value);
+
+/* Returns the number of values in the set. */
+uint64_t bitmap_cardinality(const struct bitmap *b);
+
+/* Returns a new set holding the values in both sets, either set, or
+ * the first set but not the second.  NULL is returned on failure. */
+struct bitmap *bitmap_and(void *ctx, const struct bitmap *a,
+                          const struct bitmap *b);
+struct bitmap *bitmap_or(void *ctx, const struct bitmap *a,
+                         const struct bitmap *b);
+struct bitmap *bitmap_andnot(void *ctx, const struct bitmap *a,
+                             const struct bitmap *b);
+
+/* Returns the number of values in both sets, without building the
+ * intersection. */
+uint64_t bitmap_and_cardinality(const struct bitmap *a,
+                                const struct bitmap *b);
+
+/* Walks through every value in increasing order, stopping early if
+ * the function returns non-zero.  Returns that value, or 0. */
+int bitmap_each(const struct bitmap *b, int (*func) (uint32_t, void *),
+                void *arg);
+
+#endif
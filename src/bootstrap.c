@@ -0,0 +1,543 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "bootstrap.h"
+#include "elo.h"
+#include "trace.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <unistd.h>
+
+#ifndef BOOTSTRAP_MAX_THREADS
+#define BOOTSTRAP_MAX_THREADS 64
+#endif
+
+#ifndef BOOTSTRAP_SEED
+#define BOOTSTRAP_SEED 0x62776c6fULL
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Every replica's state just before one game: where its random
+ * stream was, and a row of ratings and game counts per replica. */
+struct bootstrap_save
+{
+    size_t game;
+    uint64_t *rng;
+    player_elo_t *elo;
+    int *games;
+};
+
+struct bootstrap_saves
+{
+    size_t spacing;
+    size_t max;
+
+    /* What the saves were taken with, they're no use for anything
+     * else. */
+    enum bootstrap_mode mode;
+    int replicas;
+    size_t player_count;
+    size_t league_count;
+
+    /* Oldest first, with room for a whole run's worth of new ones on
+     * top of the ones that are kept. */
+    struct bootstrap_save **saves;
+    size_t count;
+};
+
+/* State shared between every worker thread.  Everything here is
+ * read-only except for "next_replica", which is only touched
+ * atomically, and the disjoint rows of "results". */
+struct bootstrap_shared
+{
+    const struct timeline_game *games;
+    size_t game_count;
+    size_t player_count;
+    size_t league_count;
+    enum bootstrap_mode mode;
+    int replicas;
+
+    /* Replicas are handed out one at a time so uneven threads still
+     * finish together. */
+    int next_replica;
+
+    /* One row of final ratings per replica. */
+    player_elo_t *results;
+
+    /* Where every replica starts from, or NULL for the first game, and
+     * the saves that get filled in on the way, in order.  Each replica
+     * only writes its own row of these. */
+    const struct bootstrap_save *start;
+    struct bootstrap_save **pending;
+    size_t pending_count;
+};
+
+/* Everything a single worker thread owns. */
+struct bootstrap_worker
+{
+    struct bootstrap_shared *shared;
+    pthread_t thread;
+    int started;
+
+    player_elo_t *elo;
+    int *games;
+    int *league_weight;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static void *worker_main(void *worker_uncast);
+static void run_replica(struct bootstrap_worker *w, int replica);
+
+/* A small, fast PRNG -- each replica gets its own stream so the
+ * results don't depend on how replicas land on threads. */
+static uint64_t splitmix64(uint64_t *state);
+
+/* Draws from a Poisson distribution with a mean of 1, which is the
+ * number of times each item shows up in a resample. */
+static int poisson1(uint64_t *state);
+
+/* Drops the saves that were taken on games that have changed, points
+ * the replicas at the last one left and sets up the new ones to take.
+ * Returns 0 on success. */
+static int plan_saves(void *ctx, struct bootstrap_saves *bs,
+                      struct bootstrap_shared *s, size_t first);
+
+/* Adds the saves taken by a run, keeping only the latest ones. */
+static void keep_saves(struct bootstrap_saves *bs,
+                       struct bootstrap_shared *s);
+
+static int compare_elo(const void *a, const void *b);
+static player_elo_t percentile(const player_elo_t *sorted, int count,
+                               double p);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int bootstrap_mode_parse(const char *str, enum bootstrap_mode *mode)
+{
+    if (strcmp(str, "games") == 0)
+    {
+        *mode = BOOTSTRAP_GAMES;
+        return 0;
+    }
+    if (strcmp(str, "leagues") == 0)
+    {
+        *mode = BOOTSTRAP_LEAGUES;
+        return 0;
+    }
+
+    return -1;
+}
+
+int bootstrap_elo(void *pctx, struct timeline *tl, enum bootstrap_mode mode,
+                  int replicas, struct bootstrap_saves *saves, size_t first)
+{
+    void *ctx;
+    struct bootstrap_shared shared;
+    struct bootstrap_worker *workers;
+    long thread_count;
+    long i;
+    player_elo_t *column;
+    size_t p;
+
+    if (replicas <= 0)
+        return -1;
+
+    ctx = talloc_new(pctx);
+    if (ctx == NULL)
+        return -1;
+
+    shared.games = timeline_games(tl);
+    shared.game_count = timeline_game_count(tl);
+    shared.player_count = timeline_player_count(tl);
+    shared.league_count = timeline_league_count(tl);
+    shared.mode = mode;
+    shared.replicas = replicas;
+    shared.next_replica = 0;
+    shared.start = NULL;
+    shared.pending = NULL;
+    shared.pending_count = 0;
+    shared.results = talloc_array(ctx, player_elo_t,
+                                  (size_t)replicas * shared.player_count + 1);
+    if (shared.results == NULL)
+        goto failure;
+
+    if (saves != NULL && plan_saves(ctx, saves, &shared, first) != 0)
+        goto failure;
+
+    thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > BOOTSTRAP_MAX_THREADS)
+        thread_count = BOOTSTRAP_MAX_THREADS;
+    if (thread_count > replicas)
+        thread_count = replicas;
+
+    workers = talloc_array(ctx, struct bootstrap_worker, thread_count);
+    if (workers == NULL)
+        goto failure;
+
+    for (i = 0; i < thread_count; i++)
+    {
+        workers[i].shared = &shared;
+        workers[i].started = 0;
+        workers[i].elo = talloc_array(workers, player_elo_t,
+                                      shared.player_count + 1);
+        workers[i].games = talloc_array(workers, int,
+                                        shared.player_count + 1);
+        workers[i].league_weight = talloc_array(workers, int,
+                                                shared.league_count + 1);
+        if (workers[i].elo == NULL || workers[i].games == NULL
+            || workers[i].league_weight == NULL)
+            goto failure;
+    }
+
+    /* The calling thread acts as the first worker.  If a thread can't
+     * be started the remaining workers just pick up its share. */
+    for (i = 1; i < thread_count; i++)
+        if (pthread_create(&workers[i].thread, NULL,
+                           &worker_main, &workers[i]) == 0)
+            workers[i].started = 1;
+
+    worker_main(&workers[0]);
+
+    for (i = 1; i < thread_count; i++)
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+
+    if (saves != NULL)
+        keep_saves(saves, &shared);
+
+    /* Every player's ratings are pulled out of the replica rows,
+     * sorted, and summarized. */
+    column = talloc_array(ctx, player_elo_t, replicas);
+    if (column == NULL)
+        goto failure;
+
+    for (p = 0; p < shared.player_count; p++)
+    {
+        int r;
+
+        for (r = 0; r < replicas; r++)
+            column[r] = shared.results[(size_t)r * shared.player_count + p];
+
+        qsort(column, replicas, sizeof(*column), &compare_elo);
+
+        player_set_elo_interval(timeline_player(tl, p),
+                                percentile(column, replicas, 0.05),
+                                percentile(column, replicas, 0.50),
+                                percentile(column, replicas, 0.95));
+    }
+
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    while (shared.pending_count > 0)
+    {
+        shared.pending_count--;
+        TALLOC_FREE(shared.pending[shared.pending_count]);
+    }
+    TALLOC_FREE(ctx);
+    return -1;
+}
+
+struct bootstrap_saves *bootstrap_saves_new(void *ctx, size_t spacing,
+                                            size_t max)
+{
+    struct bootstrap_saves *bs;
+
+    bs = talloc_zero(ctx, struct bootstrap_saves);
+    if (bs == NULL)
+        return NULL;
+
+    bs->spacing = (spacing == 0) ? 1 : spacing;
+    bs->max = (max == 0) ? 1 : max;
+    bs->saves = talloc_array(bs, struct bootstrap_save *, bs->max * 2 + 1);
+    if (bs->saves == NULL)
+    {
+        TALLOC_FREE(bs);
+        return NULL;
+    }
+
+    return bs;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void *worker_main(void *worker_uncast)
+{
+    struct bootstrap_worker *w;
+    int replica;
+
+    w = worker_uncast;
+    while ((replica = __sync_fetch_and_add(&w->shared->next_replica, 1))
+           < w->shared->replicas)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "replica %d", replica);
+        trace_begin("replay", name);
+        run_replica(w, replica);
+        trace_end("replay");
+    }
+
+    return NULL;
+}
+
+void run_replica(struct bootstrap_worker *w, int replica)
+{
+    struct bootstrap_shared *s;
+    uint64_t rng;
+    size_t row;
+    size_t first, next;
+    size_t i;
+
+    s = w->shared;
+    rng = BOOTSTRAP_SEED + (uint64_t)replica * 0x9E3779B97F4A7C15ULL;
+    row = (size_t)replica * s->player_count;
+
+    for (i = 0; i < s->player_count; i++)
+    {
+        w->elo[i] = elo_default();
+        w->games[i] = 0;
+    }
+
+    /* The league weights come first off the stream, so they're drawn
+     * the same way even when carrying on from a save. */
+    if (s->mode == BOOTSTRAP_LEAGUES)
+        for (i = 0; i < s->league_count; i++)
+            w->league_weight[i] = poisson1(&rng);
+
+    first = 0;
+    if (s->start != NULL)
+    {
+        first = s->start->game;
+        rng = s->start->rng[replica];
+        memcpy(w->elo, s->start->elo + row,
+               s->player_count * sizeof(*w->elo));
+        memcpy(w->games, s->start->games + row,
+               s->player_count * sizeof(*w->games));
+    }
+
+    next = 0;
+    for (i = first; i < s->game_count; i++)
+    {
+        const struct timeline_game *g;
+        int copies;
+
+        if (next < s->pending_count && s->pending[next]->game == i)
+        {
+            struct bootstrap_save *save;
+
+            save = s->pending[next++];
+            save->rng[replica] = rng;
+            memcpy(save->elo + row, w->elo,
+                   s->player_count * sizeof(*w->elo));
+            memcpy(save->games + row, w->games,
+                   s->player_count * sizeof(*w->games));
+        }
+
+        g = s->games + i;
+        if (s->mode == BOOTSTRAP_LEAGUES)
+            copies = w->league_weight[g->league];
+        else
+            copies = poisson1(&rng);
+
+        while (copies-- > 0)
+        {
+            elo_update(&w->elo[g->winner], &w->elo[g->loser],
+                       w->games[g->winner], w->games[g->loser]);
+            w->games[g->winner]++;
+            w->games[g->loser]++;
+        }
+    }
+
+    memcpy(s->results + (size_t)replica * s->player_count, w->elo,
+           s->player_count * sizeof(*w->elo));
+}
+
+int plan_saves(void *ctx, struct bootstrap_saves *bs,
+               struct bootstrap_shared *s, size_t first)
+{
+    size_t start, count, skip;
+    size_t game;
+
+    if (bs->mode != s->mode || bs->replicas != s->replicas
+        || bs->player_count != s->player_count
+        || bs->league_count != s->league_count)
+    {
+        while (bs->count > 0)
+        {
+            bs->count--;
+            TALLOC_FREE(bs->saves[bs->count]);
+        }
+
+        bs->mode = s->mode;
+        bs->replicas = s->replicas;
+        bs->player_count = s->player_count;
+        bs->league_count = s->league_count;
+    }
+
+    while (bs->count > 0 && bs->saves[bs->count - 1]->game > first)
+    {
+        bs->count--;
+        TALLOC_FREE(bs->saves[bs->count]);
+    }
+
+    start = 0;
+    if (bs->count > 0)
+    {
+        s->start = bs->saves[bs->count - 1];
+        start = s->start->game;
+    }
+
+    /* Only the latest few of the new saves would be kept anyway. */
+    count = 0;
+    if (s->game_count > 0)
+        count = (s->game_count - 1) / bs->spacing - start / bs->spacing;
+    skip = (count > bs->max) ? count - bs->max : 0;
+
+    s->pending = talloc_array(ctx, struct bootstrap_save *,
+                              count - skip + 1);
+    if (s->pending == NULL)
+        return -1;
+
+    for (game = (start / bs->spacing + 1 + skip) * bs->spacing;
+         game < s->game_count; game += bs->spacing)
+    {
+        struct bootstrap_save *save;
+        size_t cells;
+
+        cells = (size_t)s->replicas * s->player_count + 1;
+        save = talloc(bs, struct bootstrap_save);
+        if (save == NULL)
+            break;
+
+        save->game = game;
+        save->rng = talloc_array(save, uint64_t, s->replicas);
+        save->elo = talloc_array(save, player_elo_t, cells);
+        save->games = talloc_array(save, int, cells);
+        if (save->rng == NULL || save->elo == NULL || save->games == NULL)
+        {
+            TALLOC_FREE(save);
+            break;
+        }
+
+        s->pending[s->pending_count++] = save;
+    }
+
+    return 0;
+}
+
+void keep_saves(struct bootstrap_saves *bs, struct bootstrap_shared *s)
+{
+    size_t drop;
+    size_t i;
+
+    for (i = 0; i < s->pending_count; i++)
+        bs->saves[bs->count++] = s->pending[i];
+    s->pending_count = 0;
+
+    if (bs->count <= bs->max)
+        return;
+
+    drop = bs->count - bs->max;
+    for (i = 0; i < drop; i++)
+        TALLOC_FREE(bs->saves[i]);
+    for (i = drop; i < bs->count; i++)
+        bs->saves[i - drop] = bs->saves[i];
+    bs->count -= drop;
+}
+
+uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z;
+
+    z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+int poisson1(uint64_t *state)
+{
+    double u, p, cdf;
+    int k;
+
+    /* 53 random bits make a uniform double in [0, 1). */
+    u = (splitmix64(state) >> 11) * (1.0 / 9007199254740992.0);
+
+    k = 0;
+    p = exp(-1.0);
+    cdf = p;
+    while (u > cdf && k < 32)
+    {
+        k++;
+        p /= k;
+        cdf += p;
+    }
+
+    return k;
+}
+
+int compare_elo(const void *a_uncast, const void *b_uncast)
+{
+    const player_elo_t *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    if (*a > *b)
+        return 1;
+    else if (*a < *b)
+        return -1;
+    else
+        return 0;
+}
+
+player_elo_t percentile(const player_elo_t *sorted, int count, double p)
+{
+    double pos;
+    int lo;
+
+    /* Linearly interpolates between the two closest ranks. */
+    pos = p * (count - 1);
+    lo = (int)floor(pos);
+    if (lo + 1 >= count)
+        return sorted[count - 1];
+
+    return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
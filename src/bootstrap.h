@@ -0,0 +1,66 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include "timeline.h"
+
+#include <stddef.h>
+
+/* Every replica's ratings, saved every so many games, so the replicas
+ * can carry on from part way through the timeline when only the games
+ * after that have changed. */
+struct bootstrap_saves;
+
+/* What gets resampled in each bootstrap replica. */
+enum bootstrap_mode
+{
+    /* Every game is resampled independently. */
+    BOOTSTRAP_GAMES,
+
+    /* Whole leagues are resampled, keeping every game in a league
+     * together. */
+    BOOTSTRAP_LEAGUES,
+};
+
+/* Parses a string into a bootstrap mode, returning -1 on failure. */
+int bootstrap_mode_parse(const char *str, enum bootstrap_mode *mode);
+
+/* Replays the timeline "replicas" times, each time against a
+ * resampled set of games, and stores the 5th, 50th and 95th
+ * percentile of every player's final rating with
+ * player_set_elo_interval().  Replicas are spread over every CPU:
+ * they all share the read-only timeline and each thread only keeps
+ * its own rating arrays.  When "saves" isn't NULL every replica picks
+ * up from the last save no later than "first", the first game that's
+ * changed since the saves were taken, and new saves are taken along
+ * the way.  Returns 0 on success. */
+int bootstrap_elo(void *ctx, struct timeline *tl, enum bootstrap_mode mode,
+                  int replicas, struct bootstrap_saves *saves,
+                  size_t first);
+
+/* Creates an empty set of saves, taken before every game that's a
+ * multiple of "spacing" and keeping the latest "max" of them. */
+struct bootstrap_saves *bootstrap_saves_new(void *ctx, size_t spacing,
+                                            size_t max);
+
+#endif
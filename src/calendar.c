@@ -0,0 +1,71 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "calendar.h"
+
+#ifndef CALENDAR_TIMEZONE_OFFSET
+#define CALENDAR_TIMEZONE_OFFSET 32400
+#endif
+
+#define SECONDS_PER_DAY 86400
+
+/* The Gregorian calendar repeats every 400 years, which is this many
+ * days. */
+#define DAYS_PER_ERA 146097
+
+/* Days from 0000-03-01 to 1970-01-01, counting years from March so
+ * leap days fall at the end of each year. */
+#define EPOCH_DAYS 719468
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int calendar_month(game_time_t time)
+{
+    int64_t days, era, day_of_era, year_of_era, day_of_year;
+    int64_t year, month;
+
+    time += CALENDAR_TIMEZONE_OFFSET;
+    days = time / SECONDS_PER_DAY;
+    if (time % SECONDS_PER_DAY < 0)
+        days--;
+
+    /* Splits the days up into 400 year eras, then into years and
+     * months starting from March. */
+    days += EPOCH_DAYS;
+    era = (days >= 0 ? days : days - (DAYS_PER_ERA - 1)) / DAYS_PER_ERA;
+    day_of_era = days - era * DAYS_PER_ERA;
+    year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524
+                   - day_of_era / (DAYS_PER_ERA - 1)) / 365;
+    day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4
+                                - year_of_era / 100);
+    month = (5 * day_of_year + 2) / 153;
+
+    /* Back to years starting in January. */
+    year = year_of_era + era * 400;
+    if (month >= 10)
+    {
+        year++;
+        month -= 12;
+    }
+
+    return (int)((year - 1900) * 12 + month + 2);
+}
@@ -0,0 +1,34 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include "game.h"
+
+/* Returns the calendar month a game was played in, counting from
+ * January 1900, so the months that follow each other get consecutive
+ * numbers.  Months are split in KST, the same timezone the HTML pages
+ * display dates in.  This doesn't touch any shared state, so it's safe
+ * to call from any thread. */
+int calendar_month(game_time_t time);
+
+#endif
@@ -0,0 +1,261 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "checkpoint.h"
+#include "global.h"
+#include "timeline.h"
+
+#include <talloc.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Everything needed to put the tables back to how they were just
+ * before one game.  Tables that didn't exist are left NULL. */
+struct checkpoint
+{
+    size_t game;
+
+    struct player_state *players;
+    size_t player_count;
+
+    struct matchup_checkpoint *matchup;
+    struct rank_checkpoint *rank;
+    struct rating_history_checkpoint *history;
+    struct h2h_checkpoint *h2h;
+    struct performance_checkpoint *performance;
+    struct race_stats_checkpoint *race_stats;
+    struct period_checkpoint *period;
+    struct pool_checkpoint *pool;
+    struct prediction_stats *prediction;
+};
+
+struct checkpoint_list
+{
+    size_t spacing;
+    size_t max;
+
+    /* Oldest first, each one a context of its own. */
+    struct checkpoint **checkpoints;
+    size_t count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Copies out every table, returning NULL on failure. */
+static struct checkpoint *take(void *ctx, size_t game,
+                               struct prediction_stats *ps);
+
+/* Puts every table back, returning 0 on success. */
+static int restore(const struct checkpoint *c, struct prediction_stats *ps);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct checkpoint_list *checkpoint_list_new(void *ctx, size_t spacing,
+                                            size_t max)
+{
+    struct checkpoint_list *cl;
+
+    cl = talloc(ctx, struct checkpoint_list);
+    if (cl == NULL)
+        return NULL;
+
+    cl->spacing = (spacing == 0) ? 1 : spacing;
+    cl->max = (max == 0) ? 1 : max;
+    cl->count = 0;
+    cl->checkpoints = talloc_array(cl, struct checkpoint *, cl->max + 1);
+    if (cl->checkpoints == NULL)
+    {
+        TALLOC_FREE(cl);
+        return NULL;
+    }
+
+    return cl;
+}
+
+int checkpoint_list_game(struct checkpoint_list *cl, size_t game,
+                         struct prediction_stats *ps)
+{
+    struct checkpoint *c;
+    size_t i;
+
+    /* Replays start from a checkpoint, which is already there. */
+    if (game == 0 || game % cl->spacing != 0)
+        return 0;
+    if (cl->count > 0 && cl->checkpoints[cl->count - 1]->game >= game)
+        return 0;
+
+    c = take(cl, game, ps);
+    if (c == NULL)
+        return -1;
+
+    if (cl->count == cl->max)
+    {
+        TALLOC_FREE(cl->checkpoints[0]);
+        for (i = 1; i < cl->count; i++)
+            cl->checkpoints[i - 1] = cl->checkpoints[i];
+        cl->count--;
+    }
+
+    cl->checkpoints[cl->count++] = c;
+    return 0;
+}
+
+long checkpoint_list_rollback(struct checkpoint_list *cl, size_t game,
+                              struct prediction_stats *ps)
+{
+    /* Checkpoints past the first changed game were taken on games that
+     * aren't there anymore. */
+    while (cl->count > 0 && cl->checkpoints[cl->count - 1]->game > game)
+    {
+        cl->count--;
+        TALLOC_FREE(cl->checkpoints[cl->count]);
+    }
+
+    if (cl->count == 0)
+        return -1;
+
+    /* A table that can't be put back leaves nothing to trust. */
+    if (restore(cl->checkpoints[cl->count - 1], ps) != 0)
+    {
+        while (cl->count > 0)
+        {
+            cl->count--;
+            TALLOC_FREE(cl->checkpoints[cl->count]);
+        }
+        return -1;
+    }
+
+    return (long)cl->checkpoints[cl->count - 1]->game;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+struct checkpoint *take(void *ctx, size_t game, struct prediction_stats *ps)
+{
+    struct checkpoint *c;
+    size_t i;
+
+    if (global_timeline == NULL)
+        return NULL;
+
+    c = talloc_zero(ctx, struct checkpoint);
+    if (c == NULL)
+        return NULL;
+
+    c->game = game;
+    c->player_count = timeline_player_count(global_timeline);
+    c->players = talloc_array(c, struct player_state, c->player_count + 1);
+    if (c->players == NULL)
+        goto failure;
+
+    for (i = 0; i < c->player_count; i++)
+        player_save_state(timeline_player(global_timeline, i),
+                          c->players + i);
+
+    if (global_matchup_table != NULL)
+        c->matchup = matchup_table_checkpoint(c, global_matchup_table);
+    if (global_rank_tree != NULL)
+        c->rank = rank_tree_checkpoint(c, global_rank_tree);
+    if (global_rating_history != NULL)
+        c->history = rating_history_checkpoint(c, global_rating_history);
+    if (global_h2h_table != NULL)
+        c->h2h = h2h_table_checkpoint(c, global_h2h_table);
+    if (global_performance_table != NULL)
+        c->performance =
+            performance_table_checkpoint(c, global_performance_table);
+    if (global_race_stats != NULL)
+        c->race_stats = race_stats_checkpoint(c, global_race_stats);
+    if (global_period_table != NULL)
+        c->period = period_table_checkpoint(c, global_period_table);
+    if (global_pool_set != NULL)
+        c->pool = pool_set_checkpoint(c, global_pool_set);
+    if (ps != NULL)
+        c->prediction = prediction_stats_checkpoint(c, ps);
+
+    if ((global_matchup_table != NULL && c->matchup == NULL)
+        || (global_rank_tree != NULL && c->rank == NULL)
+        || (global_rating_history != NULL && c->history == NULL)
+        || (global_h2h_table != NULL && c->h2h == NULL)
+        || (global_performance_table != NULL && c->performance == NULL)
+        || (global_race_stats != NULL && c->race_stats == NULL)
+        || (global_period_table != NULL && c->period == NULL)
+        || (global_pool_set != NULL && c->pool == NULL)
+        || (ps != NULL && c->prediction == NULL))
+        goto failure;
+
+    return c;
+
+  failure:
+    TALLOC_FREE(c);
+    return NULL;
+}
+
+int restore(const struct checkpoint *c, struct prediction_stats *ps)
+{
+    size_t i;
+
+    /* Every table has to be the one the checkpoint was taken from. */
+    if (global_timeline == NULL
+        || timeline_player_count(global_timeline) != c->player_count
+        || (global_matchup_table != NULL) != (c->matchup != NULL)
+        || (global_rank_tree != NULL) != (c->rank != NULL)
+        || (global_rating_history != NULL) != (c->history != NULL)
+        || (global_h2h_table != NULL) != (c->h2h != NULL)
+        || (global_performance_table != NULL) != (c->performance != NULL)
+        || (global_race_stats != NULL) != (c->race_stats != NULL)
+        || (global_period_table != NULL) != (c->period != NULL)
+        || (global_pool_set != NULL) != (c->pool != NULL)
+        || (ps != NULL) != (c->prediction != NULL))
+        return -1;
+
+    if (c->h2h != NULL && h2h_table_rollback(global_h2h_table, c->h2h) != 0)
+        return -1;
+
+    for (i = 0; i < c->player_count; i++)
+        player_restore_state(timeline_player(global_timeline, i),
+                             c->players + i);
+
+    if (c->matchup != NULL)
+        matchup_table_rollback(global_matchup_table, c->matchup);
+    if (c->rank != NULL)
+        rank_tree_rollback(global_rank_tree, c->rank);
+    if (c->history != NULL)
+        rating_history_rollback(global_rating_history, c->history);
+    if (c->performance != NULL)
+        performance_table_rollback(global_performance_table,
+                                   c->performance);
+    if (c->race_stats != NULL)
+        race_stats_rollback(global_race_stats, c->race_stats);
+    if (c->period != NULL)
+        period_table_rollback(global_period_table, c->period);
+    if (c->pool != NULL)
+        pool_set_rollback(global_pool_set, c->pool);
+    if (c->prediction != NULL)
+        prediction_stats_rollback(ps, c->prediction);
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/* Copies of every rating table, taken every so many games as the
+ * timeline is replayed, so that when some games change only the games
+ * from the last checkpoint before the first change get replayed.  The
+ * tables are the global ones along with every player's rating and
+ * record, plus whichever prediction stats are passed in.  Tables that
+ * only ever grow are saved as their lengths, the rest are copied. */
+struct checkpoint_list;
+
+#include "prediction.h"
+
+#include <stddef.h>
+
+/* Creates an empty list that takes a checkpoint before every game
+ * that's a multiple of "spacing", keeping the latest "max" of them. */
+struct checkpoint_list *checkpoint_list_new(void *ctx, size_t spacing,
+                                            size_t max);
+
+/* Called just before the game at the given position in the global
+ * timeline is rated, which takes a checkpoint if one is due.  Returns
+ * 0 on success, a checkpoint that can't be taken is just skipped. */
+int checkpoint_list_game(struct checkpoint_list *cl, size_t game,
+                         struct prediction_stats *ps);
+
+/* Rolls every table back to the last checkpoint no later than the
+ * given game, forgetting every checkpoint after it.  Returns the
+ * position of the game to carry on replaying from, or -1 if there's
+ * no such checkpoint, in which case the tables are left alone and
+ * have to be built again from scratch. */
+long checkpoint_list_rollback(struct checkpoint_list *cl, size_t game,
+                              struct prediction_stats *ps);
+
+#endif
@@ -0,0 +1,112 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "elo.h"
+
+#include <math.h>
+
+#ifndef PLAYER_DEFAULT_ELO
+#define PLAYER_DEFAULT_ELO 2000
+#endif
+
+#ifndef ELO_K1
+#define ELO_K1 30
+#endif
+
+#ifndef ELO_K2
+#define ELO_K2 15
+#endif
+
+#ifndef ELO_K3
+#define ELO_K3 10
+#endif
+
+#ifndef ELO_K1_GAMES
+#define ELO_K1_GAMES 30
+#endif
+
+#ifndef ELO_K2_GAMES
+#define ELO_K2_GAMES 100
+#endif
+
+#ifndef ELO_PEAK_GAMES
+#define ELO_PEAK_GAMES 10
+#endif
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+player_elo_t elo_default(void)
+{
+    return PLAYER_DEFAULT_ELO;
+}
+
+int elo_k_phase(int games)
+{
+    int phase;
+
+    phase = 0;
+    if (games > ELO_K1_GAMES)
+        phase = 1;
+    if (games > ELO_K2_GAMES)
+        phase = 2;
+
+    return phase;
+}
+
+int elo_phase_k_factor(int phase)
+{
+    static const int k[ELO_K_PHASES] = { ELO_K1, ELO_K2, ELO_K3 };
+
+    return k[phase];
+}
+
+int elo_k_factor(int games)
+{
+    return elo_phase_k_factor(elo_k_phase(games));
+}
+
+int elo_counts_for_peak(int games)
+{
+    return games > ELO_PEAK_GAMES;
+}
+
+player_elo_t elo_expected(player_elo_t a, player_elo_t b)
+{
+    player_elo_t q_a, q_b;
+
+    q_a = pow(10.0, a / 400.0);
+    q_b = pow(10.0, b / 400.0);
+
+    return q_a / (q_a + q_b);
+}
+
+void elo_update(player_elo_t *winner, player_elo_t *loser,
+                int winner_games, int loser_games)
+{
+    player_elo_t e_w, e_l;
+
+    e_w = elo_expected(*winner, *loser);
+    e_l = elo_expected(*loser, *winner);
+
+    *winner += elo_k_factor(winner_games) * (1.0 - e_w);
+    *loser += elo_k_factor(loser_games) * (0.0 - e_l);
+}
@@ -0,0 +1,63 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ELO_H
+#define ELO_H
+
+/* Elo ratings are stored as doubles so small updates don't get
+ * rounded away, they're only truncated for display. */
+typedef double player_elo_t;
+
+/* The rating every player starts out with before having played any
+ * games. */
+player_elo_t elo_default(void);
+
+/* Players move through a fixed number of K factor phases as they play
+ * more games, starting out volatile and settling down over time. */
+#define ELO_K_PHASES 3
+
+/* Returns the K factor phase (from 0 up to ELO_K_PHASES - 1) for a
+ * player that has already played the given number of games. */
+int elo_k_phase(int games);
+
+/* Returns the K factor used during the given phase. */
+int elo_phase_k_factor(int phase);
+
+/* Returns the K factor used for a player that has already played the
+ * given number of games. */
+int elo_k_factor(int games);
+
+/* Returns TRUE if a player that has already played the given number
+ * of games is eligible to have a peak Elo recorded. */
+int elo_counts_for_peak(int games);
+
+/* Returns the expected score of a player rated "a" against a player
+ * rated "b", which is the probability that "a" wins. */
+player_elo_t elo_expected(player_elo_t a, player_elo_t b);
+
+/* Updates the ratings of the winner and loser of a single game, given
+ * how many games each of them had played before this one.  This is
+ * the whole rating system, so everything that replays games (and not
+ * just player_win()) should go through here. */
+void elo_update(player_elo_t *winner, player_elo_t *loser,
+                int winner_games, int loser_games);
+
+#endif
@@ -0,0 +1,387 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "extsort.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <unistd.h>
+
+/* The stdio buffer given to each run. */
+#ifndef EXTSORT_RUN_BUFFER
+#define EXTSORT_RUN_BUFFER (32 * 1024)
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct extsort
+{
+    const char *dir;
+
+    /* The run that's currently being filled. */
+    struct extsort_record *records;
+    size_t used;
+    size_t run_records;
+
+    /* Every run that's been spilled, oldest first.  The files are
+     * unlinked as soon as they're created, so they go away on their
+     * own. */
+    FILE **runs;
+    size_t run_count;
+    size_t run_alloc;
+
+    uint64_t count;
+    int walked;
+};
+
+/* The next record from each run that's being merged, kept as a binary
+ * min-heap. */
+struct merge_head
+{
+    struct extsort_record record;
+    FILE *run;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int extsort_destructor(struct extsort *es);
+
+/* Sorts the current run and writes it out to a new temporary file. */
+static int spill(struct extsort *es);
+static FILE *new_run(struct extsort *es);
+static int add_run(struct extsort *es, FILE *run);
+
+/* Merges the given runs, passing every record to the function in
+ * order. */
+static int merge(FILE **runs, size_t count,
+                 int (*func) (const struct extsort_record *, void *),
+                 void *arg);
+static void sift_down(struct merge_head *heap, size_t count, size_t i);
+
+static int write_record(const struct extsort_record *r, void *run);
+static int compare_records(const void *a, const void *b);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct extsort *extsort_new(void *ctx, const char *dir, size_t run_records)
+{
+    struct extsort *es;
+
+    es = talloc(ctx, struct extsort);
+    if (es == NULL)
+        return NULL;
+
+    if (run_records == 0)
+        run_records = EXTSORT_RUN_RECORDS;
+
+    es->dir = talloc_strdup(es, dir);
+    es->records = talloc_array(es, struct extsort_record, run_records);
+    es->used = 0;
+    es->run_records = run_records;
+    es->runs = NULL;
+    es->run_count = 0;
+    es->run_alloc = 0;
+    es->count = 0;
+    es->walked = 0;
+    talloc_set_destructor(es, &extsort_destructor);
+
+    if (es->dir == NULL || es->records == NULL)
+    {
+        TALLOC_FREE(es);
+        return NULL;
+    }
+
+    return es;
+}
+
+int extsort_add(struct extsort *es, const struct extsort_record *r)
+{
+    if (es->walked)
+        return -1;
+
+    if (es->used == es->run_records && spill(es) != 0)
+        return -1;
+
+    es->records[es->used++] = *r;
+    es->count++;
+    return 0;
+}
+
+uint64_t extsort_count(struct extsort *es)
+{
+    return es->count;
+}
+
+size_t extsort_run_count(struct extsort *es)
+{
+    return es->run_count;
+}
+
+int extsort_each(struct extsort *es,
+                 int (*func) (const struct extsort_record *, void *),
+                 void *arg)
+{
+    size_t i;
+
+    if (es->walked)
+        return -1;
+    es->walked = 1;
+
+    /* Everything fit in memory, so there's nothing to merge. */
+    if (es->run_count == 0)
+    {
+        qsort(es->records, es->used, sizeof(*es->records),
+              &compare_records);
+        for (i = 0; i < es->used; i++)
+        {
+            int ret;
+
+            if ((ret = func(es->records + i, arg)) != 0)
+                return ret;
+        }
+
+        return 0;
+    }
+
+    if (es->used > 0 && spill(es) != 0)
+        return -1;
+    TALLOC_FREE(es->records);
+
+    /* Too many runs to merge at once are merged into longer ones
+     * first, oldest first, so every record is written the same number
+     * of times give or take one. */
+    i = 0;
+    while (es->run_count - i > EXTSORT_MERGE_WAY)
+    {
+        FILE *run;
+        size_t j;
+
+        run = new_run(es);
+        if (run == NULL
+            || merge(es->runs + i, EXTSORT_MERGE_WAY, &write_record,
+                     run) != 0
+            || fflush(run) != 0 || add_run(es, run) != 0)
+        {
+            if (run != NULL)
+                fclose(run);
+            return -1;
+        }
+
+        for (j = i; j < i + EXTSORT_MERGE_WAY; j++)
+        {
+            fclose(es->runs[j]);
+            es->runs[j] = NULL;
+        }
+        i += EXTSORT_MERGE_WAY;
+    }
+
+    return merge(es->runs + i, es->run_count - i, func, arg);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int extsort_destructor(struct extsort *es)
+{
+    size_t i;
+
+    for (i = 0; i < es->run_count; i++)
+        if (es->runs[i] != NULL)
+            fclose(es->runs[i]);
+
+    return 0;
+}
+
+int spill(struct extsort *es)
+{
+    FILE *run;
+
+    qsort(es->records, es->used, sizeof(*es->records), &compare_records);
+
+    run = new_run(es);
+    if (run == NULL)
+        return -1;
+
+    if (fwrite(es->records, sizeof(*es->records), es->used, run)
+        != es->used || fflush(run) != 0 || add_run(es, run) != 0)
+    {
+        perror("Unable to spill a run");
+        fclose(run);
+        return -1;
+    }
+
+    es->used = 0;
+    return 0;
+}
+
+FILE *new_run(struct extsort *es)
+{
+    char *path;
+    int fd;
+    FILE *run;
+
+    path = talloc_asprintf(es, "%s/bwelo-run-XXXXXX", es->dir);
+    if (path == NULL)
+        return NULL;
+
+    fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror(path);
+        TALLOC_FREE(path);
+        return NULL;
+    }
+
+    unlink(path);
+    TALLOC_FREE(path);
+
+    run = fdopen(fd, "w+b");
+    if (run == NULL)
+        close(fd);
+    else
+        setvbuf(run, NULL, _IOFBF, EXTSORT_RUN_BUFFER);
+
+    return run;
+}
+
+int add_run(struct extsort *es, FILE *run)
+{
+    if (es->run_count == es->run_alloc)
+    {
+        FILE **grown;
+        size_t alloc;
+
+        alloc = (es->run_alloc == 0) ? 16 : es->run_alloc * 2;
+        grown = talloc_realloc(es, es->runs, FILE *, alloc);
+        if (grown == NULL)
+            return -1;
+
+        es->runs = grown;
+        es->run_alloc = alloc;
+    }
+
+    es->runs[es->run_count++] = run;
+    return 0;
+}
+
+int merge(FILE **runs, size_t count,
+          int (*func) (const struct extsort_record *, void *), void *arg)
+{
+    struct merge_head *heap;
+    size_t live;
+    size_t i;
+    int ret;
+
+    heap = talloc_array(NULL, struct merge_head, count);
+    if (heap == NULL)
+        return -1;
+
+    live = 0;
+    for (i = 0; i < count; i++)
+    {
+        rewind(runs[i]);
+
+        if (fread(&heap[live].record, sizeof(heap[live].record), 1,
+                  runs[i]) == 1)
+        {
+            heap[live].run = runs[i];
+            live++;
+        }
+    }
+
+    for (i = live; i-- > 0;)
+        sift_down(heap, live, i);
+
+    /* The smallest record is always at the top, it's replaced by the
+     * next one from the same run. */
+    ret = 0;
+    while (live > 0)
+    {
+        if ((ret = func(&heap[0].record, arg)) != 0)
+            break;
+
+        if (fread(&heap[0].record, sizeof(heap[0].record), 1,
+                  heap[0].run) != 1)
+        {
+            if (ferror(heap[0].run))
+            {
+                ret = -1;
+                break;
+            }
+
+            heap[0] = heap[--live];
+        }
+
+        sift_down(heap, live, 0);
+    }
+
+    TALLOC_FREE(heap);
+    return ret;
+}
+
+void sift_down(struct merge_head *heap, size_t count, size_t i)
+{
+    for (;;)
+    {
+        struct merge_head tmp;
+        size_t smallest, child;
+
+        smallest = i;
+        for (child = 2 * i + 1; child <= 2 * i + 2 && child < count;
+             child++)
+            if (compare_records(&heap[child].record,
+                                &heap[smallest].record) < 0)
+                smallest = child;
+
+        if (smallest == i)
+            return;
+
+        tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+int write_record(const struct extsort_record *r, void *run)
+{
+    return (fwrite(r, sizeof(*r), 1, run) == 1) ? 0 : -1;
+}
+
+int compare_records(const void *a_uncast, const void *b_uncast)
+{
+    const struct extsort_record *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    if (a->game.time != b->game.time)
+        return (a->game.time > b->game.time) ? 1 : -1;
+
+    return (a->order > b->order) - (a->order < b->order);
+}
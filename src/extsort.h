@@ -0,0 +1,76 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+/* Sorts compact game records into chronological order when there are
+ * too many of them to hold in memory at once.  Records are collected
+ * into fixed-size runs, each of which is sorted and spilled to a
+ * temporary file as it fills up, and the runs are then merged back
+ * together while they're walked.  Only one run's worth of records and
+ * a small buffer per run are ever in memory. */
+struct extsort;
+
+#include "timeline.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of records in each run, unless told otherwise. */
+#ifndef EXTSORT_RUN_RECORDS
+#define EXTSORT_RUN_RECORDS (1 << 20)
+#endif
+
+/* The most runs merged at once.  When there are more than this, runs
+ * are merged into longer ones first. */
+#ifndef EXTSORT_MERGE_WAY
+#define EXTSORT_MERGE_WAY 128
+#endif
+
+/* A single game to sort.  Games are ordered by time, and then by
+ * "order" for games from the same time. */
+struct extsort_record
+{
+    struct timeline_game game;
+    uint64_t order;
+};
+
+/* Creates an empty sorter that spills its runs into the given
+ * directory.  A "run_records" of 0 uses EXTSORT_RUN_RECORDS. */
+struct extsort *extsort_new(void *ctx, const char *dir, size_t run_records);
+
+/* Adds a record, spilling a run if that fills one up.  Returns 0 on
+ * success. */
+int extsort_add(struct extsort *es, const struct extsort_record *r);
+
+/* Returns the number of records added, and the number of runs that
+ * have been spilled to disk. */
+uint64_t extsort_count(struct extsort *es);
+size_t extsort_run_count(struct extsort *es);
+
+/* Walks through every record in sorted order.  This can only be done
+ * once, and nothing can be added afterwards. */
+int extsort_each(struct extsort *es,
+                 int (*func) (const struct extsort_record *, void *),
+                 void *arg);
+
+#endif
@@ -20,14 +20,26 @@
  */
 
 #include "game.h"
+#include "arena.h"
+#include "stats.h"
 
 #include <talloc.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifndef LINE_MAX
 #define LINE_MAX 1024
 #endif
 
+/* Turns the value of a macro into a string literal, so LINE_MAX can be
+ * spliced into the sscanf() format below. */
+#define STRINGIFY(x) STRINGIFY_VALUE(x)
+#define STRINGIFY_VALUE(x) #x
+
+/* The field widths keep sscanf() inside the LINE_MAX+1 buffers. */
+#define LINE_FORMAT "%ld %" STRINGIFY(LINE_MAX) "s %" STRINGIFY(LINE_MAX) \
+    "s %1c %" STRINGIFY(LINE_MAX) "s"
+
 /***********************************************************************
  * Structures                                                          *
  ***********************************************************************/
@@ -55,6 +67,26 @@ struct game
     game_time_t start_time;
 };
 
+/* The parts of a line from a league file.  The winner and loser point
+ * at the player keys. */
+struct game_line
+{
+    game_time_t time;
+    char map_key[LINE_MAX + 1];
+    char player_1_key[LINE_MAX + 1];
+    char player_2_key[LINE_MAX + 1];
+
+    const char *winner_key;
+    const char *loser_key;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Splits up a line from a league file, returning 0 on success. */
+static int parse_line(const char *desc, struct game_line *line);
+
 /***********************************************************************
  * Extern Methods                                                      *
  ***********************************************************************/
@@ -68,74 +100,132 @@ int game_compare_time(const struct game *a, const struct game *b)
         return 0;
 }
 
+struct game *game_new(void *ctx, game_time_t time, const char *map_key,
+                      const char *winner_key, const char *loser_key,
+                      const char *league_name)
+{
+    struct game *game;
+
+    game = talloc(ctx, struct game);
+    if (game == NULL)
+        return NULL;
+
+    game->start_time = time;
+    game->league_name = stats_reference(game, league_name);
+    game->map_key = talloc_strdup(game, map_key);
+    game->winner_key = talloc_strdup(game, winner_key);
+    game->loser_key = talloc_strdup(game, loser_key);
+    game->round = NULL;
+    game->group = NULL;
+
+    if (game->map_key == NULL || game->winner_key == NULL
+        || game->loser_key == NULL)
+    {
+        TALLOC_FREE(game);
+        return NULL;
+    }
+
+    return stats_track(game, STATS_MEMORY_GAMES);
+}
+
+int game_same(struct game *a, struct game *b)
+{
+    return a->start_time == b->start_time
+        && strcmp(a->map_key, b->map_key) == 0
+        && strcmp(a->winner_key, b->winner_key) == 0
+        && strcmp(a->loser_key, b->loser_key) == 0;
+}
+
 struct game *game_parse(void *ctx, const char *desc,
                         const char *league_name,
                         const char *round, const char *group)
 {
-    void *tmp;
-    game_time_t start_date;
-    char map_key[LINE_MAX];
-    char player_1_key[LINE_MAX];
-    char player_2_key[LINE_MAX];
-    char winner;
-    int count;
-    const char *format;
+    struct game_line line;
     struct game *game;
 
-    game = NULL;
-    tmp = talloc_new(ctx);
-    if (tmp == NULL)
+    if (parse_line(desc, &line) != 0)
         return NULL;
 
-    /* The sscanf format string needs to be generated in order to
-     * insert those LINE_MAX width specifiers to avoid buffer
-     * overflows. */
-    format = talloc_asprintf(tmp, "%%ld %%%ds %%%ds %%1c %%%ds",
-                             LINE_MAX, LINE_MAX, LINE_MAX);
-    if (format == NULL)
-        goto failure;
-    count = sscanf(desc, format, &start_date, map_key, player_1_key,
-                   &winner, player_2_key);
-    if (count != 5)
-        goto failure;
-
     /* Fills out a new game. */
     game = talloc(ctx, struct game);
     if (game == NULL)
-        goto failure;
+        return NULL;
 
-    game->start_time = start_date;
-    game->league_name = talloc_reference(game, league_name);
-    game->map_key = talloc_strdup(game, map_key);
-    game->round = talloc_reference(game, round);
+    game->start_time = line.time;
+    game->league_name = stats_reference(game, league_name);
+    game->map_key = talloc_strdup(game, line.map_key);
+    game->round = stats_reference(game, round);
 
     if (group != NULL)
-        game->group = talloc_reference(game, group);
+        game->group = stats_reference(game, group);
     else
         game->group = NULL;
 
-    if (winner == '>')
+    game->winner_key = talloc_strdup(game, line.winner_key);
+    game->loser_key = talloc_strdup(game, line.loser_key);
+    if (game->map_key == NULL || game->winner_key == NULL
+        || game->loser_key == NULL)
     {
-        game->winner_key = talloc_strdup(game, player_1_key);
-        game->loser_key = talloc_strdup(game, player_2_key);
-    }
-    else if (winner == '<')
-    {
-        game->winner_key = talloc_strdup(game, player_2_key);
-        game->loser_key = talloc_strdup(game, player_1_key);
+        TALLOC_FREE(game);
+        return NULL;
     }
-    else
-        goto failure;
 
-    TALLOC_FREE(tmp);
+    return stats_track(game, STATS_MEMORY_GAMES);
+}
+
+struct game *game_parse_arena(struct arena *a, const char *desc,
+                              const char *league_name,
+                              const char *round, const char *group)
+{
+    struct game_line line;
+    struct game *game;
+
+    if (parse_line(desc, &line) != 0)
+        return NULL;
+
+    game = arena_alloc(a, sizeof(*game));
+    if (game == NULL)
+        return NULL;
+
+    game->start_time = line.time;
+    game->league_name = league_name;
+    game->round = round;
+    game->group = group;
+    game->map_key = arena_intern(a, line.map_key);
+    game->winner_key = arena_intern(a, line.winner_key);
+    game->loser_key = arena_intern(a, line.loser_key);
+    if (game->map_key == NULL || game->winner_key == NULL
+        || game->loser_key == NULL)
+        return NULL;
+
     return game;
+}
 
-  failure:
-    if (game != NULL)
-        TALLOC_FREE(game);
+struct game *game_copy(struct arena *a, struct game *game,
+                       const char *league_name)
+{
+    struct game *copy;
 
-    TALLOC_FREE(tmp);
-    return NULL;
+    copy = arena_alloc(a, sizeof(*copy));
+    if (copy == NULL)
+        return NULL;
+
+    copy->start_time = game->start_time;
+    copy->league_name = league_name;
+    copy->round = NULL;
+    copy->group = NULL;
+    if (game->round != NULL)
+        copy->round = arena_intern(a, game->round);
+    if (game->group != NULL)
+        copy->group = arena_intern(a, game->group);
+    copy->map_key = arena_intern(a, game->map_key);
+    copy->winner_key = arena_intern(a, game->winner_key);
+    copy->loser_key = arena_intern(a, game->loser_key);
+    if (copy->map_key == NULL || copy->winner_key == NULL
+        || copy->loser_key == NULL)
+        return NULL;
+
+    return copy;
 }
 
 const char *game_winner_key(struct game *game)
@@ -162,3 +252,33 @@ const char *game_map_key(struct game *game)
 {
     return game->map_key;
 }
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int parse_line(const char *desc, struct game_line *line)
+{
+    long time;
+    char winner;
+
+    if (sscanf(desc, LINE_FORMAT, &time, line->map_key, line->player_1_key,
+               &winner, line->player_2_key) != 5)
+        return -1;
+    stats_count(STATS_GAMES_PARSED, 1);
+
+    line->time = time;
+    if (winner == '>')
+    {
+        line->winner_key = line->player_1_key;
+        line->loser_key = line->player_2_key;
+    }
+    else if (winner == '<')
+    {
+        line->winner_key = line->player_2_key;
+        line->loser_key = line->player_1_key;
+    }
+    else
+        return -1;
+
+    return 0;
+}
@@ -25,6 +25,7 @@
 #include <stdint.h>
 
 struct game;
+struct arena;
 
 /* Game times are stored as UNIX time, in seconds, in this format.  -1
  * means an unknown time. */
@@ -34,6 +35,10 @@ typedef int64_t game_time_t;
  * if a is newer than b, and -1 if b is newer than a. */
 int game_compare_time(const struct game *a, const struct game *b);
 
+/* Returns 1 if both games were played at the same time on the same
+ * map with the same result, and 0 otherwise. */
+int game_same(struct game *a, struct game *b);
+
 /* Parses a game given a string read directly from the game listing
  * file.  This string should have the "GAME " part stripped
  * already. */
@@ -41,6 +46,23 @@ struct game *game_parse(void *ctx, const char *desc,
                         const char *league_name,
                         const char *round, const char *group);
 
+/* Parses a game just like game_parse(), but puts it in an arena, where
+ * the keys are interned.  Nothing is copied from the league name, the
+ * round or the group, so they must last as long as the arena does. */
+struct game *game_parse_arena(struct arena *a, const char *desc,
+                              const char *league_name,
+                              const char *round, const char *group);
+
+/* Copies a game into an arena, just like game_parse_arena() would have
+ * put it there. */
+struct game *game_copy(struct arena *a, struct game *game,
+                       const char *league_name);
+
+/* Creates a game from its parts, copying the keys. */
+struct game *game_new(void *ctx, game_time_t time, const char *map_key,
+                      const char *winner_key, const char *loser_key,
+                      const char *league_name);
+
 /* Returns (as a key) the winner/loser of a given game.  This will be
  * a pointer into the game structure, so don't expect it to exist for
  * long -- reference if you want it to stick around. */
@@ -0,0 +1,349 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "game_index.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+
+/* Every matchup, as a pair of races. */
+#define MATCHUP_COUNT (RACE_COUNT * RACE_COUNT)
+
+/* The most sets a single filter can use. */
+#define FILTER_MAX_SETS 6
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* One bitmap of rows for every key. */
+struct game_sets
+{
+    struct bitmap **rows;
+    size_t keys;
+};
+
+struct game_index
+{
+    struct timeline_game *games;
+    size_t count;
+
+    struct game_sets players;
+    struct game_sets maps;
+    struct game_sets leagues;
+    struct game_sets matchups;
+    struct game_sets won;
+};
+
+/* Hands the rows of a filter on to its caller. */
+struct filter_state
+{
+    int (*func) (size_t row, void *);
+    void *arg;
+    size_t matched;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int new_sets(struct game_index *gi, struct game_sets *s,
+                    size_t keys);
+static int add_row(struct game_sets *s, size_t key, size_t row);
+
+/* Adds the set for a key to a filter's list of sets.  Returns -1 if
+ * there's no such key. */
+static int add_set(struct game_index *gi, const struct bitmap **sets,
+                   int *count, enum game_set set, int key);
+
+static int compare_cardinality(const void *a, const void *b);
+static int pass_row(uint32_t row, void *state_uncast);
+
+/* Returns the first row played at or after the given time. */
+static size_t time_lower_bound(struct game_index *gi, game_time_t time);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct game_index *game_index_new(void *ctx, struct timeline *tl)
+{
+    struct game_index *gi;
+    size_t row;
+
+    gi = talloc(ctx, struct game_index);
+    if (gi == NULL)
+        return NULL;
+
+    gi->count = timeline_game_count(tl);
+    gi->games = talloc_array(gi, struct timeline_game, gi->count + 1);
+    if (gi->games == NULL)
+        goto failure;
+    memcpy(gi->games, timeline_games(tl), gi->count * sizeof(*gi->games));
+
+    if (new_sets(gi, &gi->players, timeline_player_count(tl)) != 0
+        || new_sets(gi, &gi->maps, timeline_map_count(tl)) != 0
+        || new_sets(gi, &gi->leagues, timeline_league_count(tl)) != 0
+        || new_sets(gi, &gi->matchups, MATCHUP_COUNT) != 0
+        || new_sets(gi, &gi->won, MATCHUP_COUNT) != 0)
+        goto failure;
+
+    /* Rows are added in order, so every bitmap is only ever appended
+     * to. */
+    for (row = 0; row < gi->count; row++)
+    {
+        const struct timeline_game *g;
+        enum race wr, lr;
+
+        g = gi->games + row;
+        wr = player_race(timeline_player(tl, g->winner));
+        lr = player_race(timeline_player(tl, g->loser));
+
+        if (add_row(&gi->players, g->winner, row) != 0
+            || add_row(&gi->players, g->loser, row) != 0
+            || add_row(&gi->maps, g->map, row) != 0
+            || add_row(&gi->leagues, g->league, row) != 0
+            || add_row(&gi->matchups, game_index_matchup(wr, lr), row) != 0
+            || add_row(&gi->won, game_index_won(wr, lr), row) != 0)
+            goto failure;
+    }
+
+    return gi;
+
+  failure:
+    TALLOC_FREE(gi);
+    return NULL;
+}
+
+size_t game_index_count(struct game_index *gi)
+{
+    return gi->count;
+}
+
+const struct timeline_game *game_index_game(struct game_index *gi,
+                                            size_t row)
+{
+    return gi->games + row;
+}
+
+int game_index_matchup(enum race a, enum race b)
+{
+    if (a > b)
+        return b * RACE_COUNT + a;
+
+    return a * RACE_COUNT + b;
+}
+
+int game_index_won(enum race winner, enum race loser)
+{
+    return winner * RACE_COUNT + loser;
+}
+
+const struct bitmap *game_index_set(struct game_index *gi,
+                                    enum game_set set, int key)
+{
+    struct game_sets *s;
+
+    switch (set)
+    {
+    case GAME_SET_PLAYER:
+        s = &gi->players;
+        break;
+    case GAME_SET_MAP:
+        s = &gi->maps;
+        break;
+    case GAME_SET_LEAGUE:
+        s = &gi->leagues;
+        break;
+    case GAME_SET_MATCHUP:
+        s = &gi->matchups;
+        break;
+    case GAME_SET_WON:
+        s = &gi->won;
+        break;
+    default:
+        return NULL;
+    }
+
+    if (key < 0 || (size_t)key >= s->keys)
+        return NULL;
+
+    return s->rows[key];
+}
+
+struct bitmap *game_index_range(struct game_index *gi, void *ctx,
+                                game_time_t from, game_time_t to)
+{
+    struct bitmap *b;
+    size_t lo, hi;
+
+    b = bitmap_new(ctx);
+    if (b == NULL)
+        return NULL;
+
+    /* Rows are sorted by time, so any range of times is a range of
+     * rows. */
+    lo = (from >= 0) ? time_lower_bound(gi, from) : 0;
+    hi = (to >= 0) ? time_lower_bound(gi, to + 1) : gi->count;
+    if (lo < hi && bitmap_add_range(b, lo, hi) != 0)
+        TALLOC_FREE(b);
+
+    return b;
+}
+
+void game_filter_init(struct game_filter *f)
+{
+    f->player = -1;
+    f->opponent = -1;
+    f->map = -1;
+    f->league = -1;
+    f->matchup = -1;
+    f->won = -1;
+    f->from = -1;
+    f->to = -1;
+}
+
+size_t game_index_filter(struct game_index *gi, const struct game_filter *f,
+                         int (*func) (size_t row, void *), void *arg)
+{
+    const struct bitmap *sets[FILTER_MAX_SETS];
+    struct filter_state state;
+    const struct bitmap *rows;
+    void *ctx;
+    int count;
+    int i;
+
+    count = 0;
+    if (add_set(gi, sets, &count, GAME_SET_PLAYER, f->player) != 0
+        || add_set(gi, sets, &count, GAME_SET_PLAYER, f->opponent) != 0
+        || add_set(gi, sets, &count, GAME_SET_MAP, f->map) != 0
+        || add_set(gi, sets, &count, GAME_SET_LEAGUE, f->league) != 0
+        || add_set(gi, sets, &count, GAME_SET_MATCHUP, f->matchup) != 0
+        || add_set(gi, sets, &count, GAME_SET_WON, f->won) != 0)
+        return 0;
+
+    ctx = talloc_new(NULL);
+    if (ctx == NULL)
+        return 0;
+
+    /* The smallest sets are intersected first, so everything after
+     * that is as small as it can be. */
+    qsort(sets, count, sizeof(*sets), &compare_cardinality);
+
+    /* The time range is only needed when it leaves something out. */
+    i = 0;
+    if (count == 0 || f->from >= 0 || f->to >= 0)
+        rows = game_index_range(gi, ctx, f->from, f->to);
+    else
+        rows = sets[i++];
+    for (; rows != NULL && i < count; i++)
+        rows = bitmap_and(ctx, sets[i], rows);
+
+    state.func = func;
+    state.arg = arg;
+    state.matched = 0;
+    if (rows != NULL)
+        bitmap_each(rows, &pass_row, &state);
+
+    TALLOC_FREE(ctx);
+    return state.matched;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int new_sets(struct game_index *gi, struct game_sets *s, size_t keys)
+{
+    size_t k;
+
+    s->keys = keys;
+    s->rows = talloc_array(gi, struct bitmap *, keys + 1);
+    if (s->rows == NULL)
+        return -1;
+
+    for (k = 0; k < keys; k++)
+        if ((s->rows[k] = bitmap_new(s->rows)) == NULL)
+            return -1;
+
+    return 0;
+}
+
+int add_row(struct game_sets *s, size_t key, size_t row)
+{
+    if (key >= s->keys)
+        return 0;
+
+    return bitmap_add(s->rows[key], row);
+}
+
+int add_set(struct game_index *gi, const struct bitmap **sets, int *count,
+            enum game_set set, int key)
+{
+    const struct bitmap *b;
+
+    if (key < 0)
+        return 0;
+
+    b = game_index_set(gi, set, key);
+    if (b == NULL)
+        return -1;
+
+    sets[(*count)++] = b;
+    return 0;
+}
+
+int compare_cardinality(const void *a_uncast, const void *b_uncast)
+{
+    uint64_t a, b;
+
+    a = bitmap_cardinality(*(const struct bitmap *const *)a_uncast);
+    b = bitmap_cardinality(*(const struct bitmap *const *)b_uncast);
+    return (a > b) - (a < b);
+}
+
+int pass_row(uint32_t row, void *state_uncast)
+{
+    struct filter_state *state;
+
+    state = state_uncast;
+    state->matched++;
+    return state->func(row, state->arg);
+}
+
+size_t time_lower_bound(struct game_index *gi, game_time_t time)
+{
+    size_t lo, hi;
+
+    lo = 0;
+    hi = gi->count;
+    while (lo < hi)
+    {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if (gi->games[mid].time < time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
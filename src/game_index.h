@@ -0,0 +1,105 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GAME_INDEX_H
+#define GAME_INDEX_H
+
+/* Secondary indexes over every game in a timeline, so games can be
+ * found without walking all of them.  Rows are positions in the
+ * timeline, which is already sorted by time, so the time index is just
+ * a binary search.  Every player, map, league and race matchup gets a
+ * compressed bitmap of the rows it's in, and a filter intersects
+ * whichever of those it needs.  Like the query tables everything is
+ * copied, so an index never changes once it's built. */
+struct game_index;
+
+#include "bitmap.h"
+#include "timeline.h"
+#include "race.h"
+
+#include <stddef.h>
+
+/* Picks out games.  Anything that's -1 matches every game.  The times
+ * are both inclusive. */
+struct game_filter
+{
+    /* Games this player played, optionally only against another. */
+    int player;
+    int opponent;
+
+    int map;
+    int league;
+
+    /* See game_index_matchup() and game_index_won(). */
+    int matchup;
+    int won;
+
+    game_time_t from;
+    game_time_t to;
+};
+
+/* The sets of rows that are indexed. */
+enum game_set
+{
+    GAME_SET_PLAYER,
+    GAME_SET_MAP,
+    GAME_SET_LEAGUE,
+    GAME_SET_MATCHUP,
+    GAME_SET_WON
+};
+
+/* Builds the indexes for every game in the timeline, as played by the
+ * races the players have now. */
+struct game_index *game_index_new(void *ctx, struct timeline *tl);
+
+/* Returns the number of games indexed, and a single game by row. */
+size_t game_index_count(struct game_index *gi);
+const struct timeline_game *game_index_game(struct game_index *gi,
+                                            size_t row);
+
+/* Returns the matchup for a game between the two races, which is the
+ * same whichever order they're given in. */
+int game_index_matchup(enum race a, enum race b);
+
+/* Returns the key for games one race won against another. */
+int game_index_won(enum race winner, enum race loser);
+
+/* Returns the rows of every game with the given key, or NULL if there
+ * is no such key.  These can be combined with the bitmap operations
+ * for anything a filter can't express. */
+const struct bitmap *game_index_set(struct game_index *gi,
+                                    enum game_set set, int key);
+
+/* Returns a new bitmap of every row played between the two times,
+ * either of which can be -1 to leave that end open. */
+struct bitmap *game_index_range(struct game_index *gi, void *ctx,
+                                game_time_t from, game_time_t to);
+
+/* Sets a filter up to match every game. */
+void game_filter_init(struct game_filter *f);
+
+/* Passes the row of every game that matches the filter to the given
+ * function, oldest first, stopping early if it returns non-zero.
+ * Returns the number of matching rows that were passed along. */
+size_t game_index_filter(struct game_index *gi, const struct game_filter *f,
+                         int (*func) (size_t row, void *), void *arg);
+
+#endif
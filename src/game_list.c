@@ -39,6 +39,9 @@ struct game_list
 {
     struct game_list_node *head;
     struct game_list_node *tail;
+
+    /* Where the nodes come from. */
+    struct arena *arena;
 };
 
 /* Allows for iteration along a list of games. */
@@ -60,6 +63,12 @@ struct game_list *game_list_new(void *ctx)
 
     gl->head = NULL;
     gl->tail = NULL;
+    gl->arena = arena_new(gl, STATS_MEMORY_NODES);
+    if (gl->arena == NULL)
+    {
+        TALLOC_FREE(gl);
+        return NULL;
+    }
 
     return gl;
 }
@@ -68,9 +77,16 @@ int game_list_add(struct game_list *gl, struct game *g)
 {
     struct game_list_node *new;
 
-    new = talloc(gl, struct game_list_node);
+    /* Ensure the games are all added in order */
+    if (gl->tail != NULL && game_compare_time(gl->tail->data, g) != -1)
+        return -1;
+
+    new = arena_alloc(gl->arena, sizeof(*new));
+    if (new == NULL)
+        return -1;
+
     new->next = NULL;
-    new->data = talloc_reference(new, g);
+    new->data = g;
 
     /* Special case for an empty list */
     if (gl->tail == NULL)
@@ -79,18 +95,70 @@ int game_list_add(struct game_list *gl, struct game *g)
         return 0;
     }
 
-    /* Ensure the games are all added in order */
-    if (game_compare_time(gl->tail->data, new->data) != -1)
-    {
-        TALLOC_FREE(new);
+    gl->tail->next = new;
+    gl->tail = new;
+    return 0;
+}
+
+int game_list_insert(struct game_list *gl, struct game *g)
+{
+    struct game_list_node *new;
+    struct game_list_node **cur;
+
+    new = arena_alloc(gl->arena, sizeof(*new));
+    if (new == NULL)
         return -1;
+
+    new->next = NULL;
+    new->data = g;
+
+    if (gl->tail == NULL || game_compare_time(gl->tail->data, g) <= 0)
+    {
+        if (gl->tail == NULL)
+            gl->head = new;
+        else
+            gl->tail->next = new;
+
+        gl->tail = new;
+        return 0;
     }
 
-    gl->tail->next = new;
-    gl->tail = new;
+    cur = &gl->head;
+    while (game_compare_time((*cur)->data, g) <= 0)
+        cur = &(*cur)->next;
+
+    new->next = *cur;
+    *cur = new;
     return 0;
 }
 
+int game_list_remove(struct game_list *gl, struct game *g)
+{
+    struct game_list_node **cur;
+    struct game_list_node *prev;
+
+    prev = NULL;
+    for (cur = &gl->head; *cur != NULL; cur = &(*cur)->next)
+    {
+        struct game_list_node *old;
+
+        if (!game_same((*cur)->data, g))
+        {
+            prev = *cur;
+            continue;
+        }
+
+        old = *cur;
+        *cur = old->next;
+        if (gl->tail == old)
+            gl->tail = prev;
+
+        return 0;
+    }
+
+    return -1;
+}
+
 struct game_list_iterator *game_list_iterator_new(void *c,
                                                   struct game_list *gl)
 {
@@ -24,13 +24,16 @@
 
 struct game_list;
 
+#include "arena.h"
 #include "game.h"
 #include <stdint.h>
 
 /* Allows for iteration along a list of games. */
 struct game_list_iterator;
 
-/* Creates an empty list of games */
+/* Creates an empty list of games, whose nodes come out of an arena of
+ * the list's own.  The list doesn't hold on to its games, so they have
+ * to last as long as it does. */
 struct game_list *game_list_new(void *c);
 
 /* Adds the given game to the end of the list.  This checks that the
@@ -38,6 +41,16 @@ struct game_list *game_list_new(void *c);
  * error if it's not.  Returns 0 on success. */
 int game_list_add(struct game_list *gl, struct game *g);
 
+/* Adds the given game in chronological order, after any games from
+ * the same time.  Games that are newest go straight on the end, older
+ * ones have to walk the list.  Returns 0 on success. */
+int game_list_insert(struct game_list *gl, struct game *g);
+
+/* Removes the first game that's the same as the given one, as
+ * game_same() sees it.  Returns 0 if there was such a game.  Its node
+ * is only given back when the list is freed. */
+int game_list_remove(struct game_list *gl, struct game *g);
+
 /* Creates a new game list iterator that points to the start of the list. */
 struct game_list_iterator *game_list_iterator_new(void *c,
                                                   struct game_list *gl);
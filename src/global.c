@@ -23,3 +23,12 @@
 
 struct player_list *global_player_list = NULL;
 struct map_list *global_map_list = NULL;
+struct timeline *global_timeline = NULL;
+struct matchup_table *global_matchup_table = NULL;
+struct rank_tree *global_rank_tree = NULL;
+struct pool_set *global_pool_set = NULL;
+struct rating_history *global_rating_history = NULL;
+struct h2h_table *global_h2h_table = NULL;
+struct performance_table *global_performance_table = NULL;
+struct race_stats *global_race_stats = NULL;
+struct period_table *global_period_table = NULL;
@@ -24,6 +24,16 @@
 
 #include "player_list.h"
 #include "map_list.h"
+#include "matchup.h"
+#include "rank.h"
+#include "pool.h"
+#include "history.h"
+#include "h2h.h"
+#include "performance.h"
+#include "race_stats.h"
+#include "period.h"
+
+struct timeline;
 
 /* Stores a list of all the players that have ever played.  This
  * exists to avoid having to pass this player list to whole bunch of
@@ -34,4 +44,41 @@ extern struct player_list *global_player_list;
  * it. */
 extern struct map_list *global_map_list;
 
+/* Every game that's been played, in order.  This is NULL until the
+ * leagues have been read. */
+extern struct timeline *global_timeline;
+
+/* Stores every player's rating against each race, indexed by the
+ * player's index.  This is NULL until the games have been indexed. */
+extern struct matchup_table *global_matchup_table;
+
+/* Tracks every player's rank, along with how ranks changed over time.
+ * This is NULL until the games have been indexed. */
+extern struct rank_tree *global_rank_tree;
+
+/* Every named rating pool, each rated from its own subset of the
+ * leagues. */
+extern struct pool_set *global_pool_set;
+
+/* Every player's rating after each of their games. */
+extern struct rating_history *global_rating_history;
+
+/* How many times every player has beaten every other player, indexed
+ * by the players' indices.  This is NULL until the games have been
+ * indexed. */
+extern struct h2h_table *global_h2h_table;
+
+/* How every player has done on every map, indexed by the players' and
+ * maps' indices.  This is NULL until the games have been indexed. */
+extern struct performance_table *global_performance_table;
+
+/* How every race has done against every other race on each map, in
+ * each league and in each month.  This is NULL until the games have
+ * been indexed. */
+extern struct race_stats *global_race_stats;
+
+/* A snapshot of the ratings and games at the end of every period.
+ * This is NULL until the games have been indexed. */
+extern struct period_table *global_period_table;
+
 #endif
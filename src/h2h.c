@@ -0,0 +1,465 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "h2h.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <talloc.h>
+
+/* The width of a square tile of the dense matrix. */
+#define H2H_BLOCK 16
+
+/* How many pairs the hash table starts out with room for. */
+#ifndef H2H_INITIAL_PAIRS
+#define H2H_INITIAL_PAIRS 1024
+#endif
+
+/* Marks an unused slot of the hash table. */
+#define EMPTY_PAIR UINT32_MAX
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Two players that have played, with "a" the lower index. */
+struct h2h_pair
+{
+    uint32_t a;
+    uint32_t b;
+    uint32_t a_wins;
+    uint32_t b_wins;
+};
+
+/* One of a player's opponents. */
+struct h2h_opponent
+{
+    uint32_t opponent;
+    uint32_t wins;
+    uint32_t losses;
+};
+
+struct h2h_table
+{
+    size_t player_count;
+
+    /* The dense matrix, where the number of times "a" beat "b" is in
+     * the tile at row a / H2H_BLOCK and column b / H2H_BLOCK.  This is
+     * NULL for sparse tables. */
+    uint32_t *cells;
+    size_t blocks;
+
+    /* The hash table of pairs for sparse tables, which is always a
+     * power of two long and at most half full. */
+    struct h2h_pair *pairs;
+    size_t pair_alloc;
+    size_t pair_count;
+
+    /* Every player's opponents in a sparse table, laid out from the
+     * hash table the first time they're walked after a change: player
+     * "p" has opponents[offsets[p]] up to opponents[offsets[p + 1]]. */
+    uint32_t *offsets;
+    struct h2h_opponent *opponents;
+    bool opponents_stale;
+};
+
+/* A copy of whichever of the matrix or the hash table is in use. */
+struct h2h_checkpoint
+{
+    uint32_t *cells;
+    struct h2h_pair *pairs;
+    size_t pair_alloc;
+    size_t pair_count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static uint32_t *cell(struct h2h_table *t, size_t a, size_t b);
+
+/* Finds the slot for a pair in the hash table, which is empty if the
+ * pair hasn't played. */
+static struct h2h_pair *find_pair(struct h2h_pair *pairs, size_t alloc,
+                                  uint32_t a, uint32_t b);
+static int grow_pairs(struct h2h_table *t);
+
+static int build_opponents(struct h2h_table *t);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct h2h_table *h2h_table_new(void *ctx, size_t player_count)
+{
+    struct h2h_table *t;
+    size_t i;
+
+    t = talloc(ctx, struct h2h_table);
+    if (t == NULL)
+        return NULL;
+
+    t->player_count = player_count;
+    t->cells = NULL;
+    t->blocks = 0;
+    t->pairs = NULL;
+    t->pair_alloc = 0;
+    t->pair_count = 0;
+    t->offsets = NULL;
+    t->opponents = NULL;
+    t->opponents_stale = true;
+
+    if (player_count <= H2H_DENSE_MAX)
+    {
+        t->blocks = (player_count + H2H_BLOCK - 1) / H2H_BLOCK;
+        t->cells = talloc_zero_array(t, uint32_t,
+                                     t->blocks * t->blocks * H2H_BLOCK
+                                     * H2H_BLOCK + 1);
+        if (t->cells == NULL)
+            goto failure;
+
+        return t;
+    }
+
+    t->pair_alloc = H2H_INITIAL_PAIRS;
+    t->pairs = talloc_array(t, struct h2h_pair, t->pair_alloc);
+    if (t->pairs == NULL)
+        goto failure;
+    for (i = 0; i < t->pair_alloc; i++)
+        t->pairs[i].a = EMPTY_PAIR;
+
+    return t;
+
+  failure:
+    TALLOC_FREE(t);
+    return NULL;
+}
+
+int h2h_table_win(struct h2h_table *t, int winner, int loser)
+{
+    struct h2h_pair *p;
+
+    if (winner < 0 || loser < 0 || (size_t)winner >= t->player_count
+        || (size_t)loser >= t->player_count || winner == loser)
+        return -1;
+
+    if (t->cells != NULL)
+    {
+        (*cell(t, winner, loser))++;
+        return 0;
+    }
+
+    /* Keeps the table at most half full, so probes stay short. */
+    if ((t->pair_count + 1) * 2 > t->pair_alloc && grow_pairs(t) != 0)
+        return -1;
+
+    if (winner < loser)
+        p = find_pair(t->pairs, t->pair_alloc, winner, loser);
+    else
+        p = find_pair(t->pairs, t->pair_alloc, loser, winner);
+
+    if (p->a == EMPTY_PAIR)
+    {
+        p->a = (winner < loser) ? winner : loser;
+        p->b = (winner < loser) ? loser : winner;
+        p->a_wins = p->b_wins = 0;
+        t->pair_count++;
+    }
+
+    if ((int)p->a == winner)
+        p->a_wins++;
+    else
+        p->b_wins++;
+
+    t->opponents_stale = true;
+    return 0;
+}
+
+struct h2h_checkpoint *h2h_table_checkpoint(void *ctx, struct h2h_table *t)
+{
+    struct h2h_checkpoint *cp;
+
+    cp = talloc_zero(ctx, struct h2h_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    if (t->cells != NULL)
+        cp->cells = talloc_memdup(cp, t->cells,
+                                  (t->blocks * t->blocks * H2H_BLOCK
+                                   * H2H_BLOCK + 1) * sizeof(*t->cells));
+    else
+    {
+        cp->pair_alloc = t->pair_alloc;
+        cp->pair_count = t->pair_count;
+        cp->pairs = talloc_memdup(cp, t->pairs,
+                                  t->pair_alloc * sizeof(*t->pairs));
+    }
+
+    if (cp->cells == NULL && cp->pairs == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    return cp;
+}
+
+int h2h_table_rollback(struct h2h_table *t, const struct h2h_checkpoint *cp)
+{
+    struct h2h_pair *pairs;
+
+    if (t->cells != NULL)
+    {
+        memcpy(t->cells, cp->cells, (t->blocks * t->blocks * H2H_BLOCK
+                                     * H2H_BLOCK + 1) * sizeof(*t->cells));
+        return 0;
+    }
+
+    /* The hash table may have grown since, it goes back to the size it
+     * was so pairs are laid out just as they were. */
+    if (t->pair_alloc != cp->pair_alloc)
+    {
+        pairs = talloc_realloc(t, t->pairs, struct h2h_pair,
+                               cp->pair_alloc);
+        if (pairs == NULL)
+            return -1;
+
+        t->pairs = pairs;
+        t->pair_alloc = cp->pair_alloc;
+    }
+
+    memcpy(t->pairs, cp->pairs, cp->pair_alloc * sizeof(*t->pairs));
+    t->pair_count = cp->pair_count;
+    t->opponents_stale = true;
+    return 0;
+}
+
+int h2h_wins(struct h2h_table *t, int player, int opponent)
+{
+    struct h2h_pair *p;
+
+    if (player < 0 || opponent < 0 || (size_t)player >= t->player_count
+        || (size_t)opponent >= t->player_count || player == opponent)
+        return 0;
+
+    if (t->cells != NULL)
+        return *cell(t, player, opponent);
+
+    if (player < opponent)
+    {
+        p = find_pair(t->pairs, t->pair_alloc, player, opponent);
+        return (p->a == EMPTY_PAIR) ? 0 : (int)p->a_wins;
+    }
+
+    p = find_pair(t->pairs, t->pair_alloc, opponent, player);
+    return (p->a == EMPTY_PAIR) ? 0 : (int)p->b_wins;
+}
+
+int h2h_each_opponent(struct h2h_table *t, int player,
+                      int (*func) (int, int, int, void *), void *arg)
+{
+    size_t i;
+    int ret;
+
+    if (player < 0 || (size_t)player >= t->player_count)
+        return 0;
+
+    /* The whole row and column are only a few tiles. */
+    if (t->cells != NULL)
+    {
+        for (i = 0; i < t->player_count; i++)
+        {
+            uint32_t wins, losses;
+
+            wins = *cell(t, player, i);
+            losses = *cell(t, i, player);
+            if (wins + losses == 0)
+                continue;
+
+            if ((ret = func(i, wins, losses, arg)) != 0)
+                return ret;
+        }
+
+        return 0;
+    }
+
+    if (t->opponents_stale && build_opponents(t) != 0)
+        return -1;
+
+    for (i = t->offsets[player]; i < t->offsets[player + 1]; i++)
+    {
+        const struct h2h_opponent *o;
+
+        o = t->opponents + i;
+        if ((ret = func(o->opponent, o->wins, o->losses, arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int h2h_each_pair(struct h2h_table *t,
+                  int (*func) (int, int, int, int, void *), void *arg)
+{
+    size_t a, b;
+    int ret;
+
+    if (t->cells != NULL)
+    {
+        for (a = 0; a < t->player_count; a++)
+        {
+            for (b = a + 1; b < t->player_count; b++)
+            {
+                uint32_t a_wins, b_wins;
+
+                a_wins = *cell(t, a, b);
+                b_wins = *cell(t, b, a);
+                if (a_wins + b_wins == 0)
+                    continue;
+
+                if ((ret = func(a, b, a_wins, b_wins, arg)) != 0)
+                    return ret;
+            }
+        }
+
+        return 0;
+    }
+
+    for (a = 0; a < t->pair_alloc; a++)
+    {
+        const struct h2h_pair *p;
+
+        p = t->pairs + a;
+        if (p->a == EMPTY_PAIR)
+            continue;
+
+        if ((ret = func(p->a, p->b, p->a_wins, p->b_wins, arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+uint32_t *cell(struct h2h_table *t, size_t a, size_t b)
+{
+    size_t tile;
+
+    tile = (a / H2H_BLOCK) * t->blocks + b / H2H_BLOCK;
+    return t->cells + tile * H2H_BLOCK * H2H_BLOCK
+        + (a % H2H_BLOCK) * H2H_BLOCK + b % H2H_BLOCK;
+}
+
+struct h2h_pair *find_pair(struct h2h_pair *pairs, size_t alloc,
+                           uint32_t a, uint32_t b)
+{
+    size_t i;
+
+    /* Linear probing from a multiplicative hash of both players. */
+    i = ((uint64_t)a * 0x9E3779B97F4A7C15ULL
+         ^ (uint64_t)b * 0xC2B2AE3D27D4EB4FULL) >> 32;
+    for (i &= alloc - 1;; i = (i + 1) & (alloc - 1))
+        if (pairs[i].a == EMPTY_PAIR || (pairs[i].a == a && pairs[i].b == b))
+            return pairs + i;
+}
+
+int grow_pairs(struct h2h_table *t)
+{
+    struct h2h_pair *pairs;
+    size_t alloc;
+    size_t i;
+
+    alloc = t->pair_alloc * 2;
+    pairs = talloc_array(t, struct h2h_pair, alloc);
+    if (pairs == NULL)
+        return -1;
+    for (i = 0; i < alloc; i++)
+        pairs[i].a = EMPTY_PAIR;
+
+    for (i = 0; i < t->pair_alloc; i++)
+        if (t->pairs[i].a != EMPTY_PAIR)
+            *find_pair(pairs, alloc, t->pairs[i].a, t->pairs[i].b) =
+                t->pairs[i];
+
+    TALLOC_FREE(t->pairs);
+    t->pairs = pairs;
+    t->pair_alloc = alloc;
+    return 0;
+}
+
+int build_opponents(struct h2h_table *t)
+{
+    uint32_t *fill;
+    size_t i;
+
+    TALLOC_FREE(t->offsets);
+    TALLOC_FREE(t->opponents);
+    t->offsets = talloc_zero_array(t, uint32_t, t->player_count + 2);
+    t->opponents = talloc_array(t, struct h2h_opponent,
+                                t->pair_count * 2 + 1);
+    fill = talloc_array(t, uint32_t, t->player_count + 1);
+    if (t->offsets == NULL || t->opponents == NULL || fill == NULL)
+    {
+        TALLOC_FREE(t->offsets);
+        TALLOC_FREE(t->opponents);
+        TALLOC_FREE(fill);
+        return -1;
+    }
+
+    /* Every pair is listed under both of its players. */
+    for (i = 0; i < t->pair_alloc; i++)
+    {
+        if (t->pairs[i].a == EMPTY_PAIR)
+            continue;
+
+        t->offsets[t->pairs[i].a + 1]++;
+        t->offsets[t->pairs[i].b + 1]++;
+    }
+
+    for (i = 0; i < t->player_count; i++)
+        t->offsets[i + 1] += t->offsets[i];
+    memcpy(fill, t->offsets, t->player_count * sizeof(*fill));
+
+    for (i = 0; i < t->pair_alloc; i++)
+    {
+        const struct h2h_pair *p;
+        struct h2h_opponent *o;
+
+        p = t->pairs + i;
+        if (p->a == EMPTY_PAIR)
+            continue;
+
+        o = t->opponents + fill[p->a]++;
+        o->opponent = p->b;
+        o->wins = p->a_wins;
+        o->losses = p->b_wins;
+
+        o = t->opponents + fill[p->b]++;
+        o->opponent = p->a;
+        o->wins = p->b_wins;
+        o->losses = p->a_wins;
+    }
+
+    TALLOC_FREE(fill);
+    t->opponents_stale = false;
+    return 0;
+}
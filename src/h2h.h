@@ -0,0 +1,75 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef H2H_H
+#define H2H_H
+
+/* Counts how many times every player has beaten every other player,
+ * built up alongside the ratings so rivalries never need the games
+ * walked again.  Small rosters get a dense matrix of wins, stored in
+ * square tiles so a player's row and column both stay in a few cache
+ * lines.  Past H2H_DENSE_MAX players that gets too big, so only the
+ * pairs that have actually played are kept, in a hash table. */
+struct h2h_table;
+
+/* Every record in a table as it stood at some point. */
+struct h2h_checkpoint;
+
+#include <stddef.h>
+
+/* The most players that get a dense matrix. */
+#ifndef H2H_DENSE_MAX
+#define H2H_DENSE_MAX 1024
+#endif
+
+/* Creates an empty table for the given number of players. */
+struct h2h_table *h2h_table_new(void *ctx, size_t player_count);
+
+/* Records a win for one player over another, both given by index.
+ * Returns 0 on success. */
+int h2h_table_win(struct h2h_table *t, int winner, int loser);
+
+/* Copies out every record, so the table can go back to this point
+ * later.  Returns NULL on failure. */
+struct h2h_checkpoint *h2h_table_checkpoint(void *ctx, struct h2h_table *t);
+
+/* Puts every record back to how it was at the checkpoint.  Returns 0
+ * on success, on failure the table has to be built again. */
+int h2h_table_rollback(struct h2h_table *t, const struct h2h_checkpoint *cp);
+
+/* Returns the number of times one player has beaten another. */
+int h2h_wins(struct h2h_table *t, int player, int opponent);
+
+/* Walks through everyone a player has played, passing along how many
+ * times they won and lost against them.  Opponents come in no
+ * particular order.  Stops early if the function returns non-zero,
+ * returning that value. */
+int h2h_each_opponent(struct h2h_table *t, int player,
+                      int (*func) (int opponent, int wins, int losses,
+                                   void *), void *arg);
+
+/* Walks through every pair of players that has played, with "a"
+ * always the lower index. */
+int h2h_each_pair(struct h2h_table *t,
+                  int (*func) (int a, int b, int a_wins, int b_wins,
+                               void *), void *arg);
+
+#endif
@@ -0,0 +1,189 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "history.h"
+
+#include <talloc.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A single player's history, grown geometrically. */
+struct player_history
+{
+    struct rating_history_entry *entries;
+    size_t count;
+    size_t alloc;
+};
+
+struct rating_history
+{
+    struct player_history *players;
+    size_t player_count;
+};
+
+/* Entries are only ever appended, so going back just means forgetting
+ * the ones past each player's count. */
+struct rating_history_checkpoint
+{
+    size_t *counts;
+};
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct rating_history *rating_history_new(void *ctx, size_t player_count)
+{
+    struct rating_history *rh;
+
+    rh = talloc(ctx, struct rating_history);
+    if (rh == NULL)
+        return NULL;
+
+    rh->player_count = player_count;
+    rh->players = talloc_zero_array(rh, struct player_history,
+                                    player_count + 1);
+    if (rh->players == NULL)
+    {
+        TALLOC_FREE(rh);
+        return NULL;
+    }
+
+    return rh;
+}
+
+int rating_history_add(struct rating_history *rh, int player,
+                       game_time_t time, player_elo_t elo, size_t game)
+{
+    struct player_history *ph;
+    struct rating_history_entry *e;
+
+    ph = rh->players + player;
+    if (ph->count == ph->alloc)
+    {
+        size_t alloc;
+        struct rating_history_entry *entries;
+
+        alloc = (ph->alloc == 0) ? 16 : ph->alloc * 2;
+        entries = talloc_realloc(rh, ph->entries,
+                                 struct rating_history_entry, alloc);
+        if (entries == NULL)
+            return -1;
+
+        ph->entries = entries;
+        ph->alloc = alloc;
+    }
+
+    e = ph->entries + ph->count++;
+    e->time = time;
+    e->elo = elo;
+    e->game = game;
+    return 0;
+}
+
+struct rating_history_checkpoint *rating_history_checkpoint(void *ctx,
+                                                            struct
+                                                            rating_history
+                                                            *rh)
+{
+    struct rating_history_checkpoint *cp;
+    size_t i;
+
+    cp = talloc(ctx, struct rating_history_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    cp->counts = talloc_array(cp, size_t, rh->player_count + 1);
+    if (cp->counts == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    for (i = 0; i < rh->player_count; i++)
+        cp->counts[i] = rh->players[i].count;
+
+    return cp;
+}
+
+void rating_history_rollback(struct rating_history *rh,
+                             const struct rating_history_checkpoint *cp)
+{
+    size_t i;
+
+    for (i = 0; i < rh->player_count; i++)
+        if (rh->players[i].count > cp->counts[i])
+            rh->players[i].count = cp->counts[i];
+}
+
+size_t rating_history_count(struct rating_history *rh, int player)
+{
+    return rh->players[player].count;
+}
+
+const struct rating_history_entry *rating_history_entries(struct
+                                                          rating_history
+                                                          *rh, int player)
+{
+    return rh->players[player].entries;
+}
+
+player_elo_t rating_history_at(struct rating_history *rh, int player,
+                               game_time_t time, size_t *games)
+{
+    struct player_history *ph;
+    size_t played;
+
+    ph = rh->players + player;
+    played = rating_history_search(ph->entries, ph->count, time);
+
+    if (games != NULL)
+        *games = played;
+
+    if (played == 0)
+        return elo_default();
+
+    return ph->entries[played - 1].elo;
+}
+
+size_t rating_history_search(const struct rating_history_entry *entries,
+                             size_t count, game_time_t time)
+{
+    size_t lo, hi;
+
+    /* Binary searches for the number of games played no later than
+     * the given time. */
+    lo = 0;
+    hi = count;
+    while (lo < hi)
+    {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if (entries[mid].time <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
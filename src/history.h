@@ -0,0 +1,87 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* Remembers every player's rating after each game they played, so
+ * their rating at any point in time can be looked up without
+ * replaying anything. */
+struct rating_history;
+
+/* How long every player's history was at some point. */
+struct rating_history_checkpoint;
+
+#include "elo.h"
+#include "game.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A player's rating just after one of their games. */
+struct rating_history_entry
+{
+    game_time_t time;
+    player_elo_t elo;
+
+    /* The game's position in the timeline. */
+    uint32_t game;
+};
+
+/* Creates an empty history for the given number of players. */
+struct rating_history *rating_history_new(void *ctx, size_t player_count);
+
+/* Appends a player's new rating after a game.  Games must be added in
+ * chronological order.  Returns 0 on success. */
+int rating_history_add(struct rating_history *rh, int player,
+                       game_time_t time, player_elo_t elo, size_t game);
+
+/* Remembers how far every player's history goes, so anything added
+ * after this can be dropped again.  Returns NULL on failure. */
+struct rating_history_checkpoint *rating_history_checkpoint(void *ctx,
+                                                            struct
+                                                            rating_history
+                                                            *rh);
+
+/* Drops every entry added since the checkpoint was taken. */
+void rating_history_rollback(struct rating_history *rh,
+                             const struct rating_history_checkpoint *cp);
+
+/* Returns the number of games in a player's history, and the entries
+ * themselves in chronological order. */
+size_t rating_history_count(struct rating_history *rh, int player);
+const struct rating_history_entry *rating_history_entries(struct
+                                                          rating_history
+                                                          *rh, int player);
+
+/* Returns a player's rating as of the given time, which is the rating
+ * after the last game they played no later than that time.  The
+ * number of games they had played by then is stored in "games" if
+ * it's not NULL. */
+player_elo_t rating_history_at(struct rating_history *rh, int player,
+                               game_time_t time, size_t *games);
+
+/* Returns the number of entries, out of a chronological run of them,
+ * from no later than the given time. */
+size_t rating_history_search(const struct rating_history_entry *entries,
+                             size_t count, game_time_t time);
+
+#endif
@@ -24,12 +24,18 @@
 #include "html.h"
 #include "game.h"
 #include "global.h"
+#include "league.h"
 #include "player.h"
 #include "player_list.h"
+#include "stats.h"
+#include "timeline.h"
+#include "trace.h"
 
 #include <ftw.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <talloc.h>
@@ -40,6 +46,11 @@
 #define LINE_MAX 1024
 #endif
 
+/* How many rivalries get listed. */
+#ifndef HTML_RIVALRIES
+#define HTML_RIVALRIES 100
+#endif
+
 #ifndef JS_TABLE_SORT_URL
 #define JS_TABLE_SORT_URL "http://web.archive.org/web/20130118015748/http://www.frequency-decoder.com/demo/table-sort-revisited/js/tablesort.min.js"
 #endif
@@ -64,6 +75,8 @@ struct player_page_table_args
     void *pctx;
     FILE *file;
     const char *player_key;
+    int player_index;
+    size_t game_number;
 };
 
 struct map_list_table_iter_args
@@ -85,31 +98,124 @@ struct map_page_table_args
     const char *map_key;
 };
 
+/* Two players and their record against each other. */
+struct rivalry
+{
+    int a;
+    int b;
+    int a_wins;
+    int b_wins;
+};
+
+/* A player's results on a map, keyed by whichever of the two the page
+ * isn't about. */
+struct breakdown
+{
+    int key;
+    const struct performance *p;
+};
+
+struct collect_breakdowns_args
+{
+    void *ctx;
+    struct breakdown *breakdowns;
+    size_t count;
+    size_t alloc;
+};
+
+struct collect_rivalries_args
+{
+    void *ctx;
+    struct rivalry *rivalries;
+    size_t count;
+    size_t alloc;
+    int player;
+};
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+
+/* When set, pages are only rewritten when their contents change, and
+ * every page that is rewritten gets counted. */
+static bool only_changed = false;
+static int pages_written = 0;
+
+/* The only players and maps that get pages, by index, or NULL for
+ * every one of them. */
+static const struct bitmap *only_players = NULL;
+static const struct bitmap *only_maps = NULL;
+
 /***********************************************************************
  * Static Method Headers                                               *
  ***********************************************************************/
+static int generate_all(void *pctx, const char *outdir);
+
 static int nftw_rm_rf(const char *path, const struct stat *sb,
                       int type, struct FTW *ftwbuf);
 
+/* Opens a page for writing.  Every page opened this way must be closed
+ * with close_page(), which decides whether it replaces the old page. */
+static FILE *open_page(const char *filename);
+static int close_page(FILE * file, const char *filename);
+
+/* Returns TRUE if the two files have exactly the same contents. */
+static bool same_contents(const char *a, const char *b);
+
 static int write_header(void *pctx, FILE * file, const char *page_name,
                         bool links);
 static int write_footer(void *pctx, FILE * file);
 
-/* Creates a new table.  id is what ends up inside the ID field of the
- * <table> tag.  sort_index is the index to start sorting by.
- * reverse_sort only controls the starting index's reverse sort. */
-static int start_table(void *pctx, FILE * file, const char *id,
-                       int sort_index, bool reverse_sort, ...);
-static int table_row(void *pctx, FILE * file, ...);
-static int end_table(void *pctx, FILE * file);
-
 static int generate_index_page(void *pctx, const char *filename);
 
 static int generate_player_list(void *ctx, const char *filename);
 static int player_list_table_iter(struct player *player, void *args_uc);
 
 static int generate_player_page(struct player *player, void *args);
+static int player_page_matchups(void *pctx, FILE * file,
+                                struct player *player);
 static int player_page_table(struct game *game, void *args);
+static int player_page_opponents(void *pctx, FILE * file,
+                                 struct player *player);
+
+/* Gathers up rivalries from the head-to-head table, and sorts them
+ * with the most games first. */
+static int collect_opponent(int opponent, int wins, int losses,
+                            void *args_uc);
+static int collect_pair(int a, int b, int a_wins, int b_wins,
+                        void *args_uc);
+static int add_rivalry(struct collect_rivalries_args *args, int a, int b,
+                       int a_wins, int b_wins);
+static int compare_rivalries(const void *a, const void *b);
+
+static int generate_rivalries_page(void *ctx, const char *filename);
+
+/* Lists out how a player did on every map, or how every player did on
+ * a map, from the performance table. */
+static int player_page_maps(void *pctx, FILE * file, struct player *player);
+static int map_page_players(void *pctx, FILE * file, struct map *map);
+static int collect_breakdown(int key, const struct performance *p,
+                             void *args_uc);
+static int compare_breakdowns(const void *a, const void *b);
+
+/* Formats a record and its winrate, or the rating change, for a
+ * table. */
+static const char *format_record(void *ctx, const struct performance *p);
+static const char *format_winrate(void *ctx, const struct performance *p);
+static const char *format_change(void *ctx, const struct performance *p);
+
+static int generate_movers_page(void *ctx, const char *filename);
+
+/* Lists how every race did against every other race, in each league
+ * and in each month. */
+static int generate_races_page(void *ctx, const char *filename);
+static int races_row(void *ctx, FILE * file, const char *name,
+                     const struct race_counts *rc);
+static const char *format_matchup(void *ctx, const struct race_counts *rc,
+                                  enum race a, enum race b);
+
+static int generate_pool_list(void *ctx, const char *filename);
+static int generate_pool_page(void *ctx, const char *outdir, int pool);
 
 static int generate_map_list(void *ctx, const char *filename);
 static int map_list_table_iter(struct map *map, void *args_uc);
@@ -121,23 +227,142 @@ static int map_page_table(struct game *game, void *args);
  * Extern Methods                                                      *
  ***********************************************************************/
 int html_generate(void *parent_context, const char *outdir)
+{
+    /* This is an "rm -rf outdir", it cleans up everything in the
+     * output directory */
+    nftw(outdir, &nftw_rm_rf, 16, FTW_DEPTH);
+    mkdir(outdir, 0777);
+
+    only_changed = false;
+    pages_written = 0;
+    only_players = only_maps = NULL;
+    return generate_all(parent_context, outdir);
+}
+
+int html_update(void *parent_context, const char *outdir,
+                const struct bitmap *players, const struct bitmap *maps)
+{
+    int ret;
+
+    mkdir(outdir, 0777);
+
+    only_changed = true;
+    pages_written = 0;
+    only_players = players;
+    only_maps = maps;
+    ret = generate_all(parent_context, outdir);
+    only_players = only_maps = NULL;
+    if (ret != 0)
+        return -1;
+
+    return pages_written;
+}
+
+int html_start_table(void *pctx __attribute__ ((unused)),
+                     FILE * file, const char *table_id, int sort_index,
+                     bool reverse_sort, ...)
+{
+    va_list args;
+    const char *col_name;
+    const char *reverse;
+
+    va_start(args, reverse_sort);
+
+    if (reverse_sort)
+        reverse = "r";
+    else
+        reverse = "";
+
+    fprintf(file, "<table id=\"%s\""
+            "class=\"sortable-onload-%d%s\""
+            "class=\"rowstyle-alternate\""
+            ">\n", table_id, sort_index, reverse);
+
+    fprintf(file, "<thead><tr>\n");
+    while ((col_name = va_arg(args, const char *)) != NULL)
+          fprintf(file, "<th class=\"sortable\">%s</th>\n", col_name);
+    fprintf(file, "</tr></thead>\n");
+
+    return 0;
+}
+
+int html_table_row(void *pctx __attribute__ ((unused)), FILE * file, ...)
+{
+    va_list args;
+    const char *val;
+
+    va_start(args, file);
+
+    fprintf(file, "<tr>\n");
+    while ((val = va_arg(args, const char *)) != NULL)
+          fprintf(file, "<td>%s</td>\n", val);
+    fprintf(file, "</tr>\n");
+
+    return 0;
+}
+
+int html_end_table(void *pctx __attribute__ ((unused)), FILE * file)
+{
+    fprintf(file, "</table>\n");
+    return 0;
+}
+
+int html_player_row(void *pctx, FILE * file, struct player *player)
+{
+    const char *rank, *elo, *elo_peak;
+    const char *player_link;
+    void *ctx;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    rank = "-";
+    if (global_rank_tree != NULL && player_index(player) >= 0
+        && rank_tree_rank(global_rank_tree, player_index(player)) > 0)
+        rank = talloc_asprintf(ctx, "%d",
+                               rank_tree_rank(global_rank_tree,
+                                              player_index(player)));
+
+    elo = talloc_asprintf(ctx, "%d", (int)player_elo(player));
+    elo_peak = talloc_asprintf(ctx, "%d", (int)player_elo_peak(player));
+    player_link = talloc_asprintf(ctx,
+                                  "<a href=\"player_%s.html\">%s</a>",
+                                  player_key(player), player_id(player));
+    html_table_row(ctx, file, rank, player_link,
+                   race_string(player_race(player)), elo, elo_peak, NULL);
+
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    if (ctx != NULL)
+        TALLOC_FREE(ctx);
+    return 1;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int generate_all(void *parent_context, const char *outdir)
 {
     void *ctx;
     const char *index_filename;
     const char *player_list_filename;
+    const char *movers_filename;
+    const char *rivalries_filename;
+    const char *races_filename;
+    const char *pool_list_filename;
     const char *map_list_filename;
     struct generate_player_page_args gpp_args;
     struct generate_map_page_args gmp_args;
 
-    ctx = talloc_new(parent_context);
+    /* Every page gets scratch memory of its own under this, which is
+     * measured as it's freed. */
+    ctx = stats_scratch_new(parent_context, STATS_MEMORY_HTML);
     if (ctx == NULL)
         return 1;
 
-    /* This is an "rm -rf outdir", it cleans up everything in the
-     * output directory */
-    nftw(outdir, &nftw_rm_rf, 16, FTW_DEPTH);
-    mkdir(outdir, 0777);
-
     /* The index page is very simple. */
     index_filename = talloc_asprintf(ctx, "%s/index.html", outdir);
     generate_index_page(ctx, index_filename);
@@ -151,6 +376,29 @@ int html_generate(void *parent_context, const char *outdir)
     gpp_args.outdir = outdir;
     player_list_each(global_player_list, generate_player_page, &gpp_args);
 
+    /* Generates the list of who moved up and down the rankings */
+    movers_filename = talloc_asprintf(ctx, "%s/movers.html", outdir);
+    generate_movers_page(ctx, movers_filename);
+
+    /* Generates the list of the most played rivalries */
+    rivalries_filename = talloc_asprintf(ctx, "%s/rivalries.html", outdir);
+    generate_rivalries_page(ctx, rivalries_filename);
+
+    /* Generates the race balance tables */
+    races_filename = talloc_asprintf(ctx, "%s/races.html", outdir);
+    generate_races_page(ctx, races_filename);
+
+    /* Generates the list of rating pools, and a page for each */
+    pool_list_filename = talloc_asprintf(ctx, "%s/pools.html", outdir);
+    generate_pool_list(ctx, pool_list_filename);
+    if (global_pool_set != NULL)
+    {
+        int i;
+
+        for (i = 0; i < pool_set_count(global_pool_set); i++)
+            generate_pool_page(ctx, outdir, i);
+    }
+
     /* Generates the list of all maps */
     map_list_filename = talloc_asprintf(ctx, "%s/maps.html", outdir);
     generate_map_list(ctx, map_list_filename);
@@ -160,13 +408,11 @@ int html_generate(void *parent_context, const char *outdir)
     gmp_args.outdir = outdir;
     map_list_each(global_map_list, generate_map_page, &gmp_args);
 
+    stats_sample_memory();
     TALLOC_FREE(ctx);
     return 0;
 }
 
-/***********************************************************************
- * Static Methods                                                      *
- ***********************************************************************/
 int nftw_rm_rf(const char *path,
                const struct stat *sb __attribute__ ((unused)),
                int type __attribute__ ((unused)),
@@ -180,6 +426,96 @@ int nftw_rm_rf(const char *path,
     return 0;
 }
 
+FILE *open_page(const char *filename)
+{
+    FILE *file;
+    char *new_filename;
+
+    /* The new page is written next to the old one, and only moved over
+     * it once it's known to be different. */
+    if (only_changed)
+    {
+        new_filename = talloc_asprintf(NULL, "%s.new", filename);
+        if (new_filename == NULL)
+            return NULL;
+
+        file = fopen(new_filename, "w");
+        TALLOC_FREE(new_filename);
+    }
+    else
+        file = fopen(filename, "w");
+
+    /* Each page is traced until it's closed. */
+    if (file != NULL)
+        trace_begin("page", filename);
+
+    return file;
+}
+
+int close_page(FILE * file, const char *filename)
+{
+    char *new_filename;
+    int ret;
+
+    if (file == NULL)
+        return -1;
+
+    /* Pages are always written from scratch, so this is their size. */
+    stats_count(STATS_PAGES_WRITTEN, 1);
+    stats_count(STATS_BYTES_WRITTEN, ftell(file));
+    ret = fclose(file);
+    trace_end("page");
+    if (!only_changed)
+    {
+        pages_written++;
+        return ret;
+    }
+
+    new_filename = talloc_asprintf(NULL, "%s.new", filename);
+    if (new_filename == NULL)
+        return -1;
+
+    if (ret == 0 && !same_contents(new_filename, filename))
+    {
+        ret = rename(new_filename, filename);
+        pages_written++;
+    }
+    else
+        unlink(new_filename);
+
+    TALLOC_FREE(new_filename);
+    return ret;
+}
+
+bool same_contents(const char *a, const char *b)
+{
+    FILE *fa, *fb;
+    char buf_a[BUFSIZ], buf_b[BUFSIZ];
+    size_t len_a, len_b;
+    bool same;
+
+    fa = fopen(a, "r");
+    fb = fopen(b, "r");
+    same = (fa != NULL && fb != NULL);
+
+    while (same)
+    {
+        len_a = fread(buf_a, 1, sizeof(buf_a), fa);
+        len_b = fread(buf_b, 1, sizeof(buf_b), fb);
+        if (len_a != len_b || memcmp(buf_a, buf_b, len_a) != 0)
+            same = false;
+        else if (len_a == 0)
+            break;
+    }
+
+    if (fa != NULL)
+        fclose(fa);
+    if (fb != NULL)
+        fclose(fb);
+
+    return same;
+}
+
 int write_header(void *pctx __attribute__ ((unused)),
                  FILE * file, const char *page_name, bool links)
 {
@@ -207,6 +543,8 @@ int write_header(void *pctx __attribute__ ((unused)),
         fprintf(file, "<small>\n");
         fprintf(file, "  <a href=\"players.html\">Players</a>\n");
         fprintf(file, "  <a href=\"maps.html\">Maps</a>\n");
+        fprintf(file, "  <a href=\"movers.html\">Movers</a>\n");
+        fprintf(file, "  <a href=\"pools.html\">Pools</a>\n");
         fprintf(file, "  <br/>");
         fprintf(file, "  <br/>");
         fprintf(file, "</small>\n");
@@ -223,60 +561,11 @@ int write_footer(void *pctx __attribute__ ((unused)), FILE * file)
     return 0;
 }
 
-int start_table(void *pctx __attribute__ ((unused)),
-                FILE * file, const char *table_id, int sort_index,
-                bool reverse_sort, ...)
-{
-    va_list args;
-    const char *col_name;
-    const char *reverse;
-
-    va_start(args, reverse_sort);
-
-    if (reverse_sort)
-        reverse = "r";
-    else
-        reverse = "";
-
-    fprintf(file, "<table id=\"%s\""
-            "class=\"sortable-onload-%d%s\""
-            "class=\"rowstyle-alternate\""
-            ">\n", table_id, sort_index, reverse);
-
-    fprintf(file, "<thead><tr>\n");
-    while ((col_name = va_arg(args, const char *)) != NULL)
-          fprintf(file, "<th class=\"sortable\">%s</th>\n", col_name);
-    fprintf(file, "</tr></thead>\n");
-
-    return 0;
-}
-
-int table_row(void *pctx __attribute__ ((unused)), FILE * file, ...)
-{
-    va_list args;
-    const char *val;
-
-    va_start(args, file);
-
-    fprintf(file, "<tr>\n");
-    while ((val = va_arg(args, const char *)) != NULL)
-          fprintf(file, "<td>%s</td>\n", val);
-    fprintf(file, "</tr>\n");
-
-    return 0;
-}
-
-int end_table(void *pctx __attribute__ ((unused)), FILE * file)
-{
-    fprintf(file, "</table>\n");
-    return 0;
-}
-
 int generate_index_page(void *pctx, const char *filename)
 {
     FILE *file;
 
-    file = fopen(filename, "w");
+    file = open_page(filename);
     if (file == NULL)
         return -1;
 
@@ -284,9 +573,14 @@ int generate_index_page(void *pctx, const char *filename)
 
     fprintf(file, "<a href=\"players.html\">Player List</a><br/>\n");
     fprintf(file, "<a href=\"maps.html\">Map List</a><br/>\n");
+    fprintf(file, "<a href=\"movers.html\">Biggest Movers</a><br/>\n");
+    fprintf(file, "<a href=\"rivalries.html\">Top Rivalries</a><br/>\n");
+    fprintf(file, "<a href=\"races.html\">Race Balance</a><br/>\n");
+    fprintf(file, "<a href=\"pools.html\">Rating Pools</a><br/>\n");
 
     write_footer(pctx, file);
 
+    close_page(file, filename);
     return 0;
 }
 
@@ -296,30 +590,30 @@ int generate_player_list(void *pctx, const char *filename)
     void *ctx;
     struct player_list_table_iter_args plti_args;
 
-    file = fopen(filename, "w");
+    file = open_page(filename);
 
-    ctx = talloc_new(pctx);
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         goto failure;
 
     write_header(ctx, file, "Player List", true);
 
-    start_table(ctx, file, "player_list", 2, true,
-                "ID", "Race", "ELO", "ELO Peak", NULL);
+    html_start_table(ctx, file, "player_list", 0, false,
+                     "Rank", "ID", "Race", "ELO", "ELO Peak", NULL);
 
     plti_args.file = file;
     plti_args.pctx = ctx;
     player_list_each(global_player_list, &player_list_table_iter, &plti_args);
 
-    end_table(ctx, file);
+    html_end_table(ctx, file);
 
     write_footer(ctx, file);
 
-    fclose(file);
+    close_page(file, filename);
     return 0;
 
   failure:
-    fclose(file);
+    close_page(file, filename);
     TALLOC_FREE(ctx);
     return 1;
 }
@@ -327,31 +621,9 @@ int generate_player_list(void *pctx, const char *filename)
 int player_list_table_iter(struct player *player, void *args_uc)
 {
     struct player_list_table_iter_args *args;
-    const char *elo, *elo_peak;
-    const char *player_link;
-    void *ctx;
 
     args = args_uc;
-    ctx = talloc_new(args->pctx);
-    if (ctx == NULL)
-        goto failure;
-
-    elo = talloc_asprintf(ctx, "%d", (int)player_elo(player));
-    elo_peak = talloc_asprintf(ctx, "%d", (int)player_elo_peak(player));
-    player_link = talloc_asprintf(ctx,
-                                  "<a href=\"player_%s.html\">%s</a>",
-                                  player_key(player), player_id(player));
-    table_row(ctx, args->file,
-              player_link,
-              race_string(player_race(player)), elo, elo_peak, NULL);
-
-    TALLOC_FREE(ctx);
-    return 0;
-
-  failure:
-    if (ctx != NULL)
-        TALLOC_FREE(ctx);
-    return 1;
+    return html_player_row(args->pctx, args->file, player);
 }
 
 int generate_player_page(struct player *player, void *args_uncast)
@@ -364,14 +636,18 @@ int generate_player_page(struct player *player, void *args_uncast)
     struct player_page_table_args ppt_args;
 
     args = args_uncast;
-    ctx = talloc_new(args->pctx);
+    if (only_players != NULL && player_index(player) >= 0
+        && !bitmap_contains(only_players, player_index(player)))
+        return 0;
+
+    ctx = stats_scratch_new(args->pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         return 1;
 
     file_name = talloc_asprintf(ctx, "%s/player_%s.html",
                                 args->outdir, player_key(player));
 
-    file = fopen(file_name, "w");
+    file = open_page(file_name);
     if (file == NULL)
         goto failure;
 
@@ -382,23 +658,42 @@ int generate_player_page(struct player *player, void *args_uncast)
     fprintf(file, "Race: <b>%s</b><br/>\n", race_string(player_race(player)));
     fprintf(file, "Elo: <b>%d</b><br/>\n", (int)player_elo(player));
     fprintf(file, "Elo Peak: <b>%d</b><br/>\n", (int)player_elo_peak(player));
+    if (player_has_elo_interval(player))
+        fprintf(file, "Elo 90%% Interval: <b>%d</b> - <b>%d</b>"
+                " (median <b>%d</b>)<br/>\n",
+                (int)player_elo_low(player), (int)player_elo_high(player),
+                (int)player_elo_median(player));
     fprintf(file, "Record: <b>%d</b> - <b>%d</b> (%.02f%%)<br/>\n",
             player_wins(player), player_losses(player),
             player_winrate(player) * 100);
-
-    start_table(ctx, file, "game_list", 1, true,
-                "Tournament", "Date", "Map", "Opponent", "Result", NULL);
+    if (global_rank_tree != NULL && player_index(player) >= 0
+        && rank_tree_rank(global_rank_tree, player_index(player)) > 0)
+        fprintf(file, "Rank: <b>%d</b> of %d (top %.0f%%)<br/>\n",
+                rank_tree_rank(global_rank_tree, player_index(player)),
+                rank_tree_count(global_rank_tree),
+                rank_tree_percentile(global_rank_tree,
+                                     player_index(player)));
+
+    player_page_matchups(ctx, file, player);
+    player_page_opponents(ctx, file, player);
+    player_page_maps(ctx, file, player);
+
+    html_start_table(ctx, file, "game_list", 1, true,
+                     "Tournament", "Date", "Map", "Opponent", "Result", "Rank",
+                     NULL);
 
     ppt_args.pctx = ctx;
     ppt_args.file = file;
     ppt_args.player_key = player_key(player);
+    ppt_args.player_index = player_index(player);
+    ppt_args.game_number = 0;
     player_each_game(player, &player_page_table, &ppt_args);
 
-    end_table(ctx, file);
+    html_end_table(ctx, file);
 
     write_footer(ctx, file);
 
-    fclose(file);
+    close_page(file, file_name);
     TALLOC_FREE(ctx);
     return 0;
 
@@ -408,6 +703,54 @@ int generate_player_page(struct player *player, void *args_uncast)
     return 1;
 }
 
+int player_page_matchups(void *pctx, FILE * file, struct player *player)
+{
+    static const enum race races[] = {
+        RACE_TERRAN, RACE_ZERG, RACE_PROTOSS, RACE_RANDOM
+    };
+    void *ctx;
+    size_t i;
+
+    if (global_matchup_table == NULL || player_index(player) < 0)
+        return 0;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        return 1;
+
+    html_start_table(ctx, file, "matchup_list", 0, false,
+                     "Versus", "Elo", "Record", NULL);
+
+    for (i = 0; i < sizeof(races) / sizeof(races[0]); i++)
+    {
+        int wins, losses;
+        const char *elo, *record;
+
+        wins = matchup_wins(global_matchup_table, player_index(player),
+                            races[i]);
+        losses = matchup_losses(global_matchup_table, player_index(player),
+                                races[i]);
+
+        /* Hardly anyone plays random, so it's only listed when it's
+         * actually been played against. */
+        if (races[i] == RACE_RANDOM && wins + losses == 0)
+            continue;
+
+        elo = talloc_asprintf(ctx, "%d",
+                              (int)matchup_elo(global_matchup_table,
+                                               player_index(player),
+                                               races[i]));
+        record = talloc_asprintf(ctx, "%d - %d", wins, losses);
+        html_table_row(ctx, file, race_string(races[i]), elo, record, NULL);
+    }
+
+    html_end_table(ctx, file);
+    fprintf(file, "<br/>\n");
+
+    TALLOC_FREE(ctx);
+    return 0;
+}
+
 int player_page_table(struct game *game, void *args_uncast)
 {
     struct player_page_table_args *args;
@@ -421,9 +764,10 @@ int player_page_table(struct game *game, void *args_uncast)
     const char *result;
     struct map *map;
     const char *map_link;
+    const char *rank;
 
     args = args_uncast;
-    ctx = talloc_new(args->pctx);
+    ctx = stats_scratch_new(args->pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         return 1;
 
@@ -454,8 +798,19 @@ int player_page_table(struct game *game, void *args_uncast)
     map_link = talloc_asprintf(ctx, "<a href=\"map_%s.html\">%s</a>",
                                map_key(map), map_name(map));
 
-    table_row(ctx, args->file, game_league_name(game), game_time_str,
-              map_link, opponent_link, result, NULL);
+    /* The rank this player ended up at right after this game. */
+    rank = "-";
+    if (global_rank_tree != NULL && args->player_index >= 0
+        && rank_tree_history(global_rank_tree, args->player_index,
+                             args->game_number) > 0)
+        rank = talloc_asprintf(ctx, "%d",
+                               rank_tree_history(global_rank_tree,
+                                                 args->player_index,
+                                                 args->game_number));
+    args->game_number++;
+
+    html_table_row(ctx, args->file, game_league_name(game), game_time_str,
+                   map_link, opponent_link, result, rank, NULL);
 
     TALLOC_FREE(ctx);
     return 0;
@@ -466,35 +821,719 @@ int player_page_table(struct game *game, void *args_uncast)
     return 1;
 }
 
-int generate_map_list(void *pctx, const char *filename)
+int player_page_opponents(void *pctx, FILE * file, struct player *player)
 {
-    FILE *file;
+    struct collect_rivalries_args args;
     void *ctx;
-    struct map_list_table_iter_args mlti_args;
+    size_t i;
 
-    file = fopen(filename, "w");
+    if (global_h2h_table == NULL || global_timeline == NULL
+        || player_index(player) < 0)
+        return 0;
 
-    ctx = talloc_new(pctx);
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
-        goto failure;
+        return 1;
 
-    write_header(ctx, file, "Map List", true);
+    args.ctx = ctx;
+    args.rivalries = talloc_array(ctx, struct rivalry, 1);
+    args.count = 0;
+    args.alloc = 1;
+    args.player = player_index(player);
+    if (args.rivalries == NULL
+        || h2h_each_opponent(global_h2h_table, player_index(player),
+                             &collect_opponent, &args) != 0)
+        goto failure;
 
-    start_table(ctx, file, "map_list", 0, false, "Name", NULL);
+    qsort(args.rivalries, args.count, sizeof(*args.rivalries),
+          &compare_rivalries);
 
-    mlti_args.file = file;
-    mlti_args.pctx = ctx;
-    map_list_each(global_map_list, &map_list_table_iter, &mlti_args);
+    html_start_table(ctx, file, "opponent_list", 1, true,
+                     "Opponent", "Games", "Record", "Win %", NULL);
 
-    end_table(ctx, file);
+    for (i = 0; i < args.count; i++)
+    {
+        const struct rivalry *r;
+        struct player *opponent;
+        const char *opponent_link, *games, *record, *winrate;
+
+        r = args.rivalries + i;
+        opponent = timeline_player(global_timeline, r->b);
+        if (opponent == NULL)
+            continue;
+
+        opponent_link =
+            talloc_asprintf(ctx, "<a href=\"player_%s.html\">%s</a> (%s)",
+                            player_key(opponent), player_id(opponent),
+                            race_string(player_race(opponent)));
+        games = talloc_asprintf(ctx, "%d", r->a_wins + r->b_wins);
+        record = talloc_asprintf(ctx, "%d - %d", r->a_wins, r->b_wins);
+        winrate = talloc_asprintf(ctx, "%.02f%%", r->a_wins * 100.0
+                                  / (r->a_wins + r->b_wins));
+        html_table_row(ctx, file, opponent_link, games, record, winrate, NULL);
+    }
 
-    write_footer(ctx, file);
+    html_end_table(ctx, file);
+    fprintf(file, "<br/>\n");
 
-    fclose(file);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int collect_opponent(int opponent, int wins, int losses, void *args_uc)
+{
+    struct collect_rivalries_args *args;
+
+    args = args_uc;
+    return add_rivalry(args, args->player, opponent, wins, losses);
+}
+
+int collect_pair(int a, int b, int a_wins, int b_wins, void *args_uc)
+{
+    return add_rivalry(args_uc, a, b, a_wins, b_wins);
+}
+
+int add_rivalry(struct collect_rivalries_args *args, int a, int b,
+                int a_wins, int b_wins)
+{
+    struct rivalry *r;
+
+    if (args->count == args->alloc)
+    {
+        r = talloc_realloc(args->ctx, args->rivalries, struct rivalry,
+                           args->alloc * 2);
+        if (r == NULL)
+            return -1;
+
+        args->rivalries = r;
+        args->alloc *= 2;
+    }
+
+    r = args->rivalries + args->count++;
+    r->a = a;
+    r->b = b;
+    r->a_wins = a_wins;
+    r->b_wins = b_wins;
+    return 0;
+}
+
+int compare_rivalries(const void *a_uncast, const void *b_uncast)
+{
+    const struct rivalry *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    if (a->a_wins + a->b_wins != b->a_wins + b->b_wins)
+        return (b->a_wins + b->b_wins) - (a->a_wins + a->b_wins);
+    if (a->a != b->a)
+        return a->a - b->a;
+    return a->b - b->b;
+}
+
+int generate_rivalries_page(void *pctx, const char *filename)
+{
+    struct collect_rivalries_args args;
+    FILE *file;
+    void *ctx;
+    size_t i;
+
+    file = open_page(filename);
+    if (file == NULL)
+        return 1;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    write_header(ctx, file, "Top Rivalries", true);
+
+    /* Every pair that's played comes straight out of the head-to-head
+     * table, only the most played ones get listed. */
+    args.ctx = ctx;
+    args.rivalries = talloc_array(ctx, struct rivalry, 1);
+    args.count = 0;
+    args.alloc = 1;
+    args.player = -1;
+    if (args.rivalries == NULL)
+        goto failure;
+    if (global_h2h_table != NULL && global_timeline != NULL
+        && h2h_each_pair(global_h2h_table, &collect_pair, &args) != 0)
+        goto failure;
+
+    qsort(args.rivalries, args.count, sizeof(*args.rivalries),
+          &compare_rivalries);
+    if (args.count > HTML_RIVALRIES)
+        args.count = HTML_RIVALRIES;
+
+    html_start_table(ctx, file, "rivalry_list", 2, true,
+                     "Player", "Player", "Games", "Record", NULL);
+
+    for (i = 0; i < args.count; i++)
+    {
+        const struct rivalry *r;
+        struct player *a, *b;
+        const char *a_link, *b_link, *games, *record;
+
+        r = args.rivalries + i;
+        a = timeline_player(global_timeline, r->a);
+        b = timeline_player(global_timeline, r->b);
+        if (a == NULL || b == NULL)
+            continue;
+
+        a_link = talloc_asprintf(ctx, "<a href=\"player_%s.html\">%s</a>",
+                                 player_key(a), player_id(a));
+        b_link = talloc_asprintf(ctx, "<a href=\"player_%s.html\">%s</a>",
+                                 player_key(b), player_id(b));
+        games = talloc_asprintf(ctx, "%d", r->a_wins + r->b_wins);
+        record = talloc_asprintf(ctx, "%d - %d", r->a_wins, r->b_wins);
+        html_table_row(ctx, file, a_link, b_link, games, record, NULL);
+    }
+
+    html_end_table(ctx, file);
+
+    write_footer(ctx, file);
+
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int generate_races_page(void *pctx, const char *filename)
+{
+    FILE *file;
+    void *ctx;
+    size_t i;
+
+    file = open_page(filename);
+    if (file == NULL)
+        return 1;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    write_header(ctx, file, "Race Balance", true);
+
+    if (global_race_stats == NULL || global_timeline == NULL)
+        goto done;
+
+    fprintf(file, "<h2>By League</h2>\n");
+    html_start_table(ctx, file, "league_race_list", 0, false,
+                     "League", "Games", "TvZ", "ZvP", "PvT", "Mirrors",
+                     "Random", NULL);
+    for (i = 0; i < timeline_league_count(global_timeline); i++)
+    {
+        struct league *league;
+        const char *name;
+
+        league = timeline_league(global_timeline, i);
+        if (league == NULL)
+            continue;
+
+        name = league_name(league);
+        if (name == NULL)
+            name = league_key(league);
+        races_row(ctx, file, name, race_stats_league(global_race_stats, i));
+    }
+    html_end_table(ctx, file);
+    fprintf(file, "<br/>\n");
+
+    fprintf(file, "<h2>By Month</h2>\n");
+    html_start_table(ctx, file, "month_race_list", 0, true,
+                     "Month", "Games", "TvZ", "ZvP", "PvT", "Mirrors",
+                     "Random", NULL);
+    for (i = 0; i < race_stats_month_count(global_race_stats); i++)
+    {
+        const struct race_counts *rc;
+        game_time_t start;
+        time_t start_int;
+        struct tm start_tm;
+        char month[LINE_MAX];
+
+        rc = race_stats_month(global_race_stats, i, &start);
+
+        /* Convert the month start to KST */
+        start_int = start + 32400;
+        gmtime_r(&start_int, &start_tm);
+        strftime(month, LINE_MAX, "%Y-%m", &start_tm);
+
+        races_row(ctx, file, month, rc);
+    }
+    html_end_table(ctx, file);
+
+  done:
+    write_footer(ctx, file);
+
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int races_row(void *ctx, FILE * file, const char *name,
+              const struct race_counts *rc)
+{
+    const char *games, *tvz, *zvp, *pvt, *mirrors, *random;
+    uint32_t mirror_count, random_count;
+    int r;
+
+    if (rc == NULL || race_counts_games(rc) == 0)
+        return 0;
+
+    /* Mirrors sit on the diagonal, anything a Random player was in is
+     * its row and column. */
+    mirror_count = 0;
+    random_count = 0;
+    for (r = 0; r < RACE_COUNT; r++)
+    {
+        if (r != RACE_RANDOM)
+            mirror_count += rc->wins[r][r];
+        random_count += rc->wins[RACE_RANDOM][r];
+        if (r != RACE_RANDOM)
+            random_count += rc->wins[r][RACE_RANDOM];
+    }
+
+    games = talloc_asprintf(ctx, "%u", (unsigned)race_counts_games(rc));
+    tvz = format_matchup(ctx, rc, RACE_TERRAN, RACE_ZERG);
+    zvp = format_matchup(ctx, rc, RACE_ZERG, RACE_PROTOSS);
+    pvt = format_matchup(ctx, rc, RACE_PROTOSS, RACE_TERRAN);
+    mirrors = talloc_asprintf(ctx, "%u", (unsigned)mirror_count);
+    random = talloc_asprintf(ctx, "%u", (unsigned)random_count);
+
+    return html_table_row(ctx, file, name, games, tvz, zvp, pvt, mirrors,
+                          random, NULL);
+}
+
+const char *format_matchup(void *ctx, const struct race_counts *rc,
+                           enum race a, enum race b)
+{
+    uint32_t wins, losses;
+
+    wins = rc->wins[a][b];
+    losses = rc->wins[b][a];
+    if (wins + losses == 0)
+        return "";
+
+    return talloc_asprintf(ctx, "%u - %u (%.1f%%)", (unsigned)wins,
+                           (unsigned)losses,
+                           100.0 * wins / (double)(wins + losses));
+}
+
+int player_page_maps(void *pctx, FILE * file, struct player *player)
+{
+    static const enum race races[] = {
+        RACE_TERRAN, RACE_ZERG, RACE_PROTOSS
+    };
+    struct collect_breakdowns_args args;
+    void *ctx;
+    size_t i;
+
+    if (global_performance_table == NULL || global_timeline == NULL
+        || player_index(player) < 0)
+        return 0;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        return 1;
+
+    args.ctx = ctx;
+    args.breakdowns = talloc_array(ctx, struct breakdown, 1);
+    args.count = 0;
+    args.alloc = 1;
+    if (args.breakdowns == NULL
+        || performance_each_map(global_performance_table,
+                                player_index(player), &collect_breakdown,
+                                &args) != 0)
+        goto failure;
+
+    qsort(args.breakdowns, args.count, sizeof(*args.breakdowns),
+          &compare_breakdowns);
+
+    html_start_table(ctx, file, "map_list", 1, true,
+                     "Map", "Games", "Record", "Win %", "Elo +/-",
+                     "vs Terran", "vs Zerg", "vs Protoss", NULL);
+
+    for (i = 0; i < args.count; i++)
+    {
+        const struct breakdown *b;
+        const char *vs[sizeof(races) / sizeof(races[0])];
+        const char *map_link, *games;
+        struct map *map;
+        size_t r;
+
+        b = args.breakdowns + i;
+        map = timeline_map(global_timeline, b->key);
+        if (map == NULL)
+            continue;
+
+        map_link = talloc_asprintf(ctx, "<a href=\"map_%s.html\">%s</a>",
+                                   map_key(map), map_name(map));
+        games = talloc_asprintf(ctx, "%d", b->p->wins + b->p->losses);
+
+        /* Every race breakdown is a cell of its own. */
+        for (r = 0; r < sizeof(races) / sizeof(races[0]); r++)
+        {
+            const struct performance *p;
+
+            p = performance_vs(global_performance_table,
+                               player_index(player), b->key, races[r]);
+            vs[r] = (p == NULL) ? "-" : format_record(ctx, p);
+        }
+
+        html_table_row(ctx, file, map_link, games, format_record(ctx, b->p),
+                       format_winrate(ctx, b->p), format_change(ctx, b->p),
+                       vs[0], vs[1], vs[2], NULL);
+    }
+
+    html_end_table(ctx, file);
+    fprintf(file, "<br/>\n");
+
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int map_page_players(void *pctx, FILE * file, struct map *map)
+{
+    struct collect_breakdowns_args args;
+    void *ctx;
+    size_t i;
+
+    if (global_performance_table == NULL || global_timeline == NULL
+        || map_index(map) < 0)
+        return 0;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        return 1;
+
+    args.ctx = ctx;
+    args.breakdowns = talloc_array(ctx, struct breakdown, 1);
+    args.count = 0;
+    args.alloc = 1;
+    if (args.breakdowns == NULL
+        || performance_each_player(global_performance_table, map_index(map),
+                                   &collect_breakdown, &args) != 0)
+        goto failure;
+
+    qsort(args.breakdowns, args.count, sizeof(*args.breakdowns),
+          &compare_breakdowns);
+
+    html_start_table(ctx, file, "player_list", 1, true,
+                     "Player", "Games", "Record", "Win %", "Elo +/-", NULL);
+
+    for (i = 0; i < args.count; i++)
+    {
+        const struct breakdown *b;
+        const char *player_link, *games;
+        struct player *player;
+
+        b = args.breakdowns + i;
+        player = timeline_player(global_timeline, b->key);
+        if (player == NULL)
+            continue;
+
+        player_link =
+            talloc_asprintf(ctx, "<a href=\"player_%s.html\">%s</a> (%s)",
+                            player_key(player), player_id(player),
+                            race_string(player_race(player)));
+        games = talloc_asprintf(ctx, "%d", b->p->wins + b->p->losses);
+        html_table_row(ctx, file, player_link, games, format_record(ctx, b->p),
+                       format_winrate(ctx, b->p), format_change(ctx, b->p),
+                       NULL);
+    }
+
+    html_end_table(ctx, file);
+    fprintf(file, "<br/>\n");
+
+    TALLOC_FREE(ctx);
     return 0;
 
   failure:
-    fclose(file);
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int collect_breakdown(int key, const struct performance *p, void *args_uc)
+{
+    struct collect_breakdowns_args *args;
+    struct breakdown *b;
+
+    args = args_uc;
+    if (args->count == args->alloc)
+    {
+        b = talloc_realloc(args->ctx, args->breakdowns, struct breakdown,
+                           args->alloc * 2);
+        if (b == NULL)
+            return -1;
+
+        args->breakdowns = b;
+        args->alloc *= 2;
+    }
+
+    b = args->breakdowns + args->count++;
+    b->key = key;
+    b->p = p;
+    return 0;
+}
+
+int compare_breakdowns(const void *a_uncast, const void *b_uncast)
+{
+    const struct breakdown *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    if (a->p->wins + a->p->losses != b->p->wins + b->p->losses)
+        return (b->p->wins + b->p->losses) - (a->p->wins + a->p->losses);
+    return a->key - b->key;
+}
+
+const char *format_record(void *ctx, const struct performance *p)
+{
+    return talloc_asprintf(ctx, "%d - %d", p->wins, p->losses);
+}
+
+const char *format_winrate(void *ctx, const struct performance *p)
+{
+    return talloc_asprintf(ctx, "%.02f%%",
+                           p->wins * 100.0 / (p->wins + p->losses));
+}
+
+const char *format_change(void *ctx, const struct performance *p)
+{
+    return talloc_asprintf(ctx, "%+d", (int)(p->elo_change
+                                             + (p->elo_change < 0
+                                                ? -0.5 : 0.5)));
+}
+
+int generate_movers_page(void *pctx, const char *filename)
+{
+    FILE *file;
+    void *ctx;
+    size_t period;
+
+    file = open_page(filename);
+    if (file == NULL)
+        return 1;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    write_header(ctx, file, "Biggest Movers", true);
+
+    html_start_table(ctx, file, "mover_list", 0, true,
+                     "Month", "ID", "From", "To", NULL);
+
+    period = 0;
+    if (global_rank_tree != NULL && global_timeline != NULL)
+        period = rank_tree_period_count(global_rank_tree);
+
+    /* Newest periods go first, as they're the interesting ones. */
+    while (period-- > 0)
+    {
+        const struct rank_mover *movers;
+        time_t start_int;
+        struct tm start_tm;
+        char month[LINE_MAX];
+        int count;
+        int i;
+
+        /* Convert the period start to KST */
+        start_int = rank_tree_period_start(global_rank_tree, period) + 32400;
+        gmtime_r(&start_int, &start_tm);
+        strftime(month, LINE_MAX, "%Y-%m", &start_tm);
+
+        count = rank_tree_period_movers(global_rank_tree, period, &movers);
+        for (i = 0; i < count; i++)
+        {
+            struct player *player;
+            const char *player_link, *from, *to;
+
+            player = timeline_player(global_timeline, movers[i].player);
+            if (player == NULL)
+                continue;
+
+            player_link = talloc_asprintf(ctx,
+                                          "<a href=\"player_%s.html\">%s</a>",
+                                          player_key(player),
+                                          player_id(player));
+            from = talloc_asprintf(ctx, "%d", movers[i].from);
+            to = talloc_asprintf(ctx, "%d", movers[i].to);
+            html_table_row(ctx, file, month, player_link, from, to, NULL);
+        }
+    }
+
+    html_end_table(ctx, file);
+
+    write_footer(ctx, file);
+
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int generate_pool_list(void *pctx, const char *filename)
+{
+    FILE *file;
+    void *ctx;
+    int i;
+
+    file = open_page(filename);
+    if (file == NULL)
+        return 1;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    write_header(ctx, file, "Rating Pools", true);
+
+    html_start_table(ctx, file, "pool_list", 0, false, "Name", NULL);
+
+    for (i = 0; global_pool_set != NULL
+         && i < pool_set_count(global_pool_set); i++)
+    {
+        const char *pool_link;
+
+        pool_link = talloc_asprintf(ctx, "<a href=\"pool_%s.html\">%s</a>",
+                                    pool_key(global_pool_set, i),
+                                    pool_name(global_pool_set, i));
+        html_table_row(ctx, file, pool_link, NULL);
+    }
+
+    html_end_table(ctx, file);
+
+    write_footer(ctx, file);
+
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    close_page(file, filename);
+    TALLOC_FREE(ctx);
+    return 1;
+}
+
+int generate_pool_page(void *pctx, const char *outdir, int pool)
+{
+    void *ctx;
+    const char *file_name;
+    const char *page_title;
+    FILE *file;
+    size_t i;
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        return 1;
+
+    file_name = talloc_asprintf(ctx, "%s/pool_%s.html",
+                                outdir, pool_key(global_pool_set, pool));
+
+    file = open_page(file_name);
+    if (file == NULL)
+        goto failure;
+
+    page_title = talloc_asprintf(ctx, "Pool Page: %s\n",
+                                 pool_name(global_pool_set, pool));
+    write_header(ctx, file, page_title, true);
+
+    fprintf(file, "Name: <b>%s</b><br/>\n", pool_name(global_pool_set, pool));
+
+    html_start_table(ctx, file, "player_list", 2, true,
+                     "ID", "Race", "ELO", "Record", NULL);
+
+    /* Only players that have played a game in this pool are listed. */
+    for (i = 0; global_timeline != NULL
+         && i < timeline_player_count(global_timeline); i++)
+    {
+        struct player *player;
+        int wins, losses;
+        const char *player_link, *elo, *record;
+
+        wins = pool_wins(global_pool_set, pool, i);
+        losses = pool_losses(global_pool_set, pool, i);
+        if (wins + losses == 0)
+            continue;
+
+        player = timeline_player(global_timeline, i);
+        player_link = talloc_asprintf(ctx,
+                                      "<a href=\"player_%s.html\">%s</a>",
+                                      player_key(player), player_id(player));
+        elo = talloc_asprintf(ctx, "%d",
+                              (int)pool_elo(global_pool_set, pool, i));
+        record = talloc_asprintf(ctx, "%d - %d", wins, losses);
+        html_table_row(ctx, file, player_link,
+                       race_string(player_race(player)), elo, record, NULL);
+    }
+
+    html_end_table(ctx, file);
+
+    write_footer(ctx, file);
+
+    close_page(file, file_name);
+    TALLOC_FREE(ctx);
+    return 0;
+
+  failure:
+    if (ctx != NULL)
+        TALLOC_FREE(ctx);
+    return 1;
+}
+
+int generate_map_list(void *pctx, const char *filename)
+{
+    FILE *file;
+    void *ctx;
+    struct map_list_table_iter_args mlti_args;
+
+    file = open_page(filename);
+
+    ctx = stats_scratch_new(pctx, STATS_MEMORY_HTML);
+    if (ctx == NULL)
+        goto failure;
+
+    write_header(ctx, file, "Map List", true);
+
+    html_start_table(ctx, file, "map_list", 0, false, "Name", NULL);
+
+    mlti_args.file = file;
+    mlti_args.pctx = ctx;
+    map_list_each(global_map_list, &map_list_table_iter, &mlti_args);
+
+    html_end_table(ctx, file);
+
+    write_footer(ctx, file);
+
+    close_page(file, filename);
+    return 0;
+
+  failure:
+    close_page(file, filename);
     TALLOC_FREE(ctx);
     return 1;
 }
@@ -506,14 +1545,14 @@ int map_list_table_iter(struct map *map, void *args_uc)
     void *ctx;
 
     args = args_uc;
-    ctx = talloc_new(args->pctx);
+    ctx = stats_scratch_new(args->pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         goto failure;
 
     map_link = talloc_asprintf(ctx, "<a href=\"map_%s.html\">%s</a>",
                                map_key(map), map_name(map));
 
-    table_row(ctx, args->file, map_link, NULL);
+    html_table_row(ctx, args->file, map_link, NULL);
 
     TALLOC_FREE(ctx);
     return 0;
@@ -534,14 +1573,18 @@ int generate_map_page(struct map *map, void *args_uncast)
     struct map_page_table_args mpt_args;
 
     args = args_uncast;
-    ctx = talloc_new(args->pctx);
+    if (only_maps != NULL && map_index(map) >= 0
+        && !bitmap_contains(only_maps, map_index(map)))
+        return 0;
+
+    ctx = stats_scratch_new(args->pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         return 1;
 
     file_name = talloc_asprintf(ctx, "%s/map_%s.html",
                                 args->outdir, map_key(map));
 
-    file = fopen(file_name, "w");
+    file = open_page(file_name);
     if (file == NULL)
         goto failure;
 
@@ -558,20 +1601,23 @@ int generate_map_page(struct map *map, void *args_uncast)
     fprintf(file, "PvT: <b>%d</b> - <b>%d</b> (%.02f%%)<br/>\n",
             map_pvt_wins(map), map_pvt_losses(map),
             map_pvt_winrate(map) * 100);
+    fprintf(file, "<br/>\n");
+
+    map_page_players(ctx, file, map);
 
-    start_table(ctx, file, "game_list", 1, true,
-                "Tournament", "Date", "Winner", "Loser", NULL);
+    html_start_table(ctx, file, "game_list", 1, true,
+                     "Tournament", "Date", "Winner", "Loser", NULL);
 
     mpt_args.pctx = ctx;
     mpt_args.file = file;
     mpt_args.map_key = map_key(map);
     map_each_game(map, &map_page_table, &mpt_args);
 
-    end_table(ctx, file);
+    html_end_table(ctx, file);
 
     write_footer(ctx, file);
 
-    fclose(file);
+    close_page(file, file_name);
     TALLOC_FREE(ctx);
     return 0;
 
@@ -593,7 +1639,7 @@ int map_page_table(struct game *game, void *args_uncast)
     const char *winner_link, *loser_link;
 
     args = args_uncast;
-    ctx = talloc_new(args->pctx);
+    ctx = stats_scratch_new(args->pctx, STATS_MEMORY_HTML);
     if (ctx == NULL)
         return 1;
 
@@ -625,9 +1671,9 @@ int map_page_table(struct game *game, void *args_uncast)
     if (winner_link == NULL || loser_link == NULL)
         goto failure;
 
-    table_row(ctx, args->file,
-              game_league_name(game),
-              game_time_str, winner_link, loser_link, NULL);
+    html_table_row(ctx, args->file,
+                   game_league_name(game),
+                   game_time_str, winner_link, loser_link, NULL);
 
     TALLOC_FREE(ctx);
     return 0;
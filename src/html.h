@@ -22,7 +22,38 @@
 #ifndef HTML_H
 #define HTML_H
 
+#include "bitmap.h"
+#include "player.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
 /* Cleans the given output directory and generates a new one */
 int html_generate(void *parent_context, const char *outdir);
 
+/* Regenerates the given output directory in place, only touching the
+ * pages whose contents have changed since they were last written.
+ * Player and map pages are only looked at for the players and maps
+ * whose index is in "players" and "maps", either of which can be NULL
+ * to look at every one; every other page is always looked at.
+ * Returns the number of pages rewritten, or -1 on failure. */
+int html_update(void *parent_context, const char *outdir,
+                const struct bitmap *players, const struct bitmap *maps);
+
+/* Creates a new table.  id is what ends up inside the ID field of the
+ * <table> tag.  sort_index is the index to start sorting by.
+ * reverse_sort only controls the starting index's reverse sort.  The
+ * column names follow, ending with NULL. */
+int html_start_table(void *pctx, FILE * file, const char *id,
+                     int sort_index, bool reverse_sort, ...);
+
+/* Writes one row of a table, with the cells ending with NULL. */
+int html_table_row(void *pctx, FILE * file, ...);
+
+int html_end_table(void *pctx, FILE * file);
+
+/* Writes a player's row of the player list: their rank, a link to
+ * their page, race, rating and peak rating. */
+int html_player_row(void *pctx, FILE * file, struct player *player);
+
 #endif
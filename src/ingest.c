@@ -0,0 +1,283 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "ingest.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+#include <unistd.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A queued game.  These are allocated with malloc() rather than
+ * talloc, as producers may be on any thread. */
+struct ingest_node
+{
+    struct ingest_node *next;
+    enum ingest_op op;
+    char line[INGEST_LINE_MAX];
+};
+
+/* An intrusive multi-producer, single-consumer queue: producers swap
+ * themselves in at the head and then link the old head to themselves,
+ * while the consumer follows the links from the tail.  The stub node
+ * means the queue is never truly empty, so producers never have to
+ * touch the tail. */
+struct ingest
+{
+    struct ingest_node *head;
+    struct ingest_node *tail;
+    struct ingest_node stub;
+
+    /* Set by the consumer when it's about to sleep, so producers know
+     * to wake it up through the pipe. */
+    int waiting;
+    int wake_fds[2];
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int ingest_destructor(struct ingest *in);
+
+static void push_node(struct ingest *in, struct ingest_node *node);
+
+/* Takes the oldest node off the queue, or returns NULL if there isn't
+ * one ready yet. */
+static struct ingest_node *pop_node(struct ingest *in);
+
+/* Returns TRUE if a node may be waiting. */
+static int maybe_waiting(struct ingest *in);
+
+/* Wakes the consumer up if it's asleep. */
+static void wake(struct ingest *in);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct ingest *ingest_new(void *ctx)
+{
+    struct ingest *in;
+
+    in = talloc(ctx, struct ingest);
+    if (in == NULL)
+        return NULL;
+
+    in->stub.next = NULL;
+    in->head = &in->stub;
+    in->tail = &in->stub;
+    in->waiting = 1;
+
+    if (pipe(in->wake_fds) != 0)
+    {
+        perror("pipe");
+        TALLOC_FREE(in);
+        return NULL;
+    }
+
+    fcntl(in->wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(in->wake_fds[1], F_SETFL, O_NONBLOCK);
+    talloc_set_destructor(in, &ingest_destructor);
+
+    return in;
+}
+
+int ingest_push(struct ingest *in, enum ingest_op op, const char *line)
+{
+    struct ingest_node *node;
+    char map[INGEST_LINE_MAX], p1[INGEST_LINE_MAX], p2[INGEST_LINE_MAX];
+    char winner;
+    long time;
+
+    if (strlen(line) >= INGEST_LINE_MAX)
+        return -1;
+
+    /* The same format game_parse() reads, which can't overflow these
+     * buffers as they're as long as the whole line. */
+    if (sscanf(line, "%ld %s %s %c %s", &time, map, p1, &winner, p2) != 5)
+        return -1;
+    if (winner != '<' && winner != '>')
+        return -1;
+
+    node = malloc(sizeof(*node));
+    if (node == NULL)
+        return -1;
+
+    node->op = op;
+    strcpy(node->line, line);
+    push_node(in, node);
+
+    wake(in);
+    return 0;
+}
+
+int ingest_fd(struct ingest *in)
+{
+    return in->wake_fds[0];
+}
+
+struct ingest_record *ingest_take(struct ingest *in, void *ctx, size_t max,
+                                  size_t *count)
+{
+    struct ingest_record *records;
+    char buf[64];
+    size_t alloc;
+
+    *count = 0;
+    alloc = 0;
+    records = NULL;
+
+    while (read(in->wake_fds[0], buf, sizeof(buf)) > 0)
+        ;
+
+    while (*count < max)
+    {
+        struct ingest_node *node;
+
+        node = pop_node(in);
+        if (node == NULL)
+            break;
+
+        if (*count == alloc)
+        {
+            struct ingest_record *grown;
+
+            alloc = (alloc == 0) ? 64 : alloc * 2;
+            grown = talloc_realloc(ctx, records, struct ingest_record, alloc);
+            if (grown == NULL)
+            {
+                free(node);
+                break;
+            }
+            records = grown;
+        }
+
+        records[*count].op = node->op;
+        records[*count].line = talloc_strdup(records, node->line);
+        free(node);
+        if (records[*count].line != NULL)
+            (*count)++;
+    }
+
+    /* Anything pushed after this point will wake us, and anything
+     * pushed before it (or left over) means there's more to do right
+     * away. */
+    __atomic_store_n(&in->waiting, 1, __ATOMIC_SEQ_CST);
+    if (maybe_waiting(in))
+        wake(in);
+
+    return records;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int ingest_destructor(struct ingest *in)
+{
+    struct ingest_node *node;
+
+    while ((node = pop_node(in)) != NULL)
+        free(node);
+
+    close(in->wake_fds[0]);
+    close(in->wake_fds[1]);
+    return 0;
+}
+
+void push_node(struct ingest *in, struct ingest_node *node)
+{
+    struct ingest_node *prev;
+
+    node->next = NULL;
+    prev = __atomic_exchange_n(&in->head, node, __ATOMIC_ACQ_REL);
+
+    /* Between the exchange and this store the queue is briefly broken
+     * in two, the consumer just waits for the link to show up. */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+struct ingest_node *pop_node(struct ingest *in)
+{
+    struct ingest_node *tail, *next, *head;
+
+    tail = in->tail;
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &in->stub)
+    {
+        if (next == NULL)
+            return NULL;
+
+        in->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL)
+    {
+        in->tail = next;
+        return tail;
+    }
+
+    /* The tail is the last node, unless a producer is part way through
+     * adding another after it. */
+    head = __atomic_load_n(&in->head, __ATOMIC_ACQUIRE);
+    if (tail != head)
+        return NULL;
+
+    /* Puts the stub back behind the last node so it can be taken. */
+    push_node(in, &in->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next != NULL)
+    {
+        in->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+int maybe_waiting(struct ingest *in)
+{
+    struct ingest_node *tail;
+
+    tail = in->tail;
+    if (tail != &in->stub)
+        return 1;
+
+    return __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void wake(struct ingest *in)
+{
+    /* Only whoever finds the consumer asleep writes to the pipe, so it
+     * never fills up. */
+    if (__atomic_exchange_n(&in->waiting, 0, __ATOMIC_SEQ_CST))
+        if (write(in->wake_fds[1], "", 1) != 1)
+            perror("ingest");
+}
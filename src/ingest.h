@@ -0,0 +1,73 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INGEST_H
+#define INGEST_H
+
+/* A queue of new games waiting to be rated.  Any number of threads can
+ * push games in at once without ever taking a lock, while a single
+ * consumer takes them out in batches.  Games are pushed as the text of
+ * a league file's GAME line (without the "GAME" itself), and only
+ * their format is checked on the way in: whether the players and map
+ * exist is up to the consumer.  Games can be taken back out again the
+ * same way, to correct mistakes. */
+struct ingest;
+
+#include <stddef.h>
+
+/* What to do with a queued game. */
+enum ingest_op
+{
+    INGEST_ADD,
+    INGEST_REMOVE
+};
+
+/* A single queued game, as handed to the consumer. */
+struct ingest_record
+{
+    enum ingest_op op;
+    char *line;
+};
+
+/* The longest game line that can be queued. */
+#ifndef INGEST_LINE_MAX
+#define INGEST_LINE_MAX 256
+#endif
+
+/* Creates an empty queue. */
+struct ingest *ingest_new(void *ctx);
+
+/* Queues up a single game, from any thread.  Returns 0 on success, or
+ * -1 if the game line is malformed. */
+int ingest_push(struct ingest *in, enum ingest_op op, const char *line);
+
+/* Returns a descriptor that becomes readable whenever there are games
+ * waiting, for the consumer to poll() on. */
+int ingest_fd(struct ingest *in);
+
+/* Takes up to "max" waiting games off the queue, in the order they
+ * were pushed.  They're returned as an array allocated under the given
+ * context, with the number of them stored in "count".  Only one thread
+ * may ever take games from a queue. */
+struct ingest_record *ingest_take(struct ingest *in, void *ctx, size_t max,
+                                  size_t *count);
+
+#endif
@@ -0,0 +1,711 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <talloc.h>
+#include <unistd.h>
+
+/* Every journal starts with this, so nothing else gets replayed. */
+#define JOURNAL_MAGIC "BWJ1"
+#define JOURNAL_MAGIC_LEN 4
+
+/* The longest key a record can hold. */
+#ifndef JOURNAL_KEY_MAX
+#define JOURNAL_KEY_MAX 255
+#endif
+
+/* The largest a single record can be: the op, the time, three keys
+ * with their lengths and the checksum. */
+#define JOURNAL_RECORD_MAX (1 + 10 + 3 * (2 + JOURNAL_KEY_MAX) + 4)
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct journal
+{
+    const char *path;
+
+    /* The previous journal is moved here while it's being compacted,
+     * and removed once that's done. */
+    const char *old_path;
+    int old_exists;
+
+    int fd;
+
+    /* The number of bytes in the file, and the records that haven't
+     * been written to it yet. */
+    off_t size;
+    unsigned char *buf;
+    size_t used;
+    size_t alloc;
+
+    /* The background compaction, if there's one. */
+    pthread_t thread;
+    int running;
+    int done;
+    int failed;
+};
+
+/* Everything the compaction thread needs.  This is allocated with
+ * malloc(), as it's freed by the thread. */
+struct compaction
+{
+    struct journal *journal;
+    char *text;
+    char *tmp_path;
+    char *path;
+    char *dir;
+    char *old_path;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int journal_destructor(struct journal *j);
+
+/* Replays a single journal file, which may not exist. */
+static int replay_file(const char *path,
+                       int (*func) (const struct journal_entry *, void *),
+                       void *arg);
+
+/* Replays every good record in an open journal, storing the length of
+ * the good part in "good".  Returns -1 if it isn't a journal at all or
+ * can't be read. */
+static int replay_fd(int fd, const char *path,
+                     int (*func) (const struct journal_entry *, void *),
+                     void *arg, off_t *good);
+
+/* Starts a new, empty journal file. */
+static int create_file(struct journal *j);
+
+/* Waits for any finished compaction, returning TRUE if one is still
+ * running. */
+static int reap_compaction(struct journal *j);
+static void *compact(void *job_uncast);
+static void free_compaction(struct compaction *job);
+
+static int write_all(int fd, const void *buf, size_t len);
+
+/* Flushes a directory, so renames in it are durable. */
+static int sync_dir(const char *dir);
+
+/* Returns a copy of the directory part of a path. */
+static char *dir_of(void *ctx, const char *path);
+
+static unsigned char *put_varint(unsigned char *p, uint64_t v);
+static const unsigned char *get_varint(const unsigned char *p,
+                                       const unsigned char *end,
+                                       uint64_t *v);
+static uint32_t crc32(const unsigned char *p, size_t len);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct journal *journal_open(void *ctx, const char *path,
+                             int (*func) (const struct journal_entry *,
+                                          void *), void *arg)
+{
+    struct journal *j;
+    struct stat sb;
+    off_t good;
+
+    j = talloc(ctx, struct journal);
+    if (j == NULL)
+        return NULL;
+
+    j->path = talloc_strdup(j, path);
+    j->old_path = talloc_asprintf(j, "%s.compacting", path);
+    j->fd = -1;
+    j->size = 0;
+    j->buf = NULL;
+    j->used = 0;
+    j->alloc = 0;
+    j->running = 0;
+    j->done = 0;
+    j->failed = 0;
+    talloc_set_destructor(j, &journal_destructor);
+
+    if (j->path == NULL || j->old_path == NULL)
+        goto failure;
+
+    /* Records that were on their way into a league file when we last
+     * stopped come first. */
+    j->old_exists = (stat(j->old_path, &sb) == 0);
+    if (j->old_exists && replay_file(j->old_path, func, arg) != 0)
+        goto failure;
+
+    j->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (j->fd < 0)
+    {
+        perror(path);
+        goto failure;
+    }
+
+    if (replay_fd(j->fd, path, func, arg, &good) != 0)
+        goto failure;
+
+    if (good == 0)
+    {
+        if (create_file(j) != 0)
+            goto failure;
+    }
+    else
+    {
+        if (fstat(j->fd, &sb) == 0 && sb.st_size > good)
+        {
+            fprintf(stderr, "%s: dropping %ld torn byte(s)\n", path,
+                    (long)(sb.st_size - good));
+            if (ftruncate(j->fd, good) != 0 || fsync(j->fd) != 0)
+            {
+                perror(path);
+                goto failure;
+            }
+        }
+
+        j->size = good;
+        if (lseek(j->fd, good, SEEK_SET) < 0)
+            goto failure;
+    }
+
+    return j;
+
+  failure:
+    TALLOC_FREE(j);
+    return NULL;
+}
+
+int journal_replay(const char *path,
+                   int (*func) (const struct journal_entry *, void *),
+                   void *arg)
+{
+    char *old_path;
+    int ret;
+
+    old_path = talloc_asprintf(NULL, "%s.compacting", path);
+    if (old_path == NULL)
+        return -1;
+
+    ret = replay_file(old_path, func, arg);
+    TALLOC_FREE(old_path);
+    if (ret != 0)
+        return ret;
+
+    return replay_file(path, func, arg);
+}
+
+int journal_append(struct journal *j, const struct journal_entry *e)
+{
+    unsigned char *start, *p;
+    const char *keys[3];
+    uint64_t time;
+    uint32_t crc;
+    int i;
+
+    if (j->used + JOURNAL_RECORD_MAX > j->alloc)
+    {
+        unsigned char *grown;
+        size_t alloc;
+
+        alloc = (j->alloc == 0) ? 4096 : j->alloc * 2;
+        grown = talloc_realloc(j, j->buf, unsigned char, alloc);
+        if (grown == NULL)
+            return -1;
+
+        j->buf = grown;
+        j->alloc = alloc;
+    }
+
+    keys[0] = e->map_key;
+    keys[1] = e->winner_key;
+    keys[2] = e->loser_key;
+    for (i = 0; i < 3; i++)
+        if (strlen(keys[i]) > JOURNAL_KEY_MAX)
+            return -1;
+
+    /* Times are zig-zag encoded, so the odd negative one stays
+     * short. */
+    time = ((uint64_t)e->time << 1) ^ (uint64_t)(e->time >> 63);
+
+    start = p = j->buf + j->used;
+    *p++ = (unsigned char)e->op;
+    p = put_varint(p, time);
+    for (i = 0; i < 3; i++)
+    {
+        size_t len;
+
+        len = strlen(keys[i]);
+        p = put_varint(p, len);
+        memcpy(p, keys[i], len);
+        p += len;
+    }
+
+    crc = crc32(start, p - start);
+    for (i = 0; i < 4; i++)
+        *p++ = (crc >> (8 * i)) & 0xFF;
+
+    j->used = p - j->buf;
+    return 0;
+}
+
+int journal_sync(struct journal *j)
+{
+    if (j->used > 0)
+    {
+        if (write_all(j->fd, j->buf, j->used) != 0)
+        {
+            /* Whatever made it out is cut off again, so the next
+             * batch doesn't land after a torn record. */
+            perror(j->path);
+            if (ftruncate(j->fd, j->size) == 0)
+                lseek(j->fd, j->size, SEEK_SET);
+            j->used = 0;
+            return -1;
+        }
+
+        j->size += j->used;
+        j->used = 0;
+    }
+
+    if (fdatasync(j->fd) != 0)
+    {
+        perror(j->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int journal_needs_compaction(struct journal *j)
+{
+    return j->old_exists
+        || j->size + (off_t)j->used >= JOURNAL_COMPACT_BYTES;
+}
+
+int journal_compact(struct journal *j, const char *dir, const char *name,
+                    const char *text)
+{
+    struct compaction *job;
+    sigset_t stop_signals, old_signals;
+    int ret;
+
+    if (reap_compaction(j))
+        return 1;
+
+    if (journal_sync(j) != 0)
+        return -1;
+
+    /* The journal is moved out of the way, unless there's already an
+     * older one still waiting: the text covers that one too, and it
+     * can't be overwritten until the text is safely on disk. */
+    if (!j->old_exists)
+    {
+        if (rename(j->path, j->old_path) != 0)
+        {
+            perror(j->old_path);
+            return -1;
+        }
+
+        j->old_exists = 1;
+        close(j->fd);
+        j->fd = open(j->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (j->fd < 0 || create_file(j) != 0)
+        {
+            perror(j->path);
+            return -1;
+        }
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL)
+        return -1;
+
+    job->journal = j;
+    job->text = strdup(text);
+    job->path = malloc(strlen(dir) + strlen(name) + 2);
+    job->tmp_path = malloc(strlen(dir) + strlen(name) + 7);
+    job->dir = strdup(dir);
+    job->old_path = strdup(j->old_path);
+    if (job->text == NULL || job->path == NULL || job->tmp_path == NULL
+        || job->dir == NULL || job->old_path == NULL)
+    {
+        free_compaction(job);
+        return -1;
+    }
+
+    /* The temporary file is hidden, so nothing reads it as a league
+     * if it's left behind. */
+    sprintf(job->path, "%s/%s", dir, name);
+    sprintf(job->tmp_path, "%s/.%s.tmp", dir, name);
+
+    j->done = 0;
+    j->failed = 0;
+
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+    ret = pthread_create(&j->thread, NULL, &compact, job);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (ret != 0)
+    {
+        free_compaction(job);
+        return -1;
+    }
+
+    j->running = 1;
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int journal_destructor(struct journal *j)
+{
+    if (j->running)
+        pthread_join(j->thread, NULL);
+
+    if (j->fd >= 0)
+        close(j->fd);
+
+    return 0;
+}
+
+int replay_file(const char *path,
+                int (*func) (const struct journal_entry *, void *),
+                void *arg)
+{
+    int fd;
+    int ret;
+    off_t good;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return 0;
+
+        perror(path);
+        return -1;
+    }
+
+    ret = replay_fd(fd, path, func, arg, &good);
+    close(fd);
+    return ret;
+}
+
+int replay_fd(int fd, const char *path,
+              int (*func) (const struct journal_entry *, void *),
+              void *arg, off_t *good)
+{
+    struct stat sb;
+    unsigned char *data;
+    const unsigned char *p, *end;
+    ssize_t got;
+    size_t len;
+    int ret;
+
+    *good = 0;
+    if (fstat(fd, &sb) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (sb.st_size == 0)
+        return 0;
+
+    len = sb.st_size;
+    data = malloc(len);
+    if (data == NULL)
+        return -1;
+
+    got = pread(fd, data, len, 0);
+    if (got < JOURNAL_MAGIC_LEN
+        || memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0)
+    {
+        fprintf(stderr, "%s: not a journal\n", path);
+        free(data);
+        return -1;
+    }
+
+    ret = 0;
+    end = data + got;
+    p = data + JOURNAL_MAGIC_LEN;
+    while (p < end)
+    {
+        struct journal_entry e;
+        char keys[3][JOURNAL_KEY_MAX + 1];
+        const unsigned char *start;
+        uint64_t time, klen;
+        uint32_t crc;
+        int i;
+
+        start = p;
+        e.op = *p++;
+        if (e.op != JOURNAL_ADD && e.op != JOURNAL_REMOVE)
+            break;
+
+        if ((p = get_varint(p, end, &time)) == NULL)
+            break;
+
+        for (i = 0; i < 3; i++)
+        {
+            if ((p = get_varint(p, end, &klen)) == NULL
+                || klen > JOURNAL_KEY_MAX || (uint64_t)(end - p) < klen)
+                break;
+
+            memcpy(keys[i], p, klen);
+            keys[i][klen] = '\0';
+            p += klen;
+        }
+
+        if (i < 3 || end - p < 4)
+            break;
+
+        crc = (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+            | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        if (crc != crc32(start, p - start))
+            break;
+        p += 4;
+
+        e.time = (game_time_t)(time >> 1) ^ -(game_time_t)(time & 1);
+        e.map_key = keys[0];
+        e.winner_key = keys[1];
+        e.loser_key = keys[2];
+        if ((ret = func(&e, arg)) != 0)
+            break;
+
+        *good = p - data;
+    }
+
+    if (*good == 0)
+        *good = JOURNAL_MAGIC_LEN;
+
+    free(data);
+    return ret;
+}
+
+int create_file(struct journal *j)
+{
+    char *dir;
+    int ret;
+
+    if (ftruncate(j->fd, 0) != 0 || lseek(j->fd, 0, SEEK_SET) != 0
+        || write_all(j->fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0
+        || fsync(j->fd) != 0)
+        return -1;
+
+    j->size = JOURNAL_MAGIC_LEN;
+
+    dir = dir_of(j, j->path);
+    ret = (dir == NULL) ? -1 : sync_dir(dir);
+    TALLOC_FREE(dir);
+    return ret;
+}
+
+int reap_compaction(struct journal *j)
+{
+    if (!j->running)
+        return 0;
+
+    if (!__atomic_load_n(&j->done, __ATOMIC_ACQUIRE))
+        return 1;
+
+    pthread_join(j->thread, NULL);
+    j->running = 0;
+
+    /* A failed compaction leaves the old journal where it is, so the
+     * next one tries again. */
+    if (!j->failed)
+        j->old_exists = 0;
+
+    return 0;
+}
+
+void *compact(void *job_uncast)
+{
+    struct compaction *job;
+    int fd;
+    int failed;
+
+    job = job_uncast;
+    failed = 1;
+
+    fd = open(job->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        perror(job->tmp_path);
+    else
+    {
+        if (write_all(fd, job->text, strlen(job->text)) != 0
+            || fsync(fd) != 0)
+            perror(job->tmp_path);
+        else if (rename(job->tmp_path, job->path) != 0)
+            perror(job->path);
+        else if (sync_dir(job->dir) != 0)
+            perror(job->dir);
+        else if (unlink(job->old_path) != 0)
+            perror(job->old_path);
+        else
+            failed = 0;
+
+        close(fd);
+    }
+
+    if (failed)
+        unlink(job->tmp_path);
+
+    job->journal->failed = failed;
+    __atomic_store_n(&job->journal->done, 1, __ATOMIC_RELEASE);
+    free_compaction(job);
+    return NULL;
+}
+
+void free_compaction(struct compaction *job)
+{
+    free(job->text);
+    free(job->tmp_path);
+    free(job->path);
+    free(job->dir);
+    free(job->old_path);
+    free(job);
+}
+
+int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p;
+
+    p = buf;
+    while (len > 0)
+    {
+        ssize_t wrote;
+
+        wrote = write(fd, p, len);
+        if (wrote < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        p += wrote;
+        len -= wrote;
+    }
+
+    return 0;
+}
+
+int sync_dir(const char *dir)
+{
+    int fd;
+    int ret;
+
+    fd = open(dir, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+char *dir_of(void *ctx, const char *path)
+{
+    const char *slash;
+
+    slash = strrchr(path, '/');
+    if (slash == NULL)
+        return talloc_strdup(ctx, ".");
+
+    return talloc_strndup(ctx, path, slash - path);
+}
+
+unsigned char *put_varint(unsigned char *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+
+    *p++ = v;
+    return p;
+}
+
+const unsigned char *get_varint(const unsigned char *p,
+                                const unsigned char *end, uint64_t *v)
+{
+    int shift;
+
+    *v = 0;
+    for (shift = 0; p < end && shift < 64; shift += 7)
+    {
+        *v |= (uint64_t)(*p & 0x7F) << shift;
+        if ((*p++ & 0x80) == 0)
+            return p;
+    }
+
+    return NULL;
+}
+
+uint32_t crc32(const unsigned char *p, size_t len)
+{
+    static uint32_t table[256];
+    static int have_table = 0;
+    uint32_t crc;
+
+    /* The usual reflected CRC-32, as used by zlib. */
+    if (!have_table)
+    {
+        uint32_t i;
+
+        for (i = 0; i < 256; i++)
+        {
+            uint32_t c;
+            int k;
+
+            c = i;
+            for (k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+
+        have_table = 1;
+    }
+
+    crc = 0xFFFFFFFF;
+    while (len-- > 0)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    return crc ^ 0xFFFFFFFF;
+}
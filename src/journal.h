@@ -0,0 +1,97 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/* An append-only binary log of changes to the games, so games that
+ * come in while running survive a restart without rewriting any
+ * league files.  Each record is varint-encoded and checksummed, and
+ * records are made durable in batches with a single fsync().  When
+ * opened the journal is replayed on top of the league files, stopping
+ * at the first record that's torn or corrupt.  Every so often the
+ * journal is compacted: everything it holds is written out as a plain
+ * league file in the background, and the journal starts again empty,
+ * so replaying it at startup never takes long. */
+struct journal;
+
+#include "game.h"
+#include <stddef.h>
+
+/* Once the journal is this big it should be compacted. */
+#ifndef JOURNAL_COMPACT_BYTES
+#define JOURNAL_COMPACT_BYTES (1024 * 1024)
+#endif
+
+/* What a record does with its game. */
+enum journal_op
+{
+    JOURNAL_ADD = 1,
+    JOURNAL_REMOVE = 2
+};
+
+/* A single record, which refers to a game by its parts. */
+struct journal_entry
+{
+    enum journal_op op;
+    game_time_t time;
+    const char *map_key;
+    const char *winner_key;
+    const char *loser_key;
+};
+
+/* Opens the journal at the given path, creating it if it doesn't
+ * exist.  Every record it holds is passed to the given function
+ * first, including those still waiting on a compaction that didn't
+ * finish, so the function has to cope with seeing a record twice.  A
+ * torn record at the end is cut off.  Returns NULL on failure. */
+struct journal *journal_open(void *ctx, const char *path,
+                             int (*func) (const struct journal_entry *,
+                                          void *), void *arg);
+
+/* Replays the journal at the given path without opening it for
+ * writing, just like journal_open() does.  A missing journal is
+ * empty.  Returns 0 on success. */
+int journal_replay(const char *path,
+                   int (*func) (const struct journal_entry *, void *),
+                   void *arg);
+
+/* Adds a record to the journal.  It's only buffered in memory until
+ * the next call to journal_sync().  Returns 0 on success. */
+int journal_append(struct journal *j, const struct journal_entry *e);
+
+/* Writes out every buffered record and waits for it to reach the
+ * disk.  Returns 0 on success. */
+int journal_sync(struct journal *j);
+
+/* Returns TRUE when the journal has grown large enough that it should
+ * be compacted, or when a previous compaction didn't finish. */
+int journal_needs_compaction(struct journal *j);
+
+/* Compacts the journal into a league file, given the text of that
+ * file with every record so far folded in.  The journal is started
+ * again right away, while the file is written out to "dir/name" on
+ * a background thread.  Returns 0 when a compaction was started, 1 if
+ * one is already running, and -1 on failure. */
+int journal_compact(struct journal *j, const char *dir, const char *name,
+                    const char *text);
+
+#endif
@@ -0,0 +1,187 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "key_index.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <talloc.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A single slot in the hash table, empty slots have a NULL key. */
+struct key_index_slot
+{
+    const char *key;
+    uint32_t hash;
+    int index;
+};
+
+/* An open addressing hash table with linear probing, which is always
+ * a power of two in size and never more than half full. */
+struct key_index
+{
+    struct key_index_slot *slots;
+    size_t mask;
+    size_t count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static uint32_t hash_key(const char *key);
+static struct key_index_slot *find_slot(struct key_index *ki,
+                                        const char *key, uint32_t hash);
+static int grow(struct key_index *ki);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct key_index *key_index_new(void *ctx, size_t expected)
+{
+    struct key_index *ki;
+    size_t size;
+
+    ki = talloc(ctx, struct key_index);
+    if (ki == NULL)
+        return NULL;
+
+    size = 16;
+    while (size < expected * 2)
+        size *= 2;
+
+    ki->slots = talloc_zero_array(ki, struct key_index_slot, size);
+    if (ki->slots == NULL)
+    {
+        TALLOC_FREE(ki);
+        return NULL;
+    }
+
+    ki->mask = size - 1;
+    ki->count = 0;
+    return ki;
+}
+
+int key_index_add(struct key_index *ki, const char *key, int index)
+{
+    struct key_index_slot *slot;
+    uint32_t hash;
+
+    if ((ki->count + 1) * 2 > ki->mask + 1)
+        if (grow(ki) != 0)
+            return -1;
+
+    hash = hash_key(key);
+    slot = find_slot(ki, key, hash);
+    if (slot->key == NULL)
+    {
+        slot->key = talloc_strdup(ki, key);
+        if (slot->key == NULL)
+            return -1;
+
+        slot->hash = hash;
+        ki->count++;
+    }
+
+    slot->index = index;
+    return 0;
+}
+
+int key_index_get(struct key_index *ki, const char *key)
+{
+    struct key_index_slot *slot;
+
+    slot = find_slot(ki, key, hash_key(key));
+    if (slot->key == NULL)
+        return -1;
+
+    return slot->index;
+}
+
+size_t key_index_count(struct key_index *ki)
+{
+    return ki->count;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+uint32_t hash_key(const char *key)
+{
+    uint32_t hash;
+
+    /* FNV-1a, keys are short so there's no need for anything
+     * fancier. */
+    hash = 2166136261U;
+    while (*key != '\0')
+    {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+struct key_index_slot *find_slot(struct key_index *ki, const char *key,
+                                 uint32_t hash)
+{
+    size_t i;
+
+    i = hash & ki->mask;
+    while (ki->slots[i].key != NULL)
+    {
+        if (ki->slots[i].hash == hash && strcmp(ki->slots[i].key, key) == 0)
+            break;
+
+        i = (i + 1) & ki->mask;
+    }
+
+    return ki->slots + i;
+}
+
+int grow(struct key_index *ki)
+{
+    struct key_index_slot *old;
+    size_t old_size;
+    size_t i;
+
+    old = ki->slots;
+    old_size = ki->mask + 1;
+
+    ki->slots = talloc_zero_array(ki, struct key_index_slot, old_size * 2);
+    if (ki->slots == NULL)
+    {
+        ki->slots = old;
+        return -1;
+    }
+    ki->mask = old_size * 2 - 1;
+
+    /* The keys themselves are already owned by the index, so only the
+     * slots need moving. */
+    for (i = 0; i < old_size; i++)
+        if (old[i].key != NULL)
+            *find_slot(ki, old[i].key, old[i].hash) = old[i];
+
+    TALLOC_FREE(old);
+    return 0;
+}
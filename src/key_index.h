@@ -0,0 +1,47 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEY_INDEX_H
+#define KEY_INDEX_H
+
+/* Maps keys (for players, maps or leagues) to their integer index
+ * with a hash table, for when looking them up by walking a list is
+ * too slow. */
+struct key_index;
+
+#include <stddef.h>
+
+/* Creates an empty index sized for about the given number of keys,
+ * it grows as needed. */
+struct key_index *key_index_new(void *ctx, size_t expected);
+
+/* Associates a key with an index, copying the key.  Adding a key
+ * that's already present replaces its index.  Returns 0 on
+ * success. */
+int key_index_add(struct key_index *ki, const char *key, int index);
+
+/* Looks up the index of a key, returning -1 if it's not present. */
+int key_index_get(struct key_index *ki, const char *key);
+
+/* Returns the number of keys in the index. */
+size_t key_index_count(struct key_index *ki);
+
+#endif
@@ -20,9 +20,14 @@
  */
 
 #include "league.h"
+#include "text.h"
+#include "arena.h"
 #include "game_list.h"
 #include "player_list.h"
 #include "global.h"
+#include "key_index.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <ctype.h>
 #include <stdbool.h>
@@ -40,60 +45,96 @@ struct league
 {
     const char *name;
 
+    /* The key that uniquely identifies this league, which is the name
+     * of the file it was read from. */
+    const char *key;
+
     /* Lists every player in this league. */
     struct player_list *players;
 
     /* Lists every map played in this league. */
     struct map_list *maps;
 
-    /* Lists every game played during this league. */
+    /* Lists every game played during this league.  The games and
+     * their keys live in the arena, the list's nodes in its own. */
     struct game_list *games;
+    struct arena *arena;
+
+    /* This league's position in every per-league array. */
+    int index;
+};
+
+/* Builds up the text of a league file, see league_format(). */
+struct format_state
+{
+    void *tmp;
+
+    /* The PLAYER and MAP lines, followed by the GAME lines. */
+    char *header;
+    char *games;
+
+    /* Every player and map that's been listed so far. */
+    struct key_index *players;
+    struct key_index *maps;
 };
 
 /***********************************************************************
  * Static Method Headers                                               *
  ***********************************************************************/
 
-/* Returns TRUE if the haystack starts with the needle. */
-static bool string_starts_with(const char *haystack, const char *needle);
-
-/* Returts NULL if the haystack doesn't start with the needle.
- * Otherwise, removes the needle from the start of the hackstack and
- * strips any leading whitespace.  Note that no memory is allocated
- * here, it's just pointer arithmetic. */
-static const char *strip_front(const char *hs, const char *ne);
+/* Adds a single game to a league file being formatted. */
+static int format_game(struct game *game, void *state_uncast);
 
 /***********************************************************************
  * Extern Methods                                                      *
  ***********************************************************************/
-struct league *league_read_file(void *c, const char *filename)
+struct league *league_read_file(void *c, const char *filename,
+                                const char *key)
+{
+    return league_stream_file(c, filename, key, NULL, NULL);
+}
+
+struct league *league_stream_file(void *c, const char *filename,
+                                  const char *key,
+                                  int (*func) (struct league *,
+                                               struct game *, void *),
+                                  void *arg)
 {
     struct league *l;
     FILE *lf;
     char buf[LINE_MAX];
     void *tmp;
+    struct arena *games;
     const char *round;
     const char *group;
     int line_number;
 
-    l = talloc(c, struct league);
+    l = league_new(c, key, NULL);
     if (l == NULL)
         return NULL;
 
+    trace_begin("league", filename);
+
     /* Sets everything to the default. */
     line_number = 1;
+    lf = NULL;
     tmp = talloc_new(l);
     round = NULL;
     group = NULL;
-    l->name = NULL;
-    l->players = player_list_new(l, NULL);
-    l->maps = map_list_new(l, NULL);
-    l->games = game_list_new(l);
+
+    /* Games that aren't kept are parsed into an arena of their own,
+     * which is emptied out after each one. */
+    games = l->arena;
+    if (func != NULL)
+        games = arena_new(tmp, STATS_MEMORY_GAMES);
+    if (tmp == NULL || games == NULL)
+        goto error;
 
     /* Reads the input file. */
     lf = fopen(filename, "r");
     if (lf == NULL)
         goto error;
+    stats_count(STATS_FILES_READ, 1);
 
     while (fgets(buf, LINE_MAX, lf) != NULL)
     {
@@ -109,9 +150,9 @@ struct league *league_read_file(void *c, const char *filename)
         {
             /* Skip comments! */
         }
-        else if ((b = strip_front(buf, "NAME ")) != NULL)
+        else if ((b = text_strip_front(buf, "NAME ")) != NULL)
             l->name = talloc_strdup(l, b);
-        else if ((b = strip_front(buf, "PLAYER ")) != NULL)
+        else if ((b = text_strip_front(buf, "PLAYER ")) != NULL)
         {
             const char *k;
 
@@ -122,7 +163,7 @@ struct league *league_read_file(void *c, const char *filename)
                 goto error;
             }
         }
-        else if ((b = strip_front(buf, "MAP ")) != NULL)
+        else if ((b = text_strip_front(buf, "MAP ")) != NULL)
         {
             const char *k;
 
@@ -133,14 +174,14 @@ struct league *league_read_file(void *c, const char *filename)
                 goto error;
             }
         }
-        else if ((b = strip_front(buf, "ROUND ")) != NULL)
+        else if ((b = text_strip_front(buf, "ROUND ")) != NULL)
         {
-            round = talloc_strdup(tmp, b);
+            round = arena_intern(l->arena, b);
             group = NULL;
         }
-        else if ((b = strip_front(buf, "GROUP ")) != NULL)
-            group = talloc_strdup(tmp, b);
-        else if ((b = strip_front(buf, "GAME ")) != NULL)
+        else if ((b = text_strip_front(buf, "GROUP ")) != NULL)
+            group = arena_intern(l->arena, b);
+        else if ((b = text_strip_front(buf, "GAME ")) != NULL)
         {
             struct game *game;
             const char *winner_key, *loser_key;
@@ -148,7 +189,7 @@ struct league *league_read_file(void *c, const char *filename)
             const char *map_key;
             struct map *map;
 
-            game = game_parse(tmp, b, l->name, round, group);
+            game = game_parse_arena(games, b, l->name, round, group);
             if (game == NULL)
             {
                 fprintf(stderr, "%s:%d Unable to parse game data\n",
@@ -171,7 +212,17 @@ struct league *league_read_file(void *c, const char *filename)
             if (map == NULL)
                 goto error;
 
-            game_list_add(l->games, game);
+            /* Games that are out of order are dropped, as they always
+             * have been. */
+            if (func == NULL)
+                game_list_add(l->games, game);
+            else
+            {
+                if (func(l, game, arg) != 0)
+                    goto error;
+
+                arena_reset(games);
+            }
         }
         else if (strcmp(buf, "") == 0)
         {
@@ -185,6 +236,7 @@ struct league *league_read_file(void *c, const char *filename)
     TALLOC_FREE(tmp);
     fclose(lf);
     lf = NULL;
+    trace_end("league");
     return l;
 
   error:
@@ -195,31 +247,188 @@ struct league *league_read_file(void *c, const char *filename)
 
     TALLOC_FREE(tmp);
     TALLOC_FREE(l);
+    trace_end("league");
     return NULL;
 }
 
+struct league *league_new(void *c, const char *key, const char *name)
+{
+    struct league *l;
+
+    l = talloc(c, struct league);
+    if (l == NULL)
+        return NULL;
+
+    l->name = NULL;
+    l->key = NULL;
+    l->players = player_list_new(l, NULL);
+    l->maps = map_list_new(l, NULL);
+    l->arena = arena_new(l, STATS_MEMORY_GAMES);
+    l->games = game_list_new(l);
+    l->index = -1;
+
+    if (key != NULL)
+        l->key = talloc_strdup(l, key);
+
+    if (name != NULL)
+        l->name = talloc_strdup(l, name);
+
+    return stats_track(l, STATS_MEMORY_LEAGUES);
+}
+
+struct game *league_add_game(struct league *l, struct game *game)
+{
+    struct game *copy;
+
+    copy = game_copy(l->arena, game, l->name);
+    if (copy == NULL || game_list_insert(l->games, copy) != 0)
+        return NULL;
+
+    return copy;
+}
+
+int league_remove_game(struct league *l, struct game *game)
+{
+    return game_list_remove(l->games, game);
+}
+
+void *league_repack(struct league *l)
+{
+    void *old;
+    struct arena *arena;
+    struct game_list *games;
+    struct game_list_iterator *gli;
+    struct game *game;
+
+    old = talloc_new(l);
+    if (old == NULL)
+        return NULL;
+
+    arena = arena_new(l, STATS_MEMORY_GAMES);
+    games = game_list_new(l);
+    gli = league_game_iterator(l, old);
+    if (arena == NULL || games == NULL || gli == NULL)
+        goto failure;
+
+    while ((game = game_list_iterator_cur(gli)) != NULL)
+    {
+        struct game *copy;
+
+        copy = game_copy(arena, game, l->name);
+        if (copy == NULL || game_list_insert(games, copy) != 0)
+            goto failure;
+
+        game_list_iterator_next(gli);
+    }
+
+    TALLOC_FREE(gli);
+    talloc_steal(old, l->games);
+    talloc_steal(old, l->arena);
+    l->games = games;
+    l->arena = arena;
+    return old;
+
+  failure:
+    TALLOC_FREE(games);
+    TALLOC_FREE(arena);
+    TALLOC_FREE(old);
+    return NULL;
+}
+
+char *league_format(void *ctx, struct league *l)
+{
+    struct format_state state;
+
+    state.tmp = talloc_new(ctx);
+    if (state.tmp == NULL)
+        return NULL;
+
+    state.players = key_index_new(state.tmp, 64);
+    state.maps = key_index_new(state.tmp, 16);
+    state.header = talloc_asprintf(state.tmp, "NAME %s\n\n",
+                                   (l->name != NULL) ? l->name : l->key);
+    state.games = talloc_strdup(state.tmp, "\n");
+    if (state.players == NULL || state.maps == NULL
+        || state.header == NULL || state.games == NULL
+        || game_list_each(l->games, &format_game, &state) != 0)
+    {
+        TALLOC_FREE(state.tmp);
+        return NULL;
+    }
+
+    state.header = talloc_asprintf(ctx, "%s%s", state.header, state.games);
+    TALLOC_FREE(state.tmp);
+    return state.header;
+}
+
 struct game_list_iterator *league_game_iterator(struct league *l, void *c)
 {
     return game_list_iterator_new(c, l->games);
 }
 
+const char *league_name(struct league *l)
+{
+    return l->name;
+}
+
+const char *league_key(struct league *l)
+{
+    return l->key;
+}
+
+int league_index(struct league *l)
+{
+    return l->index;
+}
+
+void league_set_index(struct league *l, int index)
+{
+    l->index = index;
+}
+
 /***********************************************************************
  * Static Methods                                                      *
  ***********************************************************************/
-bool string_starts_with(const char *haystack, const char *needle)
+static int format_game(struct game *game, void *state_uncast)
 {
-    return (strncmp(haystack, needle, strlen(needle)) == 0);
-}
+    struct format_state *state;
+    const char *keys[2];
+    int i;
 
-const char *strip_front(const char *haystack, const char *needle)
-{
-    if (!string_starts_with(haystack, needle))
-        return false;
+    state = state_uncast;
 
-    haystack += strlen(needle);
+    keys[0] = game_winner_key(game);
+    keys[1] = game_loser_key(game);
+    for (i = 0; i < 2; i++)
+    {
+        if (key_index_get(state->players, keys[i]) >= 0)
+            continue;
+
+        if (key_index_add(state->players, keys[i], 0) != 0)
+            return -1;
+        state->header = talloc_asprintf_append_buffer(state->header,
+                                                      "PLAYER %s\n",
+                                                      keys[i]);
+    }
 
-    while (isspace(*haystack))
-        haystack++;
+    if (key_index_get(state->maps, game_map_key(game)) < 0)
+    {
+        if (key_index_add(state->maps, game_map_key(game), 0) != 0)
+            return -1;
+        state->header = talloc_asprintf_append_buffer(state->header,
+                                                      "MAP %s\n",
+                                                      game_map_key(game));
+    }
 
-    return haystack;
+    /* Appending to the end of the buffer rather than the end of the
+     * string keeps this linear in the number of games. */
+    state->games = talloc_asprintf_append_buffer(state->games,
+                                                 "GAME %ld %s %s > %s\n",
+                                                 (long)game_time(game),
+                                                 game_map_key(game),
+                                                 keys[0], keys[1]);
+    if (state->header == NULL || state->games == NULL)
+        return -1;
+
+    return 0;
 }
@@ -30,10 +30,58 @@ struct league;
 
 /* Reads a league's information from a file, setting the remaining
  * information to the default values. */
-struct league *league_read_file(void *c, const char *filename);
+struct league *league_read_file(void *c, const char *filename,
+                                const char *key);
+
+/* Reads a league file just like league_read_file(), except that each
+ * game is handed to the given function as it's read rather than being
+ * kept in the league, so files with any number of games can be read.
+ * The game only lasts until the function returns, so anything that's
+ * needed has to be copied out.  A non-zero return stops reading and
+ * fails.  Without a function every game is kept, which is all
+ * league_read_file() does. */
+struct league *league_stream_file(void *c, const char *filename,
+                                  const char *key,
+                                  int (*func) (struct league *,
+                                               struct game *, void *),
+                                  void *arg);
+
+/* Creates a league with no games, which isn't backed by any file. */
+struct league *league_new(void *c, const char *key, const char *name);
+
+/* Adds a copy of a game to a league, in chronological order.  Returns
+ * the league's copy, which lasts as long as the league does, or NULL
+ * on failure. */
+struct game *league_add_game(struct league *l, struct game *game);
+
+/* Removes a game from this league, returning 0 if it was there.  Its
+ * memory is only given back along with the league's, or by
+ * league_repack(). */
+int league_remove_game(struct league *l, struct game *game);
+
+/* Copies every game still in this league into fresh memory, so the
+ * space held by removed games can be given back.  Returns the old
+ * copies, which are freed along with the league unless they're freed
+ * sooner once nothing points at them, or NULL on failure (when the
+ * league is left as it was). */
+void *league_repack(struct league *l);
+
+/* Formats every game in this league as a league file that
+ * league_read_file() can read back in, listing each player and map
+ * that the games need. */
+char *league_format(void *ctx, struct league *l);
 
 /* Returns an iterator that iterates through every game in this league
  * in chronological order. */
 struct game_list_iterator *league_game_iterator(struct league *l, void *c);
 
+/* Access some basic data about a league. */
+const char *league_name(struct league *l);
+const char *league_key(struct league *l);
+
+/* Leagues get a dense integer index, just like players and maps.
+ * This is -1 for leagues that haven't been indexed. */
+int league_index(struct league *l);
+void league_set_index(struct league *l, int index);
+
 #endif
@@ -23,8 +23,10 @@
 
 #include "league_list.h"
 #include "league.h"
+#include "stats.h"
 
 #include <dirent.h>
+#include <string.h>
 #include <talloc.h>
 
 /***********************************************************************
@@ -44,6 +46,19 @@ struct league_list
     struct league_list_node *head;
 };
 
+/* Adapts a plain game iterator to the league-aware one. */
+struct each_game_args
+{
+    int (*iter) (struct game *, void *);
+    void *data;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int each_game_adapter(struct league *league, struct game *game,
+                             void *args_uncast);
+
 /***********************************************************************
  * Extern Methods                                                      *
  ***********************************************************************/
@@ -65,6 +80,11 @@ struct league_list *league_list_new(void *context, const char *indir)
 
     /* Start off with no leagues. */
     ll->head = NULL;
+    if (indir == NULL)
+    {
+        TALLOC_FREE(tcxt);
+        return ll;
+    }
 
     /* Read the entire directory we've been passed. */
     dir_entries = scandir(indir, &namelist, NULL, NULL);
@@ -86,7 +106,7 @@ struct league_list *league_list_new(void *context, const char *indir)
 
         /* Read the league information from the given file  */
         league_filename = talloc_asprintf(tcxt, "%s/%s", indir, league_name);
-        league = league_read_file(tcxt, league_filename);
+        league = league_read_file(tcxt, league_filename, league_name);
 
         /* Adds the league to this list. */
         if (league_list_add(ll, league) != 0)
@@ -115,17 +135,109 @@ int league_list_add(struct league_list *ll, struct league *league)
 
     /* Simply adds to the head of the list without any checking at all! */
     new->next = ll->head;
-    new->data = talloc_reference(new, league);
+    new->data = stats_reference(new, league);
+    stats_track(new, STATS_MEMORY_NODES);
     ll->head = new;
     return 0;
 }
 
+int league_list_replace(struct league_list *ll, struct league *league)
+{
+    struct league_list_node **cur;
+
+    for (cur = &ll->head; *cur != NULL; cur = &(*cur)->next)
+    {
+        struct league_list_node *new;
+
+        if (strcmp(league_key((*cur)->data), league_key(league)) != 0)
+            continue;
+
+        new = talloc(ll, struct league_list_node);
+        if (new == NULL)
+            return -1;
+
+        /* Dropping the old node drops its reference to the old
+         * league, along with every game in it. */
+        new->next = (*cur)->next;
+        new->data = stats_reference(new, league);
+        stats_track(new, STATS_MEMORY_NODES);
+        TALLOC_FREE(*cur);
+        *cur = new;
+        return 0;
+    }
+
+    return league_list_add(ll, league);
+}
+
+struct league *league_list_get(struct league_list *ll, const char *key)
+{
+    struct league_list_node *cur;
+
+    for (cur = ll->head; cur != NULL; cur = cur->next)
+        if (strcmp(league_key(cur->data), key) == 0)
+            return cur->data;
+
+    return NULL;
+}
+
+int league_list_remove(struct league_list *ll, const char *key)
+{
+    struct league_list_node **cur;
+
+    for (cur = &ll->head; *cur != NULL; cur = &(*cur)->next)
+    {
+        struct league_list_node *old;
+
+        if (strcmp(league_key((*cur)->data), key) != 0)
+            continue;
+
+        old = *cur;
+        *cur = old->next;
+        TALLOC_FREE(old);
+        return 0;
+    }
+
+    return -1;
+}
+
+int league_list_each(struct league_list *ll,
+                     int (*func) (struct league *, void *), void *arg)
+{
+    struct league_list_node *cur;
+
+    cur = ll->head;
+    while (cur != NULL)
+    {
+        int ret;
+
+        if ((ret = func(cur->data, arg)) != 0)
+            return ret;
+
+        cur = cur->next;
+    }
+
+    return 0;
+}
+
 int league_list_each_game(struct league_list *ll,
                           int (*iter) (struct game *, void *), void *data)
+{
+    struct each_game_args args;
+
+    args.iter = iter;
+    args.data = data;
+    return league_list_each_league_game(ll, &each_game_adapter, &args);
+}
+
+int league_list_each_league_game(struct league_list *ll,
+                                 int (*iter) (struct league *,
+                                              struct game *, void *),
+                                 void *data)
 {
     size_t league_count;
     void *ctx;
     struct game_list_iterator **iters;
+    struct league **leagues;
 
     ctx = talloc_new(ll);
     if (ctx == NULL)
@@ -146,6 +258,7 @@ int league_list_each_game(struct league_list *ll,
 
     /* Create a new game_list_iterator for every league */
     iters = talloc_array(ctx, struct game_list_iterator *, league_count);
+    leagues = talloc_array(ctx, struct league *, league_count);
     {
         struct league_list_node *cur;
         size_t i;
@@ -155,6 +268,7 @@ int league_list_each_game(struct league_list *ll,
         while (cur != NULL)
         {
             iters[i] = league_game_iterator(cur->data, iters);
+            leagues[i] = cur->data;
             i++;
             cur = cur->next;
         }
@@ -164,6 +278,7 @@ int league_list_each_game(struct league_list *ll,
     {
         struct game *game;
         struct game_list_iterator *game_iter;
+        struct league *game_league;
 
         do
         {
@@ -190,6 +305,7 @@ int league_list_each_game(struct league_list *ll,
                 {
                     game = ngame;
                     game_iter = iters[i];
+                    game_league = leagues[i];
                 }
             }
 
@@ -199,7 +315,7 @@ int league_list_each_game(struct league_list *ll,
             {
                 int ret;
 
-                if ((ret = iter(game, data)) != 0)
+                if ((ret = iter(game_league, game, data)) != 0)
                 {
                     TALLOC_FREE(ctx);
                     return ret;
@@ -212,3 +328,15 @@ int league_list_each_game(struct league_list *ll,
     TALLOC_FREE(ctx);
     return 0;
 }
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int each_game_adapter(struct league *league __attribute__ ((unused)),
+                      struct game *game, void *args_uncast)
+{
+    struct each_game_args *args;
+
+    args = args_uncast;
+    return args->iter(game, args->data);
+}
@@ -30,14 +30,37 @@ struct league_list;
 
 /* Creates a new list of leagues by reading a directory full of league
  * files.  Every file in the directory should coorespond to a single
- * league.*/
+ * league.  A NULL directory creates an empty list. */
 struct league_list *league_list_new(void *ctx, const char *indir);
 
 /* Adds a league to the given list of leagues.  Returns 0 on success. */
 int league_list_add(struct league_list *ll, struct league *league);
 
+/* Replaces the league that has the same key as the given one, keeping
+ * its place in the list, or adds it if there's no such league yet.
+ * Returns 0 on success. */
+int league_list_replace(struct league_list *ll, struct league *league);
+
+/* Returns the league with the given key, or NULL if there isn't one. */
+struct league *league_list_get(struct league_list *ll, const char *key);
+
+/* Removes the league with the given key.  Returns 0 if it was found. */
+int league_list_remove(struct league_list *ll, const char *key);
+
+/* Walks through every league in the list in no particular order. */
+int league_list_each(struct league_list *ll,
+                     int (*func) (struct league *, void *), void *arg);
+
 /* Walks through every game that's been played in chronological order. */
 int league_list_each_game(struct league_list *ll,
                           int (*iter) (struct game *, void *), void *);
 
+/* Walks through every game in chronological order, just like
+ * league_list_each_game(), but also passes along the league that each
+ * game was played in. */
+int league_list_each_league_game(struct league_list *ll,
+                                 int (*iter) (struct league *,
+                                              struct game *, void *),
+                                 void *);
+
 #endif
@@ -19,19 +19,288 @@
  * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _XOPEN_SOURCE 500
+#define _BSD_SOURCE
+
 #include "player_list.h"
 #include "league_list.h"
 #include "global.h"
 #include "html.h"
+#include "timeline.h"
+#include "bootstrap.h"
+#include "checkpoint.h"
+#include "bitmap.h"
+#include "prediction.h"
+#include "query.h"
+#include "server.h"
+#include "snapshot.h"
+#include "ingest.h"
+#include "journal.h"
+#include "key_index.h"
+#include "extsort.h"
+#include "stream.h"
+#include "watch.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <talloc.h>
 
+/* The most ingested games that are rated in one batch. */
+#ifndef INGEST_BATCH_MAX
+#define INGEST_BATCH_MAX 65536
+#endif
+
+/* Publishing rebuilds the query tables from every game, so while
+ * games keep coming in the batches are rated as they arrive but only
+ * published this often, or less often when publishing takes longer
+ * than this share of the time. */
+#ifndef PUBLISH_INTERVAL_MS
+#define PUBLISH_INTERVAL_MS 250
+#endif
+
+#ifndef PUBLISH_COST_RATIO
+#define PUBLISH_COST_RATIO 4
+#endif
+
+/* While the ratings are kept up to date, every table is checkpointed
+ * every so often along the timeline so a change only gets replayed
+ * from the last checkpoint before it.  There are about CHECKPOINT_MAX
+ * of them over the games at startup, but never closer together than
+ * CHECKPOINT_MIN_GAMES, and only the latest CHECKPOINT_MAX are kept as
+ * more games come in. */
+#ifndef CHECKPOINT_MAX
+#define CHECKPOINT_MAX 8
+#endif
+
+#ifndef CHECKPOINT_MIN_GAMES
+#define CHECKPOINT_MIN_GAMES 64
+#endif
+
+/* Where changes to the ingested games are journaled. */
+#ifndef JOURNAL_PATH
+#define JOURNAL_PATH INDIR "/journal"
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Everything needed to keep the ratings up to date after they've been
+ * generated for the first time. */
+struct updater
+{
+    struct league_list *league_list;
+
+    /* The context holding the current rating tables, and the
+     * prediction scores that go along with them. */
+    void *ratings;
+    struct prediction_stats *prediction_stats;
+
+    int bootstrap_replicas;
+    enum bootstrap_mode bootstrap_mode;
+    enum period_length period_length;
+
+    /* Checkpoints of the rating tables and the bootstrap replicas along
+     * the timeline, which live with the tables.  These are only kept
+     * when "checkpointed" is set, and may be NULL anyway. */
+    int checkpointed;
+    struct checkpoint_list *checkpoints;
+    struct bootstrap_saves *bootstrap_saves;
+
+    /* New ratings are published here when serving queries, otherwise
+     * the HTML gets rewritten. */
+    struct snapshot *snapshot;
+
+    /* Set when there are ratings that haven't been published yet, they
+     * will be once "next_publish" has passed. */
+    int unpublished;
+    struct timeval next_publish;
+
+    /* Games that come in through the server, which all end up in a
+     * league of their own.  The queue and the journal are NULL unless
+     * serving queries, and the league is NULL if there are no such
+     * games. */
+    struct ingest *ingest;
+    struct league *ingested;
+    struct journal *journal;
+
+    /* Every game in the ingested league, so the same game is never
+     * added twice, along with every time they were played at.  The
+     * league file can't hold two games from the same time, so only
+     * the first one from any time is kept. */
+    struct key_index *ingested_keys;
+
+    /* The data directories, when they're being watched. */
+    struct watch *watch;
+    int players_dir, maps_dir, leagues_dir;
+
+    /* The number of reloaded files in this batch that changed
+     * anything.  Changing a player or map, or adding, removing or
+     * renaming a league, moves the indices or shows up on every page,
+     * so that sets "rerate_all" to replay everything. */
+    int reloaded;
+    int rerate_all;
+
+    /* The players and maps, by index, whose pages the last re-rating
+     * may have changed.  NULL means every one of them. */
+    struct bitmap *touched_players;
+    struct bitmap *touched_maps;
+};
+
+/* Rating games straight from the league files through an external
+ * sort, see rate_external(). */
+struct external_state
+{
+    struct extsort *extsort;
+    struct timeline *lookup;
+    struct prediction_stats *prediction_stats;
+
+    /* The league that's being read, by the order the files were read
+     * in, and where each game is in that league. */
+    uint32_t league;
+    uint32_t seq;
+    game_time_t last;
+    struct league **leagues;
+};
+
+/* An ingested game, along with the order it came in. */
+struct ingested_game
+{
+    struct game *game;
+    size_t order;
+};
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+
+/* Set by the signal handler to ask the updater to stop. */
+static volatile sig_atomic_t stop_requested = 0;
+
 /***********************************************************************
  * Static Method Headers                                               *
  ***********************************************************************/
+static void print_usage(const char *argv0);
+
+/* Prints the run's stats to stderr, and writes them out as JSON to the
+ * given file, if asked for. */
+static void print_run_stats(int print, const char *json);
+
+/* Writes out everything that's been traced to the given file, if
+ * there is one. */
+static void write_trace(const char *filename);
 static int print_elo(struct player *player, void *unused);
-static int update_elo(struct game *game, void *unused);
+
+/* Rates every game in the updater's leagues from scratch.  Every
+ * rating table lives in a new context that's stored in "ratings",
+ * along with the prediction stats and the checkpoints, so the old
+ * tables should be freed first.  Returns 0 on success. */
+static int rate_leagues(void *ctx, struct updater *u);
+
+/* Rates the games in the global timeline from "first" on, taking
+ * checkpoints along the way. */
+static void replay_games(struct updater *u, size_t first);
+static int rate_game(struct updater *u, const struct timeline_game *tg,
+                     struct game *game);
+
+/* Rates every game in the given directory of league files without
+ * ever holding the games in memory, sorting them through temporary
+ * files in "spill_dir" instead.  Only the players' ratings and the
+ * other per-player tables are kept.  Returns 0 on success. */
+static int rate_external(void *ctx, const char *indir,
+                         const char *spill_dir,
+                         struct prediction_stats **prediction_stats);
+static int spill_game(struct league *league, struct game *game,
+                      void *state_uncast);
+static int replay_external(const struct extsort_record *r,
+                           void *state_uncast);
+static int reset_player(struct player *player, void *unused);
+static int update_elo(const struct timeline_game *tg, struct game *game,
+                      void *prediction_stats);
+
+/* Builds the query tables for the current ratings and publishes them
+ * to the server.  Returns the new version, or 0 on failure. */
+static unsigned long publish_ratings(struct snapshot *snapshot);
+
+/* Keeps the ratings up to date until interrupted, re-rating whenever
+ * a watched data file changes and rating ingested games as they come
+ * in.  Then either whichever pages changed get rewritten, or when
+ * there's a snapshot the new ratings are published to it. */
+static int run_updater(void *ctx, struct updater *u);
+static void handle_stop(int signum);
+
+/* Brings the ratings up to date with the leagues, which is only a
+ * replay from the last checkpoint before the first changed game when
+ * that's possible, or rating everything again when it's not. */
+static int rerate(void *ctx, struct updater *u);
+
+/* Rolls the ratings back to the last checkpoint before the first game
+ * that's changed and replays the games from there, noting whose pages
+ * that touched.  Returns 0 on success, or -1 if everything has to be
+ * rated again instead. */
+static int replay_changes(struct updater *u);
+
+/* Marks the players and maps of every game from "first" on. */
+static int touch_games(struct updater *u, struct timeline *tl,
+                       size_t first);
+
+/* Publishes the current ratings or writes them out, reporting what
+ * was done and how long it took since "start".  Ratings that are
+ * published too soon after the last ones are held back instead. */
+static void finish_update(void *ctx, struct updater *u,
+                          const char *what, struct timeval *start);
+
+/* Publishes the current ratings, and works out when the next ones can
+ * be.  Returns the new version, or 0 on failure. */
+static unsigned long publish_update(struct updater *u);
+
+/* Returns the number of milliseconds from "from" to "to". */
+static long elapsed_ms(const struct timeval *from, const struct timeval *to);
+
+static int reload_file(int dir, const char *name, void *u_uncast);
+
+/* Returns TRUE if two names are the same, either of which may be
+ * missing. */
+static int same_name(const char *a, const char *b);
+
+/* Rates a batch of ingested games.  When they're all newer than every
+ * game that's already been rated they're just appended to the
+ * timeline, otherwise everything is re-rated. */
+static int rate_ingested(void *ctx, struct updater *u);
+static int compare_ingested(const void *a, const void *b);
+
+/* Sets up the league of ingested games, replaying the journal on top
+ * of whatever's already in the league files.  The journal is only
+ * opened for writing when games are accepted. */
+static int load_ingested(void *ctx, struct updater *u, int accept_games);
+static int replay_journal(const struct journal_entry *e, void *u_uncast);
+
+/* Adds or removes an ingested game.  Returns 1 if that changed
+ * anything, or 0 if the game was already there (or not) or another
+ * game was already played at the same time.  The league
+ * keeps a copy of any game it adds, which is passed back through
+ * "kept" when that's not NULL. */
+static int apply_ingested(struct updater *u, enum journal_op op,
+                          struct game *game, struct game **kept);
+static char *ingested_key(void *ctx, struct game *game);
+static char *ingested_time_key(void *ctx, struct game *game);
+
+/* Indexes the key and time of every game in the ingested league. */
+static struct key_index *index_ingested(void *ctx, struct league *l);
+
+/* Folds the journal into the ingested league's file, if it's grown
+ * enough.  That's also when the memory held by removed games is given
+ * back. */
+static void compact_journal(void *ctx, struct updater *u);
 
 /***********************************************************************
  * Extern Methods                                                      *
@@ -40,38 +309,283 @@ int main(int argc, char **argv)
 {
     void *root_context;
     struct league_list *league_list;
+    struct updater updater;
+    int bootstrap_replicas;
+    enum bootstrap_mode bootstrap_mode;
+    enum period_length period_length;
+    int print_quality;
+    int print_stats;
+    const char *stats_json;
+    const char *trace_file;
+    const char *daemon_socket;
+    const char *external_dir;
+    int stream;
+    enum stream_format stream_format;
+    int watch;
+
+    bootstrap_replicas = 0;
+    bootstrap_mode = BOOTSTRAP_GAMES;
+    period_length = PERIOD_MONTH;
+    print_quality = 0;
+    print_stats = 0;
+    stats_json = NULL;
+    trace_file = NULL;
+    daemon_socket = NULL;
+    external_dir = NULL;
+    stream = 0;
+    stream_format = STREAM_CSV;
+    watch = 0;
 
     /* Parse commandline arguments. */
     {
         int i;
 
         for (i = 1; i < argc; i++)
-            fprintf(stderr, "Unknown argument: '%s'\n", argv[i]);
+        {
+            if (strcmp(argv[i], "--bootstrap") == 0 && i + 1 < argc)
+            {
+                bootstrap_replicas = atoi(argv[++i]);
+                if (bootstrap_replicas <= 0)
+                {
+                    fprintf(stderr, "Bad replica count: '%s'\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--bootstrap-mode") == 0
+                     && i + 1 < argc)
+            {
+                if (bootstrap_mode_parse(argv[++i], &bootstrap_mode) != 0)
+                {
+                    fprintf(stderr, "Bad bootstrap mode: '%s'\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--period") == 0 && i + 1 < argc)
+            {
+                if (period_length_parse(argv[++i], &period_length) != 0)
+                {
+                    fprintf(stderr, "Bad period: '%s'\n", argv[i]);
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--quality") == 0)
+                print_quality = 1;
+            else if (strcmp(argv[i], "--stats") == 0)
+                print_stats = 1;
+            else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+                stats_json = argv[++i];
+            else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                trace_file = argv[++i];
+            else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+                daemon_socket = argv[++i];
+            else if (strcmp(argv[i], "--watch") == 0)
+                watch = 1;
+            else if (strcmp(argv[i], "--external") == 0 && i + 1 < argc)
+                external_dir = argv[++i];
+            else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+            {
+                stream = 1;
+                if (stream_format_parse(argv[++i], &stream_format) != 0)
+                {
+                    fprintf(stderr, "Bad stream format: '%s'\n", argv[i]);
+                    return 1;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Unknown argument: '%s'\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
 
-        if (i > 1)
+        /* Without the games in memory there's nothing to resample,
+         * serve or rewrite. */
+        if (external_dir != NULL
+            && (bootstrap_replicas > 0 || daemon_socket != NULL || watch
+                || stream))
         {
-            fprintf(stderr, "Hint, %s takes no arguments\n", argv[0]);
+            fprintf(stderr, "--external only works on its own\n");
+            return 1;
+        }
+        if (stream && (bootstrap_replicas > 0 || daemon_socket != NULL
+                       || watch || print_quality))
+        {
+            fprintf(stderr, "--stream only works on its own\n");
             return 1;
         }
     }
 
     /* Create an empty root context. */
     root_context = talloc_new(NULL);
+    if (print_stats || stats_json != NULL)
+        stats_enable(root_context);
+    if (trace_file != NULL)
+        trace_enable();
 
     /* Initialize the list of players, leagues, and games. */
+    stats_begin(STATS_PLAYERS);
     global_player_list = player_list_new(root_context, INDIR "/players");
+    stats_end(STATS_PLAYERS);
+    stats_begin(STATS_MAPS);
     global_map_list = map_list_new(root_context, INDIR "/maps");
+    stats_end(STATS_MAPS);
+
+    /* Games piped in are rated on their own, starting from scratch. */
+    if (stream)
+    {
+        int ret;
+
+        ret = stream_games(root_context, stdin, stdout, stream_format);
+        write_trace(trace_file);
+        TALLOC_FREE(root_context);
+        return (ret == 0) ? 0 : 1;
+    }
+
+    /* Only the ratings come out of an external run, there's no HTML. */
+    if (external_dir != NULL)
+    {
+        struct prediction_stats *prediction_stats;
+        int ret;
+
+        ret = rate_external(root_context, INDIR "/leagues", external_dir,
+                            &prediction_stats);
+        if (ret == 0)
+        {
+            player_list_each(global_player_list, &print_elo, NULL);
+            if (print_quality)
+            {
+                printf("\n");
+                prediction_stats_print(prediction_stats, stdout);
+            }
+        }
+
+        write_trace(trace_file);
+        TALLOC_FREE(root_context);
+        return (ret == 0) ? 0 : 1;
+    }
+
+    stats_begin(STATS_LEAGUES);
     league_list = league_list_new(root_context, INDIR "/leagues");
 
-    /* Generates each player's Elo rating */
-    league_list_each_game(league_list, &update_elo, NULL);
+    updater.league_list = league_list;
+    updater.bootstrap_replicas = bootstrap_replicas;
+    updater.bootstrap_mode = bootstrap_mode;
+    updater.period_length = period_length;
+    updater.checkpointed = (watch || daemon_socket != NULL);
+    updater.checkpoints = NULL;
+    updater.bootstrap_saves = NULL;
+    updater.snapshot = NULL;
+    updater.unpublished = 0;
+    updater.next_publish.tv_sec = 0;
+    updater.next_publish.tv_usec = 0;
+    updater.ingest = NULL;
+    updater.ingested = NULL;
+    updater.journal = NULL;
+    updater.ingested_keys = NULL;
+    updater.watch = NULL;
+    updater.reloaded = 0;
+    updater.rerate_all = 0;
+    updater.touched_players = NULL;
+    updater.touched_maps = NULL;
+
+    /* Games sent to the server go in a league of their own, which has
+     * to exist before anything is indexed. */
+    if (daemon_socket != NULL)
+    {
+        updater.ingest = ingest_new(root_context);
+        if (updater.ingest == NULL)
+        {
+            TALLOC_FREE(root_context);
+            return 1;
+        }
+    }
+
+    if (league_list == NULL
+        || load_ingested(root_context, &updater, daemon_socket != NULL) != 0)
+    {
+        TALLOC_FREE(root_context);
+        return 1;
+    }
+    stats_end(STATS_LEAGUES);
+
+    /* Rates every game, and estimates how certain those ratings are */
+    if (rate_leagues(root_context, &updater) != 0)
+    {
+        TALLOC_FREE(root_context);
+        return 1;
+    }
+
+    if (watch)
+    {
+        updater.watch = watch_new(root_context);
+        if (updater.watch != NULL)
+        {
+            updater.players_dir = watch_add(updater.watch, INDIR "/players");
+            updater.maps_dir = watch_add(updater.watch, INDIR "/maps");
+            updater.leagues_dir = watch_add(updater.watch, INDIR "/leagues");
+        }
+
+        if (updater.watch == NULL || updater.players_dir < 0
+            || updater.maps_dir < 0 || updater.leagues_dir < 0)
+        {
+            TALLOC_FREE(root_context);
+            return 1;
+        }
+    }
+
+    /* In daemon mode everything stays in memory to answer queries,
+     * rather than being written out.  New ratings are published to the
+     * server as games come in or the data changes. */
+    if (daemon_socket != NULL)
+    {
+        struct server *server;
+        int ret;
+
+        print_run_stats(print_stats, stats_json);
+
+        ret = 1;
+        updater.snapshot = snapshot_new(root_context);
+        if (updater.snapshot == NULL
+            || publish_ratings(updater.snapshot) == 0)
+            fprintf(stderr, "Unable to index the ratings\n");
+        else if ((server = server_start(root_context, updater.snapshot,
+                                        updater.ingest,
+                                        daemon_socket)) != NULL)
+        {
+            compact_journal(root_context, &updater);
+            ret = run_updater(root_context, &updater);
+            server_stop(server);
+        }
+
+        write_trace(trace_file);
+        TALLOC_FREE(root_context);
+        return (ret == 0) ? 0 : 1;
+    }
 
     /* List every player's Elo rating to stdout */
     player_list_each(global_player_list, &print_elo, NULL);
 
+    /* Report how good those ratings were at predicting results */
+    if (print_quality)
+    {
+        printf("\n");
+        prediction_stats_print(updater.prediction_stats, stdout);
+    }
+
     /* Open up a new HTML generator */
+    stats_begin(STATS_HTML);
     if (html_generate(root_context, OUTDIR) != 0)
         fprintf(stderr, "HTML generation failed\n");
+    stats_end(STATS_HTML);
+
+    print_run_stats(print_stats, stats_json);
+
+    /* Keeps the output up to date as the data changes */
+    if (watch)
+        run_updater(root_context, &updater);
+
+    write_trace(trace_file);
 
     /* Clean up everything we've allocated. */
     TALLOC_FREE(root_context);
@@ -82,6 +596,74 @@ int main(int argc, char **argv)
 /***********************************************************************
  * Static Methods                                                      *
  ***********************************************************************/
+void print_usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv0);
+    fprintf(stderr, "  --bootstrap <replicas>    "
+            "Estimate 90%% intervals around every rating\n");
+    fprintf(stderr, "  --bootstrap-mode <mode>   "
+            "Resample 'games' (default) or 'leagues'\n");
+    fprintf(stderr, "  --period <length>         "
+            "Snapshot every 'month' (default), 'quarter' or 'year'\n");
+    fprintf(stderr, "  --quality                 "
+            "Report how well the ratings predicted results\n");
+    fprintf(stderr, "  --stats                   "
+            "Report how long each phase took and what it did\n");
+    fprintf(stderr, "  --stats-json <file>       "
+            "Write the same out as JSON ('-' for stdout)\n");
+    fprintf(stderr, "  --trace <file>            "
+            "Write a timeline of the run as Chrome trace events\n");
+    fprintf(stderr, "  --daemon <socket>         "
+            "Answer queries on a Unix socket instead of writing HTML\n");
+    fprintf(stderr, "  --watch                   "
+            "Keep the HTML up to date as the data files change\n");
+    fprintf(stderr, "  --stream <format>         "
+            "Rate games from stdin, writing 'csv' or 'binary' deltas\n");
+    fprintf(stderr, "  --external <dir>          "
+            "Only print ratings, sorting games through files in <dir>\n");
+}
+
+void print_run_stats(int print, const char *json)
+{
+    FILE *file;
+
+    if (print)
+        stats_print(stderr);
+
+    if (json == NULL)
+        return;
+
+    file = (strcmp(json, "-") == 0) ? stdout : fopen(json, "w");
+    if (file == NULL)
+    {
+        perror(json);
+        return;
+    }
+
+    stats_print_json(file);
+    if (file != stdout)
+        fclose(file);
+}
+
+void write_trace(const char *filename)
+{
+    FILE *file;
+
+    if (filename == NULL)
+        return;
+
+    file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        perror(filename);
+        return;
+    }
+
+    if (trace_write(file) != 0)
+        fprintf(stderr, "Unable to write the trace\n");
+    fclose(file);
+}
+
 int print_elo(struct player *player, void *uu __attribute__ ((unused)))
 {
     printf("%4d (%2d-%2d) %s\n", (int)player_elo(player),
@@ -89,32 +671,1184 @@ int print_elo(struct player *player, void *uu __attribute__ ((unused)))
     return 0;
 }
 
-int update_elo(struct game *game, void *uu __attribute__ ((unused)))
+int rate_leagues(void *pctx, struct updater *u)
+{
+    void *ctx;
+    struct timeline *timeline;
+
+    ctx = talloc_new(pctx);
+    if (ctx == NULL)
+        return -1;
+
+    /* Players and maps outlive the ratings, so anything left over from
+     * a previous rating has to be cleared out. */
+    player_list_each(global_player_list, &reset_player, NULL);
+
+    /* Merges every league into a single ordered list of games. */
+    stats_begin(STATS_MERGE);
+    timeline = timeline_new(ctx, u->league_list);
+    if (timeline == NULL)
+    {
+        fprintf(stderr, "Unable to build the game timeline\n");
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+    global_timeline = timeline;
+    stats_count(STATS_GAMES_MERGED, timeline_game_count(timeline));
+    stats_end(STATS_MERGE);
+
+    /* Every player's per-race ratings are built up alongside the
+     * overall ratings */
+    global_matchup_table = matchup_table_new(ctx,
+                                             timeline_player_count(timeline));
+    global_rank_tree = rank_tree_new(ctx, timeline_player_count(timeline));
+
+    /* So is every rivalry's record, and how everyone does on every
+     * map */
+    global_h2h_table = h2h_table_new(ctx, timeline_player_count(timeline));
+    global_performance_table = performance_table_new(ctx);
+
+    /* And how every race does against every other race */
+    global_race_stats = race_stats_new(ctx, timeline_map_count(timeline),
+                                       timeline_league_count(timeline));
+
+    /* Snapshots are taken at the end of every period, so periods can
+     * be looked up later without replaying anything */
+    global_period_table = period_table_new(ctx, u->period_length,
+                                           timeline_player_count(timeline),
+                                           timeline_map_count(timeline));
+
+    /* Every rating change is kept so past ratings can be looked up */
+    global_rating_history =
+        rating_history_new(ctx, timeline_player_count(timeline));
+
+    /* So is every named pool's ratings */
+    global_pool_set = pool_set_new(ctx, INDIR "/pools");
+    if (global_pool_set != NULL)
+        if (pool_set_index(global_pool_set, timeline) != 0)
+            global_pool_set = NULL;
+
+    /* Checkpoints are spread over the games there are now */
+    u->checkpoints = NULL;
+    u->bootstrap_saves = NULL;
+    if (u->checkpointed)
+    {
+        size_t spacing;
+
+        spacing = timeline_game_count(timeline) / CHECKPOINT_MAX + 1;
+        if (spacing < CHECKPOINT_MIN_GAMES)
+            spacing = CHECKPOINT_MIN_GAMES;
+
+        u->checkpoints = checkpoint_list_new(ctx, spacing, CHECKPOINT_MAX);
+        if (u->bootstrap_replicas > 0)
+            u->bootstrap_saves = bootstrap_saves_new(ctx, spacing,
+                                                     CHECKPOINT_MAX);
+    }
+
+    /* Generates each player's Elo rating, scoring how well the
+     * ratings predicted each game along the way */
+    stats_begin(STATS_ELO);
+    u->prediction_stats = prediction_stats_new(ctx);
+    trace_begin("replay", "timeline");
+    replay_games(u, 0);
+    trace_end("replay");
+    if (global_rank_tree != NULL)
+        rank_tree_finish(global_rank_tree);
+    stats_end(STATS_ELO);
+
+    /* Estimates how certain each of those ratings is */
+    if (u->bootstrap_replicas > 0)
+        if (bootstrap_elo(ctx, timeline, u->bootstrap_mode,
+                          u->bootstrap_replicas, u->bootstrap_saves, 0) != 0)
+            fprintf(stderr, "Bootstrapping failed\n");
+
+    u->ratings = ctx;
+    return 0;
+}
+
+void replay_games(struct updater *u, size_t first)
+{
+    const struct timeline_game *games;
+    size_t count;
+    size_t i;
+
+    games = timeline_games(global_timeline);
+    count = timeline_game_count(global_timeline);
+    for (i = first; i < count; i++)
+        if (rate_game(u, games + i, timeline_game(global_timeline, i)) != 0)
+            break;
+}
+
+int rate_game(struct updater *u, const struct timeline_game *tg,
+              struct game *game)
+{
+    if (u->checkpoints != NULL)
+        checkpoint_list_game(u->checkpoints,
+                             tg - timeline_games(global_timeline),
+                             u->prediction_stats);
+
+    return update_elo(tg, game, u->prediction_stats);
+}
+
+int rate_external(void *pctx, const char *indir, const char *spill_dir,
+                  struct prediction_stats **prediction_stats)
+{
+    void *ctx;
+    struct league_list *ll;
+    struct external_state state;
+    struct dirent **namelist;
+    int entries;
+    int i;
+    int ret;
+
+    ctx = talloc_new(pctx);
+    if (ctx == NULL)
+        return -1;
+
+    /* An empty timeline is enough to look up players and maps by key,
+     * the leagues are indexed once they've all been read. */
+    ll = league_list_new(ctx, NULL);
+    state.lookup = (ll == NULL) ? NULL : timeline_new(ctx, ll);
+    state.extsort = extsort_new(ctx, spill_dir, 0);
+    if (state.lookup == NULL || state.extsort == NULL)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    entries = scandir(indir, &namelist, NULL, NULL);
+    if (entries < 0)
+    {
+        perror(indir);
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    /* Each league keeps its players and maps, but none of its games.
+     * The names still need freeing if there's nowhere to put them. */
+    state.league = 0;
+    state.leagues = talloc_array(ctx, struct league *, entries + 1);
+    ret = (state.leagues == NULL) ? -1 : 0;
+    for (i = 0; i < entries; i++)
+    {
+        struct league *league;
+        char *filename;
+
+        if (ret == 0 && namelist[i]->d_name[0] != '.')
+        {
+            filename = talloc_asprintf(ctx, "%s/%s", indir,
+                                       namelist[i]->d_name);
+            state.seq = 0;
+            state.last = -1;
+            league = league_stream_file(ctx, filename, namelist[i]->d_name,
+                                        &spill_game, &state);
+            if (league == NULL || league_list_add(ll, league) != 0)
+            {
+                fprintf(stderr, "Failed to read league '%s'\n",
+                        namelist[i]->d_name);
+                ret = -1;
+            }
+            else
+                state.leagues[state.league++] = league;
+
+            TALLOC_FREE(filename);
+        }
+
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    if (ret != 0)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    /* The rest is set up just like rate_leagues(), other than the
+     * tables that hold something for every game. */
+    global_timeline = timeline_new(ctx, ll);
+    if (global_timeline == NULL)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    global_matchup_table =
+        matchup_table_new(ctx, timeline_player_count(global_timeline));
+    global_pool_set = pool_set_new(ctx, INDIR "/pools");
+    if (global_pool_set != NULL)
+        if (pool_set_index(global_pool_set, global_timeline) != 0)
+            global_pool_set = NULL;
+
+    *prediction_stats = prediction_stats_new(ctx);
+    state.prediction_stats = *prediction_stats;
+    if (extsort_each(state.extsort, &replay_external, &state) != 0)
+    {
+        fprintf(stderr, "Unable to sort the games\n");
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    fprintf(stderr, "Rated %lu game(s) from %lu run(s) on disk\n",
+            (unsigned long)extsort_count(state.extsort),
+            (unsigned long)extsort_run_count(state.extsort));
+    return 0;
+}
+
+int spill_game(struct league *league __attribute__ ((unused)),
+               struct game *game, void *state_uncast)
+{
+    struct external_state *state;
+    struct extsort_record r;
+    int winner, loser, map;
+
+    state = state_uncast;
+
+    /* Just like league_read_file(), a game that isn't newer than the
+     * one before it is dropped. */
+    if (state->seq > 0 && game_time(game) <= state->last)
+        return 0;
+
+    winner = timeline_player_lookup(state->lookup, game_winner_key(game));
+    loser = timeline_player_lookup(state->lookup, game_loser_key(game));
+    map = timeline_map_lookup(state->lookup, game_map_key(game));
+    if (winner < 0 || loser < 0 || map < 0)
+        return -1;
+
+    /* Games from the same time are rated in the same order as the
+     * league list walks them: the last league read first, then in the
+     * order they're listed. */
+    r.game.time = game_time(game);
+    r.game.winner = winner;
+    r.game.loser = loser;
+    r.game.map = map;
+    r.game.league = state->league;
+    r.order = ((uint64_t)(UINT32_MAX - state->league) << 32) | state->seq;
+
+    state->seq++;
+    state->last = game_time(game);
+    return extsort_add(state->extsort, &r);
+}
+
+int replay_external(const struct extsort_record *r, void *state_uncast)
+{
+    struct external_state *state;
+    struct timeline_game tg;
+
+    state = state_uncast;
+
+    tg = r->game;
+    tg.league = league_index(state->leagues[tg.league]);
+    return update_elo(&tg, NULL, state->prediction_stats);
+}
+
+int reset_player(struct player *player, void *uu __attribute__ ((unused)))
+{
+    return player_reset(player);
+}
+
+int update_elo(const struct timeline_game *tg,
+               struct game *game __attribute__ ((unused)),
+               void *prediction_stats)
 {
-    const char *winner_key, *loser_key;
     struct player *winner, *loser;
-    const char *map_key;
+    player_elo_t winner_before, loser_before;
     struct map *map;
+    int phase;
 
-    winner_key = game_winner_key(game);
-    loser_key = game_loser_key(game);
-    if (winner_key == NULL || loser_key == NULL)
+    /* The timeline has already looked up every key. */
+    winner = timeline_player(global_timeline, tg->winner);
+    loser = timeline_player(global_timeline, tg->loser);
+    map = timeline_map(global_timeline, tg->map);
+    if (winner == NULL || loser == NULL || map == NULL)
         return -1;
 
-    winner = player_list_get(global_player_list, winner_key);
-    loser = player_list_get(global_player_list, loser_key);
-    if (winner == NULL || loser == NULL)
-        return -1;
+    /* Scores the prediction made by the ratings from before this game,
+     * the K factor phase is that of the less experienced player. */
+    if (prediction_stats != NULL)
+    {
+        if (player_games(winner) < player_games(loser))
+            phase = elo_k_phase(player_games(winner));
+        else
+            phase = elo_k_phase(player_games(loser));
+
+        prediction_stats_add(prediction_stats,
+                             player_expected_score(winner, loser), phase,
+                             player_race(winner), player_race(loser));
+    }
+
+    if (global_rank_tree != NULL)
+        rank_tree_begin_game(global_rank_tree, tg->time);
 
+    winner_before = player_elo(winner);
+    loser_before = player_elo(loser);
     if (player_win(winner, loser) != 0)
         return -1;
+    stats_count(STATS_GAMES_RATED, 1);
+
+    if (global_rank_tree != NULL)
+    {
+        rank_tree_move(global_rank_tree, tg->winner, player_elo(winner));
+        rank_tree_move(global_rank_tree, tg->loser, player_elo(loser));
+        if (rank_tree_record(global_rank_tree, tg->winner) != 0
+            || rank_tree_record(global_rank_tree, tg->loser) != 0)
+            return -1;
+    }
+
+    if (global_rating_history != NULL)
+    {
+        size_t index;
+
+        index = tg - timeline_games(global_timeline);
+        rating_history_add(global_rating_history, tg->winner, tg->time,
+                           player_elo(winner), index);
+        rating_history_add(global_rating_history, tg->loser, tg->time,
+                           player_elo(loser), index);
+    }
+
+    if (global_h2h_table != NULL)
+        h2h_table_win(global_h2h_table, tg->winner, tg->loser);
+
+    if (global_performance_table != NULL)
+        performance_table_game(global_performance_table, tg->map,
+                               tg->winner, player_race(winner),
+                               player_elo(winner) - winner_before,
+                               tg->loser, player_race(loser),
+                               player_elo(loser) - loser_before);
+
+    if (global_matchup_table != NULL)
+        matchup_table_win(global_matchup_table,
+                          tg->winner, player_race(winner),
+                          tg->loser, player_race(loser));
+
+    /* Every pool this game's league belongs to is updated as well. */
+    if (global_pool_set != NULL)
+        pool_set_win(global_pool_set,
+                     pool_set_league_mask(global_pool_set, tg->league),
+                     tg->winner, tg->loser);
+
+    if (global_race_stats != NULL)
+        race_stats_game(global_race_stats, tg,
+                        player_race(winner), player_race(loser));
+
+    if (global_period_table != NULL)
+        period_table_game(global_period_table, tg,
+                          player_elo(winner), player_race(winner),
+                          player_elo(loser), player_race(loser));
+
+    return 0;
+}
+
+unsigned long publish_ratings(struct snapshot *snapshot)
+{
+    struct query_db *db;
+
+    /* The snapshot takes the tables over from here. */
+    db = query_db_new(NULL, global_timeline, global_rating_history,
+                      global_period_table);
+    if (db == NULL)
+        return 0;
+
+    return snapshot_publish(snapshot, db);
+}
+
+int run_updater(void *ctx, struct updater *u)
+{
+    struct sigaction sa;
+    struct pollfd fds[2];
+    int watch_index, ingest_index;
+    int count;
+
+    /* Signals interrupt the poll() below rather than killing us. */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &handle_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    count = 0;
+    watch_index = ingest_index = -1;
+    if (u->watch != NULL)
+    {
+        watch_index = count++;
+        fds[watch_index].fd = watch_fd(u->watch);
+        fds[watch_index].events = POLLIN;
+        fprintf(stderr, "Watching '%s' for changes\n", INDIR);
+    }
+    if (u->ingest != NULL)
+    {
+        ingest_index = count++;
+        fds[ingest_index].fd = ingest_fd(u->ingest);
+        fds[ingest_index].events = POLLIN;
+    }
+
+    while (!stop_requested)
+    {
+        int timeout;
+
+        /* Held back ratings are published when they're due, even if
+         * nothing else happens by then. */
+        timeout = -1;
+        if (u->unpublished)
+        {
+            struct timeval now;
+
+            gettimeofday(&now, NULL);
+            timeout = elapsed_ms(&now, &u->next_publish);
+            if (timeout < 0)
+                timeout = 0;
+        }
+
+        if (poll(fds, count, timeout) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("poll");
+            return -1;
+        }
+
+        if (watch_index >= 0 && fds[watch_index].revents != 0)
+        {
+            struct timeval start;
+
+            u->reloaded = 0;
+            if (watch_read(u->watch, &reload_file, u) != 0)
+                return -1;
+
+            /* Only the changed files have been read again, everything
+             * else is still in memory: rating the games from there is
+             * quick, and only pages that come out different get
+             * written. */
+            gettimeofday(&start, NULL);
+            if (u->reloaded > 0 && rerate(ctx, u) == 0)
+            {
+                char *what;
+
+                what = talloc_asprintf(ctx, "Reloaded %d file(s)",
+                                       u->reloaded);
+                finish_update(ctx, u, what, &start);
+                TALLOC_FREE(what);
+            }
+        }
+
+        if (ingest_index >= 0 && fds[ingest_index].revents != 0)
+            rate_ingested(ctx, u);
+
+        if (u->unpublished)
+        {
+            struct timeval start, end;
+            unsigned long version;
+
+            gettimeofday(&start, NULL);
+            if (elapsed_ms(&start, &u->next_publish) <= 0)
+            {
+                version = publish_update(u);
+                gettimeofday(&end, NULL);
+                fprintf(stderr, "Published version %lu in %ld ms\n",
+                        version, elapsed_ms(&start, &end));
+            }
+        }
+    }
+
+    return 0;
+}
+
+void handle_stop(int signum __attribute__ ((unused)))
+{
+    stop_requested = 1;
+}
+
+int rerate(void *ctx, struct updater *u)
+{
+    TALLOC_FREE(u->touched_players);
+    TALLOC_FREE(u->touched_maps);
+
+    if (!u->rerate_all && u->checkpoints != NULL && replay_changes(u) == 0)
+        return 0;
+
+    TALLOC_FREE(u->touched_players);
+    TALLOC_FREE(u->touched_maps);
+    u->rerate_all = 0;
+
+    TALLOC_FREE(u->ratings);
+    global_timeline = NULL;
+    global_matchup_table = NULL;
+    global_rank_tree = NULL;
+    global_rating_history = NULL;
+    global_pool_set = NULL;
+    global_h2h_table = NULL;
+    global_performance_table = NULL;
+    global_race_stats = NULL;
+    global_period_table = NULL;
+
+    if (rate_leagues(ctx, u) != 0)
+    {
+        fprintf(stderr, "Unable to rate the games, fix the data and "
+                "save again\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int replay_changes(struct updater *u)
+{
+    struct timeline *old, *tl;
+    const struct timeline_game *a, *b;
+    size_t a_count, b_count;
+    size_t first;
+    int *ranks;
+    int rank_count;
+    long from;
+    size_t i;
+
+    old = global_timeline;
+    tl = timeline_new(u->ratings, u->league_list);
+    if (tl == NULL)
+        return -1;
+
+    /* The tables are sized and indexed by the old timeline. */
+    if (timeline_player_count(tl) != timeline_player_count(old)
+        || timeline_map_count(tl) != timeline_map_count(old)
+        || timeline_league_count(tl) != timeline_league_count(old))
+        goto failure;
+
+    a = timeline_games(old);
+    b = timeline_games(tl);
+    a_count = timeline_game_count(old);
+    b_count = timeline_game_count(tl);
+    for (first = 0; first < a_count && first < b_count; first++)
+        if (a[first].time != b[first].time
+            || a[first].winner != b[first].winner
+            || a[first].loser != b[first].loser
+            || a[first].map != b[first].map
+            || a[first].league != b[first].league)
+            break;
+
+    /* Only the players and maps in a game that's changed can have
+     * different results, but anyone's rank can move. */
+    u->touched_players = bitmap_new(u->ratings);
+    u->touched_maps = bitmap_new(u->ratings);
+    ranks = talloc_array(tl, int, timeline_player_count(tl) + 1);
+    if (u->touched_players == NULL || u->touched_maps == NULL
+        || ranks == NULL || touch_games(u, old, first) != 0
+        || touch_games(u, tl, first) != 0)
+        goto failure;
+
+    rank_count = 0;
+    if (global_rank_tree != NULL)
+    {
+        rank_count = rank_tree_count(global_rank_tree);
+        for (i = 0; i < timeline_player_count(tl); i++)
+            ranks[i] = rank_tree_rank(global_rank_tree, i);
+    }
+
+    from = checkpoint_list_rollback(u->checkpoints, first,
+                                    u->prediction_stats);
+    if (from < 0)
+        goto failure;
+
+    /* The tables carry on from the checkpoint along the new timeline,
+     * and the games before that are the same on both. */
+    global_timeline = tl;
+    TALLOC_FREE(old);
+
+    trace_begin("replay", "changes");
+    replay_games(u, from);
+    if (global_rank_tree != NULL)
+        rank_tree_finish(global_rank_tree);
+    trace_end("replay");
+
+    if (u->bootstrap_replicas > 0)
+        if (bootstrap_elo(u->ratings, tl, u->bootstrap_mode,
+                          u->bootstrap_replicas, u->bootstrap_saves,
+                          first) != 0)
+            fprintf(stderr, "Bootstrapping failed\n");
+
+    if (global_rank_tree != NULL)
+    {
+        if (rank_tree_count(global_rank_tree) != rank_count)
+            TALLOC_FREE(u->touched_players);
+        else
+            for (i = 0; i < timeline_player_count(tl); i++)
+                if (rank_tree_rank(global_rank_tree, i) != ranks[i]
+                    && bitmap_add(u->touched_players, i) != 0)
+                {
+                    TALLOC_FREE(u->touched_players);
+                    break;
+                }
+    }
+
+    TALLOC_FREE(ranks);
+    return 0;
+
+  failure:
+    TALLOC_FREE(tl);
+    TALLOC_FREE(u->touched_players);
+    TALLOC_FREE(u->touched_maps);
+    return -1;
+}
+
+int touch_games(struct updater *u, struct timeline *tl, size_t first)
+{
+    const struct timeline_game *games;
+    size_t i;
+
+    games = timeline_games(tl);
+    for (i = first; i < timeline_game_count(tl); i++)
+        if (bitmap_add(u->touched_players, games[i].winner) != 0
+            || bitmap_add(u->touched_players, games[i].loser) != 0
+            || bitmap_add(u->touched_maps, games[i].map) != 0)
+            return -1;
+
+    return 0;
+}
+
+void finish_update(void *ctx, struct updater *u, const char *what,
+                   struct timeval *start)
+{
+    struct timeval end;
+    char *done;
+
+    if (u->snapshot == NULL)
+        done = talloc_asprintf(ctx, "rewrote %d page(s)",
+                               html_update(ctx, OUTDIR, u->touched_players,
+                                           u->touched_maps));
+    else
+    {
+        gettimeofday(&end, NULL);
+        u->unpublished = 1;
+        if (elapsed_ms(&end, &u->next_publish) <= 0)
+            done = talloc_asprintf(ctx, "published version %lu",
+                                   publish_update(u));
+        else
+            done = talloc_strdup(ctx, "publishing later");
+    }
+    gettimeofday(&end, NULL);
+
+    fprintf(stderr, "%s, %s in %ld ms\n", what, done,
+            elapsed_ms(start, &end));
+    TALLOC_FREE(done);
+    TALLOC_FREE(u->touched_players);
+    TALLOC_FREE(u->touched_maps);
+}
+
+unsigned long publish_update(struct updater *u)
+{
+    struct timeval start, end;
+    unsigned long version;
+    long wait;
+
+    gettimeofday(&start, NULL);
+    version = publish_ratings(u->snapshot);
+    gettimeofday(&end, NULL);
+
+    wait = elapsed_ms(&start, &end) * PUBLISH_COST_RATIO;
+    if (wait < PUBLISH_INTERVAL_MS)
+        wait = PUBLISH_INTERVAL_MS;
+
+    u->unpublished = 0;
+    u->next_publish = end;
+    u->next_publish.tv_sec += wait / 1000;
+    u->next_publish.tv_usec += (wait % 1000) * 1000;
+    if (u->next_publish.tv_usec >= 1000000)
+    {
+        u->next_publish.tv_sec++;
+        u->next_publish.tv_usec -= 1000000;
+    }
+
+    return version;
+}
+
+long elapsed_ms(const struct timeval *from, const struct timeval *to)
+{
+    return (long)((to->tv_sec - from->tv_sec) * 1000
+                  + (to->tv_usec - from->tv_usec) / 1000);
+}
+
+int reload_file(int dir, const char *name, void *u_uncast)
+{
+    struct updater *u;
+    void *ctx;
+    const char *filename;
+    struct stat sb;
+    int applied;
+
+    u = u_uncast;
+    ctx = talloc_new(u->league_list);
+    if (ctx == NULL)
+        return -1;
+
+    /* Files that are already gone again by now were only ever
+     * temporary, so they're skipped without a word. */
+    applied = 0;
+    if (dir == u->players_dir)
+    {
+        struct player *player, *old;
+
+        filename = talloc_asprintf(ctx, "%s/%s", INDIR "/players", name);
+        old = player_list_get(global_player_list, name);
+        player = NULL;
+        if (stat(filename, &sb) == 0)
+            player = player_read_file(ctx, filename, name);
+
+        /* Players can't be removed while leagues still point at
+         * them, so a deleted player just keeps their old details. */
+        if (player == NULL)
+        {
+            if (old != NULL || stat(filename, &sb) == 0)
+                fprintf(stderr, "Unable to read player '%s'\n", name);
+        }
+        else if (old == NULL)
+            applied = (player_list_add(global_player_list,
+                                       talloc_strdup(ctx, name),
+                                       player) == 0);
+        else if (strcmp(player_id(old), player_id(player)) != 0
+                 || player_race(old) != player_race(player))
+        {
+            player_update(old, player);
+            applied = 1;
+        }
+
+        if (applied)
+            u->rerate_all = 1;
+    }
+    else if (dir == u->maps_dir)
+    {
+        struct map *map, *old;
+
+        filename = talloc_asprintf(ctx, "%s/%s", INDIR "/maps", name);
+        old = map_list_get(global_map_list, name);
+        map = NULL;
+        if (stat(filename, &sb) == 0)
+            map = map_read_file(ctx, filename, name);
+
+        if (map == NULL)
+        {
+            if (old != NULL || stat(filename, &sb) == 0)
+                fprintf(stderr, "Unable to read map '%s'\n", name);
+        }
+        else if (old == NULL)
+            applied = (map_list_add(global_map_list,
+                                    talloc_strdup(ctx, name), map) == 0);
+        else if (strcmp(map_name(old), map_name(map)) != 0)
+        {
+            map_update(old, map);
+            applied = 1;
+        }
+
+        if (applied)
+            u->rerate_all = 1;
+    }
+    else if (dir == u->leagues_dir)
+    {
+        struct league *league, *old;
+
+        /* The ingested games live in memory, their file is only ever
+         * written by compacting the journal. */
+        if (u->journal != NULL && strcmp(name, league_key(u->ingested)) == 0)
+        {
+            TALLOC_FREE(ctx);
+            return 0;
+        }
+
+        filename = talloc_asprintf(ctx, "%s/%s", INDIR "/leagues", name);
+        old = league_list_get(u->league_list, name);
+        if (stat(filename, &sb) != 0)
+        {
+            applied = (league_list_remove(u->league_list, name) == 0);
+            if (applied)
+                u->rerate_all = 1;
+        }
+        else
+        {
+            /* A league that doesn't parse is left as it was, so the
+             * rest of the output stays up. */
+            league = league_read_file(ctx, filename, name);
+            if (league == NULL)
+                fprintf(stderr, "Unable to read league '%s'\n", name);
+            else
+            {
+                /* Every game's page lists its league by name. */
+                if (old == NULL
+                    || !same_name(league_name(old), league_name(league)))
+                    u->rerate_all = 1;
+                applied = (league_list_replace(u->league_list,
+                                               league) == 0);
+            }
+        }
+    }
+
+    if (applied)
+        u->reloaded++;
+    TALLOC_FREE(ctx);
+    return 0;
+}
+
+int same_name(const char *a, const char *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    return strcmp(a, b) == 0;
+}
+
+int rate_ingested(void *pctx, struct updater *u)
+{
+    void *ctx;
+    struct ingest_record *records;
+    struct ingested_game *games;
+    struct timeval start;
+    size_t count, added, removed;
+    size_t i;
+    int in_order;
+
+    ctx = talloc_new(pctx);
+    if (ctx == NULL)
+        return -1;
+
+    gettimeofday(&start, NULL);
+    records = ingest_take(u->ingest, ctx, INGEST_BATCH_MAX, &count);
+    if (count == 0)
+    {
+        TALLOC_FREE(ctx);
+        return 0;
+    }
+
+    games = talloc_array(ctx, struct ingested_game, count);
+    if (games == NULL)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    /* Games naming a player or map that doesn't exist are dropped, as
+     * there's nobody left to tell about them.  So are games that are
+     * already there, games from the same time as one that is, and
+     * removals of games that aren't. */
+    added = removed = 0;
+    for (i = 0; i < count; i++)
+    {
+        struct game *game, *kept;
+        struct journal_entry e;
+        int applied;
+
+        game = game_parse(ctx, records[i].line, league_name(u->ingested),
+                          NULL, NULL);
+        if (game == NULL || global_timeline == NULL
+            || timeline_player_lookup(global_timeline,
+                                      game_winner_key(game)) < 0
+            || timeline_player_lookup(global_timeline,
+                                      game_loser_key(game)) < 0
+            || timeline_map_lookup(global_timeline, game_map_key(game)) < 0
+            || strcmp(game_winner_key(game), game_loser_key(game)) == 0)
+        {
+            TALLOC_FREE(game);
+            continue;
+        }
+
+        e.op = (records[i].op == INGEST_ADD) ? JOURNAL_ADD : JOURNAL_REMOVE;
+        e.time = game_time(game);
+        e.map_key = game_map_key(game);
+        e.winner_key = game_winner_key(game);
+        e.loser_key = game_loser_key(game);
+
+        applied = apply_ingested(u, e.op, game, &kept);
+        if (applied > 0 && journal_append(u->journal, &e) != 0)
+            fprintf(stderr, "Unable to journal a game\n");
+
+        if (applied <= 0 || e.op == JOURNAL_REMOVE)
+        {
+            if (applied > 0)
+                removed++;
+            TALLOC_FREE(game);
+            continue;
+        }
+
+        TALLOC_FREE(game);
+        games[added].game = kept;
+        games[added].order = i;
+        added++;
+    }
+
+    /* Everything is on disk before anyone can see it rated. */
+    if (journal_sync(u->journal) != 0)
+        fprintf(stderr, "Unable to write the journal, these games will "
+                "be lost on restart\n");
+
+    qsort(games, added, sizeof(*games), &compare_ingested);
+
+    in_order = (removed == 0);
+    if (in_order && added > 0 && timeline_game_count(global_timeline) > 0)
+    {
+        const struct timeline_game *last;
+
+        last = timeline_games(global_timeline)
+            + timeline_game_count(global_timeline) - 1;
+        in_order = (last->time <= game_time(games[0].game));
+    }
+
+    if (in_order)
+    {
+        /* The common case: just carry on from where the ratings were. */
+        trace_begin("replay", "ingested");
+        for (i = 0; i < added; i++)
+        {
+            const struct timeline_game *tg;
+
+            tg = timeline_append(global_timeline, u->ingested,
+                                 games[i].game);
+            if (tg == NULL)
+                break;
+
+            rate_game(u, tg, games[i].game);
+        }
+
+        if (global_rank_tree != NULL)
+            rank_tree_finish(global_rank_tree);
+        trace_end("replay");
+    }
+    else if (rerate(pctx, u) != 0)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
 
-    player_play(winner, game);
-    player_play(loser, game);
+    /* A batch that changed nothing has nothing to publish. */
+    if (added == 0 && removed == 0)
+        fprintf(stderr, "Rejected %lu game(s)\n", (unsigned long)count);
+    else
+    {
+        char *what;
 
-    map_key = game_map_key(game);
-    map = map_list_get(global_map_list, map_key);
-    map_play(map, game);
+        what = talloc_asprintf(ctx, "Ingested %lu game(s), removed %lu "
+                               "(%lu rejected%s)",
+                               (unsigned long)added, (unsigned long)removed,
+                               (unsigned long)(count - added - removed),
+                               in_order ? "" : ", re-rated");
+        finish_update(ctx, u, what, &start);
+    }
 
+    compact_journal(ctx, u);
+    TALLOC_FREE(ctx);
     return 0;
 }
+
+int compare_ingested(const void *a_uncast, const void *b_uncast)
+{
+    const struct ingested_game *a, *b;
+    int c;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    c = game_compare_time(a->game, b->game);
+    if (c != 0)
+        return c;
+
+    return (a->order > b->order) - (a->order < b->order);
+}
+
+int load_ingested(void *ctx, struct updater *u, int accept_games)
+{
+    struct game_list_iterator *gli;
+    int listed;
+
+    u->ingested = league_list_get(u->league_list, "ingested");
+    listed = (u->ingested != NULL);
+    if (!listed)
+        u->ingested = league_new(ctx, "ingested", "Ingested Games");
+
+    /* Games that were compacted into the league file are already in
+     * it, so they'll be skipped if they're replayed again. */
+    if (u->ingested == NULL)
+        return -1;
+    u->ingested_keys = index_ingested(ctx, u->ingested);
+    if (u->ingested_keys == NULL)
+        return -1;
+
+    if (accept_games)
+    {
+        u->journal = journal_open(ctx, JOURNAL_PATH, &replay_journal, u);
+        if (u->journal == NULL)
+            return -1;
+    }
+    else if (journal_replay(JOURNAL_PATH, &replay_journal, u) != 0)
+        return -1;
+
+    /* The league is only shown when there's something in it, unless
+     * games may still come in. */
+    gli = league_game_iterator(u->ingested, ctx);
+    if (gli == NULL)
+        return -1;
+    if (!listed && (accept_games || game_list_iterator_cur(gli) != NULL)
+        && league_list_add(u->league_list, u->ingested) != 0)
+        return -1;
+    TALLOC_FREE(gli);
+
+    return 0;
+}
+
+int replay_journal(const struct journal_entry *e, void *u_uncast)
+{
+    struct updater *u;
+    struct game *game;
+    void *tmp;
+    int ret;
+
+    u = u_uncast;
+
+    /* Players and maps may have been removed since the game was
+     * journaled, in which case it's skipped. */
+    if (player_list_get(global_player_list, e->winner_key) == NULL
+        || player_list_get(global_player_list, e->loser_key) == NULL
+        || map_list_get(global_map_list, e->map_key) == NULL
+        || strcmp(e->winner_key, e->loser_key) == 0)
+        return 0;
+
+    /* The league keeps its own copy of any game it adds. */
+    tmp = talloc_new(u->ingested);
+    if (tmp == NULL)
+        return -1;
+
+    game = game_new(tmp, e->time, e->map_key, e->winner_key, e->loser_key,
+                    league_name(u->ingested));
+    ret = (game == NULL || apply_ingested(u, e->op, game, NULL) < 0)
+        ? -1 : 0;
+    TALLOC_FREE(tmp);
+    return ret;
+}
+
+int apply_ingested(struct updater *u, enum journal_op op,
+                   struct game *game, struct game **kept)
+{
+    char *key, *time_key;
+    int present, taken;
+    int ret;
+
+    key = ingested_key(u->ingested_keys, game);
+    time_key = (key == NULL) ? NULL : ingested_time_key(key, game);
+    if (time_key == NULL)
+    {
+        TALLOC_FREE(key);
+        return -1;
+    }
+
+    present = (key_index_get(u->ingested_keys, key) > 0);
+    taken = (key_index_get(u->ingested_keys, time_key) > 0);
+
+    ret = 0;
+    if (op == JOURNAL_ADD && !present && !taken)
+    {
+        game = league_add_game(u->ingested, game);
+        if (game == NULL || key_index_add(u->ingested_keys, key, 1) != 0
+            || key_index_add(u->ingested_keys, time_key, 1) != 0)
+            ret = -1;
+        else
+        {
+            if (kept != NULL)
+                *kept = game;
+            ret = 1;
+        }
+    }
+    else if (op == JOURNAL_REMOVE && present)
+    {
+        league_remove_game(u->ingested, game);
+        ret = (key_index_add(u->ingested_keys, key, 0) == 0
+               && key_index_add(u->ingested_keys, time_key, 0) == 0)
+            ? 1 : -1;
+    }
+
+    TALLOC_FREE(key);
+    return ret;
+}
+
+char *ingested_key(void *ctx, struct game *game)
+{
+    return talloc_asprintf(ctx, "%ld %s %s %s", (long)game_time(game),
+                           game_map_key(game), game_winner_key(game),
+                           game_loser_key(game));
+}
+
+char *ingested_time_key(void *ctx, struct game *game)
+{
+    return talloc_asprintf(ctx, "%ld", (long)game_time(game));
+}
+
+struct key_index *index_ingested(void *ctx, struct league *l)
+{
+    struct key_index *keys;
+    struct game_list_iterator *gli;
+    struct game *game;
+
+    keys = key_index_new(ctx, 1024);
+    gli = league_game_iterator(l, keys);
+    if (keys == NULL || gli == NULL)
+    {
+        TALLOC_FREE(keys);
+        return NULL;
+    }
+
+    while ((game = game_list_iterator_cur(gli)) != NULL)
+    {
+        char *key, *time_key;
+        int ret;
+
+        key = ingested_key(gli, game);
+        time_key = (key == NULL) ? NULL : ingested_time_key(key, game);
+        ret = (time_key == NULL || key_index_add(keys, key, 1) != 0
+               || key_index_add(keys, time_key, 1) != 0) ? -1 : 0;
+        TALLOC_FREE(key);
+        if (ret != 0)
+        {
+            TALLOC_FREE(keys);
+            return NULL;
+        }
+
+        game_list_iterator_next(gli);
+    }
+
+    TALLOC_FREE(gli);
+    return keys;
+}
+
+void compact_journal(void *ctx, struct updater *u)
+{
+    struct key_index *keys;
+    void *old;
+    char *text;
+
+    if (!journal_needs_compaction(u->journal))
+        return;
+
+    text = league_format(ctx, u->ingested);
+    if (text == NULL)
+        return;
+
+    if (journal_compact(u->journal, INDIR "/leagues",
+                        league_key(u->ingested), text) != 0)
+    {
+        TALLOC_FREE(text);
+        return;
+    }
+
+    fprintf(stderr, "Compacting the journal into '%s/%s'\n",
+            INDIR "/leagues", league_key(u->ingested));
+    TALLOC_FREE(text);
+
+    /* Removed games (and the keys of every game ever seen) would
+     * otherwise pile up for as long as the server runs.  If the
+     * timeline can't be pointed at the new copies then the old ones
+     * just stay around with the league. */
+    old = league_repack(u->ingested);
+    if (old != NULL && timeline_relink(global_timeline, u->ingested) == 0)
+        TALLOC_FREE(old);
+
+    keys = index_ingested(u->ingested, u->ingested);
+    if (keys != NULL)
+    {
+        TALLOC_FREE(u->ingested_keys);
+        u->ingested_keys = keys;
+    }
+}
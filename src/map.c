@@ -20,9 +20,11 @@
  */
 
 #include "map.h"
-#include "game_list.h"
+#include "text.h"
 #include "global.h"
 #include "player_list.h"
+#include "stats.h"
+#include "timeline.h"
 #include "race.h"
 
 #include <ctype.h>
@@ -43,31 +45,13 @@ struct map
     /* The English name of this map. */
     const char *name;
 
-    /* A list of every game this map has played. */
-    struct game_list *games;
-
     /* The key that uniquely identifies this map */
     const char *key;
 
-    /* Calculates the winrates for each game type. */
-    int zvp_wins, zvp_losses;
-    int pvt_wins, pvt_losses;
-    int tvz_wins, tvz_losses;
+    /* This map's position in every per-map array. */
+    int index;
 };
 
-/***********************************************************************
- * Static Method Headers                                               *
- ***********************************************************************/
-
-/* Returns TRUE if the haystack starts with the needle. */
-static bool string_starts_with(const char *haystack, const char *needle);
-
-/* Returts NULL if the haystack doesn't start with the needle.
- * Otherwise, removes the needle from the start of the hackstack and
- * strips any leading whitespace.  Note that no memory is allocated
- * here, it's just pointer arithmetic. */
-static const char *strip_front(const char *hs, const char *ne);
-
 /***********************************************************************
  * Extern Methods                                                      *
  ***********************************************************************/
@@ -83,21 +67,19 @@ struct map *map_read_file(void *c, const char *filename, const char *key)
 
     /* Sets everything to the default. */
     m->name = NULL;
-    m->games = game_list_new(m);
     m->key = NULL;
-    m->zvp_wins = m->zvp_losses = 0;
-    m->pvt_wins = m->pvt_losses = 0;
-    m->tvz_wins = m->tvz_losses = 0;
+    m->index = -1;
 
     /* There should be a unique key, but apparently sometimes there's
      * not. */
     if (key != NULL)
-        m->key = talloc_reference(m, key);
+        m->key = stats_reference(m, key);
 
     /* Reads the input file. */
     mf = fopen(filename, "r");
     if (mf == NULL)
         goto error;
+    stats_count(STATS_FILES_READ, 1);
 
     while (fgets(buf, LINE_MAX, mf) != NULL)
     {
@@ -109,13 +91,13 @@ struct map *map_read_file(void *c, const char *filename, const char *key)
             buf[strlen(buf) - 1] = '\0';
 
         /* Attempt to parse! */
-        if ((b = strip_front(buf, "NAME ")) != NULL)
+        if ((b = text_strip_front(buf, "NAME ")) != NULL)
             m->name = talloc_strdup(m, b);
     }
 
     fclose(mf);
     mf = NULL;
-    return m;
+    return stats_track(m, STATS_MEMORY_MAPS);
 
   error:
     if (mf != NULL)
@@ -125,31 +107,13 @@ struct map *map_read_file(void *c, const char *filename, const char *key)
     return NULL;
 }
 
-int map_play(struct map *map, struct game *game)
+void map_update(struct map *map, struct map *source)
 {
-    struct player *winner, *loser;
-    enum race winner_race, loser_race;
+    const char *old_name;
 
-    winner = player_list_get(global_player_list, game_winner_key(game));
-    loser = player_list_get(global_player_list, game_loser_key(game));
-
-    winner_race = player_race(winner);
-    loser_race = player_race(loser);
-
-    if (winner_race == RACE_ZERG && loser_race == RACE_PROTOSS)
-        map->zvp_wins++;
-    if (winner_race == RACE_PROTOSS && loser_race == RACE_TERRAN)
-        map->pvt_wins++;
-    if (winner_race == RACE_TERRAN && loser_race == RACE_ZERG)
-        map->tvz_wins++;
-    if (loser_race == RACE_ZERG && winner_race == RACE_PROTOSS)
-        map->zvp_losses++;
-    if (loser_race == RACE_PROTOSS && winner_race == RACE_TERRAN)
-        map->pvt_losses++;
-    if (loser_race == RACE_TERRAN && winner_race == RACE_ZERG)
-        map->tvz_losses++;
-
-    return game_list_add(map->games, game);
+    old_name = map->name;
+    map->name = talloc_strdup(map, source->name);
+    talloc_free((char *)old_name);
 }
 
 const char *map_name(struct map *map)
@@ -162,74 +126,84 @@ const char *map_key(struct map *map)
     return map->key;
 }
 
+int map_race_wins(struct map *map, enum race winner, enum race loser)
+{
+    const struct race_counts *rc;
+
+    if (global_race_stats == NULL)
+        return 0;
+
+    rc = race_stats_map(global_race_stats, map->index);
+    if (rc == NULL || (unsigned)winner >= RACE_COUNT
+        || (unsigned)loser >= RACE_COUNT)
+        return 0;
+
+    return rc->wins[winner][loser];
+}
+
 int map_zvp_wins(struct map *map)
 {
-    return map->zvp_wins;
+    return map_race_wins(map, RACE_ZERG, RACE_PROTOSS);
 }
 
 int map_pvt_wins(struct map *map)
 {
-    return map->pvt_wins;
+    return map_race_wins(map, RACE_PROTOSS, RACE_TERRAN);
 }
 
 int map_tvz_wins(struct map *map)
 {
-    return map->tvz_wins;
+    return map_race_wins(map, RACE_TERRAN, RACE_ZERG);
 }
 
 int map_zvp_losses(struct map *map)
 {
-    return map->zvp_losses;
+    return map_race_wins(map, RACE_PROTOSS, RACE_ZERG);
 }
 
 int map_pvt_losses(struct map *map)
 {
-    return map->pvt_losses;
+    return map_race_wins(map, RACE_TERRAN, RACE_PROTOSS);
 }
 
 int map_tvz_losses(struct map *map)
 {
-    return map->tvz_losses;
+    return map_race_wins(map, RACE_ZERG, RACE_TERRAN);
 }
 
 double map_zvp_winrate(struct map *map)
 {
-    return map->zvp_wins / (double)(map->zvp_wins + map->zvp_losses);
+    return map_zvp_wins(map) / (double)(map_zvp_wins(map)
+                                        + map_zvp_losses(map));
 }
 
 double map_pvt_winrate(struct map *map)
 {
-    return map->pvt_wins / (double)(map->pvt_wins + map->pvt_losses);
+    return map_pvt_wins(map) / (double)(map_pvt_wins(map)
+                                        + map_pvt_losses(map));
 }
 
 double map_tvz_winrate(struct map *map)
 {
-    return map->tvz_wins / (double)(map->tvz_wins + map->tvz_losses);
+    return map_tvz_wins(map) / (double)(map_tvz_wins(map)
+                                        + map_tvz_losses(map));
 }
 
-int map_each_game(struct map *map,
-                  int (*iter) (struct game *, void *), void *data)
+int map_index(struct map *map)
 {
-    return game_list_each(map->games, iter, data);
+    return map->index;
 }
 
-/***********************************************************************
- * Static Methods                                                      *
- ***********************************************************************/
-bool string_starts_with(const char *haystack, const char *needle)
+void map_set_index(struct map *map, int index)
 {
-    return (strncmp(haystack, needle, strlen(needle)) == 0);
+    map->index = index;
 }
 
-const char *strip_front(const char *haystack, const char *needle)
+int map_each_game(struct map *map,
+                  int (*iter) (struct game *, void *), void *data)
 {
-    if (!string_starts_with(haystack, needle))
-        return false;
-
-    haystack += strlen(needle);
-
-    while (isspace(*haystack))
-        haystack++;
+    if (global_timeline == NULL)
+        return 0;
 
-    return haystack;
+    return timeline_each_map_game(global_timeline, map->index, iter, data);
 }
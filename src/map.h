@@ -26,17 +26,23 @@
 struct map;
 
 #include "game.h"
+#include "race.h"
 
 /* Reads a map's information from a file, setting the remaining
  * information to the default values. */
 struct map *map_read_file(void *c, const char *filename, const char *key);
 
-/* Adds a played game to the list of games this played has played */
-int map_play(struct map *map, struct game *game);
+/* Copies everything that's read from a map's file from a freshly read
+ * copy of the same map, leaving its games alone. */
+void map_update(struct map *map, struct map *source);
 
 /* Access some basic data about a map. */
 const char *map_name(struct map *map);
 const char *map_key(struct map *map);
+
+/* How many games one race won against another on this map, and the
+ * usual matchups' records, as counted by the global race stats. */
+int map_race_wins(struct map *map, enum race winner, enum race loser);
 int map_zvp_wins(struct map *map);
 int map_pvt_wins(struct map *map);
 int map_tvz_wins(struct map *map);
@@ -47,7 +53,13 @@ double map_zvp_winrate(struct map *map);
 double map_pvt_winrate(struct map *map);
 double map_tvz_winrate(struct map *map);
 
-/* Iterates through every game this map has played */
+/* Like players, maps in the global list get a dense integer index.
+ * This is -1 for maps that haven't been indexed. */
+int map_index(struct map *map);
+void map_set_index(struct map *map, int index);
+
+/* Iterates through every game this map has played, as listed by the
+ * global timeline. */
 int map_each_game(struct map *map,
                   int (*iter) (struct game *, void *), void *data);
 
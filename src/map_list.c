@@ -22,6 +22,7 @@
 #define _BSD_SOURCE
 
 #include "map_list.h"
+#include "stats.h"
 
 #include <dirent.h>
 #include <talloc.h>
@@ -121,8 +122,9 @@ int map_list_add(struct map_list *ml, const char *key, struct map *map)
 
     /* Simply adds to the head of the list without any checking at all! */
     new->next = ml->head;
-    new->key = talloc_reference(new, key);
-    new->data = talloc_reference(new, map);
+    new->key = stats_reference(new, key);
+    new->data = stats_reference(new, map);
+    stats_track(new, STATS_MEMORY_NODES);
     ml->head = new;
     return 0;
 }
@@ -145,6 +147,7 @@ struct map *map_list_get(struct map_list *ml, const char *key)
 {
     struct map_list_node *cur;
 
+    stats_count(STATS_LOOKUPS, 1);
     cur = ml->head;
     while (cur != NULL)
     {
@@ -0,0 +1,161 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "matchup.h"
+
+#include <string.h>
+#include <talloc.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct matchup_table
+{
+    size_t player_count;
+
+    /* One column per opponent race, each "player_count" long. */
+    player_elo_t *elo[RACE_COUNT];
+    int *wins[RACE_COUNT];
+    int *losses[RACE_COUNT];
+};
+
+/* A copy of every column. */
+struct matchup_checkpoint
+{
+    player_elo_t *elo[RACE_COUNT];
+    int *wins[RACE_COUNT];
+    int *losses[RACE_COUNT];
+};
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct matchup_table *matchup_table_new(void *ctx, size_t player_count)
+{
+    struct matchup_table *mt;
+    int r;
+
+    mt = talloc(ctx, struct matchup_table);
+    if (mt == NULL)
+        return NULL;
+
+    mt->player_count = player_count;
+
+    for (r = 0; r < RACE_COUNT; r++)
+    {
+        size_t i;
+
+        mt->elo[r] = talloc_array(mt, player_elo_t, player_count + 1);
+        mt->wins[r] = talloc_zero_array(mt, int, player_count + 1);
+        mt->losses[r] = talloc_zero_array(mt, int, player_count + 1);
+        if (mt->elo[r] == NULL || mt->wins[r] == NULL
+            || mt->losses[r] == NULL)
+        {
+            TALLOC_FREE(mt);
+            return NULL;
+        }
+
+        for (i = 0; i < player_count; i++)
+            mt->elo[r][i] = elo_default();
+    }
+
+    return mt;
+}
+
+void matchup_table_win(struct matchup_table *mt,
+                       int winner, enum race winner_race,
+                       int loser, enum race loser_race)
+{
+    int g_w, g_l;
+
+    /* The winner's rating against the loser's race plays the loser's
+     * rating against the winner's race. */
+    g_w = mt->wins[loser_race][winner] + mt->losses[loser_race][winner];
+    g_l = mt->wins[winner_race][loser] + mt->losses[winner_race][loser];
+
+    elo_update(&mt->elo[loser_race][winner], &mt->elo[winner_race][loser],
+               g_w, g_l);
+
+    mt->wins[loser_race][winner]++;
+    mt->losses[winner_race][loser]++;
+}
+
+struct matchup_checkpoint *matchup_table_checkpoint(void *ctx,
+                                                    struct matchup_table
+                                                    *mt)
+{
+    struct matchup_checkpoint *cp;
+    size_t n;
+    int r;
+
+    cp = talloc(ctx, struct matchup_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    n = mt->player_count + 1;
+    for (r = 0; r < RACE_COUNT; r++)
+    {
+        cp->elo[r] = talloc_memdup(cp, mt->elo[r], n * sizeof(*mt->elo[r]));
+        cp->wins[r] = talloc_memdup(cp, mt->wins[r],
+                                    n * sizeof(*mt->wins[r]));
+        cp->losses[r] = talloc_memdup(cp, mt->losses[r],
+                                      n * sizeof(*mt->losses[r]));
+        if (cp->elo[r] == NULL || cp->wins[r] == NULL
+            || cp->losses[r] == NULL)
+        {
+            TALLOC_FREE(cp);
+            return NULL;
+        }
+    }
+
+    return cp;
+}
+
+void matchup_table_rollback(struct matchup_table *mt,
+                            const struct matchup_checkpoint *cp)
+{
+    size_t n;
+    int r;
+
+    n = mt->player_count + 1;
+    for (r = 0; r < RACE_COUNT; r++)
+    {
+        memcpy(mt->elo[r], cp->elo[r], n * sizeof(*mt->elo[r]));
+        memcpy(mt->wins[r], cp->wins[r], n * sizeof(*mt->wins[r]));
+        memcpy(mt->losses[r], cp->losses[r], n * sizeof(*mt->losses[r]));
+    }
+}
+
+player_elo_t matchup_elo(struct matchup_table *mt, int player,
+                         enum race opponent)
+{
+    return mt->elo[opponent][player];
+}
+
+int matchup_wins(struct matchup_table *mt, int player, enum race opponent)
+{
+    return mt->wins[opponent][player];
+}
+
+int matchup_losses(struct matchup_table *mt, int player, enum race opponent)
+{
+    return mt->losses[opponent][player];
+}
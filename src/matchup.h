@@ -0,0 +1,69 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MATCHUP_H
+#define MATCHUP_H
+
+/* Tracks a separate Elo rating for every player against each race,
+ * alongside the overall rating.  This is stored as a struct of arrays
+ * indexed by the player's index and the opponent's race, so updating
+ * it as part of the main replay touches only a couple of cache
+ * lines. */
+struct matchup_table;
+
+/* Every rating and record in a table as it stood at some point. */
+struct matchup_checkpoint;
+
+#include "elo.h"
+#include "race.h"
+
+#include <stddef.h>
+
+/* Creates a table for the given number of players, everyone starting
+ * out with the default rating against every race. */
+struct matchup_table *matchup_table_new(void *ctx, size_t player_count);
+
+/* Records a win for the winner against the loser's race, and a loss
+ * for the loser against the winner's race.  Players are given by
+ * their index. */
+void matchup_table_win(struct matchup_table *mt,
+                       int winner, enum race winner_race,
+                       int loser, enum race loser_race);
+
+/* Copies out the whole table, so it can be rolled back to this point
+ * if the games after it change.  Returns NULL on failure. */
+struct matchup_checkpoint *matchup_table_checkpoint(void *ctx,
+                                                    struct matchup_table
+                                                    *mt);
+
+/* Puts every player's ratings and records back to how they were at
+ * the checkpoint, which must have come from this table. */
+void matchup_table_rollback(struct matchup_table *mt,
+                            const struct matchup_checkpoint *cp);
+
+/* Access a single player's data against a single race. */
+player_elo_t matchup_elo(struct matchup_table *mt, int player,
+                         enum race opponent);
+int matchup_wins(struct matchup_table *mt, int player, enum race opponent);
+int matchup_losses(struct matchup_table *mt, int player,
+                   enum race opponent);
+
+#endif
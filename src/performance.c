@@ -0,0 +1,456 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "performance.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <talloc.h>
+
+/* How many cells the table starts out with room for. */
+#ifndef PERFORMANCE_INITIAL_CELLS
+#define PERFORMANCE_INITIAL_CELLS 1024
+#endif
+
+/* Stands in for the race of a pair's total cell. */
+#define TOTAL RACE_COUNT
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct cell
+{
+    uint32_t player;
+    uint32_t map;
+    uint32_t race;
+    struct performance p;
+};
+
+/* Every pair's total cell, by player and by map: player "p" has
+ * cells[rows[offsets[p]]] up to cells[rows[offsets[p + 1]]]. */
+struct cell_index
+{
+    uint32_t *offsets;
+    uint32_t *rows;
+    size_t keys;
+};
+
+struct performance_table
+{
+    /* Every cell in the order they were first played. */
+    struct cell *cells;
+    size_t count;
+    size_t alloc;
+
+    /* Open addressing on the player, map and race of a cell, holding
+     * one more than the cell's position, or 0 if it's unused.  This is
+     * always a power of two long and at most half full. */
+    uint32_t *slots;
+    size_t slot_count;
+
+    /* The indices are only built when they're first walked, and again
+     * whenever a new total cell has been added. */
+    struct cell_index by_player;
+    struct cell_index by_map;
+    size_t player_count;
+    size_t map_count;
+    size_t totals;
+    size_t indexed_totals;
+};
+
+/* Cells are added and changed, but never moved, so a copy of the ones
+ * there so far is enough to go back. */
+struct performance_checkpoint
+{
+    struct cell *cells;
+    size_t count;
+    size_t player_count;
+    size_t map_count;
+    size_t totals;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Returns the slot a cell is in, or would go in if it's not there. */
+static uint32_t *find_slot(const struct cell *cells, uint32_t *slots,
+                           size_t slot_count, uint32_t player,
+                           uint32_t map, uint32_t race);
+
+/* Returns a cell, adding it if it's not there yet. */
+static struct cell *get_cell(struct performance_table *pt, uint32_t player,
+                             uint32_t map, uint32_t race);
+static const struct cell *lookup_cell(struct performance_table *pt,
+                                      int player, int map, uint32_t race);
+static int grow_slots(struct performance_table *pt);
+
+static void add_result(struct cell *c, int won, player_elo_t change);
+
+static int update_indices(struct performance_table *pt);
+static int build_index(struct performance_table *pt, struct cell_index *ci,
+                       size_t keys, int by_map);
+static int each_cell(struct performance_table *pt,
+                     const struct cell_index *ci, int key, int pass_map,
+                     int (*func) (int, const struct performance *, void *),
+                     void *arg);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct performance_table *performance_table_new(void *ctx)
+{
+    struct performance_table *pt;
+
+    pt = talloc_zero(ctx, struct performance_table);
+    if (pt == NULL)
+        return NULL;
+
+    pt->alloc = PERFORMANCE_INITIAL_CELLS;
+    pt->cells = talloc_array(pt, struct cell, pt->alloc);
+    pt->slot_count = PERFORMANCE_INITIAL_CELLS * 2;
+    pt->slots = talloc_zero_array(pt, uint32_t, pt->slot_count);
+    if (pt->cells == NULL || pt->slots == NULL)
+    {
+        TALLOC_FREE(pt);
+        return NULL;
+    }
+
+    return pt;
+}
+
+int performance_table_game(struct performance_table *pt, int map,
+                           int winner, enum race winner_race,
+                           player_elo_t winner_change,
+                           int loser, enum race loser_race,
+                           player_elo_t loser_change)
+{
+    struct cell *c[4];
+    int i;
+
+    if (map < 0 || winner < 0 || loser < 0)
+        return -1;
+
+    /* Cells can move as the table grows, so every one is looked up
+     * before any of them are written to. */
+    if (get_cell(pt, winner, map, TOTAL) == NULL
+        || get_cell(pt, winner, map, loser_race) == NULL
+        || get_cell(pt, loser, map, TOTAL) == NULL
+        || get_cell(pt, loser, map, winner_race) == NULL)
+        return -1;
+
+    c[0] = get_cell(pt, winner, map, TOTAL);
+    c[1] = get_cell(pt, winner, map, loser_race);
+    c[2] = get_cell(pt, loser, map, TOTAL);
+    c[3] = get_cell(pt, loser, map, winner_race);
+    for (i = 0; i < 4; i++)
+        add_result(c[i], i < 2, (i < 2) ? winner_change : loser_change);
+
+    return 0;
+}
+
+struct performance_checkpoint *performance_table_checkpoint(void *ctx,
+                                                            struct
+                                                            performance_table
+                                                            *pt)
+{
+    struct performance_checkpoint *cp;
+
+    cp = talloc(ctx, struct performance_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    cp->cells = talloc_memdup(cp, pt->cells,
+                              (pt->count + 1) * sizeof(*pt->cells));
+    if (cp->cells == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    cp->count = pt->count;
+    cp->player_count = pt->player_count;
+    cp->map_count = pt->map_count;
+    cp->totals = pt->totals;
+    return cp;
+}
+
+void performance_table_rollback(struct performance_table *pt,
+                                const struct performance_checkpoint *cp)
+{
+    size_t i;
+
+    /* The table only ever grows, so the saved cells always fit and the
+     * slots just have to be filled in again. */
+    memcpy(pt->cells, cp->cells, cp->count * sizeof(*pt->cells));
+    pt->count = cp->count;
+    pt->player_count = cp->player_count;
+    pt->map_count = cp->map_count;
+    pt->totals = cp->totals;
+
+    memset(pt->slots, 0, pt->slot_count * sizeof(*pt->slots));
+    for (i = 0; i < pt->count; i++)
+        *find_slot(pt->cells, pt->slots, pt->slot_count,
+                   pt->cells[i].player, pt->cells[i].map,
+                   pt->cells[i].race) = i + 1;
+
+    TALLOC_FREE(pt->by_player.offsets);
+}
+
+const struct performance *performance_total(struct performance_table *pt,
+                                            int player, int map)
+{
+    const struct cell *c;
+
+    c = lookup_cell(pt, player, map, TOTAL);
+    return (c == NULL) ? NULL : &c->p;
+}
+
+const struct performance *performance_vs(struct performance_table *pt,
+                                         int player, int map,
+                                         enum race opponent)
+{
+    const struct cell *c;
+
+    if ((int)opponent < 0 || opponent >= RACE_COUNT)
+        return NULL;
+
+    c = lookup_cell(pt, player, map, opponent);
+    return (c == NULL) ? NULL : &c->p;
+}
+
+int performance_each_map(struct performance_table *pt, int player,
+                         int (*func) (int, const struct performance *,
+                                      void *), void *arg)
+{
+    if (update_indices(pt) != 0)
+        return -1;
+
+    return each_cell(pt, &pt->by_player, player, 1, func, arg);
+}
+
+int performance_each_player(struct performance_table *pt, int map,
+                            int (*func) (int, const struct performance *,
+                                         void *), void *arg)
+{
+    if (update_indices(pt) != 0)
+        return -1;
+
+    return each_cell(pt, &pt->by_map, map, 0, func, arg);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+uint32_t *find_slot(const struct cell *cells, uint32_t *slots,
+                    size_t slot_count, uint32_t player, uint32_t map,
+                    uint32_t race)
+{
+    size_t i;
+
+    i = ((uint64_t)player * 0x9E3779B97F4A7C15ULL
+         ^ (uint64_t)map * 0xC2B2AE3D27D4EB4FULL
+         ^ (uint64_t)race * 0x165667B19E3779F9ULL) >> 32;
+    for (i &= slot_count - 1;; i = (i + 1) & (slot_count - 1))
+    {
+        const struct cell *c;
+
+        if (slots[i] == 0)
+            return slots + i;
+
+        c = cells + slots[i] - 1;
+        if (c->player == player && c->map == map && c->race == race)
+            return slots + i;
+    }
+}
+
+struct cell *get_cell(struct performance_table *pt, uint32_t player,
+                      uint32_t map, uint32_t race)
+{
+    uint32_t *slot;
+    struct cell *c;
+
+    slot = find_slot(pt->cells, pt->slots, pt->slot_count, player, map,
+                     race);
+    if (*slot != 0)
+        return pt->cells + *slot - 1;
+
+    if ((pt->count + 1) * 2 > pt->slot_count)
+    {
+        if (grow_slots(pt) != 0)
+            return NULL;
+
+        slot = find_slot(pt->cells, pt->slots, pt->slot_count, player,
+                         map, race);
+    }
+
+    if (pt->count == pt->alloc)
+    {
+        struct cell *cells;
+
+        cells = talloc_realloc(pt, pt->cells, struct cell, pt->alloc * 2);
+        if (cells == NULL)
+            return NULL;
+
+        pt->cells = cells;
+        pt->alloc *= 2;
+    }
+
+    c = pt->cells + pt->count++;
+    c->player = player;
+    c->map = map;
+    c->race = race;
+    c->p.wins = c->p.losses = 0;
+    c->p.elo_change = 0;
+    *slot = pt->count;
+
+    if (race == TOTAL)
+    {
+        pt->totals++;
+        if (player >= pt->player_count)
+            pt->player_count = player + 1;
+        if (map >= pt->map_count)
+            pt->map_count = map + 1;
+    }
+
+    return c;
+}
+
+const struct cell *lookup_cell(struct performance_table *pt, int player,
+                               int map, uint32_t race)
+{
+    uint32_t *slot;
+
+    if (player < 0 || map < 0)
+        return NULL;
+
+    slot = find_slot(pt->cells, pt->slots, pt->slot_count, player, map,
+                     race);
+    return (*slot == 0) ? NULL : pt->cells + *slot - 1;
+}
+
+int grow_slots(struct performance_table *pt)
+{
+    uint32_t *slots;
+    size_t slot_count;
+    size_t i;
+
+    slot_count = pt->slot_count * 2;
+    slots = talloc_zero_array(pt, uint32_t, slot_count);
+    if (slots == NULL)
+        return -1;
+
+    for (i = 0; i < pt->count; i++)
+        *find_slot(pt->cells, slots, slot_count, pt->cells[i].player,
+                   pt->cells[i].map, pt->cells[i].race) = i + 1;
+
+    TALLOC_FREE(pt->slots);
+    pt->slots = slots;
+    pt->slot_count = slot_count;
+    return 0;
+}
+
+void add_result(struct cell *c, int won, player_elo_t change)
+{
+    if (won)
+        c->p.wins++;
+    else
+        c->p.losses++;
+
+    c->p.elo_change += change;
+}
+
+int update_indices(struct performance_table *pt)
+{
+    if (pt->by_player.offsets != NULL && pt->indexed_totals == pt->totals)
+        return 0;
+
+    if (build_index(pt, &pt->by_player, pt->player_count, 0) != 0
+        || build_index(pt, &pt->by_map, pt->map_count, 1) != 0)
+    {
+        TALLOC_FREE(pt->by_player.offsets);
+        return -1;
+    }
+
+    pt->indexed_totals = pt->totals;
+    return 0;
+}
+
+int build_index(struct performance_table *pt, struct cell_index *ci,
+                size_t keys, int by_map)
+{
+    uint32_t *fill;
+    size_t i;
+
+    TALLOC_FREE(ci->offsets);
+    TALLOC_FREE(ci->rows);
+    ci->keys = keys;
+    ci->offsets = talloc_zero_array(pt, uint32_t, keys + 2);
+    ci->rows = talloc_array(pt, uint32_t, pt->totals + 1);
+    fill = talloc_array(pt, uint32_t, keys + 1);
+    if (ci->offsets == NULL || ci->rows == NULL || fill == NULL)
+    {
+        TALLOC_FREE(ci->offsets);
+        TALLOC_FREE(ci->rows);
+        TALLOC_FREE(fill);
+        return -1;
+    }
+
+    for (i = 0; i < pt->count; i++)
+        if (pt->cells[i].race == TOTAL)
+            ci->offsets[(by_map ? pt->cells[i].map
+                         : pt->cells[i].player) + 1]++;
+
+    for (i = 0; i < keys; i++)
+        ci->offsets[i + 1] += ci->offsets[i];
+    memcpy(fill, ci->offsets, keys * sizeof(*fill));
+
+    for (i = 0; i < pt->count; i++)
+        if (pt->cells[i].race == TOTAL)
+            ci->rows[fill[by_map ? pt->cells[i].map
+                          : pt->cells[i].player]++] = i;
+
+    TALLOC_FREE(fill);
+    return 0;
+}
+
+int each_cell(struct performance_table *pt, const struct cell_index *ci,
+              int key, int pass_map,
+              int (*func) (int, const struct performance *, void *),
+              void *arg)
+{
+    uint32_t i;
+
+    if (key < 0 || (size_t)key >= ci->keys)
+        return 0;
+
+    for (i = ci->offsets[key]; i < ci->offsets[key + 1]; i++)
+    {
+        const struct cell *c;
+        int ret;
+
+        c = pt->cells + ci->rows[i];
+        if ((ret = func(pass_map ? c->map : c->player, &c->p, arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
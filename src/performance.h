@@ -0,0 +1,91 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERFORMANCE_H
+#define PERFORMANCE_H
+
+/* How every player did on every map they've played on, filled in as
+ * part of the main replay.  Only the player and map pairs that have
+ * actually played get a cell, each of which is found by hashing the
+ * two indices.  Every pair has a cell with the total, and a cell for
+ * every race they've played against there. */
+struct performance_table;
+
+/* The table's cells as they stood at some point. */
+struct performance_checkpoint;
+
+#include "elo.h"
+#include "race.h"
+
+/* A player's results on a single map. */
+struct performance
+{
+    int wins;
+    int losses;
+
+    /* The sum of every rating change from these games. */
+    player_elo_t elo_change;
+};
+
+/* Creates an empty table. */
+struct performance_table *performance_table_new(void *ctx);
+
+/* Records a game on a map, with how much each player's rating changed
+ * because of it.  Players and maps are given by index.  Returns 0 on
+ * success. */
+int performance_table_game(struct performance_table *pt, int map,
+                           int winner, enum race winner_race,
+                           player_elo_t winner_change,
+                           int loser, enum race loser_race,
+                           player_elo_t loser_change);
+
+/* Copies out every cell so far, for rolling the table back to this
+ * point.  Returns NULL on failure. */
+struct performance_checkpoint *performance_table_checkpoint(void *ctx,
+                                                            struct
+                                                            performance_table
+                                                            *pt);
+
+/* Puts the table back to how it was at the checkpoint, dropping any
+ * cells that have been added since. */
+void performance_table_rollback(struct performance_table *pt,
+                                const struct performance_checkpoint *cp);
+
+/* Returns a player's results on a map, either in total or only against
+ * one race, or NULL if they haven't played any such games. */
+const struct performance *performance_total(struct performance_table *pt,
+                                            int player, int map);
+const struct performance *performance_vs(struct performance_table *pt,
+                                         int player, int map,
+                                         enum race opponent);
+
+/* Walks through the total of every map a player has played on, or of
+ * every player that has played on a map, in no particular order.
+ * Stops early if the function returns non-zero, returning that. */
+int performance_each_map(struct performance_table *pt, int player,
+                         int (*func) (int map, const struct performance *,
+                                      void *), void *arg);
+int performance_each_player(struct performance_table *pt, int map,
+                            int (*func) (int player,
+                                         const struct performance *,
+                                         void *), void *arg);
+
+#endif
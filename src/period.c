@@ -0,0 +1,507 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "period.h"
+#include "calendar.h"
+
+#include <string.h>
+#include <talloc.h>
+
+/* The number of counters in a period's games table, one for every
+ * winner's race and loser's race on every map. */
+#define CELLS(pt) ((pt)->map_count * RACE_COUNT * RACE_COUNT)
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A closed period.  Its leaders, histogram and games live in the
+ * table's flat arrays, at this period's index times their stride. */
+struct period
+{
+    struct period_summary summary;
+    int key;
+    int leader_count;
+};
+
+struct period_table
+{
+    enum period_length length;
+    size_t player_count;
+    size_t map_count;
+
+    /* Every player's current rating, and one more than the index of
+     * the last period they played in (or 0 if they haven't). */
+    player_elo_t *elo;
+    size_t *last_period;
+    uint32_t rated_players;
+
+    /* The period that's still open, or -1 before the first game. */
+    int key;
+    struct period_summary current;
+    uint32_t *current_games;
+
+    /* Every closed period, oldest first. */
+    struct period *periods;
+    size_t count;
+    size_t alloc;
+    struct period_leader *leaders;
+    uint32_t *histograms;
+    uint32_t *games;
+};
+
+/* Closed periods never change, so only how many there were is kept,
+ * along with a copy of everything about the open one. */
+struct period_checkpoint
+{
+    player_elo_t *elo;
+    size_t *last_period;
+    uint32_t rated_players;
+    int key;
+    struct period_summary current;
+    uint32_t *current_games;
+    size_t count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Returns a number that's the same for every time in a period, and
+ * grows from one period to the next. */
+static int period_key(enum period_length length, game_time_t time);
+
+/* Snapshots the open period onto the end of the closed ones. */
+static int close_period(struct period_table *pt);
+
+/* Returns TRUE if player "a" ranks above player "b", with players
+ * that have exactly the same rating ordered by index. */
+static int ranks_above(const struct period_table *pt, int a, int b);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int period_length_parse(const char *str, enum period_length *length)
+{
+    if (strcmp(str, "month") == 0)
+    {
+        *length = PERIOD_MONTH;
+        return 0;
+    }
+    if (strcmp(str, "quarter") == 0)
+    {
+        *length = PERIOD_QUARTER;
+        return 0;
+    }
+    if (strcmp(str, "year") == 0)
+    {
+        *length = PERIOD_YEAR;
+        return 0;
+    }
+
+    return -1;
+}
+
+struct period_table *period_table_new(void *ctx, enum period_length length,
+                                      size_t player_count,
+                                      size_t map_count)
+{
+    struct period_table *pt;
+    size_t i;
+
+    pt = talloc_zero(ctx, struct period_table);
+    if (pt == NULL)
+        return NULL;
+
+    pt->length = length;
+    pt->player_count = player_count;
+    pt->map_count = map_count;
+    pt->key = -1;
+    pt->elo = talloc_array(pt, player_elo_t, player_count + 1);
+    pt->last_period = talloc_zero_array(pt, size_t, player_count + 1);
+    pt->current_games = talloc_zero_array(pt, uint32_t, CELLS(pt) + 1);
+    if (pt->elo == NULL || pt->last_period == NULL
+        || pt->current_games == NULL)
+    {
+        TALLOC_FREE(pt);
+        return NULL;
+    }
+
+    for (i = 0; i < player_count; i++)
+        pt->elo[i] = elo_default();
+
+    return pt;
+}
+
+int period_table_game(struct period_table *pt,
+                      const struct timeline_game *tg,
+                      player_elo_t winner_elo, enum race winner_race,
+                      player_elo_t loser_elo, enum race loser_race)
+{
+    uint32_t players[2];
+    int key;
+    int i;
+
+    if (tg->winner >= pt->player_count || tg->loser >= pt->player_count
+        || tg->map >= pt->map_count
+        || (unsigned)winner_race >= RACE_COUNT
+        || (unsigned)loser_race >= RACE_COUNT)
+        return -1;
+
+    /* Games come in order, so a new period means the open one is
+     * done. */
+    key = period_key(pt->length, tg->time);
+    if (key != pt->key)
+    {
+        if (pt->key != -1 && close_period(pt) != 0)
+            return -1;
+
+        pt->key = key;
+        memset(&pt->current, 0, sizeof(pt->current));
+        pt->current.start = tg->time;
+    }
+
+    pt->elo[tg->winner] = winner_elo;
+    pt->elo[tg->loser] = loser_elo;
+
+    players[0] = tg->winner;
+    players[1] = tg->loser;
+    for (i = 0; i < 2; i++)
+    {
+        if (pt->last_period[players[i]] == pt->count + 1)
+            continue;
+
+        if (pt->last_period[players[i]] == 0)
+            pt->rated_players++;
+        pt->last_period[players[i]] = pt->count + 1;
+        pt->current.active_players++;
+    }
+
+    pt->current.games++;
+    pt->current.rated_players = pt->rated_players;
+    pt->current_games[(tg->map * RACE_COUNT + winner_race) * RACE_COUNT
+                      + loser_race]++;
+    return 0;
+}
+
+struct period_checkpoint *period_table_checkpoint(void *ctx,
+                                                  struct period_table *pt)
+{
+    struct period_checkpoint *cp;
+
+    cp = talloc(ctx, struct period_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    cp->elo = talloc_memdup(cp, pt->elo,
+                            (pt->player_count + 1) * sizeof(*pt->elo));
+    cp->last_period = talloc_memdup(cp, pt->last_period,
+                                    (pt->player_count + 1)
+                                    * sizeof(*pt->last_period));
+    cp->current_games = talloc_memdup(cp, pt->current_games,
+                                      (CELLS(pt) + 1)
+                                      * sizeof(*pt->current_games));
+    if (cp->elo == NULL || cp->last_period == NULL
+        || cp->current_games == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    cp->rated_players = pt->rated_players;
+    cp->key = pt->key;
+    cp->current = pt->current;
+    cp->count = pt->count;
+    return cp;
+}
+
+void period_table_rollback(struct period_table *pt,
+                           const struct period_checkpoint *cp)
+{
+    memcpy(pt->elo, cp->elo, (pt->player_count + 1) * sizeof(*pt->elo));
+    memcpy(pt->last_period, cp->last_period,
+           (pt->player_count + 1) * sizeof(*pt->last_period));
+    memcpy(pt->current_games, cp->current_games,
+           (CELLS(pt) + 1) * sizeof(*pt->current_games));
+    pt->rated_players = cp->rated_players;
+    pt->key = cp->key;
+    pt->current = cp->current;
+    pt->count = cp->count;
+}
+
+struct period_table *period_table_freeze(void *ctx,
+                                         struct period_table *pt)
+{
+    struct period_table *copy;
+
+    copy = talloc(ctx, struct period_table);
+    if (copy == NULL)
+        return NULL;
+
+    *copy = *pt;
+    copy->elo = talloc_memdup(copy, pt->elo,
+                              (pt->player_count + 1) * sizeof(*pt->elo));
+    copy->last_period = talloc_memdup(copy, pt->last_period,
+                                      (pt->player_count + 1)
+                                      * sizeof(*pt->last_period));
+    copy->current_games = talloc_memdup(copy, pt->current_games,
+                                        (CELLS(pt) + 1)
+                                        * sizeof(*pt->current_games));
+    if (copy->elo == NULL || copy->last_period == NULL
+        || copy->current_games == NULL)
+        goto failure;
+
+    if (pt->alloc > 0)
+    {
+        copy->periods = talloc_memdup(copy, pt->periods,
+                                      pt->alloc * sizeof(*pt->periods));
+        copy->leaders = talloc_memdup(copy, pt->leaders,
+                                      pt->alloc * PERIOD_LEADERS
+                                      * sizeof(*pt->leaders));
+        copy->histograms = talloc_memdup(copy, pt->histograms,
+                                         pt->alloc * PERIOD_HISTOGRAM_BUCKETS
+                                         * sizeof(*pt->histograms));
+        copy->games = talloc_memdup(copy, pt->games,
+                                    (pt->alloc * CELLS(pt) + 1)
+                                    * sizeof(*pt->games));
+        if (copy->periods == NULL || copy->leaders == NULL
+            || copy->histograms == NULL || copy->games == NULL)
+            goto failure;
+    }
+
+    if (copy->key != -1 && close_period(copy) != 0)
+        goto failure;
+
+    /* Nothing else gets played, so only the snapshots are kept. */
+    copy->key = -1;
+    TALLOC_FREE(copy->elo);
+    TALLOC_FREE(copy->last_period);
+    TALLOC_FREE(copy->current_games);
+    return copy;
+
+  failure:
+    TALLOC_FREE(copy);
+    return NULL;
+}
+
+size_t period_table_count(struct period_table *pt)
+{
+    return pt->count;
+}
+
+int period_table_find(struct period_table *pt, game_time_t time)
+{
+    size_t lo, hi;
+    int key;
+
+    /* Finds the first period that's after the given time's. */
+    key = period_key(pt->length, time);
+    lo = 0;
+    hi = pt->count;
+    while (lo < hi)
+    {
+        size_t mid;
+
+        mid = lo + (hi - lo) / 2;
+        if (pt->periods[mid].key <= key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (int)lo - 1;
+}
+
+const struct period_summary *period_table_summary(struct period_table *pt,
+                                                  size_t period)
+{
+    return &pt->periods[period].summary;
+}
+
+int period_table_leaders(struct period_table *pt, size_t period,
+                         const struct period_leader **leaders)
+{
+    *leaders = pt->leaders + period * PERIOD_LEADERS;
+    return pt->periods[period].leader_count;
+}
+
+const uint32_t *period_table_histogram(struct period_table *pt,
+                                       size_t period)
+{
+    return pt->histograms + period * PERIOD_HISTOGRAM_BUCKETS;
+}
+
+uint32_t period_table_games(struct period_table *pt, size_t period,
+                            int map, int winner_race, int loser_race)
+{
+    const uint32_t *games;
+    uint32_t total;
+    size_t m;
+    int w, l;
+
+    if (map >= (int)pt->map_count || winner_race >= RACE_COUNT
+        || loser_race >= RACE_COUNT)
+        return 0;
+
+    games = pt->games + period * CELLS(pt);
+    total = 0;
+    for (m = 0; m < pt->map_count; m++)
+    {
+        if (map >= 0 && (int)m != map)
+            continue;
+
+        for (w = 0; w < RACE_COUNT; w++)
+        {
+            if (winner_race >= 0 && w != winner_race)
+                continue;
+
+            for (l = 0; l < RACE_COUNT; l++)
+                if (loser_race < 0 || l == loser_race)
+                    total += games[(m * RACE_COUNT + w) * RACE_COUNT + l];
+        }
+    }
+
+    return total;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int period_key(enum period_length length, game_time_t time)
+{
+    int month;
+
+    /* Months are counted from a January, so quarters and years just
+     * group them up. */
+    month = calendar_month(time);
+
+    switch (length)
+    {
+    case PERIOD_MONTH:
+        return month;
+    case PERIOD_QUARTER:
+        return month / 3;
+    case PERIOD_YEAR:
+        return month / 12;
+    }
+
+    return 0;
+}
+
+int close_period(struct period_table *pt)
+{
+    struct period *period;
+    struct period_leader *leaders;
+    uint32_t *histogram;
+    size_t i;
+
+    if (pt->count == pt->alloc)
+    {
+        struct period *periods;
+        struct period_leader *l;
+        uint32_t *h, *g;
+        size_t alloc;
+
+        alloc = (pt->alloc == 0) ? 16 : pt->alloc * 2;
+        periods = talloc_realloc(pt, pt->periods, struct period, alloc);
+        if (periods == NULL)
+            return -1;
+        pt->periods = periods;
+
+        l = talloc_realloc(pt, pt->leaders, struct period_leader,
+                           alloc * PERIOD_LEADERS);
+        if (l == NULL)
+            return -1;
+        pt->leaders = l;
+
+        h = talloc_realloc(pt, pt->histograms, uint32_t,
+                           alloc * PERIOD_HISTOGRAM_BUCKETS);
+        if (h == NULL)
+            return -1;
+        pt->histograms = h;
+
+        g = talloc_realloc(pt, pt->games, uint32_t, alloc * CELLS(pt) + 1);
+        if (g == NULL)
+            return -1;
+        pt->games = g;
+
+        pt->alloc = alloc;
+    }
+
+    period = pt->periods + pt->count;
+    leaders = pt->leaders + pt->count * PERIOD_LEADERS;
+    histogram = pt->histograms + pt->count * PERIOD_HISTOGRAM_BUCKETS;
+    period->summary = pt->current;
+    period->key = pt->key;
+    period->leader_count = 0;
+    memset(histogram, 0, PERIOD_HISTOGRAM_BUCKETS * sizeof(*histogram));
+
+    /* One pass over every rated player fills in the histogram, and
+     * keeps the leaders sorted by insertion. */
+    for (i = 0; i < pt->player_count; i++)
+    {
+        int bucket;
+        int n;
+
+        if (pt->last_period[i] == 0)
+            continue;
+
+        bucket = ((int)pt->elo[i] - PERIOD_HISTOGRAM_MIN)
+            / PERIOD_HISTOGRAM_WIDTH;
+        if ((int)pt->elo[i] < PERIOD_HISTOGRAM_MIN)
+            bucket = 0;
+        if (bucket >= PERIOD_HISTOGRAM_BUCKETS)
+            bucket = PERIOD_HISTOGRAM_BUCKETS - 1;
+        histogram[bucket]++;
+
+        n = period->leader_count;
+        if (n == PERIOD_LEADERS
+            && !ranks_above(pt, i, leaders[n - 1].player))
+            continue;
+        if (n < PERIOD_LEADERS)
+            period->leader_count++;
+        else
+            n--;
+
+        while (n > 0 && ranks_above(pt, i, leaders[n - 1].player))
+        {
+            leaders[n] = leaders[n - 1];
+            n--;
+        }
+        leaders[n].player = i;
+        leaders[n].elo = pt->elo[i];
+    }
+
+    memcpy(pt->games + pt->count * CELLS(pt), pt->current_games,
+           CELLS(pt) * sizeof(*pt->games));
+    memset(pt->current_games, 0, CELLS(pt) * sizeof(*pt->current_games));
+
+    pt->count++;
+    return 0;
+}
+
+int ranks_above(const struct period_table *pt, int a, int b)
+{
+    if (pt->elo[a] != pt->elo[b])
+        return pt->elo[a] > pt->elo[b];
+
+    return a < b;
+}
@@ -0,0 +1,149 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERIOD_H
+#define PERIOD_H
+
+/* Takes a snapshot of the ratings and the games at the end of every
+ * calendar period as the games are replayed, so questions about a
+ * past period can be answered without replaying anything.  Every
+ * snapshot is a handful of small arrays: the best players, how many
+ * players were rated in each range, and how many games each matchup
+ * had on each map. */
+struct period_table;
+
+/* The open period, and how many were closed, at some point. */
+struct period_checkpoint;
+
+#include "elo.h"
+#include "race.h"
+#include "timeline.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of players listed at the top of each snapshot. */
+#ifndef PERIOD_LEADERS
+#define PERIOD_LEADERS 100
+#endif
+
+/* The rating histogram's buckets, the first and last of which also
+ * count every rating below and above them. */
+#ifndef PERIOD_HISTOGRAM_MIN
+#define PERIOD_HISTOGRAM_MIN 1500
+#endif
+#ifndef PERIOD_HISTOGRAM_WIDTH
+#define PERIOD_HISTOGRAM_WIDTH 25
+#endif
+#ifndef PERIOD_HISTOGRAM_BUCKETS
+#define PERIOD_HISTOGRAM_BUCKETS 40
+#endif
+
+/* How long each period is.  Periods follow the calendar in KST. */
+enum period_length
+{
+    PERIOD_MONTH,
+    PERIOD_QUARTER,
+    PERIOD_YEAR,
+};
+
+/* One of the best players at the end of a period. */
+struct period_leader
+{
+    int player;
+    player_elo_t elo;
+};
+
+/* The totals for a single period. */
+struct period_summary
+{
+    /* The time of the period's first game. */
+    game_time_t start;
+
+    uint32_t games;
+
+    /* How many players played during the period, and how many had
+     * played by the end of it. */
+    uint32_t active_players;
+    uint32_t rated_players;
+};
+
+/* Parses a string into a period length, returning -1 on failure. */
+int period_length_parse(const char *str, enum period_length *length);
+
+/* Creates an empty table for the given number of players and maps. */
+struct period_table *period_table_new(void *ctx, enum period_length length,
+                                      size_t player_count,
+                                      size_t map_count);
+
+/* Counts a game, along with both players' ratings after it.  Games
+ * must not be older than the last one, and the first game of a new
+ * period closes off the snapshot of the one before.  Returns 0 on
+ * success. */
+int period_table_game(struct period_table *pt,
+                      const struct timeline_game *tg,
+                      player_elo_t winner_elo, enum race winner_race,
+                      player_elo_t loser_elo, enum race loser_race);
+
+/* Saves what's needed to go back to this point if any later game
+ * changes.  Returns NULL on failure. */
+struct period_checkpoint *period_table_checkpoint(void *ctx,
+                                                  struct period_table *pt);
+
+/* Reopens the period that was open at the checkpoint, dropping every
+ * snapshot taken since. */
+void period_table_rollback(struct period_table *pt,
+                           const struct period_checkpoint *cp);
+
+/* Copies out every snapshot, closing off the period that's still open
+ * as well.  The copy never changes, so it can be read by any number of
+ * threads at once. */
+struct period_table *period_table_freeze(void *ctx,
+                                         struct period_table *pt);
+
+/* Returns the number of closed periods. */
+size_t period_table_count(struct period_table *pt);
+
+/* Returns the period that was current at the given time, which is the
+ * last period with a game before the end of that time's period, or -1
+ * if there were no games by then. */
+int period_table_find(struct period_table *pt, game_time_t time);
+
+/* Returns a period's totals. */
+const struct period_summary *period_table_summary(struct period_table *pt,
+                                                  size_t period);
+
+/* Returns the best players at the end of a period, best first, and
+ * sets "leaders" to point at them. */
+int period_table_leaders(struct period_table *pt, size_t period,
+                         const struct period_leader **leaders);
+
+/* Returns the number of rated players in each rating range at the end
+ * of a period, PERIOD_HISTOGRAM_BUCKETS of them. */
+const uint32_t *period_table_histogram(struct period_table *pt,
+                                       size_t period);
+
+/* Returns how many games a matchup had on a map during a period.  A
+ * negative map or race counts every map or race. */
+uint32_t period_table_games(struct period_table *pt, size_t period,
+                            int map, int winner_race, int loser_race);
+
+#endif
@@ -20,41 +20,15 @@
  */
 
 #include "player.h"
-#include "game_list.h"
+#include "text.h"
+#include "global.h"
+#include "stats.h"
+#include "timeline.h"
 
 #include <ctype.h>
 #include <stdbool.h>
 #include <string.h>
 #include <talloc.h>
-#include <math.h>
-
-#ifndef PLAYER_DEFAULT_ELO
-#define PLAYER_DEFAULT_ELO 2000
-#endif
-
-#ifndef ELO_K1
-#define ELO_K1 30
-#endif
-
-#ifndef ELO_K2
-#define ELO_K2 15
-#endif
-
-#ifndef ELO_K3
-#define ELO_K3 10
-#endif
-
-#ifndef ELO_K1_GAMES
-#define ELO_K1_GAMES 30
-#endif
-
-#ifndef ELO_K2_GAMES
-#define ELO_K2_GAMES 100
-#endif
-
-#ifndef ELO_PEAK_GAMES
-#define ELO_PEAK_GAMES 10
-#endif
 
 #ifndef LINE_MAX
 #define LINE_MAX 1024
@@ -71,9 +45,6 @@ struct player
     /* The race this player plays most often. */
     enum race race;
 
-    /* A list of every game this player has played. */
-    struct game_list *games;
-
     /* Calculates a running Elo rating. */
     player_elo_t elo;
     player_elo_t peak_elo;
@@ -84,20 +55,14 @@ struct player
 
     /* The key that uniquely identifies this player */
     const char *key;
-};
-
-/***********************************************************************
- * Static Method Headers                                               *
- ***********************************************************************/
 
-/* Returns TRUE if the haystack starts with the needle. */
-static bool string_starts_with(const char *haystack, const char *needle);
+    /* This player's position in every per-player array. */
+    int index;
 
-/* Returts NULL if the haystack doesn't start with the needle.
- * Otherwise, removes the needle from the start of the hackstack and
- * strips any leading whitespace.  Note that no memory is allocated
- * here, it's just pointer arithmetic. */
-static const char *strip_front(const char *hs, const char *ne);
+    /* The bootstrapped confidence interval around the Elo rating. */
+    bool has_interval;
+    player_elo_t elo_low, elo_median, elo_high;
+};
 
 /***********************************************************************
  * Extern Methods                                                      *
@@ -109,29 +74,15 @@ struct player *player_read_file(void *c, const char *filename,
     FILE *pf;
     char buf[LINE_MAX];
 
-    p = talloc(c, struct player);
+    p = player_new(c, key);
     if (p == NULL)
         return NULL;
 
-    /* Sets everything to the default. */
-    p->id = NULL;
-    p->race = RACE_UNKNOWN;
-    p->games = game_list_new(p);
-    p->elo = PLAYER_DEFAULT_ELO;
-    p->peak_elo = 0;
-    p->wins = 0;
-    p->losses = 0;
-    p->key = NULL;
-
-    /* There should be a unique key, but apparently sometimes there's
-     * not. */
-    if (key != NULL)
-        p->key = talloc_reference(p, key);
-
     /* Reads the input file. */
     pf = fopen(filename, "r");
     if (pf == NULL)
         goto error;
+    stats_count(STATS_FILES_READ, 1);
 
     while (fgets(buf, LINE_MAX, pf) != NULL)
     {
@@ -143,9 +94,9 @@ struct player *player_read_file(void *c, const char *filename,
             buf[strlen(buf) - 1] = '\0';
 
         /* Attempt to parse! */
-        if ((b = strip_front(buf, "ID ")) != NULL)
+        if ((b = text_strip_front(buf, "ID ")) != NULL)
             p->id = talloc_strdup(p, b);
-        else if ((b = strip_front(buf, "RACE ")) != NULL)
+        else if ((b = text_strip_front(buf, "RACE ")) != NULL)
             p->race = race_parse(b);
     }
 
@@ -161,42 +112,85 @@ struct player *player_read_file(void *c, const char *filename,
     return NULL;
 }
 
-int player_win(struct player *winner, struct player *loser)
+struct player *player_new(void *c, const char *key)
 {
-    player_elo_t q_w, q_l;
-    player_elo_t e_w, e_l;
-    int k_w, k_l;
-    int g_w, g_l;
+    struct player *p;
 
-    q_w = pow(10.0, winner->elo / 400.0);
-    q_l = pow(10.0, loser->elo / 400.0);
+    p = talloc(c, struct player);
+    if (p == NULL)
+        return NULL;
 
-    e_w = q_w / (q_w + q_l);
-    e_l = q_l / (q_l + q_w);
+    /* Sets everything to the default. */
+    p->id = NULL;
+    p->race = RACE_UNKNOWN;
+    p->elo = elo_default();
+    p->peak_elo = 0;
+    p->wins = 0;
+    p->losses = 0;
+    p->key = NULL;
+    p->index = -1;
+    p->has_interval = false;
+    p->elo_low = p->elo_median = p->elo_high = 0;
 
-    g_w = winner->wins + winner->losses;
-    g_l = loser->wins + loser->losses;
+    /* There should be a unique key, but apparently sometimes there's
+     * not. */
+    if (key != NULL)
+        p->key = talloc_strdup(p, key);
+
+    return stats_track(p, STATS_MEMORY_PLAYERS);
+}
+
+void player_update(struct player *player, struct player *source)
+{
+    const char *old_id;
+
+    old_id = player->id;
+    player->id = talloc_strdup(player, source->id);
+    player->race = source->race;
+    talloc_free((char *)old_id);
+}
+
+int player_reset(struct player *player)
+{
+    player->elo = elo_default();
+    player->peak_elo = 0;
+    player->wins = 0;
+    player->losses = 0;
+
+    return 0;
+}
+
+void player_save_state(struct player *player, struct player_state *state)
+{
+    state->elo = player->elo;
+    state->peak_elo = player->peak_elo;
+    state->wins = player->wins;
+    state->losses = player->losses;
+}
 
-    k_w = ELO_K1;
-    if (g_w > ELO_K1_GAMES)
-        k_w = ELO_K2;
-    if (g_w > ELO_K2_GAMES)
-        k_w = ELO_K3;
+void player_restore_state(struct player *player,
+                          const struct player_state *state)
+{
+    player->elo = state->elo;
+    player->peak_elo = state->peak_elo;
+    player->wins = state->wins;
+    player->losses = state->losses;
+}
 
-    k_l = ELO_K1;
-    if (g_l > ELO_K1_GAMES)
-        k_l = ELO_K2;
-    if (g_l > ELO_K2_GAMES)
-        k_l = ELO_K3;
+int player_win(struct player *winner, struct player *loser)
+{
+    int g_w, g_l;
 
-    winner->elo += k_w * (1.0 - e_w);
-    loser->elo += k_l * (0.0 - e_l);
+    g_w = winner->wins + winner->losses;
+    g_l = loser->wins + loser->losses;
 
-    if (g_w > ELO_PEAK_GAMES)
+    elo_update(&winner->elo, &loser->elo, g_w, g_l);
+
+    if (elo_counts_for_peak(g_w))
         if (winner->elo > winner->peak_elo)
             winner->peak_elo = winner->elo;
 
-    if (g_l > ELO_PEAK_GAMES)
+    if (elo_counts_for_peak(g_l))
         if (loser->elo > loser->peak_elo)
             loser->peak_elo = loser->elo;
 
@@ -206,9 +200,10 @@ int player_win(struct player *winner, struct player *loser)
     return 0;
 }
 
-int player_play(struct player *player, struct game *game)
+player_elo_t player_expected_score(struct player *player,
+                                   struct player *opponent)
 {
-    return game_list_add(player->games, game);
+    return elo_expected(player->elo, opponent->elo);
 }
 
 player_elo_t player_elo(struct player * player)
@@ -236,6 +231,11 @@ int player_losses(struct player *player)
     return player->losses;
 }
 
+int player_games(struct player *player)
+{
+    return player->wins + player->losses;
+}
+
 double player_winrate(struct player *player)
 {
     return player->wins / (double)(player->wins + player->losses);
@@ -251,29 +251,51 @@ const char *player_key(struct player *player)
     return player->key;
 }
 
-int player_each_game(struct player *player,
-                     int (*iter) (struct game *, void *), void *data)
+int player_index(struct player *player)
 {
-    return game_list_each(player->games, iter, data);
+    return player->index;
 }
 
-/***********************************************************************
- * Static Methods                                                      *
- ***********************************************************************/
-bool string_starts_with(const char *haystack, const char *needle)
+void player_set_index(struct player *player, int index)
 {
-    return (strncmp(haystack, needle, strlen(needle)) == 0);
+    player->index = index;
 }
 
-const char *strip_front(const char *haystack, const char *needle)
+int player_has_elo_interval(struct player *player)
 {
-    if (!string_starts_with(haystack, needle))
-        return false;
+    return player->has_interval;
+}
 
-    haystack += strlen(needle);
+void player_set_elo_interval(struct player *player, player_elo_t low,
+                             player_elo_t median, player_elo_t high)
+{
+    player->has_interval = true;
+    player->elo_low = low;
+    player->elo_median = median;
+    player->elo_high = high;
+}
 
-    while (isspace(*haystack))
-        haystack++;
+player_elo_t player_elo_low(struct player *player)
+{
+    return player->elo_low;
+}
+
+player_elo_t player_elo_median(struct player *player)
+{
+    return player->elo_median;
+}
+
+player_elo_t player_elo_high(struct player *player)
+{
+    return player->elo_high;
+}
+
+int player_each_game(struct player *player,
+                     int (*iter) (struct game *, void *), void *data)
+{
+    if (global_timeline == NULL)
+        return 0;
 
-    return haystack;
+    return timeline_each_player_game(global_timeline, player->index, iter,
+                                     data);
 }
@@ -25,21 +25,50 @@
 /* Stores all the information known about a single player. */
 struct player;
 
+#include "elo.h"
 #include "race.h"
 #include "game.h"
 
-typedef double player_elo_t;
+/* Everything about a player that changes as their games are rated, so
+ * it can be put back to how it stood part way through the games. */
+struct player_state
+{
+    player_elo_t elo;
+    player_elo_t peak_elo;
+    int wins;
+    int losses;
+};
 
 /* Reads a player's information from a file, setting the remaining
  * information to the default values. */
 struct player *player_read_file(void *c, const char *filename,
                                 const char *key);
 
+/* Creates a player that has no file, with the default rating and
+ * nothing else known about them.  The key is copied. */
+struct player *player_new(void *c, const char *key);
+
+/* Copies everything that's read from a player's file from a freshly
+ * read copy of the same player, leaving their games alone. */
+void player_update(struct player *player, struct player *source);
+
+/* Forgets every game this player has played, putting their rating and
+ * record back to the defaults so the games can be replayed. */
+int player_reset(struct player *player);
+
+/* Copies out a player's rating and record, or puts back ones that were
+ * copied out earlier. */
+void player_save_state(struct player *player, struct player_state *state);
+void player_restore_state(struct player *player,
+                          const struct player_state *state);
+
 /* Records a win (and a loss for the other player) */
 int player_win(struct player *winner, struct player *loser);
 
-/* Adds a played game to the list of games this played has played */
-int player_play(struct player *player, struct game *game);
+/* Returns the expected score of a player against an opponent given
+ * their current ratings, which is the chance that the player wins. */
+player_elo_t player_expected_score(struct player *player,
+                                   struct player *opponent);
 
 /* Access some basic data about a player. */
 player_elo_t player_elo(struct player *player);
@@ -47,11 +76,29 @@ player_elo_t player_elo_peak(struct player *player);
 const char *player_id(struct player *player);
 int player_wins(struct player *player);
 int player_losses(struct player *player);
+int player_games(struct player *player);
 double player_winrate(struct player *player);
 enum race player_race(struct player *player);
 const char *player_key(struct player *player);
 
-/* Iterates through every game this player has played */
+/* Every player in the global list gets a small, dense integer index
+ * so per-player data can be stored in plain arrays.  This is -1 for
+ * players that haven't been indexed. */
+int player_index(struct player *player);
+void player_set_index(struct player *player, int index);
+
+/* Bootstrapped uncertainty about a player's Elo rating: the 5th, 50th
+ * and 95th percentiles over every replica.  Players that haven't been
+ * bootstrapped report FALSE from player_has_elo_interval(). */
+int player_has_elo_interval(struct player *player);
+void player_set_elo_interval(struct player *player, player_elo_t low,
+                             player_elo_t median, player_elo_t high);
+player_elo_t player_elo_low(struct player *player);
+player_elo_t player_elo_median(struct player *player);
+player_elo_t player_elo_high(struct player *player);
+
+/* Iterates through every game this player has played, as listed by
+ * the global timeline. */
 int player_each_game(struct player *player,
                      int (*iter) (struct game *, void *), void *data);
 
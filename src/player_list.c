@@ -22,6 +22,7 @@
 #define _BSD_SOURCE
 
 #include "player_list.h"
+#include "stats.h"
 
 #include <dirent.h>
 #include <talloc.h>
@@ -122,8 +123,9 @@ int player_list_add(struct player_list *pl, const char *key,
 
     /* Simply adds to the head of the list without any checking at all! */
     new->next = pl->head;
-    new->key = talloc_reference(new, key);
-    new->data = talloc_reference(new, player);
+    new->key = stats_reference(new, key);
+    new->data = stats_reference(new, player);
+    stats_track(new, STATS_MEMORY_NODES);
     pl->head = new;
     return 0;
 }
@@ -146,6 +148,7 @@ struct player *player_list_get(struct player_list *pl, const char *key)
 {
     struct player_list_node *cur;
 
+    stats_count(STATS_LOOKUPS, 1);
     cur = pl->head;
     while (cur != NULL)
     {
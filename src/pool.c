@@ -0,0 +1,408 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _BSD_SOURCE
+
+#include "pool.h"
+#include "league.h"
+#include "stats.h"
+#include "text.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+
+#ifndef LINE_MAX
+#define LINE_MAX 1024
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A list of league key patterns. */
+struct pool_patterns
+{
+    const char **patterns;
+    size_t count;
+};
+
+struct pool
+{
+    /* The key that uniquely identifies this pool, and its English
+     * name. */
+    const char *key;
+    const char *name;
+
+    struct pool_patterns include;
+    struct pool_patterns exclude;
+
+    /* The ratings within this pool, indexed by player index. */
+    player_elo_t *elo;
+    int *wins;
+    int *losses;
+};
+
+struct pool_set
+{
+    struct pool pools[POOL_MAX];
+    int count;
+
+    /* The mask of pools each league belongs to, indexed by league
+     * index. */
+    uint32_t *league_mask;
+    size_t league_count;
+
+    /* How long every pool's rating arrays are. */
+    size_t player_count;
+};
+
+/* A copy of every pool's ratings. */
+struct pool_checkpoint
+{
+    player_elo_t *elo[POOL_MAX];
+    int *wins[POOL_MAX];
+    int *losses[POOL_MAX];
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int pool_read_file(struct pool_set *ps, struct pool *pool,
+                          const char *filename, const char *key);
+static int patterns_add(struct pool_set *ps, struct pool_patterns *pp,
+                        const char *pattern);
+static bool patterns_match(struct pool_patterns *pp, const char *key);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct pool_set *pool_set_new(void *ctx, const char *indir)
+{
+    struct pool_set *ps;
+    /* Used by the call to scandir */
+    struct dirent **namelist;
+    int dir_entries;
+    int i;
+
+    ps = talloc_zero(ctx, struct pool_set);
+    if (ps == NULL)
+        return NULL;
+
+    /* Not having any pools is perfectly fine. */
+    dir_entries = scandir(indir, &namelist, NULL, NULL);
+    if (dir_entries < 0)
+        return ps;
+
+    for (i = 0; i < dir_entries; i++)
+    {
+        const char *key;
+
+        key = namelist[i]->d_name;
+
+        /* Skip hidden files, just like everywhere else. */
+        if (key[0] != '.')
+        {
+            const char *filename;
+
+            if (ps->count == POOL_MAX)
+            {
+                fprintf(stderr, "Too many pools, skipping '%s'\n", key);
+            }
+            else
+            {
+                filename = talloc_asprintf(ps, "%s/%s", indir, key);
+                if (pool_read_file(ps, ps->pools + ps->count, filename, key)
+                    == 0)
+                    ps->count++;
+                else
+                    fprintf(stderr, "Unable to read pool '%s'\n", key);
+            }
+        }
+
+        free(namelist[i]);
+    }
+    free(namelist);
+
+    return ps;
+}
+
+int pool_set_index(struct pool_set *ps, struct timeline *tl)
+{
+    size_t players;
+    size_t l;
+    int p;
+
+    players = timeline_player_count(tl);
+    ps->player_count = players;
+    ps->league_count = timeline_league_count(tl);
+    ps->league_mask = talloc_zero_array(ps, uint32_t, ps->league_count + 1);
+    if (ps->league_mask == NULL)
+        return -1;
+
+    for (l = 0; l < ps->league_count; l++)
+    {
+        const char *key;
+
+        key = league_key(timeline_league(tl, l));
+        if (key == NULL)
+            continue;
+
+        for (p = 0; p < ps->count; p++)
+        {
+            struct pool *pool;
+
+            pool = ps->pools + p;
+            if (pool->include.count > 0
+                && !patterns_match(&pool->include, key))
+                continue;
+            if (patterns_match(&pool->exclude, key))
+                continue;
+
+            ps->league_mask[l] |= (uint32_t)1 << p;
+        }
+    }
+
+    for (p = 0; p < ps->count; p++)
+    {
+        struct pool *pool;
+        size_t i;
+
+        pool = ps->pools + p;
+        pool->elo = talloc_array(ps, player_elo_t, players + 1);
+        pool->wins = talloc_zero_array(ps, int, players + 1);
+        pool->losses = talloc_zero_array(ps, int, players + 1);
+        if (pool->elo == NULL || pool->wins == NULL || pool->losses == NULL)
+            return -1;
+
+        for (i = 0; i < players; i++)
+            pool->elo[i] = elo_default();
+    }
+
+    return 0;
+}
+
+uint32_t pool_set_league_mask(struct pool_set *ps, int league)
+{
+    if (league < 0 || (size_t)league >= ps->league_count)
+        return 0;
+
+    return ps->league_mask[league];
+}
+
+void pool_set_win(struct pool_set *ps, uint32_t mask, int winner, int loser)
+{
+    while (mask != 0)
+    {
+        struct pool *pool;
+
+        pool = ps->pools + __builtin_ctz(mask);
+        mask &= mask - 1;
+
+        elo_update(&pool->elo[winner], &pool->elo[loser],
+                   pool->wins[winner] + pool->losses[winner],
+                   pool->wins[loser] + pool->losses[loser]);
+        pool->wins[winner]++;
+        pool->losses[loser]++;
+    }
+}
+
+struct pool_checkpoint *pool_set_checkpoint(void *ctx, struct pool_set *ps)
+{
+    struct pool_checkpoint *cp;
+    size_t n;
+    int p;
+
+    cp = talloc(ctx, struct pool_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    n = ps->player_count + 1;
+    for (p = 0; p < ps->count; p++)
+    {
+        struct pool *pool;
+
+        pool = ps->pools + p;
+        cp->elo[p] = talloc_memdup(cp, pool->elo, n * sizeof(*pool->elo));
+        cp->wins[p] = talloc_memdup(cp, pool->wins, n * sizeof(*pool->wins));
+        cp->losses[p] = talloc_memdup(cp, pool->losses,
+                                      n * sizeof(*pool->losses));
+        if (cp->elo[p] == NULL || cp->wins[p] == NULL
+            || cp->losses[p] == NULL)
+        {
+            TALLOC_FREE(cp);
+            return NULL;
+        }
+    }
+
+    return cp;
+}
+
+void pool_set_rollback(struct pool_set *ps, const struct pool_checkpoint *cp)
+{
+    size_t n;
+    int p;
+
+    n = ps->player_count + 1;
+    for (p = 0; p < ps->count; p++)
+    {
+        struct pool *pool;
+
+        pool = ps->pools + p;
+        memcpy(pool->elo, cp->elo[p], n * sizeof(*pool->elo));
+        memcpy(pool->wins, cp->wins[p], n * sizeof(*pool->wins));
+        memcpy(pool->losses, cp->losses[p], n * sizeof(*pool->losses));
+    }
+}
+
+int pool_set_count(struct pool_set *ps)
+{
+    return ps->count;
+}
+
+const char *pool_key(struct pool_set *ps, int pool)
+{
+    return ps->pools[pool].key;
+}
+
+const char *pool_name(struct pool_set *ps, int pool)
+{
+    if (ps->pools[pool].name == NULL)
+        return ps->pools[pool].key;
+
+    return ps->pools[pool].name;
+}
+
+player_elo_t pool_elo(struct pool_set *ps, int pool, int player)
+{
+    return ps->pools[pool].elo[player];
+}
+
+int pool_wins(struct pool_set *ps, int pool, int player)
+{
+    return ps->pools[pool].wins[player];
+}
+
+int pool_losses(struct pool_set *ps, int pool, int player)
+{
+    return ps->pools[pool].losses[player];
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int pool_read_file(struct pool_set *ps, struct pool *pool,
+                   const char *filename, const char *key)
+{
+    FILE *pf;
+    char buf[LINE_MAX];
+
+    /* Sets everything to the default. */
+    pool->key = talloc_strdup(ps, key);
+    pool->name = NULL;
+    pool->include.patterns = NULL;
+    pool->include.count = 0;
+    pool->exclude.patterns = NULL;
+    pool->exclude.count = 0;
+    pool->elo = NULL;
+    pool->wins = NULL;
+    pool->losses = NULL;
+
+    /* Reads the input file. */
+    pf = fopen(filename, "r");
+    if (pf == NULL)
+        return -1;
+    stats_count(STATS_FILES_READ, 1);
+
+    while (fgets(buf, LINE_MAX, pf) != NULL)
+    {
+        const char *b;
+
+        /* Remove any trailing whitespace, this will be at least every
+         * newline. */
+        while (strlen(buf) > 0 && isspace(buf[strlen(buf) - 1]))
+            buf[strlen(buf) - 1] = '\0';
+
+        /* Attempt to parse! */
+        if (buf[0] == '#')
+        {
+            /* Skip comments! */
+        }
+        else if ((b = text_strip_front(buf, "NAME ")) != NULL)
+            pool->name = talloc_strdup(ps, b);
+        else if ((b = text_strip_front(buf, "INCLUDE ")) != NULL)
+        {
+            if (patterns_add(ps, &pool->include, b) != 0)
+                goto error;
+        }
+        else if ((b = text_strip_front(buf, "EXCLUDE ")) != NULL)
+        {
+            if (patterns_add(ps, &pool->exclude, b) != 0)
+                goto error;
+        }
+        else if (strcmp(buf, "") == 0)
+        {
+        }
+        else
+            goto error;
+    }
+
+    fclose(pf);
+    return 0;
+
+  error:
+    fclose(pf);
+    return -1;
+}
+
+int patterns_add(struct pool_set *ps, struct pool_patterns *pp,
+                 const char *pattern)
+{
+    const char **patterns;
+
+    patterns = talloc_realloc(ps, pp->patterns, const char *, pp->count + 1);
+    if (patterns == NULL)
+        return -1;
+
+    pp->patterns = patterns;
+    pp->patterns[pp->count] = talloc_strdup(ps, pattern);
+    if (pp->patterns[pp->count] == NULL)
+        return -1;
+
+    pp->count++;
+    return 0;
+}
+
+bool patterns_match(struct pool_patterns *pp, const char *key)
+{
+    size_t i;
+
+    for (i = 0; i < pp->count; i++)
+        if (fnmatch(pp->patterns[i], key, 0) == 0)
+            return true;
+
+    return false;
+}
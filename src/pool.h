@@ -0,0 +1,81 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+/* A set of named rating pools, each of which rates players using only
+ * the games from some subset of the leagues.  Pools are read from a
+ * directory: the file name is the pool's key, and the file contains
+ * a NAME line along with any number of INCLUDE and EXCLUDE lines,
+ * each holding a shell wildcard that's matched against league keys.
+ * A league is in a pool if it matches any INCLUDE pattern (or there
+ * are none) and doesn't match any EXCLUDE pattern.
+ *
+ * Every pool is updated during the one main replay: each league gets
+ * a bitmask of the pools it belongs to, and each game updates exactly
+ * the pools set in its league's mask. */
+struct pool_set;
+
+/* Every pool's ratings as they stood at some point. */
+struct pool_checkpoint;
+
+#include "elo.h"
+#include "timeline.h"
+
+#include <stdint.h>
+
+/* The number of bits in a pool mask. */
+#define POOL_MAX 32
+
+/* Reads every pool in the given directory.  A missing directory just
+ * means there are no pools. */
+struct pool_set *pool_set_new(void *ctx, const char *indir);
+
+/* Works out which pools every league in the timeline belongs to, and
+ * sets up each pool's ratings.  This must be called before any games
+ * are recorded.  Returns 0 on success. */
+int pool_set_index(struct pool_set *ps, struct timeline *tl);
+
+/* Returns the mask of every pool the given league belongs to. */
+uint32_t pool_set_league_mask(struct pool_set *ps, int league);
+
+/* Records a win in every pool set in the given mask.  Players are
+ * given by their index. */
+void pool_set_win(struct pool_set *ps, uint32_t mask, int winner,
+                  int loser);
+
+/* Copies out every pool's ratings and records, so they can be put
+ * back later.  Returns NULL on failure. */
+struct pool_checkpoint *pool_set_checkpoint(void *ctx, struct pool_set *ps);
+
+/* Puts every pool back to how it was at the checkpoint. */
+void pool_set_rollback(struct pool_set *ps, const struct pool_checkpoint *cp);
+
+/* Access some basic data about the pools. */
+int pool_set_count(struct pool_set *ps);
+const char *pool_key(struct pool_set *ps, int pool);
+const char *pool_name(struct pool_set *ps, int pool);
+player_elo_t pool_elo(struct pool_set *ps, int pool, int player);
+int pool_wins(struct pool_set *ps, int pool, int player);
+int pool_losses(struct pool_set *ps, int pool, int player);
+
+#endif
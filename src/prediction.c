@@ -0,0 +1,214 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "prediction.h"
+
+#include <math.h>
+#include <talloc.h>
+
+#ifndef PREDICTION_CALIBRATION_BUCKETS
+#define PREDICTION_CALIBRATION_BUCKETS 10
+#endif
+
+/* Expected scores of exactly 0 or 1 would make the log-loss infinite,
+ * so they're clamped to this far from either end. */
+#ifndef PREDICTION_EPSILON
+#define PREDICTION_EPSILON 1e-12
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Running totals for some subset of the games. */
+struct prediction_totals
+{
+    long games;
+    double log_loss;
+    double brier;
+
+    /* Games where the winner was favored.  Games where neither player
+     * was favored count as half a correct prediction. */
+    double correct;
+};
+
+/* Compares the average predicted chance of winning against how often
+ * players actually won, for predictions in a single range. */
+struct prediction_bucket
+{
+    long count;
+    double predicted;
+    double observed;
+};
+
+struct prediction_stats
+{
+    struct prediction_totals overall;
+    struct prediction_totals phase[ELO_K_PHASES];
+
+    /* Matchups are unordered, so this is only filled in where the
+     * first race is no bigger than the second. */
+    struct prediction_totals matchup[RACE_COUNT][RACE_COUNT];
+
+    struct prediction_bucket calibration[PREDICTION_CALIBRATION_BUCKETS];
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static void totals_add(struct prediction_totals *t, player_elo_t expected);
+static void totals_print(struct prediction_totals *t, FILE * file,
+                         const char *label);
+static void calibrate(struct prediction_stats *ps, player_elo_t predicted,
+                      int won);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct prediction_stats *prediction_stats_new(void *ctx)
+{
+    return talloc_zero(ctx, struct prediction_stats);
+}
+
+struct prediction_stats *prediction_stats_checkpoint(void *ctx,
+                                                     struct prediction_stats
+                                                     *ps)
+{
+    return talloc_memdup(ctx, ps, sizeof(*ps));
+}
+
+void prediction_stats_rollback(struct prediction_stats *ps,
+                               const struct prediction_stats *cp)
+{
+    *ps = *cp;
+}
+
+void prediction_stats_add(struct prediction_stats *ps,
+                          player_elo_t expected, int phase,
+                          enum race winner_race, enum race loser_race)
+{
+    if (expected < PREDICTION_EPSILON)
+        expected = PREDICTION_EPSILON;
+    if (expected > 1.0 - PREDICTION_EPSILON)
+        expected = 1.0 - PREDICTION_EPSILON;
+
+    totals_add(&ps->overall, expected);
+    totals_add(&ps->phase[phase], expected);
+
+    if (winner_race <= loser_race)
+        totals_add(&ps->matchup[winner_race][loser_race], expected);
+    else
+        totals_add(&ps->matchup[loser_race][winner_race], expected);
+
+    /* Both sides of the game are predictions, so calibration looks at
+     * each of them. */
+    calibrate(ps, expected, 1);
+    calibrate(ps, 1.0 - expected, 0);
+}
+
+int prediction_stats_print(struct prediction_stats *ps, FILE * file)
+{
+    int i, j;
+
+    fprintf(file, "%-16s %8s %9s %9s %9s\n",
+            "Games", "Count", "Log-Loss", "Brier", "Accuracy");
+
+    totals_print(&ps->overall, file, "All");
+
+    for (i = 0; i < ELO_K_PHASES; i++)
+    {
+        char label[32];
+
+        sprintf(label, "K=%d", elo_phase_k_factor(i));
+        totals_print(&ps->phase[i], file, label);
+    }
+
+    for (i = 0; i < RACE_COUNT; i++)
+    {
+        for (j = i; j < RACE_COUNT; j++)
+        {
+            char label[32];
+
+            sprintf(label, "%.1sv%.1s", race_string(i), race_string(j));
+            totals_print(&ps->matchup[i][j], file, label);
+        }
+    }
+
+    fprintf(file, "\n%-16s %8s %9s %9s\n",
+            "Calibration", "Count", "Predicted", "Observed");
+
+    for (i = 0; i < PREDICTION_CALIBRATION_BUCKETS; i++)
+    {
+        struct prediction_bucket *b;
+        char label[32];
+
+        b = ps->calibration + i;
+        if (b->count == 0)
+            continue;
+
+        sprintf(label, "%3d%% - %3d%%",
+                i * 100 / PREDICTION_CALIBRATION_BUCKETS,
+                (i + 1) * 100 / PREDICTION_CALIBRATION_BUCKETS);
+        fprintf(file, "%-16s %8ld %8.2f%% %8.2f%%\n", label, b->count,
+                b->predicted / b->count * 100, b->observed / b->count * 100);
+    }
+
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void totals_add(struct prediction_totals *t, player_elo_t expected)
+{
+    t->games++;
+    t->log_loss -= log(expected);
+    t->brier += (1.0 - expected) * (1.0 - expected);
+
+    if (expected > 0.5)
+        t->correct += 1.0;
+    else if (expected == 0.5)
+        t->correct += 0.5;
+}
+
+void totals_print(struct prediction_totals *t, FILE * file,
+                  const char *label)
+{
+    if (t->games == 0)
+        return;
+
+    fprintf(file, "%-16s %8ld %9.4f %9.4f %8.2f%%\n", label, t->games,
+            t->log_loss / t->games, t->brier / t->games,
+            t->correct / t->games * 100);
+}
+
+void calibrate(struct prediction_stats *ps, player_elo_t predicted, int won)
+{
+    int i;
+
+    i = (int)(predicted * PREDICTION_CALIBRATION_BUCKETS);
+    if (i >= PREDICTION_CALIBRATION_BUCKETS)
+        i = PREDICTION_CALIBRATION_BUCKETS - 1;
+
+    ps->calibration[i].count++;
+    ps->calibration[i].predicted += predicted;
+    ps->calibration[i].observed += won;
+}
@@ -0,0 +1,60 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+/* Measures how well the ratings predict results by scoring the
+ * expected score of every game against its actual result, as the
+ * games are replayed.  Each game is scored using only the ratings
+ * from before it was played (prequential evaluation), so there's no
+ * need for a separate held-out set. */
+struct prediction_stats;
+
+#include "elo.h"
+#include "race.h"
+
+#include <stdio.h>
+
+/* Creates an empty set of accumulators. */
+struct prediction_stats *prediction_stats_new(void *ctx);
+
+/* Takes a copy of every total so far, which is all a checkpoint needs,
+ * and later puts them back.  Returns NULL on failure. */
+struct prediction_stats *prediction_stats_checkpoint(void *ctx,
+                                                     struct prediction_stats
+                                                     *ps);
+void prediction_stats_rollback(struct prediction_stats *ps,
+                               const struct prediction_stats *cp);
+
+/* Scores a single game.  "expected" is the winner's expected score
+ * before the game was played, "phase" is the K factor phase of the
+ * less experienced of the two players. */
+void prediction_stats_add(struct prediction_stats *ps,
+                          player_elo_t expected, int phase,
+                          enum race winner_race, enum race loser_race);
+
+/* Writes a human-readable quality report: log-loss, Brier score and
+ * accuracy, overall and broken down by K factor phase and by race
+ * matchup, followed by a calibration table. */
+int prediction_stats_print(struct prediction_stats *ps, FILE * file);
+
+#endif
@@ -0,0 +1,1093 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "query.h"
+#include "bitmap.h"
+#include "game_index.h"
+#include "key_index.h"
+#include "league.h"
+#include "map.h"
+#include "player.h"
+
+#include <ctype.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+
+#ifndef LINE_MAX
+#define LINE_MAX 1024
+#endif
+
+/* The most words in a single request. */
+#ifndef QUERY_MAX_ARGS
+#define QUERY_MAX_ARGS 12
+#endif
+
+/* The most rows a single TOP or GAMES request can return. */
+#ifndef QUERY_MAX_ROWS
+#define QUERY_MAX_ROWS 1000
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Everything a query can ask about a single player. */
+struct query_player
+{
+    const char *key;
+    player_elo_t elo;
+    player_elo_t peak;
+    int wins;
+    int losses;
+
+    /* The player's rank, or 0 for unranked players. */
+    int rank;
+
+    /* Where this player's rating history starts and ends. */
+    size_t history_start;
+    size_t history_end;
+};
+
+/* Nothing in here points back at the players or the timeline, so it
+ * never changes once it's been built. */
+struct query_db
+{
+    struct query_player *players;
+    size_t player_count;
+
+    /* Looks up players by key. */
+    struct key_index *index;
+
+    /* Every player that has played a game, best first. */
+    int *leaderboard;
+    size_t leaderboard_count;
+
+    /* Every player's rating history, one after the other. */
+    struct rating_history_entry *history;
+
+    /* Every game in timeline order, along with the keys of every map
+     * and league they were played in. */
+    struct game_index *games;
+    const char **map_keys;
+    struct key_index *map_index;
+    const char **league_keys;
+    struct key_index *league_index;
+    size_t league_count;
+
+    /* A frozen copy of every period's snapshot, or NULL if there
+     * weren't any. */
+    struct period_table *periods;
+};
+
+/* Counts up the wins of two players against each other. */
+struct h2h_state
+{
+    struct query_db *db;
+    int a;
+    int a_wins;
+    int b_wins;
+};
+
+/* Lists out games for a GAMES request. */
+struct games_state
+{
+    struct query_db *db;
+    char *out;
+    long limit;
+};
+
+/* Used to sort the leaderboard. */
+struct leaderboard_entry
+{
+    int player;
+    player_elo_t elo;
+    const char *key;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Splits a line into whitespace-separated words in place, returning
+ * the number of words found. */
+static int split_words(char *line, char **words, int max);
+
+/* Orders players by their rating, best first, and then by key so ties
+ * always come out the same way. */
+static int compare_leaderboard(const void *a, const void *b);
+
+/* Returns TRUE if two ratings print the same, which is when they share
+ * a rank. */
+static int same_rating(player_elo_t a, player_elo_t b);
+
+static char *answer_rating(void *ctx, struct query_db *db, int argc,
+                           char **argv);
+static char *answer_rating_at(void *ctx, struct query_db *db, int argc,
+                              char **argv);
+static char *answer_h2h(void *ctx, struct query_db *db, int argc,
+                        char **argv);
+static char *answer_top(void *ctx, struct query_db *db, int argc,
+                        char **argv);
+static char *answer_games(void *ctx, struct query_db *db, int argc,
+                          char **argv);
+static char *answer_count(void *ctx, struct query_db *db, int argc,
+                          char **argv);
+static char *answer_periods(void *ctx, struct query_db *db, int argc,
+                            char **argv);
+static char *answer_period_top(void *ctx, struct query_db *db, int argc,
+                               char **argv);
+static char *answer_period_ratings(void *ctx, struct query_db *db,
+                                   int argc, char **argv);
+
+/* Looks up the period that was current at a time given as a string,
+ * returning -1 and setting "error" if there's no such period. */
+static int lookup_period(void *ctx, struct query_db *db, const char *str,
+                         char **error);
+static int count_h2h(size_t row, void *state_uncast);
+static int list_game(uint32_t row, void *state_uncast);
+
+/* Picks out the games a GAMES or COUNT request's filters match.  The
+ * limit is only accepted if there's somewhere to put it.  Returns NULL
+ * with an error response filled in if a filter is bad. */
+static struct bitmap *select_games(void *ctx, struct query_db *db,
+                                   int argc, char **argv, long *limit,
+                                   char **error);
+
+/* Returns every game that matches any of a filter's comma-separated
+ * values. */
+static struct bitmap *select_values(void *ctx, struct query_db *db,
+                                    const char *name, char *values,
+                                    char **error);
+
+/* Parses a pair of races such as "TvZ". */
+static int parse_races(const char *str, enum race *races);
+
+/* Looks up a player by key, filling in an error response if they
+ * don't exist. */
+static int lookup_player(void *ctx, struct query_db *db, const char *key,
+                         char **error);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct query_db *query_db_new(void *ctx, struct timeline *tl,
+                              struct rating_history *rh,
+                              struct period_table *pt)
+{
+    struct query_db *db;
+    size_t history_count;
+    size_t count;
+    size_t i;
+
+    db = talloc(ctx, struct query_db);
+    if (db == NULL)
+        return NULL;
+
+    count = timeline_player_count(tl);
+    history_count = 0;
+    for (i = 0; i < count; i++)
+        history_count += rating_history_count(rh, i);
+
+    db->player_count = count;
+    db->players = talloc_array(db, struct query_player, count + 1);
+    db->index = key_index_new(db, count);
+    db->leaderboard = talloc_array(db, int, count + 1);
+    db->history = talloc_array(db, struct rating_history_entry,
+                               history_count + 1);
+    db->games = game_index_new(db, tl);
+    db->map_keys = talloc_array(db, const char *,
+                                timeline_map_count(tl) + 1);
+    db->map_index = key_index_new(db, timeline_map_count(tl));
+    db->league_keys = talloc_array(db, const char *,
+                                   timeline_league_count(tl) + 1);
+    db->league_index = key_index_new(db, timeline_league_count(tl));
+    db->league_count = timeline_league_count(tl);
+    db->periods = NULL;
+    if (pt != NULL)
+        db->periods = period_table_freeze(db, pt);
+    if (db->players == NULL || db->index == NULL || db->leaderboard == NULL
+        || db->history == NULL || db->games == NULL
+        || db->map_keys == NULL || db->map_index == NULL
+        || db->league_keys == NULL || db->league_index == NULL
+        || (pt != NULL && db->periods == NULL))
+        goto failure;
+
+    /* Copies out everything about every player. */
+    history_count = 0;
+    db->leaderboard_count = 0;
+    for (i = 0; i < count; i++)
+    {
+        struct player *player;
+        struct query_player *qp;
+
+        player = timeline_player(tl, i);
+        qp = db->players + i;
+        qp->key = talloc_strdup(db->players, player_key(player));
+        qp->elo = player_elo(player);
+        qp->peak = player_elo_peak(player);
+        qp->wins = player_wins(player);
+        qp->losses = player_losses(player);
+        qp->rank = 0;
+        if (qp->key == NULL || key_index_add(db->index, qp->key, i) != 0)
+            goto failure;
+
+        qp->history_start = history_count;
+        memcpy(db->history + history_count, rating_history_entries(rh, i),
+               rating_history_count(rh, i) * sizeof(*db->history));
+        history_count += rating_history_count(rh, i);
+        qp->history_end = history_count;
+
+        if (player_games(player) > 0)
+            db->leaderboard[db->leaderboard_count++] = i;
+    }
+
+    for (i = 0; i < timeline_map_count(tl); i++)
+    {
+        db->map_keys[i] = talloc_strdup(db->map_keys,
+                                        map_key(timeline_map(tl, i)));
+        if (db->map_keys[i] == NULL
+            || key_index_add(db->map_index, db->map_keys[i], i) != 0)
+            goto failure;
+    }
+
+    for (i = 0; i < timeline_league_count(tl); i++)
+    {
+        db->league_keys[i] =
+            talloc_strdup(db->league_keys, league_key(timeline_league(tl, i)));
+        if (db->league_keys[i] == NULL
+            || key_index_add(db->league_index, db->league_keys[i], i) != 0)
+            goto failure;
+    }
+
+    /* Sorting happens once here, so TOP is just a slice.  Players
+     * with the same printed rating share a rank. */
+    {
+        struct leaderboard_entry *sorted;
+
+        sorted = talloc_array(db, struct leaderboard_entry,
+                              db->leaderboard_count + 1);
+        if (sorted == NULL)
+            goto failure;
+
+        for (i = 0; i < db->leaderboard_count; i++)
+        {
+            sorted[i].player = db->leaderboard[i];
+            sorted[i].elo = db->players[db->leaderboard[i]].elo;
+            sorted[i].key = db->players[db->leaderboard[i]].key;
+        }
+
+        qsort(sorted, db->leaderboard_count, sizeof(*sorted),
+              &compare_leaderboard);
+
+        for (i = 0; i < db->leaderboard_count; i++)
+        {
+            struct query_player *qp;
+
+            qp = db->players + sorted[i].player;
+            db->leaderboard[i] = sorted[i].player;
+            if (i > 0 && same_rating(sorted[i - 1].elo, sorted[i].elo))
+                qp->rank = db->players[sorted[i - 1].player].rank;
+            else
+                qp->rank = i + 1;
+        }
+
+        TALLOC_FREE(sorted);
+    }
+
+    return db;
+
+  failure:
+    TALLOC_FREE(db);
+    return NULL;
+}
+
+char *query_answer(void *ctx, struct query_db *db, const char *request)
+{
+    char buf[LINE_MAX];
+    char *argv[QUERY_MAX_ARGS];
+    int argc;
+
+    if (strlen(request) >= LINE_MAX)
+        return talloc_strdup(ctx, "ERR request too long\n");
+
+    strcpy(buf, request);
+    argc = split_words(buf, argv, QUERY_MAX_ARGS);
+    if (argc == 0)
+        return talloc_strdup(ctx, "ERR empty request\n");
+
+    if (strcmp(argv[0], "RATING") == 0)
+        return answer_rating(ctx, db, argc, argv);
+    if (strcmp(argv[0], "RATING_AT") == 0)
+        return answer_rating_at(ctx, db, argc, argv);
+    if (strcmp(argv[0], "H2H") == 0)
+        return answer_h2h(ctx, db, argc, argv);
+    if (strcmp(argv[0], "TOP") == 0)
+        return answer_top(ctx, db, argc, argv);
+    if (strcmp(argv[0], "GAMES") == 0)
+        return answer_games(ctx, db, argc, argv);
+    if (strcmp(argv[0], "COUNT") == 0)
+        return answer_count(ctx, db, argc, argv);
+    if (strcmp(argv[0], "PERIODS") == 0)
+        return answer_periods(ctx, db, argc, argv);
+    if (strcmp(argv[0], "PERIOD_TOP") == 0)
+        return answer_period_top(ctx, db, argc, argv);
+    if (strcmp(argv[0], "PERIOD_RATINGS") == 0)
+        return answer_period_ratings(ctx, db, argc, argv);
+
+    return talloc_asprintf(ctx, "ERR unknown request '%s'\n", argv[0]);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int split_words(char *line, char **words, int max)
+{
+    int count;
+
+    count = 0;
+    while (*line != '\0')
+    {
+        while (isspace(*line))
+            *line++ = '\0';
+
+        if (*line == '\0')
+            break;
+
+        if (count == max)
+            return max + 1;
+
+        words[count++] = line;
+        while (*line != '\0' && !isspace(*line))
+            line++;
+    }
+
+    return count;
+}
+
+int compare_leaderboard(const void *a_uncast, const void *b_uncast)
+{
+    const struct leaderboard_entry *a, *b;
+
+    a = a_uncast;
+    b = b_uncast;
+
+    if (a->elo != b->elo)
+        return (a->elo < b->elo) ? 1 : -1;
+
+    return strcmp(a->key, b->key);
+}
+
+int same_rating(player_elo_t a, player_elo_t b)
+{
+    char a_str[DBL_MAX_10_EXP + 8];
+    char b_str[DBL_MAX_10_EXP + 8];
+
+    sprintf(a_str, "%.2f", a);
+    sprintf(b_str, "%.2f", b);
+    return strcmp(a_str, b_str) == 0;
+}
+
+char *answer_rating(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    struct query_player *qp;
+    char *error;
+    int p;
+
+    if (argc != 2)
+        return talloc_strdup(ctx, "ERR usage: RATING <player>\n");
+
+    if ((p = lookup_player(ctx, db, argv[1], &error)) < 0)
+        return error;
+
+    qp = db->players + p;
+    return talloc_asprintf(ctx, "OK %s %.2f %.2f %d %d %d\n", argv[1],
+                           qp->elo, qp->peak, qp->wins, qp->losses,
+                           qp->rank);
+}
+
+char *answer_rating_at(void *ctx, struct query_db *db, int argc,
+                       char **argv)
+{
+    struct query_player *qp;
+    game_time_t time;
+    player_elo_t elo;
+    size_t games;
+    char *error;
+    char *end;
+    int p;
+
+    if (argc != 3)
+        return talloc_strdup(ctx, "ERR usage: RATING_AT <player> <time>\n");
+
+    if ((p = lookup_player(ctx, db, argv[1], &error)) < 0)
+        return error;
+
+    time = strtol(argv[2], &end, 10);
+    if (*end != '\0')
+        return talloc_asprintf(ctx, "ERR bad time '%s'\n", argv[2]);
+
+    qp = db->players + p;
+    games = rating_history_search(db->history + qp->history_start,
+                                  qp->history_end - qp->history_start, time);
+    if (games == 0)
+        elo = elo_default();
+    else
+        elo = db->history[qp->history_start + games - 1].elo;
+
+    return talloc_asprintf(ctx, "OK %s %ld %.2f %lu\n", argv[1],
+                           (long)time, elo, (unsigned long)games);
+}
+
+char *answer_h2h(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    struct game_filter filter;
+    struct h2h_state state;
+    char *error;
+    int b;
+
+    if (argc != 3)
+        return talloc_strdup(ctx, "ERR usage: H2H <player> <player>\n");
+
+    if ((state.a = lookup_player(ctx, db, argv[1], &error)) < 0)
+        return error;
+    if ((b = lookup_player(ctx, db, argv[2], &error)) < 0)
+        return error;
+
+    /* Only the games both players were in get looked at. */
+    game_filter_init(&filter);
+    filter.player = state.a;
+    filter.opponent = b;
+
+    state.db = db;
+    state.a_wins = state.b_wins = 0;
+    if (state.a != b)
+        game_index_filter(db->games, &filter, &count_h2h, &state);
+
+    return talloc_asprintf(ctx, "OK %s %s %d %d\n", argv[1], argv[2],
+                           state.a_wins, state.b_wins);
+}
+
+char *answer_top(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    long offset, count;
+    char *out;
+    char *end;
+    long i;
+
+    if (argc != 3)
+        return talloc_strdup(ctx, "ERR usage: TOP <offset> <count>\n");
+
+    offset = strtol(argv[1], &end, 10);
+    if (*end != '\0' || offset < 0)
+        return talloc_asprintf(ctx, "ERR bad offset '%s'\n", argv[1]);
+
+    count = strtol(argv[2], &end, 10);
+    if (*end != '\0' || count < 0)
+        return talloc_asprintf(ctx, "ERR bad count '%s'\n", argv[2]);
+
+    if (count > QUERY_MAX_ROWS)
+        count = QUERY_MAX_ROWS;
+    if ((size_t)offset > db->leaderboard_count)
+        offset = db->leaderboard_count;
+    if ((size_t)(offset + count) > db->leaderboard_count)
+        count = db->leaderboard_count - offset;
+
+    out = talloc_asprintf(ctx, "OK %ld\n", count);
+    for (i = offset; out != NULL && i < offset + count; i++)
+    {
+        struct query_player *qp;
+
+        qp = db->players + db->leaderboard[i];
+        out = talloc_asprintf_append(out, "%d %s %.2f\n", qp->rank,
+                                     qp->key, qp->elo);
+    }
+
+    return out;
+}
+
+int lookup_player(void *ctx, struct query_db *db, const char *key,
+                  char **error)
+{
+    int p;
+
+    p = key_index_get(db->index, key);
+    if (p < 0)
+        *error = talloc_asprintf(ctx, "ERR unknown player '%s'\n", key);
+
+    return p;
+}
+
+char *answer_games(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    struct games_state state;
+    struct bitmap *rows;
+    size_t matched;
+    char *error;
+
+    state.db = db;
+    state.limit = QUERY_MAX_ROWS;
+    rows = select_games(ctx, db, argc, argv, &state.limit, &error);
+    if (rows == NULL)
+        return error;
+
+    /* The games are listed first, as how many there are is only known
+     * at the end. */
+    state.out = talloc_strdup(ctx, "");
+    matched = 0;
+    if (state.limit > 0)
+    {
+        matched = bitmap_cardinality(rows);
+        if (matched > (size_t)state.limit)
+            matched = state.limit;
+        bitmap_each(rows, &list_game, &state);
+    }
+    TALLOC_FREE(rows);
+    if (state.out == NULL)
+        return NULL;
+
+    return talloc_asprintf(ctx, "OK %lu\n%s", (unsigned long)matched,
+                           state.out);
+}
+
+char *answer_count(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    struct bitmap *rows;
+    uint64_t count;
+    char *error;
+
+    rows = select_games(ctx, db, argc, argv, NULL, &error);
+    if (rows == NULL)
+        return error;
+
+    count = bitmap_cardinality(rows);
+    TALLOC_FREE(rows);
+    return talloc_asprintf(ctx, "OK %llu\n", (unsigned long long)count);
+}
+
+char *answer_periods(void *ctx, struct query_db *db, int argc, char **argv)
+{
+    enum race races[2];
+    int winner, loser;
+    int either;
+    int map;
+    size_t count;
+    size_t p;
+    char *out;
+    int i;
+
+    if (db->periods == NULL)
+        return talloc_strdup(ctx, "ERR no periods\n");
+
+    map = winner = loser = -1;
+    either = 0;
+    for (i = 1; i < argc; i++)
+    {
+        char *value;
+
+        value = strchr(argv[i], '=');
+        if (value == NULL)
+            return talloc_asprintf(ctx, "ERR bad filter '%s'\n", argv[i]);
+        *value++ = '\0';
+
+        if (strcmp(argv[i], "map") == 0)
+        {
+            map = key_index_get(db->map_index, value);
+            if (map < 0)
+                return talloc_asprintf(ctx, "ERR unknown map '%s'\n", value);
+        }
+        else if (strcmp(argv[i], "matchup") == 0
+                 || strcmp(argv[i], "won") == 0)
+        {
+            if (parse_races(value, races) != 0)
+                return talloc_asprintf(ctx, "ERR bad %s '%s'\n", argv[i],
+                                       value);
+            winner = races[0];
+            loser = races[1];
+            either = (strcmp(argv[i], "matchup") == 0);
+        }
+        else
+            return talloc_asprintf(ctx, "ERR unknown filter '%s'\n",
+                                   argv[i]);
+    }
+
+    /* Every period's games are already counted by map and matchup, so
+     * this is only a few sums each. */
+    count = period_table_count(db->periods);
+    out = talloc_asprintf(ctx, "OK %lu\n", (unsigned long)count);
+    for (p = 0; out != NULL && p < count; p++)
+    {
+        const struct period_summary *ps;
+        uint32_t games;
+
+        ps = period_table_summary(db->periods, p);
+        games = period_table_games(db->periods, p, map, winner, loser);
+        if (either && winner != loser)
+            games += period_table_games(db->periods, p, map, loser, winner);
+
+        out = talloc_asprintf_append(out, "%ld %u %u %u\n",
+                                     (long)ps->start, (unsigned)games,
+                                     (unsigned)ps->active_players,
+                                     (unsigned)ps->rated_players);
+    }
+
+    return out;
+}
+
+char *answer_period_top(void *ctx, struct query_db *db, int argc,
+                        char **argv)
+{
+    const struct period_leader *leaders;
+    struct leaderboard_entry *sorted;
+    long count;
+    char *error;
+    char *out;
+    char *end;
+    int period;
+    int rank;
+    long i;
+
+    if (argc != 3)
+        return talloc_strdup(ctx, "ERR usage: PERIOD_TOP <time> <count>\n");
+
+    if ((period = lookup_period(ctx, db, argv[1], &error)) < 0)
+        return error;
+
+    count = strtol(argv[2], &end, 10);
+    if (*end != '\0' || count < 0)
+        return talloc_asprintf(ctx, "ERR bad count '%s'\n", argv[2]);
+
+    /* Ranks work just like TOP, only out of the snapshot.  That's
+     * already sorted by rating, but breaks ties by index. */
+    i = period_table_leaders(db->periods, period, &leaders);
+    if (count > i)
+        count = i;
+
+    sorted = talloc_array(ctx, struct leaderboard_entry, count + 1);
+    if (sorted == NULL)
+        return NULL;
+
+    for (i = 0; i < count; i++)
+    {
+        sorted[i].player = leaders[i].player;
+        sorted[i].elo = leaders[i].elo;
+        sorted[i].key = db->players[leaders[i].player].key;
+    }
+    qsort(sorted, count, sizeof(*sorted), &compare_leaderboard);
+
+    rank = 0;
+    out = talloc_asprintf(ctx, "OK %ld\n", count);
+    for (i = 0; out != NULL && i < count; i++)
+    {
+        if (i == 0 || !same_rating(sorted[i - 1].elo, sorted[i].elo))
+            rank = i + 1;
+
+        out = talloc_asprintf_append(out, "%d %s %.2f\n", rank,
+                                     sorted[i].key, sorted[i].elo);
+    }
+
+    TALLOC_FREE(sorted);
+    return out;
+}
+
+char *answer_period_ratings(void *ctx, struct query_db *db, int argc,
+                            char **argv)
+{
+    const uint32_t *histogram;
+    char *error;
+    char *out;
+    int period;
+    int i;
+
+    if (argc != 2)
+        return talloc_strdup(ctx, "ERR usage: PERIOD_RATINGS <time>\n");
+
+    if ((period = lookup_period(ctx, db, argv[1], &error)) < 0)
+        return error;
+
+    histogram = period_table_histogram(db->periods, period);
+    out = talloc_asprintf(ctx, "OK %d\n", PERIOD_HISTOGRAM_BUCKETS);
+    for (i = 0; out != NULL && i < PERIOD_HISTOGRAM_BUCKETS; i++)
+        out = talloc_asprintf_append(out, "%d %u\n",
+                                     PERIOD_HISTOGRAM_MIN
+                                     + i * PERIOD_HISTOGRAM_WIDTH,
+                                     (unsigned)histogram[i]);
+
+    return out;
+}
+
+int lookup_period(void *ctx, struct query_db *db, const char *str,
+                  char **error)
+{
+    game_time_t time;
+    char *end;
+    int period;
+
+    if (db->periods == NULL)
+    {
+        *error = talloc_strdup(ctx, "ERR no periods\n");
+        return -1;
+    }
+
+    time = strtol(str, &end, 10);
+    if (*end != '\0')
+    {
+        *error = talloc_asprintf(ctx, "ERR bad time '%s'\n", str);
+        return -1;
+    }
+
+    period = period_table_find(db->periods, time);
+    if (period < 0)
+        *error = talloc_asprintf(ctx, "ERR no games by %ld\n", (long)time);
+
+    return period;
+}
+
+struct bitmap *select_games(void *ctx, struct query_db *db, int argc,
+                            char **argv, long *limit, char **error)
+{
+    struct bitmap *rows, *excluded, *range;
+    const char *player, *opponent;
+    game_time_t from, to;
+    int i;
+
+    rows = excluded = NULL;
+    player = opponent = NULL;
+    from = to = -1;
+
+    /* Every filter is a "name=value" pair, and they can come in any
+     * order.  Games have to match every filter, and any one of the
+     * values in each, or none of them if it starts with a '!'. */
+    for (i = 1; i < argc; i++)
+    {
+        struct bitmap *set, **into;
+        char *value;
+        char *end;
+
+        value = strchr(argv[i], '=');
+        if (value == NULL)
+        {
+            *error = talloc_asprintf(ctx, "ERR bad filter '%s'\n", argv[i]);
+            goto failure;
+        }
+        *value++ = '\0';
+
+        if (strcmp(argv[i], "from") == 0 || strcmp(argv[i], "to") == 0)
+        {
+            game_time_t time;
+
+            time = strtol(value, &end, 10);
+            if (*end != '\0' || time < 0)
+            {
+                *error = talloc_asprintf(ctx, "ERR bad time '%s'\n", value);
+                goto failure;
+            }
+
+            if (argv[i][0] == 'f')
+                from = time;
+            else
+                to = time;
+            continue;
+        }
+
+        if (strcmp(argv[i], "limit") == 0 && limit != NULL)
+        {
+            *limit = strtol(value, &end, 10);
+            if (*end != '\0' || *limit < 0)
+            {
+                *error = talloc_asprintf(ctx, "ERR bad limit '%s'\n", value);
+                goto failure;
+            }
+            if (*limit > QUERY_MAX_ROWS)
+                *limit = QUERY_MAX_ROWS;
+            continue;
+        }
+
+        if (strcmp(argv[i], "player") == 0)
+            player = value;
+        else if (strcmp(argv[i], "vs") == 0)
+            opponent = value;
+
+        into = &rows;
+        if (value[0] == '!')
+        {
+            into = &excluded;
+            value++;
+        }
+
+        set = select_values(ctx, db, argv[i], value, error);
+        if (set == NULL)
+            goto failure;
+
+        if (*into == NULL)
+            *into = set;
+        else
+        {
+            struct bitmap *combined;
+
+            combined = (into == &rows) ? bitmap_and(ctx, *into, set)
+                : bitmap_or(ctx, *into, set);
+            TALLOC_FREE(*into);
+            TALLOC_FREE(set);
+            if ((*into = combined) == NULL)
+                goto no_memory;
+        }
+    }
+
+    if (opponent != NULL && player == NULL)
+    {
+        *error = talloc_strdup(ctx, "ERR vs needs a player\n");
+        goto failure;
+    }
+
+    /* Nobody plays themselves. */
+    if (opponent != NULL && strcmp(player, opponent) == 0)
+    {
+        TALLOC_FREE(rows);
+        rows = bitmap_new(ctx);
+        if (rows == NULL)
+            goto no_memory;
+    }
+
+    if (rows == NULL || from >= 0 || to >= 0)
+    {
+        range = game_index_range(db->games, ctx, from, to);
+        if (range == NULL)
+            goto no_memory;
+
+        if (rows == NULL)
+            rows = range;
+        else
+        {
+            struct bitmap *combined;
+
+            combined = bitmap_and(ctx, rows, range);
+            TALLOC_FREE(rows);
+            TALLOC_FREE(range);
+            if ((rows = combined) == NULL)
+                goto no_memory;
+        }
+    }
+
+    if (excluded != NULL)
+    {
+        struct bitmap *combined;
+
+        combined = bitmap_andnot(ctx, rows, excluded);
+        TALLOC_FREE(rows);
+        TALLOC_FREE(excluded);
+        if ((rows = combined) == NULL)
+            goto no_memory;
+    }
+
+    return rows;
+
+  no_memory:
+    *error = NULL;
+  failure:
+    TALLOC_FREE(rows);
+    TALLOC_FREE(excluded);
+    return NULL;
+}
+
+struct bitmap *select_values(void *ctx, struct query_db *db,
+                             const char *name, char *values, char **error)
+{
+    struct bitmap *rows;
+    char *value;
+    char *next;
+
+    rows = bitmap_new(ctx);
+    if (rows == NULL)
+    {
+        *error = NULL;
+        return NULL;
+    }
+
+    for (value = values; value != NULL; value = next)
+    {
+        const struct bitmap *set;
+        struct bitmap *combined;
+        enum race races[2];
+        size_t length;
+        size_t l;
+
+        next = strchr(value, ',');
+        if (next != NULL)
+            *next++ = '\0';
+
+        set = NULL;
+        if (strcmp(name, "player") == 0 || strcmp(name, "vs") == 0)
+        {
+            int p;
+
+            if ((p = lookup_player(ctx, db, value, error)) < 0)
+                goto failure;
+            set = game_index_set(db->games, GAME_SET_PLAYER, p);
+        }
+        else if (strcmp(name, "map") == 0)
+        {
+            set = game_index_set(db->games, GAME_SET_MAP,
+                                 key_index_get(db->map_index, value));
+            if (set == NULL)
+            {
+                *error = talloc_asprintf(ctx, "ERR unknown map '%s'\n",
+                                         value);
+                goto failure;
+            }
+        }
+        else if (strcmp(name, "league") == 0)
+        {
+            length = strlen(value);
+            if (length == 0 || value[length - 1] != '*')
+            {
+                set = game_index_set(db->games, GAME_SET_LEAGUE,
+                                     key_index_get(db->league_index, value));
+                if (set == NULL)
+                {
+                    *error = talloc_asprintf(ctx,
+                                             "ERR unknown league '%s'\n",
+                                             value);
+                    goto failure;
+                }
+            }
+
+            /* A trailing '*' matches every league with that prefix. */
+            for (l = 0; set == NULL && l < db->league_count; l++)
+            {
+                if (strncmp(db->league_keys[l], value, length - 1) != 0)
+                    continue;
+
+                combined = bitmap_or(ctx, rows,
+                                     game_index_set(db->games,
+                                                    GAME_SET_LEAGUE, l));
+                TALLOC_FREE(rows);
+                if ((rows = combined) == NULL)
+                    goto no_memory;
+            }
+        }
+        else if (strcmp(name, "matchup") == 0 || strcmp(name, "won") == 0)
+        {
+            if (parse_races(value, races) != 0)
+            {
+                *error = talloc_asprintf(ctx, "ERR bad %s '%s'\n", name,
+                                         value);
+                goto failure;
+            }
+
+            if (name[0] == 'm')
+                set = game_index_set(db->games, GAME_SET_MATCHUP,
+                                     game_index_matchup(races[0],
+                                                        races[1]));
+            else
+                set = game_index_set(db->games, GAME_SET_WON,
+                                     game_index_won(races[0], races[1]));
+        }
+        else
+        {
+            *error = talloc_asprintf(ctx, "ERR unknown filter '%s'\n",
+                                     name);
+            goto failure;
+        }
+
+        if (set == NULL)
+            continue;
+
+        combined = bitmap_or(ctx, rows, set);
+        TALLOC_FREE(rows);
+        if ((rows = combined) == NULL)
+            goto no_memory;
+    }
+
+    return rows;
+
+  no_memory:
+    *error = NULL;
+  failure:
+    TALLOC_FREE(rows);
+    return NULL;
+}
+
+int count_h2h(size_t row, void *state_uncast)
+{
+    struct h2h_state *state;
+
+    state = state_uncast;
+    if ((int)game_index_game(state->db->games, row)->winner == state->a)
+        state->a_wins++;
+    else
+        state->b_wins++;
+
+    return 0;
+}
+
+int list_game(uint32_t row, void *state_uncast)
+{
+    struct games_state *state;
+    const struct timeline_game *g;
+
+    state = state_uncast;
+    g = game_index_game(state->db->games, row);
+    state->out = talloc_asprintf_append(state->out, "%ld %s %s %s %s\n",
+                                        (long)g->time,
+                                        state->db->map_keys[g->map],
+                                        state->db->players[g->winner].key,
+                                        state->db->players[g->loser].key,
+                                        state->db->league_keys[g->league]);
+    if (state->out == NULL)
+        return -1;
+
+    return (--state->limit == 0) ? 1 : 0;
+}
+
+int parse_races(const char *str, enum race *races)
+{
+    int i;
+
+    if (strlen(str) != 3 || (str[1] != 'v' && str[1] != 'V'))
+        return -1;
+
+    for (i = 0; i < 2; i++)
+    {
+        switch (toupper(str[i * 2]))
+        {
+        case 'T':
+            races[i] = RACE_TERRAN;
+            break;
+        case 'Z':
+            races[i] = RACE_ZERG;
+            break;
+        case 'P':
+            races[i] = RACE_PROTOSS;
+            break;
+        case 'R':
+            races[i] = RACE_RANDOM;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+}
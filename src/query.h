@@ -0,0 +1,88 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUERY_H
+#define QUERY_H
+
+/* Answers questions about the ratings from memory, once every game
+ * has been replayed.  Requests and responses are both single lines of
+ * text (responses with a list of results are followed by one line per
+ * result), so they can be sent over a socket as-is:
+ *
+ *   RATING <player>                 OK <player> <elo> <peak> <wins>
+ *                                      <losses> <rank>
+ *   RATING_AT <player> <time>       OK <player> <time> <elo> <games>
+ *   H2H <player> <player>           OK <player> <player> <wins> <wins>
+ *   TOP <offset> <count>            OK <n>, then n lines of
+ *                                      <rank> <player> <elo>
+ *   GAMES [<filter>=<value> ...]    OK <n>, then n lines of
+ *                                      <time> <map> <winner> <loser>
+ *                                      <league>
+ *   COUNT [<filter>=<value> ...]    OK <n>
+ *   PERIODS [<filter>=<value> ...]  OK <n>, then n lines of
+ *                                      <start> <games> <active>
+ *                                      <rated>
+ *   PERIOD_TOP <time> <count>       OK <n>, then n lines of
+ *                                      <rank> <player> <elo>
+ *   PERIOD_RATINGS <time>           OK <n>, then n lines of
+ *                                      <lowest elo> <players>
+ *
+ * GAMES lists games oldest first, picked out by any of "player",
+ * "vs" (needs "player"), "map", "league", "matchup" (such as "TvZ"),
+ * "won" (such as "ZvP" for Zerg beating Protoss), "from" and "to"
+ * (inclusive), and at most "limit" of them.  COUNT takes the same
+ * filters, other than "limit", and only counts the games.  Values can
+ * be a comma-separated list of which any can match, can start with a
+ * '!' to match anything else, and leagues can end in a '*' to match
+ * any league starting with the rest.
+ *
+ * The PERIOD requests are answered from the snapshot taken at the end
+ * of every period (see period.h).  PERIODS lists every period, with
+ * the games counted only on the given "map" and "matchup" or "won"
+ * (single values only), along with how many players played in it and
+ * how many had played by its end.  PERIOD_TOP and PERIOD_RATINGS look
+ * at the period that was current at the given time, as it stood when
+ * it ended.
+ *
+ * Players, maps and leagues are given by key, times as UNIX times.  Anything that goes
+ * wrong gets a single "ERR <reason>" line back. */
+struct query_db;
+
+#include "history.h"
+#include "period.h"
+#include "timeline.h"
+
+/* Builds the lookup tables needed to answer queries.  The ratings in
+ * the timeline's players must already be up to date, and the history
+ * and period snapshots (which can be NULL) must have been filled in by
+ * the same replay.  Everything is copied, so the result never changes
+ * and can be read by any number of threads at once, even after the
+ * timeline and history have been freed. */
+struct query_db *query_db_new(void *ctx, struct timeline *tl,
+                              struct rating_history *rh,
+                              struct period_table *pt);
+
+/* Answers a single request, which shouldn't include the trailing
+ * newline.  The response is allocated under the given context and
+ * always ends with a newline. */
+char *query_answer(void *ctx, struct query_db *db, const char *request);
+
+#endif
@@ -32,6 +32,9 @@ enum race
     RACE_RANDOM,
 };
 
+/* The number of values above, for sizing arrays indexed by race. */
+#define RACE_COUNT 5
+
 /* Parses a string into a race. */
 enum race race_parse(const char *str);
 
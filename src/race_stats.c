@@ -0,0 +1,216 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "race_stats.h"
+#include "calendar.h"
+
+#include <string.h>
+#include <talloc.h>
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct race_month
+{
+    int key;
+    game_time_t start;
+    struct race_counts counts;
+};
+
+struct race_stats
+{
+    struct race_counts *maps;
+    size_t map_count;
+    struct race_counts *leagues;
+    size_t league_count;
+
+    /* Every month so far, oldest first. */
+    struct race_month *months;
+    size_t month_count;
+    size_t month_alloc;
+};
+
+/* The month that was still open is copied, as later games in it are
+ * counted in place.  Months before it never change. */
+struct race_stats_checkpoint
+{
+    struct race_counts *maps;
+    struct race_counts *leagues;
+    size_t month_count;
+    struct race_month last;
+};
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct race_stats *race_stats_new(void *ctx, size_t map_count,
+                                  size_t league_count)
+{
+    struct race_stats *rs;
+
+    rs = talloc(ctx, struct race_stats);
+    if (rs == NULL)
+        return NULL;
+
+    rs->map_count = map_count;
+    rs->league_count = league_count;
+    rs->maps = talloc_zero_array(rs, struct race_counts, map_count + 1);
+    rs->leagues = talloc_zero_array(rs, struct race_counts,
+                                    league_count + 1);
+    rs->months = NULL;
+    rs->month_count = 0;
+    rs->month_alloc = 0;
+    if (rs->maps == NULL || rs->leagues == NULL)
+    {
+        TALLOC_FREE(rs);
+        return NULL;
+    }
+
+    return rs;
+}
+
+int race_stats_game(struct race_stats *rs, const struct timeline_game *tg,
+                    enum race winner_race, enum race loser_race)
+{
+    struct race_month *month;
+    int key;
+
+    if (tg->map >= rs->map_count || tg->league >= rs->league_count
+        || (unsigned)winner_race >= RACE_COUNT
+        || (unsigned)loser_race >= RACE_COUNT)
+        return -1;
+
+    /* Games come in order, so a new month always goes on the end. */
+    key = calendar_month(tg->time);
+    if (rs->month_count == 0 || rs->months[rs->month_count - 1].key != key)
+    {
+        if (rs->month_count == rs->month_alloc)
+        {
+            struct race_month *months;
+            size_t alloc;
+
+            alloc = (rs->month_alloc == 0) ? 16 : rs->month_alloc * 2;
+            months = talloc_realloc(rs, rs->months, struct race_month,
+                                    alloc);
+            if (months == NULL)
+                return -1;
+
+            rs->months = months;
+            rs->month_alloc = alloc;
+        }
+
+        month = rs->months + rs->month_count++;
+        memset(month, 0, sizeof(*month));
+        month->key = key;
+        month->start = tg->time;
+    }
+    month = rs->months + rs->month_count - 1;
+
+    rs->maps[tg->map].wins[winner_race][loser_race]++;
+    rs->leagues[tg->league].wins[winner_race][loser_race]++;
+    month->counts.wins[winner_race][loser_race]++;
+    return 0;
+}
+
+struct race_stats_checkpoint *race_stats_checkpoint(void *ctx,
+                                                    struct race_stats *rs)
+{
+    struct race_stats_checkpoint *cp;
+
+    cp = talloc(ctx, struct race_stats_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    cp->maps = talloc_memdup(cp, rs->maps,
+                             (rs->map_count + 1) * sizeof(*rs->maps));
+    cp->leagues = talloc_memdup(cp, rs->leagues,
+                                (rs->league_count + 1)
+                                * sizeof(*rs->leagues));
+    if (cp->maps == NULL || cp->leagues == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    cp->month_count = rs->month_count;
+    if (rs->month_count > 0)
+        cp->last = rs->months[rs->month_count - 1];
+    return cp;
+}
+
+void race_stats_rollback(struct race_stats *rs,
+                         const struct race_stats_checkpoint *cp)
+{
+    memcpy(rs->maps, cp->maps, (rs->map_count + 1) * sizeof(*rs->maps));
+    memcpy(rs->leagues, cp->leagues,
+           (rs->league_count + 1) * sizeof(*rs->leagues));
+
+    rs->month_count = cp->month_count;
+    if (cp->month_count > 0)
+        rs->months[cp->month_count - 1] = cp->last;
+}
+
+const struct race_counts *race_stats_map(struct race_stats *rs, int map)
+{
+    if (map < 0 || (size_t)map >= rs->map_count)
+        return NULL;
+
+    return rs->maps + map;
+}
+
+const struct race_counts *race_stats_league(struct race_stats *rs,
+                                            int league)
+{
+    if (league < 0 || (size_t)league >= rs->league_count)
+        return NULL;
+
+    return rs->leagues + league;
+}
+
+size_t race_stats_month_count(struct race_stats *rs)
+{
+    return rs->month_count;
+}
+
+const struct race_counts *race_stats_month(struct race_stats *rs,
+                                           size_t month,
+                                           game_time_t *start)
+{
+    if (month >= rs->month_count)
+        return NULL;
+
+    if (start != NULL)
+        *start = rs->months[month].start;
+    return &rs->months[month].counts;
+}
+
+uint32_t race_counts_games(const struct race_counts *rc)
+{
+    uint32_t games;
+    int w, l;
+
+    games = 0;
+    for (w = 0; w < RACE_COUNT; w++)
+        for (l = 0; l < RACE_COUNT; l++)
+            games += rc->wins[w][l];
+
+    return games;
+}
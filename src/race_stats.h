@@ -0,0 +1,82 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RACE_STATS_H
+#define RACE_STATS_H
+
+/* Counts how many games every race has won against every other race,
+ * on every map, in every league and in every calendar month.  Each of
+ * those is a table indexed by the winner's race and then the loser's,
+ * so every game is counted with the same three increments no matter
+ * which races played. */
+struct race_stats;
+
+/* Every count as it stood at some point. */
+struct race_stats_checkpoint;
+
+#include "race.h"
+#include "timeline.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* How many games each race won against each race. */
+struct race_counts
+{
+    uint32_t wins[RACE_COUNT][RACE_COUNT];
+};
+
+/* Creates empty tables for the given number of maps and leagues. */
+struct race_stats *race_stats_new(void *ctx, size_t map_count,
+                                  size_t league_count);
+
+/* Counts a game, which must not be older than the last one.  Returns
+ * 0 on success. */
+int race_stats_game(struct race_stats *rs, const struct timeline_game *tg,
+                    enum race winner_race, enum race loser_race);
+
+/* Saves the counts between two games, so they can be wound back to
+ * here if a later game changes.  Returns NULL on failure. */
+struct race_stats_checkpoint *race_stats_checkpoint(void *ctx,
+                                                    struct race_stats *rs);
+
+/* Puts every count back to how it was at the checkpoint. */
+void race_stats_rollback(struct race_stats *rs,
+                         const struct race_stats_checkpoint *cp);
+
+/* Returns the counts for a single map or league, by index, or NULL if
+ * there's no such map or league. */
+const struct race_counts *race_stats_map(struct race_stats *rs, int map);
+const struct race_counts *race_stats_league(struct race_stats *rs,
+                                            int league);
+
+/* Returns the number of months that have had a game played in them,
+ * and the counts for each, oldest first, along with when the first
+ * game of that month was played. */
+size_t race_stats_month_count(struct race_stats *rs);
+const struct race_counts *race_stats_month(struct race_stats *rs,
+                                           size_t month,
+                                           game_time_t *start);
+
+/* Returns the total number of games counted in a table. */
+uint32_t race_counts_games(const struct race_counts *rc);
+
+#endif
@@ -0,0 +1,429 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rank.h"
+#include "calendar.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+
+/* Ratings are bucketed by their integer part, anything outside of
+ * this range is clamped to the ends. */
+#ifndef RANK_BUCKETS
+#define RANK_BUCKETS 4096
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* The rank a single player had after each of their games. */
+struct rank_history
+{
+    int *ranks;
+    size_t count;
+    size_t alloc;
+};
+
+/* The biggest movers over a single month. */
+struct rank_period
+{
+    game_time_t start;
+    int mover_count;
+    struct rank_mover movers[RANK_MOVERS];
+};
+
+struct rank_tree
+{
+    /* A Fenwick tree counting the players in each rating bucket,
+     * indexed from 1. */
+    int tree[RANK_BUCKETS + 1];
+    int count;
+
+    /* The bucket each player is currently counted in, or -1 for
+     * unranked players. */
+    size_t player_count;
+    int *bucket;
+    struct rank_history *history;
+
+    /* Every player's rank as of the start of the current period. */
+    int *period_rank;
+    int period_key;
+    game_time_t period_start;
+
+    struct rank_period *periods;
+    size_t period_count;
+    size_t period_alloc;
+
+    /* Set when the last period listed is the one that's still open, as
+     * it stood the last time rank_tree_finish() was called. */
+    bool open_listed;
+};
+
+/* The tree and every player's bucket are copied, while histories and
+ * closed periods only ever grow so just their lengths are kept. */
+struct rank_checkpoint
+{
+    int tree[RANK_BUCKETS + 1];
+    int count;
+    int *bucket;
+    size_t *history_counts;
+    int *period_rank;
+    int period_key;
+    game_time_t period_start;
+    size_t period_count;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int elo_bucket(player_elo_t elo);
+static void tree_add(struct rank_tree *rt, int bucket, int delta);
+
+/* Returns the number of ranked players in buckets up to and including
+ * the given one. */
+static int tree_prefix(struct rank_tree *rt, int bucket);
+
+/* Lists the biggest movers over the current period, returning TRUE if
+ * there were any.  Only once it's closed do the ranks at its end
+ * become the start of the next one. */
+static bool list_period(struct rank_tree *rt, bool closed);
+
+/* Drops the open period's entry, if rank_tree_finish() listed it. */
+static void unlist_open_period(struct rank_tree *rt);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct rank_tree *rank_tree_new(void *ctx, size_t player_count)
+{
+    struct rank_tree *rt;
+    size_t i;
+
+    rt = talloc_zero(ctx, struct rank_tree);
+    if (rt == NULL)
+        return NULL;
+
+    rt->player_count = player_count;
+    rt->bucket = talloc_array(rt, int, player_count + 1);
+    rt->history = talloc_zero_array(rt, struct rank_history,
+                                    player_count + 1);
+    rt->period_rank = talloc_zero_array(rt, int, player_count + 1);
+    if (rt->bucket == NULL || rt->history == NULL || rt->period_rank == NULL)
+    {
+        TALLOC_FREE(rt);
+        return NULL;
+    }
+
+    for (i = 0; i < player_count; i++)
+        rt->bucket[i] = -1;
+
+    rt->period_key = -1;
+    return rt;
+}
+
+void rank_tree_begin_game(struct rank_tree *rt, game_time_t time)
+{
+    int key;
+
+    key = calendar_month(time);
+    if (key == rt->period_key)
+        return;
+
+    if (rt->period_key != -1)
+    {
+        unlist_open_period(rt);
+        list_period(rt, true);
+    }
+
+    rt->period_key = key;
+    rt->period_start = time;
+}
+
+void rank_tree_move(struct rank_tree *rt, int player, player_elo_t elo)
+{
+    int bucket;
+
+    bucket = elo_bucket(elo);
+    if (rt->bucket[player] == bucket)
+        return;
+
+    if (rt->bucket[player] == -1)
+        rt->count++;
+    else
+        tree_add(rt, rt->bucket[player], -1);
+
+    tree_add(rt, bucket, 1);
+    rt->bucket[player] = bucket;
+}
+
+int rank_tree_record(struct rank_tree *rt, int player)
+{
+    struct rank_history *h;
+
+    h = rt->history + player;
+    if (h->count == h->alloc)
+    {
+        size_t alloc;
+        int *ranks;
+
+        alloc = (h->alloc == 0) ? 16 : h->alloc * 2;
+        ranks = talloc_realloc(rt, h->ranks, int, alloc);
+        if (ranks == NULL)
+            return -1;
+
+        h->ranks = ranks;
+        h->alloc = alloc;
+    }
+    h->ranks[h->count++] = rank_tree_rank(rt, player);
+
+    return 0;
+}
+
+void rank_tree_finish(struct rank_tree *rt)
+{
+    /* More games may still come in for the same month, so the period
+     * stays open and is only listed as it stands for now. */
+    if (rt->period_key == -1)
+        return;
+
+    unlist_open_period(rt);
+    rt->open_listed = list_period(rt, false);
+}
+
+struct rank_checkpoint *rank_tree_checkpoint(void *ctx,
+                                             struct rank_tree *rt)
+{
+    struct rank_checkpoint *cp;
+    size_t n;
+    size_t i;
+
+    cp = talloc(ctx, struct rank_checkpoint);
+    if (cp == NULL)
+        return NULL;
+
+    n = rt->player_count + 1;
+    memcpy(cp->tree, rt->tree, sizeof(cp->tree));
+    cp->count = rt->count;
+    cp->bucket = talloc_memdup(cp, rt->bucket, n * sizeof(*rt->bucket));
+    cp->period_rank = talloc_memdup(cp, rt->period_rank,
+                                    n * sizeof(*rt->period_rank));
+    cp->history_counts = talloc_array(cp, size_t, n);
+    if (cp->bucket == NULL || cp->period_rank == NULL
+        || cp->history_counts == NULL)
+    {
+        TALLOC_FREE(cp);
+        return NULL;
+    }
+
+    for (i = 0; i < rt->player_count; i++)
+        cp->history_counts[i] = rt->history[i].count;
+
+    /* The open period's entry is only a preview, it's listed again by
+     * the next rank_tree_finish(). */
+    cp->period_key = rt->period_key;
+    cp->period_start = rt->period_start;
+    cp->period_count = rt->period_count - (rt->open_listed ? 1 : 0);
+    return cp;
+}
+
+void rank_tree_rollback(struct rank_tree *rt,
+                        const struct rank_checkpoint *cp)
+{
+    size_t n;
+    size_t i;
+
+    n = rt->player_count + 1;
+    memcpy(rt->tree, cp->tree, sizeof(rt->tree));
+    rt->count = cp->count;
+    memcpy(rt->bucket, cp->bucket, n * sizeof(*rt->bucket));
+    memcpy(rt->period_rank, cp->period_rank, n * sizeof(*rt->period_rank));
+
+    for (i = 0; i < rt->player_count; i++)
+        if (rt->history[i].count > cp->history_counts[i])
+            rt->history[i].count = cp->history_counts[i];
+
+    rt->period_key = cp->period_key;
+    rt->period_start = cp->period_start;
+    rt->period_count = cp->period_count;
+    rt->open_listed = false;
+}
+
+int rank_tree_rank(struct rank_tree *rt, int player)
+{
+    if (rt->bucket[player] == -1)
+        return 0;
+
+    return rt->count - tree_prefix(rt, rt->bucket[player]) + 1;
+}
+
+int rank_tree_count(struct rank_tree *rt)
+{
+    return rt->count;
+}
+
+double rank_tree_percentile(struct rank_tree *rt, int player)
+{
+    int rank;
+
+    rank = rank_tree_rank(rt, player);
+    if (rank == 0)
+        return 100.0;
+
+    return rank * 100.0 / rt->count;
+}
+
+int rank_tree_history(struct rank_tree *rt, int player, size_t game)
+{
+    if (game >= rt->history[player].count)
+        return 0;
+
+    return rt->history[player].ranks[game];
+}
+
+size_t rank_tree_period_count(struct rank_tree *rt)
+{
+    return rt->period_count;
+}
+
+game_time_t rank_tree_period_start(struct rank_tree *rt, size_t period)
+{
+    return rt->periods[period].start;
+}
+
+int rank_tree_period_movers(struct rank_tree *rt, size_t period,
+                            const struct rank_mover **movers)
+{
+    *movers = rt->periods[period].movers;
+    return rt->periods[period].mover_count;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int elo_bucket(player_elo_t elo)
+{
+    if (elo < 0)
+        return 0;
+    if (elo >= RANK_BUCKETS)
+        return RANK_BUCKETS - 1;
+
+    return (int)elo;
+}
+
+void tree_add(struct rank_tree *rt, int bucket, int delta)
+{
+    int i;
+
+    for (i = bucket + 1; i <= RANK_BUCKETS; i += i & (-i))
+        rt->tree[i] += delta;
+}
+
+int tree_prefix(struct rank_tree *rt, int bucket)
+{
+    int i;
+    int sum;
+
+    sum = 0;
+    for (i = bucket + 1; i > 0; i -= i & (-i))
+        sum += rt->tree[i];
+
+    return sum;
+}
+
+bool list_period(struct rank_tree *rt, bool closed)
+{
+    struct rank_period *period;
+    size_t p;
+
+    if (rt->period_count == rt->period_alloc)
+    {
+        size_t alloc;
+        struct rank_period *periods;
+
+        alloc = (rt->period_alloc == 0) ? 16 : rt->period_alloc * 2;
+        periods = talloc_realloc(rt, rt->periods, struct rank_period, alloc);
+        if (periods == NULL)
+            return false;
+
+        rt->periods = periods;
+        rt->period_alloc = alloc;
+    }
+
+    period = rt->periods + rt->period_count;
+    period->start = rt->period_start;
+    period->mover_count = 0;
+
+    /* Keeps the biggest movers in order with an insertion sort, there
+     * are only ever a handful of them.  Players that weren't ranked at
+     * the start of the period don't count as moving. */
+    for (p = 0; p < rt->player_count; p++)
+    {
+        struct rank_mover m;
+        int delta;
+        int i;
+
+        m.player = p;
+        m.from = rt->period_rank[p];
+        m.to = rank_tree_rank(rt, p);
+        if (closed)
+            rt->period_rank[p] = m.to;
+
+        if (m.from == 0 || m.from == m.to)
+            continue;
+
+        delta = abs(m.to - m.from);
+        i = period->mover_count;
+        while (i > 0
+               && abs(period->movers[i - 1].to - period->movers[i - 1].from)
+               < delta)
+        {
+            if (i < RANK_MOVERS)
+                period->movers[i] = period->movers[i - 1];
+            i--;
+        }
+
+        if (i < RANK_MOVERS)
+        {
+            period->movers[i] = m;
+            if (period->mover_count < RANK_MOVERS)
+                period->mover_count++;
+        }
+    }
+
+    /* The very first period never has anyone to compare against, so
+     * only periods with movers are kept around. */
+    if (period->mover_count == 0)
+        return false;
+
+    rt->period_count++;
+    return true;
+}
+
+void unlist_open_period(struct rank_tree *rt)
+{
+    if (rt->open_listed)
+        rt->period_count--;
+
+    rt->open_listed = false;
+}
@@ -0,0 +1,116 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANK_H
+#define RANK_H
+
+/* Keeps every player's current rank up to date as games are replayed.
+ * Ratings are counted in a Fenwick tree over one-point rating buckets,
+ * so moving a player or looking up a rank is O(log buckets) rather
+ * than needing the whole roster to be sorted. */
+struct rank_tree;
+
+/* Where every player stood in the tree at some point. */
+struct rank_checkpoint;
+
+#include "elo.h"
+#include "game.h"
+
+#include <stddef.h>
+
+/* The number of players listed as the biggest movers for each
+ * period. */
+#ifndef RANK_MOVERS
+#define RANK_MOVERS 5
+#endif
+
+/* A player whose rank changed over a single period. */
+struct rank_mover
+{
+    int player;
+    int from;
+    int to;
+};
+
+/* Creates an empty tree for the given number of players.  Players
+ * aren't ranked until they've played a game. */
+struct rank_tree *rank_tree_new(void *ctx, size_t player_count);
+
+/* Tells the tree that a game is about to be played at the given time.
+ * Games are grouped into calendar months, and every time a new month
+ * starts the biggest rank changes over the previous one are
+ * recorded. */
+void rank_tree_begin_game(struct rank_tree *rt, game_time_t time);
+
+/* Moves a player to their new rating after a game, ranking them if
+ * this was their first. */
+void rank_tree_move(struct rank_tree *rt, int player, player_elo_t elo);
+
+/* Appends a player's current rank to their history.  Both players in
+ * a game have to be moved before either rank is recorded, otherwise
+ * the first one is ranked against the other's old rating. */
+int rank_tree_record(struct rank_tree *rt, int player);
+
+/* Lists the movers over the period that's still open, as they stand
+ * after the last game, call this once every game so far is done.
+ * More games can still come in afterwards: the period's entry is
+ * replaced rather than added to again. */
+void rank_tree_finish(struct rank_tree *rt);
+
+/* Saves the tree as it stands between two games, so it can be rolled
+ * back here if any later game changes.  Returns NULL on failure. */
+struct rank_checkpoint *rank_tree_checkpoint(void *ctx,
+                                             struct rank_tree *rt);
+
+/* Puts every rank back to how it was at the checkpoint, forgetting
+ * the history and periods since.  Call rank_tree_finish() again once
+ * the games after it have been replayed. */
+void rank_tree_rollback(struct rank_tree *rt,
+                        const struct rank_checkpoint *cp);
+
+/* Returns the current rank (starting from 1) of a player, or 0 for a
+ * player that hasn't been ranked.  Players with the same displayed
+ * rating share a rank. */
+int rank_tree_rank(struct rank_tree *rt, int player);
+
+/* Returns the number of ranked players. */
+int rank_tree_count(struct rank_tree *rt);
+
+/* Returns the percentage of ranked players that are rated at least as
+ * high as this one, so the best player is in the top (1 / count). */
+double rank_tree_percentile(struct rank_tree *rt, int player);
+
+/* Returns a player's rank just after the given game of theirs (with
+ * the first game being 0), or 0 if they haven't played that many. */
+int rank_tree_history(struct rank_tree *rt, int player, size_t game);
+
+/* Returns the number of periods that have movers listed. */
+size_t rank_tree_period_count(struct rank_tree *rt);
+
+/* Returns the time of the first game in the given period. */
+game_time_t rank_tree_period_start(struct rank_tree *rt, size_t period);
+
+/* Returns the biggest movers over the given period, by the size of
+ * their rank change, and sets "movers" to point at them. */
+int rank_tree_period_movers(struct rank_tree *rt, size_t period,
+                            const struct rank_mover **movers);
+
+#endif
@@ -0,0 +1,541 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <talloc.h>
+#include <unistd.h>
+
+#ifndef LINE_MAX
+#define LINE_MAX 1024
+#endif
+
+#ifndef SERVER_MAX_CLIENTS
+#define SERVER_MAX_CLIENTS 64
+#endif
+
+/* Clients with more than this many bytes of answers waiting for them
+ * aren't read from until they catch up. */
+#ifndef SERVER_OUTPUT_MAX
+#define SERVER_OUTPUT_MAX (64 * 1024)
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A connected client, along with any partial request it's sent and
+ * any answers it hasn't read yet. */
+struct server_client
+{
+    int fd;
+    char buf[LINE_MAX];
+    size_t used;
+
+    char *out;
+    size_t out_used;
+
+    /* Set once the client has asked to go, it's disconnected as soon
+     * as all its answers are written. */
+    int closing;
+};
+
+struct server
+{
+    const char *path;
+    struct snapshot_reader *reader;
+    struct ingest *ingest;
+    struct server_client *clients;
+
+    int listen_fd;
+
+    /* Writing to wake_fds[1] asks the server thread to stop. */
+    int wake_fds[2];
+
+    pthread_t thread;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int listen_on(const char *path);
+
+/* The server thread's main loop. */
+static void *serve(void *server_uncast);
+
+/* Reads whatever a client has sent, answers what it can and writes
+ * out what the socket will take.  Returns -1 when the client should
+ * be disconnected. */
+static int serve_client(void *ctx, struct server *server,
+                        struct server_client *client, short revents);
+
+/* Answers every complete request in a client's buffer, until it has
+ * too many answers waiting. */
+static int answer_client(void *ctx, struct server *server,
+                         struct server_client *client);
+
+/* Queues up an answer for a client. */
+static int queue_output(void *ctx, struct server_client *client,
+                        const char *buf, size_t len);
+
+/* Writes as much of a client's answers as its socket will take
+ * without blocking. */
+static int flush_client(struct server_client *client);
+
+/* Returns what to poll a client for: its answers, if there are any,
+ * and its requests, unless it's fallen behind on its answers. */
+static short client_events(const struct server_client *client);
+
+static int write_all(int fd, const char *buf, size_t len);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct server *server_start(void *ctx, struct snapshot *snapshot,
+                            struct ingest *ingest, const char *path)
+{
+    struct server *server;
+    sigset_t stop_signals, old_signals;
+    int ret;
+
+    server = talloc(ctx, struct server);
+    if (server == NULL)
+        return NULL;
+
+    server->path = talloc_strdup(server, path);
+    server->ingest = ingest;
+    server->reader = snapshot_reader_new(snapshot);
+    server->clients = talloc_array(server, struct server_client,
+                                   SERVER_MAX_CLIENTS);
+    if (server->path == NULL || server->reader == NULL
+        || server->clients == NULL)
+        goto failure;
+
+    if (pipe(server->wake_fds) != 0)
+    {
+        perror("pipe");
+        goto failure;
+    }
+
+    server->listen_fd = listen_on(path);
+    if (server->listen_fd < 0)
+        goto close_pipe;
+
+    /* A client hanging up mid-response shouldn't kill everything. */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* The thread inherits the blocked signals, which leaves them for
+     * whoever started the server to handle. */
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+    ret = pthread_create(&server->thread, NULL, &serve, server);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (ret != 0)
+    {
+        fprintf(stderr, "Unable to start the server thread\n");
+        close(server->listen_fd);
+        unlink(path);
+        goto close_pipe;
+    }
+
+    fprintf(stderr, "Listening on '%s'\n", path);
+    return server;
+
+  close_pipe:
+    close(server->wake_fds[0]);
+    close(server->wake_fds[1]);
+  failure:
+    TALLOC_FREE(server);
+    return NULL;
+}
+
+void server_stop(struct server *server)
+{
+    write_all(server->wake_fds[1], "", 1);
+    pthread_join(server->thread, NULL);
+
+    close(server->listen_fd);
+    close(server->wake_fds[0]);
+    close(server->wake_fds[1]);
+    unlink(server->path);
+
+    TALLOC_FREE(server);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path '%s' is too long\n", path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A stale socket from a previous run would stop us binding. */
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(fd, SERVER_MAX_CLIENTS) != 0)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void *serve(void *server_uncast)
+{
+    struct server *server;
+    struct server_client *clients;
+    struct pollfd fds[SERVER_MAX_CLIENTS + 2];
+    void *ctx;
+    int count;
+    int i;
+
+    server = server_uncast;
+    clients = server->clients;
+
+    /* Talloc isn't thread safe, so this thread keeps its allocations
+     * in a tree of its own. */
+    ctx = talloc_new(NULL);
+
+    /* fds[0] is the wake pipe, fds[1] is always the listening socket
+     * and fds[i + 2] belongs to clients[i]. */
+    count = 0;
+    fds[0].fd = server->wake_fds[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = server->listen_fd;
+    fds[1].events = POLLIN;
+
+    while (ctx != NULL)
+    {
+        if (poll(fds, count + 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents != 0)
+            break;
+
+        /* Clients are served first, as accepting shuffles them. */
+        for (i = count - 1; i >= 0; i--)
+        {
+            if (fds[i + 2].revents == 0)
+                continue;
+
+            if (serve_client(ctx, server, &clients[i],
+                             fds[i + 2].revents) != 0)
+            {
+                close(clients[i].fd);
+                TALLOC_FREE(clients[i].out);
+                count--;
+                clients[i] = clients[count];
+                fds[i + 2] = fds[count + 2];
+            }
+            else
+                fds[i + 2].events = client_events(&clients[i]);
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            int fd;
+
+            fd = accept(server->listen_fd, NULL, NULL);
+            if (fd >= 0 && count == SERVER_MAX_CLIENTS)
+            {
+                write_all(fd, "ERR too many clients\n", 21);
+                close(fd);
+            }
+            else if (fd >= 0 && fcntl(fd, F_SETFL, O_NONBLOCK) != 0)
+            {
+                perror("fcntl");
+                close(fd);
+            }
+            else if (fd >= 0)
+            {
+                clients[count].fd = fd;
+                clients[count].used = 0;
+                clients[count].out = NULL;
+                clients[count].out_used = 0;
+                clients[count].closing = 0;
+                fds[count + 2].fd = fd;
+                fds[count + 2].events = POLLIN;
+                fds[count + 2].revents = 0;
+                count++;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        close(clients[i].fd);
+        TALLOC_FREE(clients[i].out);
+    }
+
+    TALLOC_FREE(ctx);
+    return NULL;
+}
+
+int serve_client(void *pctx, struct server *server,
+                 struct server_client *client, short revents)
+{
+    if (revents & (POLLERR | POLLNVAL))
+        return -1;
+
+    if ((revents & POLLOUT) && flush_client(client) != 0)
+        return -1;
+
+    if ((revents & (POLLIN | POLLHUP)) && !client->closing
+        && client->out_used < SERVER_OUTPUT_MAX)
+    {
+        ssize_t got;
+
+        got = read(client->fd, client->buf + client->used,
+                   sizeof(client->buf) - client->used - 1);
+        if (got == 0)
+            return -1;
+        if (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+            && errno != EINTR)
+            return -1;
+        if (got > 0)
+            client->used += got;
+    }
+
+    /* Requests that were held back while the client caught up are
+     * answered here too. */
+    if (answer_client(pctx, server, client) != 0
+        || flush_client(client) != 0)
+        return -1;
+
+    if (client->closing && client->out_used == 0)
+        return -1;
+
+    return 0;
+}
+
+int answer_client(void *pctx, struct server *server,
+                  struct server_client *client)
+{
+    char *start, *newline;
+
+    client->buf[client->used] = '\0';
+
+    /* Answers every complete line, leaving any partial one in the
+     * buffer for next time. */
+    start = client->buf;
+    while (!client->closing && client->out_used < SERVER_OUTPUT_MAX
+           && (newline = strchr(start, '\n')) != NULL)
+    {
+        struct query_db *db;
+        void *ctx;
+        char *response;
+
+        *newline = '\0';
+        if (newline > start && newline[-1] == '\r')
+            newline[-1] = '\0';
+
+        if (strcmp(start, "QUIT") == 0)
+        {
+            client->closing = 1;
+            start = newline + 1;
+            break;
+        }
+
+        /* New games, and corrections to them, skip the ratings
+         * entirely. */
+        if (strncmp(start, "GAME ", 5) == 0
+            || strncmp(start, "REMOVE ", 7) == 0)
+        {
+            const char *response;
+            enum ingest_op op;
+            const char *line;
+
+            op = (start[0] == 'G') ? INGEST_ADD : INGEST_REMOVE;
+            line = strchr(start, ' ') + 1;
+
+            if (server->ingest == NULL)
+                response = "ERR not accepting games\n";
+            else if (ingest_push(server->ingest, op, line) != 0)
+                response = "ERR bad game\n";
+            else
+                response = "OK queued\n";
+
+            if (queue_output(pctx, client, response, strlen(response)) != 0)
+                return -1;
+
+            start = newline + 1;
+            continue;
+        }
+
+        /* Each request sees a single version of the ratings, even if
+         * a new one is published halfway through answering it. */
+        ctx = talloc_new(pctx);
+        db = snapshot_read_lock(server->reader);
+        if (db == NULL)
+            response = talloc_strdup(ctx, "ERR no ratings yet\n");
+        else
+            response = query_answer(ctx, db, start);
+        snapshot_read_unlock(server->reader);
+
+        if (response == NULL
+            || queue_output(pctx, client, response, strlen(response)) != 0)
+        {
+            TALLOC_FREE(ctx);
+            return -1;
+        }
+        TALLOC_FREE(ctx);
+
+        start = newline + 1;
+    }
+
+    client->used -= start - client->buf;
+    memmove(client->buf, start, client->used);
+
+    /* A request that fills the whole buffer can never be answered. */
+    if (client->used == sizeof(client->buf) - 1)
+    {
+        client->used = 0;
+        client->closing = 1;
+        return queue_output(pctx, client, "ERR request too long\n", 21);
+    }
+
+    return 0;
+}
+
+int queue_output(void *ctx, struct server_client *client, const char *buf,
+                 size_t len)
+{
+    size_t size;
+
+    size = (client->out == NULL) ? 0 : talloc_get_size(client->out);
+    if (client->out_used + len > size)
+    {
+        char *out;
+
+        if (size == 0)
+            size = LINE_MAX;
+        while (client->out_used + len > size)
+            size *= 2;
+
+        out = talloc_realloc(ctx, client->out, char, size);
+        if (out == NULL)
+            return -1;
+
+        client->out = out;
+    }
+
+    memcpy(client->out + client->out_used, buf, len);
+    client->out_used += len;
+    return 0;
+}
+
+int flush_client(struct server_client *client)
+{
+    size_t done;
+
+    done = 0;
+    while (done < client->out_used)
+    {
+        ssize_t wrote;
+
+        wrote = write(client->fd, client->out + done,
+                      client->out_used - done);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (wrote <= 0)
+            return -1;
+
+        done += wrote;
+    }
+
+    client->out_used -= done;
+    memmove(client->out, client->out + done, client->out_used);
+    return 0;
+}
+
+short client_events(const struct server_client *client)
+{
+    short events;
+
+    events = 0;
+    if (client->out_used > 0)
+        events |= POLLOUT;
+    if (!client->closing && client->out_used < SERVER_OUTPUT_MAX)
+        events |= POLLIN;
+
+    return events;
+}
+
+int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t wrote;
+
+        wrote = write(fd, buf, len);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote <= 0)
+            return -1;
+
+        buf += wrote;
+        len -= wrote;
+    }
+
+    return 0;
+}
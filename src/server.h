@@ -0,0 +1,52 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/* Answers queries (see query.h) on a Unix domain socket, one request
+ * per line, from any number of clients.  Every request is answered
+ * from whichever query_db is currently published in the snapshot, so
+ * the ratings can be replaced while the server is running.
+ *
+ * Clients can also send new games, in the same format as a league
+ * file's GAME lines:
+ *
+ *   GAME <time> <map> <player> <'<' or '>'> <player>
+ *
+ * which are queued up for rating and answered with "OK queued". */
+struct server;
+
+#include "ingest.h"
+#include "query.h"
+#include "snapshot.h"
+
+/* Starts listening on the given path and serving requests on a new
+ * thread, which never sees SIGINT or SIGTERM.  New games are pushed
+ * onto the given queue.  Returns NULL on failure. */
+struct server *server_start(void *ctx, struct snapshot *snapshot,
+                            struct ingest *ingest, const char *path);
+
+/* Stops the server thread, disconnecting every client and removing
+ * the socket. */
+void server_stop(struct server *server);
+
+#endif
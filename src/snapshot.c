@@ -0,0 +1,215 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+
+#include <stdint.h>
+#include <talloc.h>
+
+/* The most readers that can be registered with one snapshot. */
+#ifndef SNAPSHOT_MAX_READERS
+#define SNAPSHOT_MAX_READERS 64
+#endif
+
+/* Readers are kept on separate cache lines so announcing an epoch
+ * doesn't slow down any other reader. */
+#ifndef SNAPSHOT_CACHE_LINE
+#define SNAPSHOT_CACHE_LINE 64
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct snapshot_reader
+{
+    /* The epoch this reader started reading in, or 0 when it's not
+     * reading at all. */
+    uint64_t epoch;
+
+    struct snapshot *snapshot;
+
+    char pad[SNAPSHOT_CACHE_LINE - sizeof(uint64_t) - sizeof(void *)];
+};
+
+/* A version that's been replaced, but might still be being read. */
+struct snapshot_retired
+{
+    void *version;
+
+    /* The epoch it was replaced in: readers that started in any later
+     * epoch can't have seen it. */
+    uint64_t epoch;
+
+    struct snapshot_retired *next;
+};
+
+struct snapshot
+{
+    void *current;
+    uint64_t epoch;
+    unsigned long version;
+
+    struct snapshot_reader *readers;
+    int reader_count;
+
+    struct snapshot_retired *retired;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Frees every retired version that no reader can still be using. */
+static void reclaim(struct snapshot *s);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct snapshot *snapshot_new(void *ctx)
+{
+    struct snapshot *s;
+
+    s = talloc(ctx, struct snapshot);
+    if (s == NULL)
+        return NULL;
+
+    s->current = NULL;
+    s->epoch = 1;
+    s->version = 0;
+    s->reader_count = 0;
+    s->retired = NULL;
+    s->readers = talloc_zero_array(s, struct snapshot_reader,
+                                   SNAPSHOT_MAX_READERS);
+    if (s->readers == NULL)
+    {
+        TALLOC_FREE(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+unsigned long snapshot_publish(struct snapshot *s, void *version)
+{
+    void *old;
+
+    talloc_steal(s, version);
+
+    /* Readers that see the new pointer never see the old one again. */
+    old = s->current;
+    __atomic_store_n(&s->current, version, __ATOMIC_SEQ_CST);
+
+    if (old != NULL)
+    {
+        struct snapshot_retired *r;
+
+        r = talloc(s, struct snapshot_retired);
+        if (r == NULL)
+        {
+            /* Leaking a version is better than freeing one that's
+             * still being read. */
+            talloc_steal(NULL, old);
+        }
+        else
+        {
+            r->version = old;
+            r->epoch = s->epoch;
+            r->next = s->retired;
+            s->retired = r;
+        }
+    }
+
+    __atomic_fetch_add(&s->epoch, 1, __ATOMIC_SEQ_CST);
+    reclaim(s);
+
+    return ++s->version;
+}
+
+struct snapshot_reader *snapshot_reader_new(struct snapshot *s)
+{
+    int i;
+
+    i = __atomic_fetch_add(&s->reader_count, 1, __ATOMIC_SEQ_CST);
+    if (i >= SNAPSHOT_MAX_READERS)
+        return NULL;
+
+    s->readers[i].epoch = 0;
+    s->readers[i].snapshot = s;
+    return s->readers + i;
+}
+
+void *snapshot_read_lock(struct snapshot_reader *r)
+{
+    uint64_t epoch;
+
+    /* The announcement has to be visible before the pointer is read,
+     * otherwise the updater could free what's about to be read. */
+    epoch = __atomic_load_n(&r->snapshot->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&r->epoch, epoch, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&r->snapshot->current, __ATOMIC_SEQ_CST);
+}
+
+void snapshot_read_unlock(struct snapshot_reader *r)
+{
+    __atomic_store_n(&r->epoch, 0, __ATOMIC_SEQ_CST);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void reclaim(struct snapshot *s)
+{
+    struct snapshot_retired **cur;
+    uint64_t oldest;
+    int count;
+    int i;
+
+    /* Finds the oldest epoch any reader is still reading in. */
+    oldest = UINT64_MAX;
+    count = __atomic_load_n(&s->reader_count, __ATOMIC_SEQ_CST);
+    if (count > SNAPSHOT_MAX_READERS)
+        count = SNAPSHOT_MAX_READERS;
+    for (i = 0; i < count; i++)
+    {
+        uint64_t epoch;
+
+        epoch = __atomic_load_n(&s->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    cur = &s->retired;
+    while (*cur != NULL)
+    {
+        struct snapshot_retired *r;
+
+        r = *cur;
+        if (r->epoch < oldest)
+        {
+            *cur = r->next;
+            talloc_free(r->version);
+            TALLOC_FREE(r);
+        }
+        else
+            cur = &r->next;
+    }
+}
@@ -0,0 +1,58 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* Publishes immutable versions of some data to any number of reader
+ * threads, RCU style.  One updater builds a whole new version off to
+ * the side and publishes it with a single pointer swap, so readers
+ * always see either all of an update or none of it.  Readers never
+ * take a lock or write to anything shared: they just announce the
+ * epoch they started reading in.  Old versions are freed by the
+ * updater once every reader that might still be looking at them has
+ * moved on. */
+struct snapshot;
+
+/* Every reading thread needs its own reader. */
+struct snapshot_reader;
+
+/* Creates a snapshot with nothing published yet. */
+struct snapshot *snapshot_new(void *ctx);
+
+/* Publishes a new version, which must be a talloc context that isn't
+ * changed again.  The snapshot takes ownership of it, and frees the
+ * previous version once no reader can still be using it.  This must
+ * only ever be called from one thread at a time.  Returns the new
+ * version number, which starts at 1. */
+unsigned long snapshot_publish(struct snapshot *s, void *version);
+
+/* Registers a new reader.  This should be done before the reading
+ * thread is started.  Returns NULL when there are too many readers. */
+struct snapshot_reader *snapshot_reader_new(struct snapshot *s);
+
+/* Returns the current version, which stays valid until the matching
+ * call to snapshot_read_unlock().  This may return NULL if nothing has
+ * been published yet.  Read sections can't be nested. */
+void *snapshot_read_lock(struct snapshot_reader *r);
+void snapshot_read_unlock(struct snapshot_reader *r);
+
+#endif
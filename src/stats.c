@@ -0,0 +1,507 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <talloc.h>
+
+#ifndef STATS_MEMORY_DEPTH
+#define STATS_MEMORY_DEPTH 64
+#endif
+
+/* The talloc names of trackers and scratch contexts. */
+#define TRACKER_NAME "stats tracker"
+#define SCRATCH_NAME "stats scratch"
+
+/* Groups from here on are counted by walking. */
+#define FIRST_WALKED STATS_MEMORY_TIMELINE
+
+/* Arenas count their own memory in the group they were made for, so
+ * a walk skips everything under one. */
+#define COUNTED_BY_ARENA STATS_MEMORY_COUNT
+
+/* talloc doesn't say how big a reference is, but each one is a handle
+ * of four pointers. */
+#define REFERENCE_BYTES (4 * sizeof(void *))
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct stats_memory_info
+{
+    size_t live_bytes;
+    size_t live_objects;
+
+    /* The most seen so far.  For the groups that aren't tracked, that's
+     * only ever looked at the end of a phase, or whenever memory is
+     * sampled. */
+    size_t peak_bytes;
+    size_t peak_objects;
+};
+
+/* Hangs off a tracked block, so whatever was counted for it is taken
+ * away again as it's freed.  Scratch contexts are one of these. */
+struct memory_tracker
+{
+    enum stats_memory group;
+    size_t bytes;
+};
+
+struct stats_phase_info
+{
+    struct timeval start;
+    unsigned long start_counters[STATS_COUNTER_COUNT];
+
+    double seconds;
+    long peak_rss_kb;
+    unsigned long counters[STATS_COUNTER_COUNT];
+    size_t live_blocks;
+    size_t live_bytes;
+    struct stats_memory_info memory[STATS_MEMORY_COUNT];
+    int runs;
+};
+
+/* The talloc type names that decide which group a block is in, so a
+ * walk can skip over everything that's already been tracked. */
+struct memory_type
+{
+    const char *name;
+    enum stats_memory group;
+};
+
+/* Where a walk over every block is up to: the group of the block at
+ * every depth down to the current one. */
+struct memory_walk
+{
+    struct stats_memory_info *memory;
+    enum stats_memory groups[STATS_MEMORY_DEPTH];
+};
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+unsigned long stats_counters[STATS_COUNTER_COUNT];
+
+static const char *counter_names[STATS_COUNTER_COUNT] = {
+    "files_read",
+    "games_parsed",
+    "lookups",
+    "games_merged",
+    "games_rated",
+    "pages_written",
+    "bytes_written",
+};
+
+static const char *phase_names[STATS_PHASE_COUNT] = {
+    "players",
+    "maps",
+    "leagues",
+    "merge",
+    "elo",
+    "html",
+};
+
+/* The counter that gives each phase's throughput. */
+static const enum stats_counter phase_units[STATS_PHASE_COUNT] = {
+    STATS_FILES_READ,
+    STATS_FILES_READ,
+    STATS_GAMES_PARSED,
+    STATS_GAMES_MERGED,
+    STATS_GAMES_RATED,
+    STATS_PAGES_WRITTEN,
+};
+
+static const char *memory_names[STATS_MEMORY_COUNT] = {
+    "players",
+    "maps",
+    "leagues",
+    "games",
+    "nodes",
+    "references",
+    "html",
+    "timeline",
+    "history",
+    "other",
+};
+
+static const struct memory_type memory_types[] = {
+    {"struct player", STATS_MEMORY_PLAYERS},
+    {"struct map", STATS_MEMORY_MAPS},
+    {"struct league", STATS_MEMORY_LEAGUES},
+    {"struct game", STATS_MEMORY_GAMES},
+    {"struct player_list_node", STATS_MEMORY_NODES},
+    {"struct map_list_node", STATS_MEMORY_NODES},
+    {"struct league_list_node", STATS_MEMORY_NODES},
+    {"struct timeline", STATS_MEMORY_TIMELINE},
+    {"struct game_index", STATS_MEMORY_TIMELINE},
+    {"struct rating_history", STATS_MEMORY_HISTORY},
+    {"struct rank_tree", STATS_MEMORY_HISTORY},
+    {"struct arena", COUNTED_BY_ARENA},
+};
+
+static struct stats_phase_info phases[STATS_PHASE_COUNT];
+static struct stats_memory_info memory_live[STATS_MEMORY_COUNT];
+
+static const void *alloc_context = NULL;
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Fills in how much memory every group is using right now, and the
+ * most each has used. */
+static void walk_memory(struct stats_memory_info *memory);
+static void count_block(const void *ptr, int depth, int max_depth,
+                        int is_ref, void *walk_uncast);
+
+/* Hangs a tracker off a block, counting it.  Returns 0 on success. */
+static int add_tracker(const void *ptr, enum stats_memory group,
+                       size_t bytes);
+
+/* Destructors for trackers and scratch contexts. */
+static int untrack(struct memory_tracker *t);
+static int measure_scratch(struct memory_tracker *t);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+void stats_enable(const void *ctx)
+{
+    alloc_context = ctx;
+}
+
+void stats_begin(enum stats_phase phase)
+{
+    struct stats_phase_info *p;
+    int i;
+
+    p = phases + phase;
+    for (i = 0; i < STATS_COUNTER_COUNT; i++)
+        p->start_counters[i] = stats_counters[i];
+
+    gettimeofday(&p->start, NULL);
+}
+
+void stats_end(enum stats_phase phase)
+{
+    struct stats_phase_info *p;
+    struct timeval end;
+    struct rusage usage;
+    int i;
+
+    p = phases + phase;
+    gettimeofday(&end, NULL);
+    p->seconds += (end.tv_sec - p->start.tv_sec)
+        + (end.tv_usec - p->start.tv_usec) / 1000000.0;
+    p->runs++;
+
+    for (i = 0; i < STATS_COUNTER_COUNT; i++)
+        p->counters[i] += stats_counters[i] - p->start_counters[i];
+
+    /* Linux reports this in kilobytes, and it never goes down, so it's
+     * the peak of the whole run up to the end of this phase. */
+    if (getrusage(RUSAGE_SELF, &usage) == 0
+        && usage.ru_maxrss > p->peak_rss_kb)
+        p->peak_rss_kb = usage.ru_maxrss;
+
+    if (alloc_context != NULL)
+    {
+        walk_memory(p->memory);
+
+        p->live_blocks = 0;
+        p->live_bytes = 0;
+        for (i = 0; i < STATS_MEMORY_COUNT; i++)
+        {
+            p->live_blocks += p->memory[i].live_objects;
+            p->live_bytes += p->memory[i].live_bytes;
+        }
+    }
+}
+
+void stats_memory_add(enum stats_memory group, size_t bytes,
+                      size_t objects)
+{
+    struct stats_memory_info *m;
+
+    m = memory_live + group;
+    m->live_bytes += bytes;
+    m->live_objects += objects;
+    if (m->live_bytes > m->peak_bytes)
+        m->peak_bytes = m->live_bytes;
+    if (m->live_objects > m->peak_objects)
+        m->peak_objects = m->live_objects;
+}
+
+void stats_memory_remove(enum stats_memory group, size_t bytes,
+                         size_t objects)
+{
+    memory_live[group].live_bytes -= bytes;
+    memory_live[group].live_objects -= objects;
+}
+
+void *stats_track(const void *ptr, enum stats_memory group)
+{
+    if (ptr != NULL && alloc_context != NULL)
+        add_tracker(ptr, group, talloc_total_size(ptr));
+
+    return (void *)ptr;
+}
+
+void *stats_reference(const void *ctx, const void *ptr)
+{
+    void *ref;
+
+    ref = (void *)talloc_reference(ctx, ptr);
+    if (ref != NULL && alloc_context != NULL)
+        add_tracker(ctx, STATS_MEMORY_REFERENCES, REFERENCE_BYTES);
+
+    return ref;
+}
+
+void *stats_scratch_new(const void *ctx, enum stats_memory group)
+{
+    struct memory_tracker *t;
+
+    t = talloc_named_const(ctx, sizeof(*t), SCRATCH_NAME);
+    if (t == NULL)
+        return NULL;
+
+    t->group = group;
+    t->bytes = 0;
+    if (alloc_context != NULL)
+    {
+        talloc_set_destructor(t, &measure_scratch);
+        stats_memory_add(group, 0, 1);
+    }
+
+    return t;
+}
+
+void stats_sample_memory(void)
+{
+    struct stats_memory_info memory[STATS_MEMORY_COUNT];
+
+    if (alloc_context != NULL)
+        walk_memory(memory);
+}
+
+void stats_print(FILE * file)
+{
+    int i, c;
+
+    fprintf(file, "%-8s %9s %11s %12s %14s", "phase", "wall_s",
+            "peak_rss_kb", "live_blocks", "per_s");
+    for (c = 0; c < STATS_COUNTER_COUNT; c++)
+        fprintf(file, " %13s", counter_names[c]);
+    fprintf(file, "\n");
+
+    for (i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        const struct stats_phase_info *p;
+        double rate;
+
+        p = phases + i;
+        if (p->runs == 0)
+            continue;
+
+        rate = 0;
+        if (p->seconds > 0)
+            rate = p->counters[phase_units[i]] / p->seconds;
+        fprintf(file, "%-8s %9.3f %11ld %12lu %14.0f", phase_names[i],
+                p->seconds, p->peak_rss_kb, (unsigned long)p->live_blocks,
+                rate);
+        for (c = 0; c < STATS_COUNTER_COUNT; c++)
+            fprintf(file, " %13lu", p->counters[c]);
+        fprintf(file, "\n");
+    }
+
+    fprintf(file, "%-8s %9s %11s %12s %14s", "total", "", "", "", "");
+    for (c = 0; c < STATS_COUNTER_COUNT; c++)
+        fprintf(file, " %13lu", stats_counters[c]);
+    fprintf(file, "\n");
+
+    if (alloc_context == NULL)
+        return;
+
+    fprintf(file, "\n%-8s %-10s %12s %12s %12s %12s\n", "phase", "memory",
+            "live_bytes", "live_objects", "peak_bytes", "peak_objects");
+    for (i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        if (phases[i].runs == 0)
+            continue;
+
+        for (c = 0; c < STATS_MEMORY_COUNT; c++)
+        {
+            const struct stats_memory_info *m;
+
+            m = phases[i].memory + c;
+            if (m->peak_objects == 0)
+                continue;
+
+            fprintf(file, "%-8s %-10s %12lu %12lu %12lu %12lu\n",
+                    phase_names[i], memory_names[c],
+                    (unsigned long)m->live_bytes,
+                    (unsigned long)m->live_objects,
+                    (unsigned long)m->peak_bytes,
+                    (unsigned long)m->peak_objects);
+        }
+    }
+}
+
+void stats_print_json(FILE * file)
+{
+    int i, c;
+
+    fprintf(file, "{\n  \"phases\": [");
+    for (i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        const struct stats_phase_info *p;
+
+        p = phases + i;
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"runs\": %d, "
+                "\"wall_s\": %.6f, \"peak_rss_kb\": %ld, "
+                "\"live_blocks\": %lu, \"live_bytes\": %lu",
+                (i == 0) ? "" : ",", phase_names[i], p->runs, p->seconds,
+                p->peak_rss_kb, (unsigned long)p->live_blocks,
+                (unsigned long)p->live_bytes);
+        for (c = 0; c < STATS_COUNTER_COUNT; c++)
+            fprintf(file, ", \"%s\": %lu", counter_names[c], p->counters[c]);
+
+        fprintf(file, ",\n     \"memory\": {");
+        for (c = 0; c < STATS_MEMORY_COUNT; c++)
+            fprintf(file, "%s\"%s\": {\"live_bytes\": %lu, "
+                    "\"live_objects\": %lu, \"peak_bytes\": %lu, "
+                    "\"peak_objects\": %lu}", (c == 0) ? "" : ", ",
+                    memory_names[c],
+                    (unsigned long)p->memory[c].live_bytes,
+                    (unsigned long)p->memory[c].live_objects,
+                    (unsigned long)p->memory[c].peak_bytes,
+                    (unsigned long)p->memory[c].peak_objects);
+        fprintf(file, "}}");
+    }
+
+    fprintf(file, "\n  ],\n  \"counters\": {");
+    for (c = 0; c < STATS_COUNTER_COUNT; c++)
+        fprintf(file, "%s\"%s\": %lu", (c == 0) ? "" : ", ", counter_names[c],
+                stats_counters[c]);
+    fprintf(file, "}\n}\n");
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void walk_memory(struct stats_memory_info *memory)
+{
+    struct memory_walk walk;
+    int i;
+
+    /* Only the groups that aren't tracked need counting up. */
+    for (i = FIRST_WALKED; i < STATS_MEMORY_COUNT; i++)
+        stats_memory_remove(i, memory_live[i].live_bytes,
+                            memory_live[i].live_objects);
+
+    walk.memory = memory_live;
+    talloc_report_depth_cb(alloc_context, 0, -1, &count_block, &walk);
+
+    /* Adding nothing brings their peaks up to date. */
+    for (i = FIRST_WALKED; i < STATS_MEMORY_COUNT; i++)
+        stats_memory_add(i, 0, 0);
+
+    memcpy(memory, memory_live, sizeof(memory_live));
+}
+
+void count_block(const void *ptr, int depth,
+                 int max_depth __attribute__ ((unused)), int is_ref,
+                 void *walk_uncast)
+{
+    struct memory_walk *walk;
+    enum stats_memory group;
+    const char *name;
+    size_t i;
+
+    walk = walk_uncast;
+
+    /* The pointer here is the block that's referenced, which is counted
+     * wherever it really lives.  References were counted as they were
+     * taken. */
+    if (is_ref)
+        return;
+
+    /* Very deep blocks share the group of the deepest one kept. */
+    if (depth > STATS_MEMORY_DEPTH)
+        depth = STATS_MEMORY_DEPTH;
+
+    group = (depth == 0) ? STATS_MEMORY_OTHER : walk->groups[depth - 1];
+    name = talloc_get_name(ptr);
+    if (name != NULL && strcmp(name, SCRATCH_NAME) == 0)
+        group = ((const struct memory_tracker *)ptr)->group;
+    for (i = 0; i < sizeof(memory_types) / sizeof(memory_types[0]); i++)
+        if (name != NULL && strcmp(name, memory_types[i].name) == 0)
+        {
+            group = memory_types[i].group;
+            break;
+        }
+
+    if (depth < STATS_MEMORY_DEPTH)
+        walk->groups[depth] = group;
+
+    if (group < FIRST_WALKED || group == COUNTED_BY_ARENA
+        || (name != NULL && strcmp(name, TRACKER_NAME) == 0))
+        return;
+
+    walk->memory[group].live_objects++;
+    walk->memory[group].live_bytes += talloc_get_size(ptr);
+}
+
+int add_tracker(const void *ptr, enum stats_memory group, size_t bytes)
+{
+    struct memory_tracker *t;
+
+    t = talloc_named_const(ptr, sizeof(*t), TRACKER_NAME);
+    if (t == NULL)
+        return -1;
+
+    t->group = group;
+    t->bytes = bytes;
+    talloc_set_destructor(t, &untrack);
+    stats_memory_add(group, bytes, 1);
+    return 0;
+}
+
+int untrack(struct memory_tracker *t)
+{
+    stats_memory_remove(t->group, t->bytes, 1);
+    return 0;
+}
+
+int measure_scratch(struct memory_tracker *t)
+{
+    size_t bytes;
+
+    /* Nothing under it has been freed yet. */
+    bytes = talloc_total_size(t);
+    stats_memory_add(t->group, bytes, 0);
+    stats_memory_remove(t->group, bytes, 1);
+    return 0;
+}
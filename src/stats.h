@@ -0,0 +1,156 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/* Keeps track of where a run spends its time: how long each phase
+ * took and the peak RSS by its end, along with counters for the work
+ * done along the way.  Counters are always kept, as bumping one is a
+ * single add, and they must only be bumped from the main thread.
+ * Phases that run more than once (such as every re-rating in watch
+ * mode) add up. */
+
+#include <stdio.h>
+
+enum stats_phase
+{
+    /* Reading the player, map and league files. */
+    STATS_PLAYERS,
+    STATS_MAPS,
+    STATS_LEAGUES,
+
+    /* Merging every league's games into the timeline. */
+    STATS_MERGE,
+
+    /* Replaying every game to compute the ratings. */
+    STATS_ELO,
+
+    /* Writing out the HTML. */
+    STATS_HTML,
+
+    STATS_PHASE_COUNT,
+};
+
+enum stats_counter
+{
+    STATS_FILES_READ,
+    STATS_GAMES_PARSED,
+
+    /* Players and maps looked up by key. */
+    STATS_LOOKUPS,
+
+    STATS_GAMES_MERGED,
+    STATS_GAMES_RATED,
+    STATS_PAGES_WRITTEN,
+    STATS_BYTES_WRITTEN,
+
+    STATS_COUNTER_COUNT,
+};
+
+/* What the memory in use is grouped by.  The groups up to the
+ * timeline are counted as they're allocated and freed, so their peaks
+ * are never missed.  The rest are only counted by walking every talloc
+ * block. */
+enum stats_memory
+{
+    STATS_MEMORY_PLAYERS,
+    STATS_MEMORY_MAPS,
+    STATS_MEMORY_LEAGUES,
+
+    /* Every game and the keys it was read with.  Games kept in an
+     * arena count each allocation as an object, and the chunks mapped
+     * for them as their bytes. */
+    STATS_MEMORY_GAMES,
+
+    /* The nodes of every player, map, league and game list.  Game list
+     * nodes come out of an arena of their own. */
+    STATS_MEMORY_NODES,
+
+    /* talloc_reference()s.  talloc doesn't say how big these are, so
+     * each is counted as the handle talloc keeps for it. */
+    STATS_MEMORY_REFERENCES,
+
+    /* Everything the HTML writer allocates as it goes. */
+    STATS_MEMORY_HTML,
+
+    /* The timeline every game is merged into, and the tables that
+     * index its games by player, map and key. */
+    STATS_MEMORY_TIMELINE,
+
+    /* Every player's rating and rank history. */
+    STATS_MEMORY_HISTORY,
+
+    /* Everything else: the rating tables and so on. */
+    STATS_MEMORY_OTHER,
+
+    STATS_MEMORY_COUNT,
+};
+
+extern unsigned long stats_counters[STATS_COUNTER_COUNT];
+
+/* Adds to one of the counters. */
+#define stats_count(counter, n) (stats_counters[(counter)] += (n))
+
+/* Also keeps track of the memory used by each of the groups above,
+ * walking every talloc block under the given context at the end of
+ * every phase for the groups that aren't counted as they go.  Tracking a block means giving it a
+ * child, so that's only done once this is called. */
+void stats_enable(const void *ctx);
+
+/* Counts memory that's been allocated or freed, which is always
+ * done. */
+void stats_memory_add(enum stats_memory group, size_t bytes,
+                      size_t objects);
+void stats_memory_remove(enum stats_memory group, size_t bytes,
+                         size_t objects);
+
+/* Counts a talloc block, along with everything under it so far, as a
+ * single object until it's freed.  Constructors call this last.
+ * Returns the block. */
+void *stats_track(const void *ptr, enum stats_memory group);
+
+/* talloc_reference(), counting the reference until its owner is
+ * freed. */
+void *stats_reference(const void *ctx, const void *ptr);
+
+/* Creates a context for scratch memory.  That's only measured as it's
+ * freed, which is when it's at its largest, so it should only hold
+ * memory that's freed along with it. */
+void *stats_scratch_new(const void *ctx, enum stats_memory group);
+
+/* Walks the blocks in use right now, just to keep track of the most
+ * seen by the groups that are walked.  This is for catching memory that's gone
+ * again by the end of a phase. */
+void stats_sample_memory(void);
+
+/* Marks the start and end of a phase. */
+void stats_begin(enum stats_phase phase);
+void stats_end(enum stats_phase phase);
+
+/* Writes out a table with a line for every phase that ran, followed by
+ * one with a line for every group of memory used by each phase. */
+void stats_print(FILE * file);
+
+/* Writes out every phase and counter as a JSON object. */
+void stats_print_json(FILE * file);
+
+#endif
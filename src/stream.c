@@ -0,0 +1,322 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stream.h"
+#include "global.h"
+#include "key_index.h"
+#include "player.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <talloc.h>
+
+#ifndef LINE_MAX
+#define LINE_MAX 1024
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* Every player seen so far, by the index they're written out with. */
+struct stream_players
+{
+    void *ctx;
+    struct key_index *keys;
+    struct player **players;
+
+    /* Whether each player's been written out yet, in binary mode. */
+    unsigned char *announced;
+    size_t count;
+    size_t alloc;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+
+/* Returns the index of the player with the given key, adding them if
+ * they haven't been seen yet (writing out a player record in binary
+ * mode).  Returns -1 on failure. */
+static int lookup_player(struct stream_players *sp, const char *key,
+                         FILE *out, enum stream_format format);
+static int add_player(struct stream_players *sp, struct player *player);
+static int add_known_player(struct player *player, void *sp);
+
+static void put_u16(FILE *out, unsigned int v);
+static void put_u32(FILE *out, uint32_t v);
+static void put_u64(FILE *out, uint64_t v);
+static void put_double(FILE *out, double v);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+int stream_format_parse(const char *str, enum stream_format *format)
+{
+    if (strcmp(str, "csv") == 0)
+    {
+        *format = STREAM_CSV;
+        return 0;
+    }
+    if (strcmp(str, "binary") == 0)
+    {
+        *format = STREAM_BINARY;
+        return 0;
+    }
+
+    return -1;
+}
+
+int stream_games(void *pctx, FILE *in, FILE *out, enum stream_format format)
+{
+    void *ctx;
+    struct stream_players sp;
+    char buf[LINE_MAX];
+    game_time_t last;
+    int have_last;
+    unsigned long line_number;
+    int ret;
+
+    ctx = talloc_new(pctx);
+    if (ctx == NULL)
+        return -1;
+
+    sp.ctx = ctx;
+    sp.keys = key_index_new(ctx, 1024);
+    sp.players = NULL;
+    sp.announced = NULL;
+    sp.count = 0;
+    sp.alloc = 0;
+    if (sp.keys == NULL)
+    {
+        TALLOC_FREE(ctx);
+        return -1;
+    }
+
+    /* Known players keep their details and get their index up front,
+     * but the binary 'P' record naming them waits until they play. */
+    if (global_player_list != NULL)
+        player_list_each(global_player_list, &add_known_player, &sp);
+
+    setvbuf(in, NULL, _IOFBF, STREAM_BUFFER);
+    setvbuf(out, NULL, _IOFBF, STREAM_BUFFER);
+
+    if (format == STREAM_CSV)
+        fprintf(out, "time,winner,loser,winner_before,winner_after,"
+                "loser_before,loser_after,expected,winner_k,loser_k\n");
+
+    ret = 0;
+    last = 0;
+    have_last = 0;
+    line_number = 0;
+    while (fgets(buf, LINE_MAX, in) != NULL)
+    {
+        struct game *game;
+        struct player *winner, *loser;
+        player_elo_t winner_before, loser_before, expected;
+        int winner_k, loser_k;
+        int w, l;
+        char *b;
+
+        line_number++;
+        b = buf;
+        while (*b == ' ' || *b == '\t')
+            b++;
+        if (*b == '\0' || *b == '\n' || *b == '#')
+            continue;
+        if (strncmp(b, "GAME ", 5) == 0)
+            b += 5;
+
+        /* Each game is thrown away as soon as it's rated. */
+        game = game_parse(ctx, b, NULL, NULL, NULL);
+        if (game == NULL)
+        {
+            fprintf(stderr, "stdin:%lu: unable to parse game\n",
+                    line_number);
+            continue;
+        }
+
+        if (have_last && game_time(game) < last)
+        {
+            fprintf(stderr, "stdin:%lu: game is out of order\n",
+                    line_number);
+            TALLOC_FREE(game);
+            continue;
+        }
+        if (strcmp(game_winner_key(game), game_loser_key(game)) == 0)
+        {
+            fprintf(stderr, "stdin:%lu: player can't play themselves\n",
+                    line_number);
+            TALLOC_FREE(game);
+            continue;
+        }
+
+        w = lookup_player(&sp, game_winner_key(game), out, format);
+        l = lookup_player(&sp, game_loser_key(game), out, format);
+        if (w < 0 || l < 0)
+        {
+            TALLOC_FREE(game);
+            ret = -1;
+            break;
+        }
+
+        last = game_time(game);
+        have_last = 1;
+
+        winner = sp.players[w];
+        loser = sp.players[l];
+        winner_before = player_elo(winner);
+        loser_before = player_elo(loser);
+        expected = player_expected_score(winner, loser);
+        winner_k = elo_k_factor(player_games(winner));
+        loser_k = elo_k_factor(player_games(loser));
+        player_win(winner, loser);
+
+        if (format == STREAM_CSV)
+            fprintf(out, "%ld,%s,%s,%.4f,%.4f,%.4f,%.4f,%.6f,%d,%d\n",
+                    (long)game_time(game), player_key(winner),
+                    player_key(loser), winner_before, player_elo(winner),
+                    loser_before, player_elo(loser), expected, winner_k,
+                    loser_k);
+        else
+        {
+            fputc('G', out);
+            put_u64(out, (uint64_t)game_time(game));
+            put_u32(out, w);
+            put_u32(out, l);
+            put_double(out, winner_before);
+            put_double(out, player_elo(winner));
+            put_double(out, loser_before);
+            put_double(out, player_elo(loser));
+            put_double(out, expected);
+            put_u16(out, winner_k);
+            put_u16(out, loser_k);
+        }
+
+        TALLOC_FREE(game);
+    }
+
+    if (fflush(out) != 0 || ferror(out))
+    {
+        perror("stdout");
+        ret = -1;
+    }
+
+    TALLOC_FREE(ctx);
+    return ret;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int lookup_player(struct stream_players *sp, const char *key, FILE *out,
+                  enum stream_format format)
+{
+    int i;
+
+    i = key_index_get(sp->keys, key);
+    if (i < 0)
+    {
+        struct player *player;
+
+        player = player_new(sp->ctx, key);
+        if (player == NULL || (i = add_player(sp, player)) < 0)
+            return -1;
+    }
+
+    /* Players are only written out the first time they play. */
+    if (format == STREAM_BINARY && !sp->announced[i])
+    {
+        size_t len;
+
+        len = strlen(key);
+        fputc('P', out);
+        put_u32(out, i);
+        put_u16(out, len);
+        fwrite(key, 1, len, out);
+        sp->announced[i] = 1;
+    }
+
+    return i;
+}
+
+int add_player(struct stream_players *sp, struct player *player)
+{
+    if (sp->count == sp->alloc)
+    {
+        struct player **grown;
+        unsigned char *grown_announced;
+        size_t alloc;
+
+        alloc = (sp->alloc == 0) ? 256 : sp->alloc * 2;
+        grown = talloc_realloc(sp->ctx, sp->players, struct player *, alloc);
+        if (grown == NULL)
+            return -1;
+        sp->players = grown;
+
+        grown_announced = talloc_realloc(sp->ctx, sp->announced,
+                                         unsigned char, alloc);
+        if (grown_announced == NULL)
+            return -1;
+        sp->announced = grown_announced;
+
+        sp->alloc = alloc;
+    }
+
+    if (key_index_add(sp->keys, player_key(player), sp->count) != 0)
+        return -1;
+
+    sp->players[sp->count] = player;
+    sp->announced[sp->count] = 0;
+    return sp->count++;
+}
+
+int add_known_player(struct player *player, void *sp)
+{
+    return (add_player(sp, player) < 0) ? -1 : 0;
+}
+
+void put_u16(FILE *out, unsigned int v)
+{
+    fputc(v & 0xFF, out);
+    fputc((v >> 8) & 0xFF, out);
+}
+
+void put_u32(FILE *out, uint32_t v)
+{
+    put_u16(out, v & 0xFFFF);
+    put_u16(out, v >> 16);
+}
+
+void put_u64(FILE *out, uint64_t v)
+{
+    put_u32(out, v & 0xFFFFFFFF);
+    put_u32(out, v >> 32);
+}
+
+void put_double(FILE *out, double v)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    put_u64(out, bits);
+}
@@ -0,0 +1,63 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+/* Rates games as they're piped in, one at a time, writing out how
+ * each game changed both players' ratings.  Nothing is kept per game,
+ * so any number of games can go through. */
+
+#include <stdio.h>
+
+/* The size of the input and output buffers, output is only written
+ * out once this much of it has built up. */
+#ifndef STREAM_BUFFER
+#define STREAM_BUFFER (1024 * 1024)
+#endif
+
+/* How each game's record is written. */
+enum stream_format
+{
+    /* One comma-separated line per game, after a header line. */
+    STREAM_CSV,
+
+    /* Packed little-endian records.  A player record ('P', a 32-bit
+     * index, a 16-bit length and the key) comes before the first game
+     * that player is in.  A game record ('G') holds the 64-bit time,
+     * the 32-bit indices of the winner and loser, each of their
+     * ratings before and after as doubles, the winner's expected
+     * score as a double, and both 16-bit K factors. */
+    STREAM_BINARY
+};
+
+/* Converts "csv" or "binary" into a format.  Returns 0 on success. */
+int stream_format_parse(const char *str, enum stream_format *format);
+
+/* Reads GAME lines (in the same format as the league files, the
+ * "GAME" is optional) from "in" in chronological order and writes a
+ * record for each one to "out".  Players start from the ratings they
+ * have in the global player list, players that aren't there start out
+ * with the default rating.  Games that are malformed or out of order
+ * are reported and skipped.  Returns 0 on success. */
+int stream_games(void *ctx, FILE *in, FILE *out, enum stream_format format);
+
+#endif
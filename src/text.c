@@ -0,0 +1,47 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "text.h"
+
+#include <ctype.h>
+#include <string.h>
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+bool text_starts_with(const char *haystack, const char *needle)
+{
+    return (strncmp(haystack, needle, strlen(needle)) == 0);
+}
+
+const char *text_strip_front(const char *haystack, const char *needle)
+{
+    if (!text_starts_with(haystack, needle))
+        return NULL;
+
+    haystack += strlen(needle);
+
+    while (isspace(*haystack))
+        haystack++;
+
+    return haystack;
+}
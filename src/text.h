@@ -0,0 +1,37 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stdbool.h>
+
+/* Returns TRUE if the haystack starts with the needle. */
+bool text_starts_with(const char *haystack, const char *needle);
+
+/* Returns NULL if the haystack doesn't start with the needle.
+ * Otherwise, skips the needle at the start of the haystack along with
+ * any whitespace after it.  No memory is allocated here, the result
+ * points into the haystack. */
+const char *text_strip_front(const char *haystack, const char *needle);
+
+#endif
@@ -0,0 +1,582 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timeline.h"
+#include "global.h"
+#include "key_index.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <talloc.h>
+
+#ifndef TIMELINE_INITIAL_GAMES
+#define TIMELINE_INITIAL_GAMES 1024
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct timeline
+{
+    /* Every game, in chronological order.  These two arrays are
+     * parallel: the compact records are what replays walk, while the
+     * original games are kept around for display. */
+    struct timeline_game *games;
+    struct game **game_ptrs;
+    size_t game_count;
+    size_t game_alloc;
+
+    /* Maps each index back to the object it was assigned to. */
+    struct player **players;
+    size_t player_count;
+    struct map **maps;
+    size_t map_count;
+    struct league **leagues;
+    size_t league_count;
+
+    /* Looks up player and map indices by key. */
+    struct key_index *player_keys;
+    struct key_index *map_keys;
+
+    /* The games every player and map was in, as rows of the arrays
+     * above: player "p" has player_rows[player_offsets[p]] up to
+     * player_rows[player_offsets[p + 1]], in order.  These are only
+     * built when they're first needed, and again if games have been
+     * appended since. */
+    uint32_t *player_offsets;
+    uint32_t *player_rows;
+    uint32_t *map_offsets;
+    uint32_t *map_rows;
+    size_t adjacency_games;
+};
+
+/* Which adjacency list is being built. */
+enum adjacency_kind
+{
+    ADJACENCY_PLAYER,
+    ADJACENCY_MAP
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int count_player(struct player *player, void *tl_uncast);
+static int index_player(struct player *player, void *tl_uncast);
+static int count_map(struct map *map, void *tl_uncast);
+static int index_map(struct map *map, void *tl_uncast);
+static int count_league(struct league *league, void *tl_uncast);
+static int index_league(struct league *league, void *tl_uncast);
+static int append_game(struct league *league, struct game *game,
+                       void *tl_uncast);
+
+/* Makes sure the adjacency lists cover every game. */
+static int update_adjacency(struct timeline *tl);
+static int build_adjacency(struct timeline *tl, enum adjacency_kind kind,
+                           size_t keys, uint32_t **offsets_out,
+                           uint32_t **rows_out);
+
+/* Walks through part of the adjacency lists. */
+static int each_row(struct timeline *tl, const uint32_t *offsets,
+                    const uint32_t *rows, size_t keys, int key,
+                    int (*iter) (struct game *, void *), void *arg);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct timeline *timeline_new(void *ctx, struct league_list *ll)
+{
+    struct timeline *tl;
+
+    tl = talloc(ctx, struct timeline);
+    if (tl == NULL)
+        return NULL;
+
+    tl->games = NULL;
+    tl->game_ptrs = NULL;
+    tl->game_count = 0;
+    tl->game_alloc = 0;
+    tl->players = NULL;
+    tl->player_count = 0;
+    tl->maps = NULL;
+    tl->map_count = 0;
+    tl->leagues = NULL;
+    tl->league_count = 0;
+    tl->player_offsets = tl->player_rows = NULL;
+    tl->map_offsets = tl->map_rows = NULL;
+    tl->adjacency_games = 0;
+
+    /* Everything is counted first so the index tables can be
+     * allocated in one go, then the indices are handed out. */
+    player_list_each(global_player_list, &count_player, tl);
+    map_list_each(global_map_list, &count_map, tl);
+    league_list_each(ll, &count_league, tl);
+
+    tl->players = talloc_array(tl, struct player *, tl->player_count + 1);
+    tl->maps = talloc_array(tl, struct map *, tl->map_count + 1);
+    tl->leagues = talloc_array(tl, struct league *, tl->league_count + 1);
+    tl->player_keys = key_index_new(tl, tl->player_count);
+    tl->map_keys = key_index_new(tl, tl->map_count);
+    if (tl->players == NULL || tl->maps == NULL || tl->leagues == NULL
+        || tl->player_keys == NULL || tl->map_keys == NULL)
+        goto failure;
+
+    tl->player_count = 0;
+    tl->map_count = 0;
+    tl->league_count = 0;
+    player_list_each(global_player_list, &index_player, tl);
+    map_list_each(global_map_list, &index_map, tl);
+    league_list_each(ll, &index_league, tl);
+
+    /* Flattens the merged list of games. */
+    if (league_list_each_league_game(ll, &append_game, tl) != 0)
+        goto failure;
+
+    return tl;
+
+  failure:
+    TALLOC_FREE(tl);
+    return NULL;
+}
+
+size_t timeline_game_count(struct timeline *tl)
+{
+    return tl->game_count;
+}
+
+size_t timeline_player_count(struct timeline *tl)
+{
+    return tl->player_count;
+}
+
+size_t timeline_map_count(struct timeline *tl)
+{
+    return tl->map_count;
+}
+
+size_t timeline_league_count(struct timeline *tl)
+{
+    return tl->league_count;
+}
+
+const struct timeline_game *timeline_games(struct timeline *tl)
+{
+    return tl->games;
+}
+
+struct game *timeline_game(struct timeline *tl, size_t i)
+{
+    if (i >= tl->game_count)
+        return NULL;
+
+    return tl->game_ptrs[i];
+}
+
+struct player *timeline_player(struct timeline *tl, size_t index)
+{
+    if (index >= tl->player_count)
+        return NULL;
+
+    return tl->players[index];
+}
+
+struct map *timeline_map(struct timeline *tl, size_t index)
+{
+    if (index >= tl->map_count)
+        return NULL;
+
+    return tl->maps[index];
+}
+
+struct league *timeline_league(struct timeline *tl, size_t index)
+{
+    if (index >= tl->league_count)
+        return NULL;
+
+    return tl->leagues[index];
+}
+
+int timeline_player_lookup(struct timeline *tl, const char *key)
+{
+    return key_index_get(tl->player_keys, key);
+}
+
+int timeline_map_lookup(struct timeline *tl, const char *key)
+{
+    return key_index_get(tl->map_keys, key);
+}
+
+const struct timeline_game *timeline_append(struct timeline *tl,
+                                            struct league *league,
+                                            struct game *game)
+{
+    if (tl->game_count > 0
+        && tl->games[tl->game_count - 1].time > game_time(game))
+        return NULL;
+
+    if (append_game(league, game, tl) != 0)
+        return NULL;
+
+    return tl->games + tl->game_count - 1;
+}
+
+int timeline_relink(struct timeline *tl, struct league *league)
+{
+    struct game_list_iterator *gli;
+    size_t l;
+    int pass;
+
+    l = league_index(league);
+    if (l >= tl->league_count || tl->leagues[l] != league)
+        return -1;
+
+    /* The first pass only checks that every game lines up, so nothing
+     * is left half relinked. */
+    for (pass = 0; pass < 2; pass++)
+    {
+        struct game *game;
+        size_t i;
+
+        gli = league_game_iterator(league, tl);
+        if (gli == NULL)
+            return -1;
+
+        for (i = 0; i < tl->game_count; i++)
+        {
+            if (tl->games[i].league != l)
+                continue;
+
+            game = game_list_iterator_cur(gli);
+            if (game == NULL || !game_same(game, tl->game_ptrs[i]))
+            {
+                TALLOC_FREE(gli);
+                return -1;
+            }
+
+            if (pass == 1)
+                tl->game_ptrs[i] = game;
+            game_list_iterator_next(gli);
+        }
+
+        game = game_list_iterator_cur(gli);
+        TALLOC_FREE(gli);
+        if (game != NULL)
+            return -1;
+    }
+
+    return 0;
+}
+
+int timeline_each_game(struct timeline *tl,
+                       int (*iter) (struct game *, void *), void *arg)
+{
+    size_t i;
+
+    for (i = 0; i < tl->game_count; i++)
+    {
+        int ret;
+
+        if ((ret = iter(tl->game_ptrs[i], arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int timeline_each(struct timeline *tl,
+                  int (*iter) (const struct timeline_game *,
+                               struct game *, void *), void *arg)
+{
+    size_t i;
+
+    for (i = 0; i < tl->game_count; i++)
+    {
+        int ret;
+
+        if ((ret = iter(tl->games + i, tl->game_ptrs[i], arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int timeline_each_player_game(struct timeline *tl, int player,
+                              int (*iter) (struct game *, void *),
+                              void *arg)
+{
+    if (update_adjacency(tl) != 0)
+        return -1;
+
+    return each_row(tl, tl->player_offsets, tl->player_rows,
+                    tl->player_count, player, iter, arg);
+}
+
+int timeline_each_map_game(struct timeline *tl, int map,
+                           int (*iter) (struct game *, void *), void *arg)
+{
+    if (update_adjacency(tl) != 0)
+        return -1;
+
+    return each_row(tl, tl->map_offsets, tl->map_rows, tl->map_count, map,
+                    iter, arg);
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int count_player(struct player *player __attribute__ ((unused)),
+                 void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    tl->player_count++;
+    return 0;
+}
+
+int index_player(struct player *player, void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    player_set_index(player, tl->player_count);
+    tl->players[tl->player_count] = player;
+    return key_index_add(tl->player_keys, player_key(player),
+                         tl->player_count++);
+}
+
+int count_map(struct map *map __attribute__ ((unused)), void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    tl->map_count++;
+    return 0;
+}
+
+int index_map(struct map *map, void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    map_set_index(map, tl->map_count);
+    tl->maps[tl->map_count] = map;
+    return key_index_add(tl->map_keys, map_key(map), tl->map_count++);
+}
+
+int count_league(struct league *league __attribute__ ((unused)),
+                 void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    tl->league_count++;
+    return 0;
+}
+
+int index_league(struct league *league, void *tl_uncast)
+{
+    struct timeline *tl;
+
+    tl = tl_uncast;
+    league_set_index(league, tl->league_count);
+    tl->leagues[tl->league_count++] = league;
+    return 0;
+}
+
+int append_game(struct league *league, struct game *game, void *tl_uncast)
+{
+    struct timeline *tl;
+    struct timeline_game *tg;
+    int winner, loser, map;
+
+    tl = tl_uncast;
+
+    /* Grows the game arrays geometrically. */
+    if (tl->game_count == tl->game_alloc)
+    {
+        size_t alloc;
+        struct timeline_game *games;
+        struct game **game_ptrs;
+
+        alloc = tl->game_alloc * 2;
+        if (alloc == 0)
+            alloc = TIMELINE_INITIAL_GAMES;
+
+        games = talloc_realloc(tl, tl->games, struct timeline_game, alloc);
+        if (games == NULL)
+            return -1;
+        tl->games = games;
+
+        game_ptrs = talloc_realloc(tl, tl->game_ptrs, struct game *, alloc);
+        if (game_ptrs == NULL)
+            return -1;
+        tl->game_ptrs = game_ptrs;
+
+        tl->game_alloc = alloc;
+    }
+
+    winner = key_index_get(tl->player_keys, game_winner_key(game));
+    loser = key_index_get(tl->player_keys, game_loser_key(game));
+    map = key_index_get(tl->map_keys, game_map_key(game));
+    if (winner < 0 || loser < 0 || map < 0)
+    {
+        fprintf(stderr, "timeline: game in '%s' has unknown keys\n",
+                league_name(league));
+        return -1;
+    }
+
+    tg = tl->games + tl->game_count;
+    tg->time = game_time(game);
+    tg->winner = winner;
+    tg->loser = loser;
+    tg->map = map;
+    tg->league = league_index(league);
+    tl->game_ptrs[tl->game_count] = game;
+    tl->game_count++;
+
+    return 0;
+}
+
+int update_adjacency(struct timeline *tl)
+{
+    if (tl->player_offsets != NULL && tl->adjacency_games == tl->game_count)
+        return 0;
+
+    TALLOC_FREE(tl->player_offsets);
+    TALLOC_FREE(tl->player_rows);
+    TALLOC_FREE(tl->map_offsets);
+    TALLOC_FREE(tl->map_rows);
+
+    if (build_adjacency(tl, ADJACENCY_PLAYER, tl->player_count,
+                        &tl->player_offsets, &tl->player_rows) != 0
+        || build_adjacency(tl, ADJACENCY_MAP, tl->map_count,
+                           &tl->map_offsets, &tl->map_rows) != 0)
+    {
+        TALLOC_FREE(tl->player_offsets);
+        return -1;
+    }
+
+    tl->adjacency_games = tl->game_count;
+    return 0;
+}
+
+int build_adjacency(struct timeline *tl, enum adjacency_kind kind,
+                    size_t keys, uint32_t **offsets_out, uint32_t **rows_out)
+{
+    uint32_t *offsets, *rows, *fill;
+    game_time_t *last;
+    int pass;
+    size_t i;
+
+    rows = fill = NULL;
+    offsets = talloc_zero_array(tl, uint32_t, keys + 2);
+    last = talloc_array(tl, game_time_t, keys + 1);
+    if (offsets == NULL || last == NULL)
+        goto failure;
+
+    /* The first pass counts how many games each key has, so the
+     * second can lay every list out in one array.  Just as a game list
+     * would, a game from the same time as the last one listed for that
+     * key is left out. */
+    for (pass = 0; pass < 2; pass++)
+    {
+        for (i = 0; i < keys; i++)
+            last[i] = -1;
+
+        for (i = 0; i < tl->game_count; i++)
+        {
+            uint32_t game_keys[2];
+            int n, k;
+
+            if (kind == ADJACENCY_PLAYER)
+            {
+                game_keys[0] = tl->games[i].winner;
+                game_keys[1] = tl->games[i].loser;
+                n = 2;
+            }
+            else
+            {
+                game_keys[0] = tl->games[i].map;
+                n = 1;
+            }
+
+            for (k = 0; k < n; k++)
+            {
+                uint32_t key;
+
+                key = game_keys[k];
+                if (key >= keys || tl->games[i].time <= last[key])
+                    continue;
+                last[key] = tl->games[i].time;
+
+                if (pass == 0)
+                    offsets[key + 1]++;
+                else
+                    rows[fill[key]++] = i;
+            }
+        }
+
+        if (pass == 0)
+        {
+            for (i = 0; i < keys; i++)
+                offsets[i + 1] += offsets[i];
+
+            rows = talloc_array(tl, uint32_t, offsets[keys] + 1);
+            fill = talloc_array(tl, uint32_t, keys + 1);
+            if (rows == NULL || fill == NULL)
+                goto failure;
+            memcpy(fill, offsets, keys * sizeof(*fill));
+        }
+    }
+
+    TALLOC_FREE(fill);
+    TALLOC_FREE(last);
+    *offsets_out = offsets;
+    *rows_out = rows;
+    return 0;
+
+  failure:
+    TALLOC_FREE(offsets);
+    TALLOC_FREE(rows);
+    TALLOC_FREE(fill);
+    TALLOC_FREE(last);
+    return -1;
+}
+
+int each_row(struct timeline *tl, const uint32_t *offsets,
+             const uint32_t *rows, size_t keys, int key,
+             int (*iter) (struct game *, void *), void *arg)
+{
+    uint32_t i;
+
+    if (key < 0 || (size_t)key >= keys)
+        return 0;
+
+    for (i = offsets[key]; i < offsets[key + 1]; i++)
+    {
+        int ret;
+
+        if ((ret = iter(tl->game_ptrs[rows[i]], arg)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+/* A read-only, chronologically ordered copy of every game that's been
+ * played, with players, maps and leagues replaced by their integer
+ * indices.  This is what anything that needs to replay the whole
+ * history more than once should walk, as it avoids both the league
+ * merge and the key lookups. */
+struct timeline;
+
+#include "game.h"
+#include "league_list.h"
+#include "map.h"
+#include "player.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A single game, as stored in the timeline.  These are kept small and
+ * in one flat array so replays stay within the cache. */
+struct timeline_game
+{
+    game_time_t time;
+    uint32_t winner;
+    uint32_t loser;
+    uint32_t map;
+    uint32_t league;
+};
+
+/* Builds a timeline from every game in the given list of leagues.
+ * This assigns an index to every player in the global player list,
+ * every map in the global map list, and every league in the given
+ * list.  The timeline only points at the games, so it must not
+ * outlive the league list. */
+struct timeline *timeline_new(void *ctx, struct league_list *ll);
+
+/* Returns the number of games, players, maps and leagues. */
+size_t timeline_game_count(struct timeline *tl);
+size_t timeline_player_count(struct timeline *tl);
+size_t timeline_map_count(struct timeline *tl);
+size_t timeline_league_count(struct timeline *tl);
+
+/* Returns the flat array of every game, in chronological order. */
+const struct timeline_game *timeline_games(struct timeline *tl);
+
+/* Maps indices back to the objects they came from. */
+struct game *timeline_game(struct timeline *tl, size_t i);
+struct player *timeline_player(struct timeline *tl, size_t index);
+struct map *timeline_map(struct timeline *tl, size_t index);
+struct league *timeline_league(struct timeline *tl, size_t index);
+
+/* Looks up the index of a player or map by key, returning -1 if
+ * there's no such player or map. */
+int timeline_player_lookup(struct timeline *tl, const char *key);
+int timeline_map_lookup(struct timeline *tl, const char *key);
+
+/* Adds a game from the given (already indexed) league to the end of
+ * the timeline.  The game can't be older than the newest game already
+ * in the timeline.  Returns the new compact record, which stays valid
+ * until the next game is appended, or NULL on failure. */
+const struct timeline_game *timeline_append(struct timeline *tl,
+                                            struct league *league,
+                                            struct game *game);
+
+/* Points the timeline at a league's games again once league_repack()
+ * has moved them.  Returns 0 on success, or -1 (changing nothing) if
+ * the timeline doesn't have the same games as the league. */
+int timeline_relink(struct timeline *tl, struct league *league);
+
+/* Walks through every game in chronological order. */
+int timeline_each_game(struct timeline *tl,
+                       int (*iter) (struct game *, void *), void *arg);
+
+/* Walks through every game a player or map (by index) was in, in
+ * chronological order.  These are laid out in one array when they're
+ * first needed, so each walk is a contiguous slice of it. */
+int timeline_each_player_game(struct timeline *tl, int player,
+                              int (*iter) (struct game *, void *),
+                              void *arg);
+int timeline_each_map_game(struct timeline *tl, int map,
+                           int (*iter) (struct game *, void *), void *arg);
+
+/* Walks through every game in chronological order, passing along both
+ * the compact record and the original game. */
+int timeline_each(struct timeline *tl,
+                  int (*iter) (const struct timeline_game *,
+                               struct game *, void *), void *arg);
+
+#endif
@@ -0,0 +1,240 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifndef TRACE_NAME_MAX
+#define TRACE_NAME_MAX 64
+#endif
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 1024
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+struct trace_event
+{
+    const char *category;
+    char name[TRACE_NAME_MAX];
+
+    /* 'B' for begin or 'E' for end, as in the trace-event format. */
+    char phase;
+
+    /* Microseconds since tracing was enabled. */
+    long time;
+};
+
+/* Every event recorded by one thread.  Only that thread ever touches
+ * it, until it's written out. */
+struct trace_buffer
+{
+    struct trace_buffer *next;
+    int tid;
+
+    struct trace_event *events;
+    size_t count;
+    size_t size;
+
+    /* Events that couldn't be recorded for lack of memory. */
+    size_t dropped;
+};
+
+/***********************************************************************
+ * Static Variables                                                    *
+ ***********************************************************************/
+static int trace_on = 0;
+static struct timeval trace_start;
+
+/* Every thread's buffer.  New ones are pushed on the front, which is
+ * the only change ever made to the list. */
+static struct trace_buffer *volatile trace_buffers = NULL;
+static int last_tid = 0;
+
+static __thread struct trace_buffer *thread_buffer = NULL;
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static void record(char phase, const char *category, const char *name);
+
+/* Returns this thread's buffer, making it the first time through. */
+static struct trace_buffer *get_buffer(void);
+
+static void write_string(FILE * file, const char *str);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+void trace_enable(void)
+{
+    gettimeofday(&trace_start, NULL);
+    trace_on = 1;
+}
+
+void trace_begin(const char *category, const char *name)
+{
+    if (trace_on)
+        record('B', category, name);
+}
+
+void trace_end(const char *category)
+{
+    if (trace_on)
+        record('E', category, NULL);
+}
+
+int trace_write(FILE * file)
+{
+    struct trace_buffer *b;
+    size_t dropped;
+    int pid;
+    int first;
+
+    pid = (int)getpid();
+    dropped = 0;
+    first = 1;
+
+    fprintf(file, "{\"traceEvents\":[");
+    for (b = trace_buffers; b != NULL; b = b->next)
+    {
+        size_t i;
+
+        for (i = 0; i < b->count; i++)
+        {
+            const struct trace_event *e;
+
+            e = b->events + i;
+            fprintf(file, "%s\n{", first ? "" : ",");
+            if (e->phase == 'B')
+            {
+                fprintf(file, "\"name\":");
+                write_string(file, e->name);
+                fprintf(file, ",");
+            }
+            fprintf(file, "\"cat\":");
+            write_string(file, e->category);
+            fprintf(file, ",\"ph\":\"%c\",\"ts\":%ld,\"pid\":%d,\"tid\":%d}",
+                    e->phase, e->time, pid, b->tid);
+            first = 0;
+        }
+
+        dropped += b->dropped;
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (dropped > 0)
+        fprintf(stderr, "Trace is missing %lu event(s)\n",
+                (unsigned long)dropped);
+
+    return ferror(file) ? -1 : 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+void record(char phase, const char *category, const char *name)
+{
+    struct trace_buffer *b;
+    struct trace_event *e;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    b = get_buffer();
+    if (b == NULL)
+        return;
+
+    if (b->count == b->size)
+    {
+        struct trace_event *events;
+        size_t size;
+
+        size = (b->size == 0) ? TRACE_BUFFER_EVENTS : b->size * 2;
+        events = realloc(b->events, size * sizeof(*events));
+        if (events == NULL)
+        {
+            b->dropped++;
+            return;
+        }
+
+        b->events = events;
+        b->size = size;
+    }
+
+    e = b->events + b->count++;
+    e->category = category;
+    e->name[0] = '\0';
+    if (name != NULL)
+    {
+        strncpy(e->name, name, TRACE_NAME_MAX - 1);
+        e->name[TRACE_NAME_MAX - 1] = '\0';
+    }
+    e->phase = phase;
+    e->time = (now.tv_sec - trace_start.tv_sec) * 1000000L
+        + (now.tv_usec - trace_start.tv_usec);
+}
+
+struct trace_buffer *get_buffer(void)
+{
+    struct trace_buffer *b, *head;
+
+    if (thread_buffer != NULL)
+        return thread_buffer;
+
+    /* Buffers are malloc()ed, as talloc contexts can't be shared
+     * between threads.  They're kept until the process exits. */
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+        return NULL;
+
+    /* Guesses that the list is empty, then tries again with whatever
+     * the head really was until nobody else got in first. */
+    b->tid = __sync_add_and_fetch(&last_tid, 1);
+    b->next = NULL;
+    while ((head = __sync_val_compare_and_swap(&trace_buffers, b->next, b))
+           != b->next)
+        b->next = head;
+
+    thread_buffer = b;
+    return b;
+}
+
+void write_string(FILE * file, const char *str)
+{
+    fputc('"', file);
+    for (; *str != '\0'; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(file, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, file);
+    }
+    fputc('"', file);
+}
@@ -0,0 +1,48 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Records when things start and stop, on every thread, so a run can be
+ * looked at in a trace viewer (chrome://tracing, or Perfetto).  Each
+ * thread writes events into a buffer of its own, so recording never
+ * takes a lock; the buffers are only read once they're written out.
+ * Nothing is recorded until tracing is enabled. */
+
+#include <stdio.h>
+
+/* Starts recording.  This must be called before any other threads are
+ * started. */
+void trace_enable(void);
+
+/* Marks the start and end of something.  The category says what sort
+ * of thing it is ("league", "page", "replay"), and must be a string
+ * that lives forever.  The name is copied, and may be cut short.
+ * Every begin needs an end on the same thread. */
+void trace_begin(const char *category, const char *name);
+void trace_end(const char *category);
+
+/* Writes out every event recorded so far as Chrome trace-event JSON.
+ * No other thread may be recording while this runs. */
+int trace_write(FILE * file);
+
+#endif
@@ -0,0 +1,282 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "watch.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <talloc.h>
+#include <unistd.h>
+
+/* The most directories that can be watched at once. */
+#ifndef WATCH_MAX_DIRS
+#define WATCH_MAX_DIRS 8
+#endif
+
+/* How long things have to be quiet before a batch of changes is
+ * handed back.  Editors tend to write a file in a few steps. */
+#ifndef WATCH_SETTLE_MS
+#define WATCH_SETTLE_MS 50
+#endif
+
+/***********************************************************************
+ * Structures                                                          *
+ ***********************************************************************/
+
+/* A single changed file, waiting to be handed back. */
+struct watch_change
+{
+    int dir;
+    const char *name;
+};
+
+struct watch
+{
+    int fd;
+
+    /* Maps each directory ID to its inotify watch descriptor. */
+    int wds[WATCH_MAX_DIRS];
+    int dir_count;
+
+    /* Every distinct file that's changed in the current batch. */
+    struct watch_change *changes;
+    size_t change_count;
+    size_t change_alloc;
+};
+
+/***********************************************************************
+ * Static Method Headers                                               *
+ ***********************************************************************/
+static int watch_destructor(struct watch *w);
+
+/* Reads every pending event, adding them to the current batch. */
+static int read_events(struct watch *w);
+static int add_change(struct watch *w, int dir, const char *name);
+
+/* Returns TRUE for files that aren't worth looking at: hidden files,
+ * backups and the temporary files editors save through. */
+static int ignored_name(const char *name);
+
+/***********************************************************************
+ * Extern Methods                                                      *
+ ***********************************************************************/
+struct watch *watch_new(void *ctx)
+{
+    struct watch *w;
+
+    w = talloc(ctx, struct watch);
+    if (w == NULL)
+        return NULL;
+
+    w->dir_count = 0;
+    w->changes = NULL;
+    w->change_count = 0;
+    w->change_alloc = 0;
+
+    w->fd = inotify_init();
+    if (w->fd < 0)
+    {
+        perror("inotify_init");
+        TALLOC_FREE(w);
+        return NULL;
+    }
+    talloc_set_destructor(w, &watch_destructor);
+
+    return w;
+}
+
+int watch_add(struct watch *w, const char *dir)
+{
+    int wd;
+
+    if (w->dir_count == WATCH_MAX_DIRS)
+        return -1;
+
+    wd = inotify_add_watch(w->fd, dir,
+                           IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM
+                           | IN_DELETE);
+    if (wd < 0)
+    {
+        perror(dir);
+        return -1;
+    }
+
+    w->wds[w->dir_count] = wd;
+    return w->dir_count++;
+}
+
+int watch_fd(struct watch *w)
+{
+    return w->fd;
+}
+
+int watch_read(struct watch *w,
+               int (*func) (int dir, const char *name, void *), void *arg)
+{
+    struct pollfd pfd;
+    int dir;
+    size_t i;
+
+    pfd.fd = w->fd;
+    pfd.events = POLLIN;
+
+    /* Keeps reading until things have been quiet for a little while,
+     * or a signal cuts the wait short. */
+    w->change_count = 0;
+    for (;;)
+    {
+        if (read_events(w) != 0)
+            return -1;
+
+        if (poll(&pfd, 1, WATCH_SETTLE_MS) <= 0)
+            break;
+    }
+
+    for (dir = 0; dir < w->dir_count; dir++)
+    {
+        for (i = 0; i < w->change_count; i++)
+        {
+            if (w->changes[i].dir != dir)
+                continue;
+
+            if (func(dir, w->changes[i].name, arg) != 0)
+                return -1;
+        }
+    }
+
+    for (i = 0; i < w->change_count; i++)
+        talloc_free((char *)w->changes[i].name);
+    w->change_count = 0;
+
+    return 0;
+}
+
+/***********************************************************************
+ * Static Methods                                                      *
+ ***********************************************************************/
+int watch_destructor(struct watch *w)
+{
+    close(w->fd);
+    return 0;
+}
+
+int read_events(struct watch *w)
+{
+    char buf[4096]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    char *cur;
+
+    len = read(w->fd, buf, sizeof(buf));
+    if (len < 0)
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+
+    for (cur = buf; cur < buf + len;
+         cur += sizeof(struct inotify_event) + ((struct inotify_event *)
+                                                cur)->len)
+    {
+        struct inotify_event *event;
+        int dir;
+
+        event = (struct inotify_event *)cur;
+        if (event->len == 0 || ignored_name(event->name))
+            continue;
+
+        for (dir = 0; dir < w->dir_count; dir++)
+            if (w->wds[dir] == event->wd)
+                break;
+
+        if (dir < w->dir_count)
+            if (add_change(w, dir, event->name) != 0)
+                return -1;
+    }
+
+    return 0;
+}
+
+int add_change(struct watch *w, int dir, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < w->change_count; i++)
+        if (w->changes[i].dir == dir && strcmp(w->changes[i].name, name) == 0)
+            return 0;
+
+    if (w->change_count == w->change_alloc)
+    {
+        size_t alloc;
+        struct watch_change *changes;
+
+        alloc = (w->change_alloc == 0) ? 16 : w->change_alloc * 2;
+        changes = talloc_realloc(w, w->changes, struct watch_change, alloc);
+        if (changes == NULL)
+            return -1;
+
+        w->changes = changes;
+        w->change_alloc = alloc;
+    }
+
+    w->changes[w->change_count].dir = dir;
+    w->changes[w->change_count].name = talloc_strdup(w, name);
+    if (w->changes[w->change_count].name == NULL)
+        return -1;
+
+    w->change_count++;
+    return 0;
+}
+
+int ignored_name(const char *name)
+{
+    size_t len;
+    size_t i;
+    int upper;
+
+    len = strlen(name);
+    if (len == 0 || name[0] == '.' || name[len - 1] == '~')
+        return 1;
+
+    /* Emacs' autosaves, and the file Vim checks it can write with. */
+    if ((name[0] == '#' && name[len - 1] == '#')
+        || strcmp(name, "4913") == 0)
+        return 1;
+
+    /* "sed -i" writes to "sed" and six random letters and digits.
+     * Keys are always lowercase, so any capital gives it away. */
+    if (len != 9 || strncmp(name, "sed", 3) != 0)
+        return 0;
+
+    upper = 0;
+    for (i = 3; i < len; i++)
+    {
+        if (!isalnum((unsigned char)name[i]))
+            return 0;
+        if (isupper((unsigned char)name[i]))
+            upper = 1;
+    }
+
+    return upper;
+}
@@ -0,0 +1,48 @@
+
+/*
+ * Copyright (C) 2012 JJ Whg
+ *   <jjwhgbw@gmail.com>
+ *
+ * This file is part of bwelo.
+ * 
+ * bwelo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * bwelo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Affero General Public License
+ * along with bwelo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Watches a handful of directories for files that are written, moved
+ * in, or removed.  This is purposely opaque. */
+struct watch;
+
+/* Creates a new watch, which doesn't watch anything yet. */
+struct watch *watch_new(void *ctx);
+
+/* Starts watching a directory.  Returns an ID for the directory
+ * (they're handed out in order, starting at 0), or -1 on failure. */
+int watch_add(struct watch *w, const char *dir);
+
+/* Returns a descriptor that becomes readable when some file changes,
+ * for poll()ing on. */
+int watch_fd(struct watch *w);
+
+/* Once the descriptor is readable, waits for the burst of changes to
+ * settle down and then calls the given function once for every file
+ * that changed -- all the files in the first directory added go
+ * first, then the second, and so on.  Hidden files and editor backups
+ * are skipped.  Returns 0 on success. */
+int watch_read(struct watch *w,
+               int (*func) (int dir, const char *name, void *), void *arg);
+
+#endif